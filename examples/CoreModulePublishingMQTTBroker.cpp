@@ -1,12 +1,11 @@
-#include <PubSubClient.h>
-
 #include "Config.h"
 #include "CoreModule.h"
+#include "MQTTPublisher.h"
 
 CoreModule cm(Diameter::Quarter);
 
 WiFiClient wifiClient;
-PubSubClient pubsubClient(wifiClient);
+MQTTPublisher publisher(cm, wifiClient);
 
 namespace MQTTConf {
 // An example for Thingsboard
@@ -15,7 +14,6 @@ const char* server = "mqtt.thingsboard.cloud";
 const int port = 1883;
 const char* topic = "v1/devices/me/telemetry";
 const char* client_id = "client-id";
-const char* password = NULL;
 // -- Fixed parameters --
 
 // Replace with an appropriate value.
@@ -39,42 +37,16 @@ void setup() {
 
   cm.init();
 
-  // Set MQTT broker property
-  pubsubClient.setServer(MQTTConf::server, MQTTConf::port);
-}
-
-void publish(int interval = 1000) {
-  static unsigned long lastPublishTime = millis();
-  if (millis() - lastPublishTime > interval) {
-    // Create a payload
-    JsonDocument payload;
-    payload["flow"] = cm.getFlow();
-    payload["temperature"] = cm.getTemperature();
-    payload["tds"] = cm.getTDS();
-
-    // Output logs
-    serializeJson(payload, Serial);
-    Serial.println();
-
-    // Publish to MQTT broker
-    char buffer[1024];
-    serializeJson(payload, buffer);
-    pubsubClient.publish(MQTTConf::topic, buffer);
-    lastPublishTime = millis();
-  }
+  // Publish every 1000 ms without the HTTP server.
+  // The publisher connects and retries on its own task, so loop() is never blocked.
+  cm.startPublishing(MQTTConf::user_name, 1000);
+  publisher.setServer(MQTTConf::server, MQTTConf::port);
+  publisher.setTopic(MQTTConf::topic);
+  publisher.setMQTTClientId(MQTTConf::client_id);
+  publisher.begin();
 }
 
 void loop() {
   cm.update();
-
-  // Connect to mqtt broker if not connected
-  if (!pubsubClient.connected()) {
-    pubsubClient.connect(
-        MQTTConf::client_id,
-        MQTTConf::user_name,
-        MQTTConf::password);
-  }
-  publish();
-
   delay(1);
-}
\ No newline at end of file
+}
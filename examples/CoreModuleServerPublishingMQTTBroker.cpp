@@ -1,13 +1,12 @@
-#include <PubSubClient.h>
-
 #include "Config.h"
 #include "CoreModule.h"
+#include "MQTTPublisher.h"
 #include "Utils.cpp"
 
 CoreModule cm(Diameter::Quarter);
 
 WiFiClient wifiClient;
-PubSubClient pubsubClient(wifiClient);
+MQTTPublisher publisher(cm, wifiClient);
 
 namespace MQTTConf {
 // An example for Thingsboard
@@ -16,7 +15,6 @@ const char* server = "mqtt.thingsboard.cloud";
 const int port = 1883;
 const char* topic = "v1/devices/me/telemetry";
 const char* client_id = "client-id";
-const char* password = NULL;
 // -- Fixed parameters --
 }  // namespace MQTTConf
 
@@ -38,46 +36,18 @@ void setup() {
   cm.init();
   cm.begin();
 
-  // Set MQTT broker property
-  pubsubClient.setServer(MQTTConf::server, MQTTConf::port);
-}
-
-void publish() {
-  static unsigned long lastPublishTime = millis();
-  if (millis() - lastPublishTime > cm.publishInterval()) {
-    // Create a payload
-    JsonDocument payload = cm.metadata();
-    payload["flow"] = cm.getFlow();
-    payload["temperature"] = cm.getTemperature();
-    payload["tds"] = cm.getTDS();
-
-    // Output logs
-    serializeJson(payload, Serial);
-    Serial.println();
-
-    // Publish to MQTT broker
-    char buffer[1024];
-    serializeJson(payload, buffer);
-    pubsubClient.publish(MQTTConf::topic, buffer);
-    lastPublishTime = millis();
-  }
+  // Publishing starts with POST /publish/start?client_id=<access token>&interval=1000
+  // and runs on its own task. Samples are kept in flash while the broker is unreachable.
+  publisher.setServer(MQTTConf::server, MQTTConf::port);
+  publisher.setTopic(MQTTConf::topic);
+  publisher.setMQTTClientId(MQTTConf::client_id);
+  publisher.enableSpool();
+  publisher.begin();
 }
 
 void loop() {
   cm.update();
 
-  // Connect to mqtt broker if not connected
-  if (cm.isPublishing()) {
-    if (!pubsubClient.connected()) {
-      pubsubClient.connect(MQTTConf::client_id, cm.clientId().c_str(), NULL);
-    }
-    publish();
-  } else {
-    if (pubsubClient.connected()) {
-      pubsubClient.disconnect();
-    }
-  }
-
   printWiFiInfo();
   delay(1);
-}
\ No newline at end of file
+}
@@ -36,7 +36,6 @@ void printExternalSensorValues(int interval = 1000) {
 
 void loop() {
   cm.update();
-  ph.update();
 
   printWiFiInfo();
   printExternalSensorValues();
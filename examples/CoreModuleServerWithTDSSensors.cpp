@@ -37,7 +37,6 @@ void printExternalSensorValues(int interval = 1000) {
 
 void loop() {
   cm.update();
-  tds.update();
 
   printWiFiInfo();
   printExternalSensorValues();
@@ -17,9 +17,17 @@ void loop() {
   static int count = 0;
   static bool alignRightRow1 = false;
   static bool alignRightRow2 = false;
+  static unsigned long lastCountTime = millis();
   cm.update();
 
-  // isConnected() returns bool
+  // Drawing only writes to RAM and the display is refreshed in the background,
+  // so the loop keeps running without delay().
+  if (millis() - lastCountTime < 1000) {
+    return;
+  }
+  lastCountTime = millis();
+
+  // isConnected() returns the cached connection state without I2C access
   Serial.printf("LCD is connected: %s\n", lcd.isConnected() ? "true" : "false");
 
   // newLine(line, text) sets line and text
@@ -38,6 +46,4 @@ void loop() {
     // clear() clears all lines, so you need to set the line again
     lcd.newLine(0, "Hello, World!", alignRightRow1);
   }
-
-  delay(1000);
 }
@@ -20,6 +20,5 @@ void printExternalSensorValues(int interval = 1000) {
 
 void loop() {
   cm.update();
-  ph.update();
   printExternalSensorValues();
 }
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <Arduino.h>
+#include <esp_timer.h>
+
+#include <cstdint>
+#include <functional>
+
+class ActuatorScheduler {
+  /*
+      Switches output ports back after a duration, or in pulse trains, with esp_timer one-shots.
+
+      - Deadlines are esp_timer_get_time() based 64 bit microseconds, so they never wrap.
+      - A pulse train advances each deadline from the previous one, so it does not drift.
+      - A schedule is released when its last transition fires, or when it is cancelled.
+      - Transitions run on the esp_timer task, independent of loop().
+      - Schedules are guarded by a spinlock, so the timer callback never waits for a task.
+        The writer is called inside it and must not block.
+  */
+ public:
+  static const int MAX_SCHEDULES = 8;
+  typedef std::function<void(int pin, int mode)> Writer;
+
+  // Creates a timer per schedule. Throws std::runtime_error if one cannot be created.
+  void begin(Writer writer);
+
+  // pin has been set to activeMode. Set it back after onDuration [us], and if repeat > 1,
+  // set it to activeMode again after offDuration [us] until repeat pulses have been made.
+  void pulse(int pin, int activeMode, int64_t onDuration, int64_t offDuration = 0, int repeat = 1);
+  void cancel(int pin);
+  bool isScheduled(int pin);
+  // esp_timer_get_time() of the next transition of pin [us], or -1 if none
+  int64_t deadline(int pin);
+  // Number of running schedules
+  int active();
+
+ private:
+  struct Schedule {
+    ActuatorScheduler* scheduler = nullptr;
+    esp_timer_handle_t timer = nullptr;
+    int pin = -1;
+    bool scheduled = false;
+    int activeMode = HIGH;
+    bool activePhase = false;  // The pin is at activeMode
+    int64_t onDuration = 0;
+    int64_t offDuration = 0;
+    int remaining = 0;  // Pulses left after the current one
+    int64_t deadline = 0;
+  };
+
+  Schedule _schedules[MAX_SCHEDULES];
+  portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+  Writer _writer;
+
+  Schedule* find(int pin);
+  void start(Schedule& schedule, int64_t deadline);
+  static void onTimer(void* arg);
+};
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstdint>
+
+struct AnalogChannel {
+  /*
+      Scheduling state of an analog sensor which is read in the batched ADC pass of
+      Base::updateAnalogSensors(). Sensors embed it through AnalogSensor.
+  */
+  uint8_t channel = 0;
+  uint16_t samples = 1;        // Readings averaged per update
+  unsigned long interval = 0;  // Minimum time between updates [ms]
+  unsigned long lastAt = 0;
+  bool started = false;
+
+  // Called with the average of samples readings
+  void (*onSample)(AnalogChannel* self, float raw) = nullptr;
+
+  bool due(unsigned long now) const { return !started || now - lastAt >= interval; }
+  void done(unsigned long now) {
+    lastAt = now;
+    started = true;
+  }
+};
@@ -7,9 +7,28 @@
 #include <SPI.h>
 #include <WiFi.h>
 
+#include <atomic>
 #include <map>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 
+#include "ActuatorScheduler.h"
+#include "AnalogChannel.h"
+#include "Calibration.h"
+#include "Diagnostics.h"
+#include "FlowCounter.h"
+#include "JsonBuffer.h"
+#include "Logger.h"
+#include "PayloadWriter.h"
+#include "Profiler.h"
+#include "PublishPolicy.h"
+#include "Router.h"
+#include "SensorHub.h"
+
+#include "modules/FlowMeter.h"
 #include "modules/Lcd16x2.h"
 #include "modules/Light.h"
 #include "modules/PHSensor.h"
@@ -19,35 +38,113 @@
 #include "modules/SolenoidValve.h"
 #include "modules/TDSSensor.h"
 
-struct Timer {
-  unsigned long time;
-  int mode;
+// A value tagged with the sample cycle it belongs to
+template <typename T>
+struct SampledValue {
+  T value;
+  uint32_t sequence;
+  unsigned long timestamp;
 };
 
 class Base : public AsyncWebServer {
+ public:
+  // Settings of a session started by startPublishing()
+  struct PublishSettings {
+    uint32_t session = 0;
+    std::string clientId;
+    int interval = 100;  // [ms]
+    PayloadFormat format = PayloadFormat::JSON;
+    boolean shortKeys = false;
+    PublishPolicy policy;
+    JsonDocument metadata{&JsonAllocationCounter::instance()};
+  };
+
  private:
   int _port;
 
-  std::unordered_map<std::string, std::string> parseQueryString(const std::string& queryString);
+  // All endpoints are dispatched by a single handler
+  Router _router;
+
+  // Port outputs of devices, which share the "/{device}/{action}" route
+  struct DeviceAction {
+    std::string device;
+    std::string action;
+    int pinNumber;
+    int mode;
+    std::function<void()> setter;
+  };
+  std::vector<DeviceAction> _deviceActions;
+  std::unordered_map<uint32_t, int> _deviceActionIndex;  // FNV-1a of "device/action" -> action
+  static uint32_t deviceActionKey(std::string_view device, std::string_view action);
+  void handleDeviceAction(AsyncWebServerRequest* request, const DeviceAction& action);
+
   void addPublishStartEndpoint();
   void addPublishEndEndpoint();
+  void addCalibrationEndpoints();
+  void addLogEndpoints();
+  void addProfilerEndpoints();
+
+  // Calibration curves which can be overridden at runtime and are persisted in NVS.
+  // Overrides replace a curve under _calibrationMux, so readers on other tasks copy it with calibration().
+  struct CalibrationEntry {
+    CalibrationCurve* curve;
+    CalibrationCurve defaults;
+    std::string key;  // NVS key, which is limited to 15 characters
+  };
+  std::map<std::string, CalibrationEntry> _calibrations;
+  portMUX_TYPE _calibrationMux = portMUX_INITIALIZER_UNLOCKED;
+  static std::string calibrationKey(const std::string& name) { return nvsName("", name); }
+  void replaceCalibration(CalibrationEntry& entry, const CalibrationCurve& curve);
+
+  // Sensors which can be read together through /sensors
+  SensorHub _sensors;
+  void addSensorsEndpoint();
 
-  // MQTT settings
-  boolean _isPublishing = false;
-  int _publishInterval = 100;
-  std::string _clientId = "";
-  JsonDocument _metadata;
+  // MQTT settings. A session is replaced as a whole by startPublishing() and never changed
+  // afterwards, so publishers on other tasks only need the lock to take a reference to it.
+  std::atomic<bool> _isPublishing{false};
+  std::atomic<uint32_t> _publishSession{0};
+  std::shared_ptr<const PublishSettings> _publishSettings;
+  portMUX_TYPE _publishMux = portMUX_INITIALIZER_UNLOCKED;
+  PublishPolicy _publishPolicy;  // For the next session
+  static void parsePublishParam(const String& name, const String& value, PublishPolicy& policy);
+
+  // Tasks whose stack is reported in /diagnostics. A null handle is looked up by name.
+  struct TaskEntry {
+    const char* name;
+    TaskHandle_t handle;
+  };
+  TaskEntry _tasks[Diagnostics::MAX_TASKS];
+  std::atomic<int> _taskCount{0};
+  void addDiagnosticsEndpoint();
 
  public:
   Base(int port);
   void init();
 
-  boolean isPublishing() { return _isPublishing; }
-  int publishInterval() { return _publishInterval; }
-  std::string clientId() { return _clientId; }
-  JsonDocument metadata() { return _metadata; }
+  boolean isPublishing() { return _isPublishing.load(std::memory_order_acquire); }
+  // Incremented every time publishing is started, so that publishers can reload settings
+  uint32_t publishSession() { return _publishSession.load(std::memory_order_acquire); }
+  // The latest session, which may be read from any task
+  std::shared_ptr<const PublishSettings> publishSettings();
+  int publishInterval() { return publishSettings()->interval; }
+  std::string clientId() { return publishSettings()->clientId; }
+  PayloadFormat publishFormat() { return publishSettings()->format; }
+  boolean publishShortKeys() { return publishSettings()->shortKeys; }
+  PublishPolicy publishPolicy() { return publishSettings()->policy; }
+  JsonDocument metadata() { return publishSettings()->metadata; }
+  // Takes effect at the next startPublishing()
+  void setPublishPolicy(const PublishPolicy& policy);
+  // metadata is published with every sample
+  void startPublishing(std::string clientId, int interval = 100, PayloadFormat format = PayloadFormat::JSON,
+                       boolean shortKeys = false, const JsonDocument& metadata = JsonDocument());
+  void stopPublishing();
 
   // [start] Methods for HTTP server
+  // Segments in braces are parameters, e.g. "/{device}/{action}"
+  // A route which cannot be added is logged, and false is returned
+  bool route(const char* path, WebRequestMethodComposite method, Router::Handler handler);
+  bool route(const char* path, WebRequestMethodComposite method, ArRequestHandlerFunction handler);
   template <typename Lambda>
   void addGetValueEndpoint(Lambda fn, std::string path, std::string unit = "");
   void addOperationEndpoint(std::function<void(void)> fn, std::string path);
@@ -61,13 +158,65 @@ class Base : public AsyncWebServer {
       std::function<boolean(void)> getter);
   // [end] Methods for HTTP server
 
+  // Calibration
+  void registerCalibration(std::string name, CalibrationCurve& curve);
+  // Throw std::invalid_argument if registerCalibration() would reject name
+  void checkCalibrationName(const std::string& name);
+  void setCalibration(std::string name, const CalibrationCurve& curve);
+  void resetCalibration(std::string name);
+  // Copy of a registered curve, which is never torn by an override from another task
+  CalibrationCurve calibration(const CalibrationCurve& curve);
+
+  // prefix + name if it fits in an NVS key or namespace (15 characters), otherwise prefix, '#' and a hash of name
+  static std::string nvsName(const std::string& prefix, const std::string& name);
+
+  // Logging
+  Logger& logger() { return _logger; }
+
+  // Stage profiling. Does nothing unless built with -D O_PROFILER.
+  StageProfiler& profiler() { return _profiler; }
+
+  // Diagnostics
+  // Report the stack of a task. name must outlive Base, and the task must never be deleted.
+  // Up to Diagnostics::MAX_TASKS are reported, and more are logged and ignored.
+  void registerTask(const char* name, TaskHandle_t task = nullptr);
+  Diagnostics diagnostics();
+
+  // Timed port control
+  ActuatorScheduler& scheduler() { return _scheduler; }
+
+  // Sensor registry
+  void registerSensor(std::string name, std::string unit, SensorHub::Getter getter, int decimals = 2);
+  // Read from the sample cycle which /sensors takes once per request (see setSensorSample())
+  void registerSensor(std::string name, std::string unit, SensorHub::SampleGetter getter, int decimals = 2);
+  const SensorHub& sensors() const { return _sensors; }
+
+  // ADC (MCP320x)
   uint16_t ADCread(uint8_t ch);
+  void ADCscan(uint8_t channelMask, int samplesPerChannel, uint16_t* buffer);
+  // Read channel n samplesPerChannel[n] times. Channels with 0 are skipped.
+  void ADCscan(const int samplesPerChannel[8], uint16_t* buffer);
+  float ADCaverage(uint8_t ch, int samples);
+  void setADCClock(uint32_t frequency);
+  uint32_t getADCClock() { return _adcClock; }
+
+  // Analog sensors (see AnalogSensor)
+  static const int MAX_ANALOG_SENSORS = 16;
+  void registerAnalogSensor(AnalogChannel& sensor);
+  void updateAnalogSensors();
 
-  boolean getPortState(int pinNumber) { return states[pinNumber]; }
-  void setPortState(int pinNumber, boolean state) {
-    digitalWrite(pinNumber, state);
-    states[pinNumber] = state;
-  }
+  // Flow counters (see FlowMeter). Each takes one of the PCNT units.
+  static const int MAX_FLOW_COUNTERS = PCNT_UNIT_MAX;
+  pcnt_unit_t claimPCNTUnit();
+  void registerFlowCounter(FlowCounter& counter, const CalibrationCurve& volume);
+  void updateFlowCounters();
+
+  // Port states are kept in a bitmask (bit n = GPIO n)
+  static constexpr uint64_t portMask(int pinNumber) { return 1ULL << pinNumber; }
+  boolean getPortState(int pinNumber) { return (getPortStates() >> pinNumber) & 1; }
+  uint64_t getPortStates() { return _portStates.load(std::memory_order_acquire); }
+  void setPortState(int pinNumber, boolean state) { setPorts(portMask(pinNumber), state ? portMask(pinNumber) : 0); }
+  void setPorts(uint64_t mask, uint64_t values);
 
   String createOperationSucceededResponse();
   String createErrorResponse(std::string detail);
@@ -80,22 +229,45 @@ class Base : public AsyncWebServer {
 
  protected:
   // Pin states
-  std::map<int, boolean> states;
+  std::atomic<uint64_t> _portStates{0};
+  portMUX_TYPE _portMux = portMUX_INITIALIZER_UNLOCKED;
 
-  void setPinState(int pinNumber, boolean state) {
-    digitalWrite(pinNumber, state);
-    states[pinNumber] = state;
-  }
+  // Deprecated read-only view for modules written against the former std::map<int, boolean> states.
+  // states[pin] still reads a port, but assigning to it no longer compiles: use setPortState().
+  struct PortStatesView {
+    const std::atomic<uint64_t>& bits;
+    boolean operator[](int pinNumber) const { return (bits.load(std::memory_order_acquire) >> pinNumber) & 1; }
+  };
+  const PortStatesView states{_portStates};
+
+  void setPinState(int pinNumber, boolean state) { setPortState(pinNumber, state); }
+
+  // Sample cycle taken once per /sensors request
+  void setSensorSample(SensorHub::SampleSource source) { _sensors.setSampleSource(source); }
+
+  Logger _logger;
+  StageProfiler _profiler;
 
   // [start] Methods for HTTP server
   void notFound(AsyncWebServerRequest* request);
 
+  // Responses are formatted on the stack, and constant bodies are sent from flash without copying.
+  // The content type is a String built once, since a literal would be copied into one per request.
+  static const String JSON_CONTENT_TYPE;
+  static const char OPERATION_SUCCEEDED_RESPONSE[];
+  static const char RESPONSE_TOO_LARGE_RESPONSE[];
+  void sendOperationSucceeded(AsyncWebServerRequest* request);
+  void sendError(AsyncWebServerRequest* request, int statusCode, const char* detail);
+  template <typename T>
+  void sendSingleValue(AsyncWebServerRequest* request, const T& value, const std::string& unit = "");
   template <typename T>
-  String createSingleValueSucceededResponse(T value, std::string unit = "");
-  void printLog(int statusCode, std::string path, String response, std::map<std::string, std::string> params = {});
+  void sendSingleValue(AsyncWebServerRequest* request, const SampledValue<T>& value, const std::string& unit = "");
+  void sendJson(AsyncWebServerRequest* request, int statusCode, const JsonBuffer& body);
+  void printLog(int statusCode, const char* path, const char* response);
   // [end] Methods for HTTP server
 
-  std::map<int, Timer> timers;
+  // Switches ports back after the duration given to digital port endpoints
+  ActuatorScheduler _scheduler;
 
   virtual int getADC_CSb() const = 0;
   virtual int getADC_SCK() const = 0;
@@ -103,39 +275,71 @@ class Base : public AsyncWebServer {
   virtual int getADC_MOSI() const = 0;
 
   void initializeADC();
+
+  // SPI clock for the ADC. MCP320x is rated up to 1 MHz at 2.7 V (2 MHz at 5 V).
+  static constexpr uint32_t ADC_DEFAULT_CLOCK = 100000;
+  static constexpr uint32_t ADC_MAX_CLOCK = 1000000;
+  static constexpr int ADC_FRAME_SIZE = 3;
+  static constexpr int ADC_SCAN_CHUNK = 16;
+  uint32_t _adcClock = ADC_DEFAULT_CLOCK;
+  // ADC may be read from the loop and the acquisition task, so frames are serialized.
+  // Created by the constructor. _adcStarted is set by init() once SPI is configured.
+  SemaphoreHandle_t _adcMutex = nullptr;
+  bool _adcStarted = false;
+
+  static void packADCCommand(uint8_t ch, uint8_t* frame);
+  static uint16_t unpackADCData(const uint8_t* frame);
+
+ private:
+  // Analog sensors read together in one ADC pass
+  AnalogChannel* _analogSensors[MAX_ANALOG_SENSORS];
+  int _analogSensorCount = 0;
+  int _analogStage = -1;
+
+  // Flow counters updated together in one pass
+  struct FlowCounterEntry {
+    FlowCounter* counter;
+    const CalibrationCurve* volume;
+  };
+  uint8_t _claimedPCNTUnits = 0;  // bit n = PCNT_UNIT_n
+  FlowCounterEntry _flowCounters[MAX_FLOW_COUNTERS];
+  int _flowCounterCount = 0;
+  int _flowStage = -1;
 };
 
 template <typename Lambda>
 void Base::addGetValueEndpoint(Lambda fn, std::string path, std::string unit) {
-  this->on(path.c_str(), HTTP_GET, [path, fn, unit, this](AsyncWebServerRequest* request) {
-                String response;
-                int statusCode;
+  this->route(path.c_str(), HTTP_GET, [fn, unit, this](AsyncWebServerRequest* request) {
                 try
                 {
-                    statusCode = 200;
-                    response = this->createSingleValueSucceededResponse(fn(), unit);
-                    this->printLog(statusCode, path, response);
-                    request->send(statusCode, "application/json", response);
+                    this->sendSingleValue(request, fn(), unit);
                 }
                 catch (std::exception &e)
                 {
-                    statusCode = 500;
-                    response = this->createErrorResponse(e.what());
-                    this->printLog(statusCode, path, response);
-                    request->send(statusCode, "application/json", response);
+                    this->sendError(request, 500, e.what());
                 } });
 
   return;
 };
 
 template <typename T>
-String Base::createSingleValueSucceededResponse(T value, std::string unit) {
-  JsonDocument doc;
-  doc["value"] = value;
+void Base::sendSingleValue(AsyncWebServerRequest* request, const T& value, const std::string& unit) {
+  JsonBuffer body;
+  body.raw("{\"value\":").value(value);
   if (!unit.empty())
-    doc["unit"] = unit;
+    body.raw(",\"unit\":").value(unit.c_str());
+  body.raw("}");
+  sendJson(request, 200, body);
+}
 
-  char serialized[1024];
-  serializeJson(doc, serialized);
-  return serialized;
-}
\ No newline at end of file
+template <typename T>
+void Base::sendSingleValue(AsyncWebServerRequest* request, const SampledValue<T>& value, const std::string& unit) {
+  JsonBuffer body;
+  body.raw("{\"value\":").value(value.value);
+  if (!unit.empty())
+    body.raw(",\"unit\":").value(unit.c_str());
+  body.raw(",\"sequence\":").value(static_cast<unsigned long>(value.sequence));
+  body.raw(",\"time\":").value(value.timestamp);
+  body.raw("}");
+  sendJson(request, 200, body);
+}
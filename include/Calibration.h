@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+struct Polynomial {
+  /*
+      c0 + c1 * x + c2 * x^2
+  */
+  float c0 = 0;
+  float c1 = 0;
+  float c2 = 0;
+
+  constexpr float operator()(float x) const { return c0 + (c1 + c2 * x) * x; }
+  constexpr double evaluate(double x) const { return c0 + (c1 + c2 * x) * x; }
+};
+
+struct CalibrationCurve {
+  /*
+      Piecewise polynomial which converts a raw value into a physical value.
+      Segment i applies from segments[i].from up to segments[i + 1].from,
+      and the first segment also applies below its from.
+      Segments must be sorted by from.
+
+      The layout is fixed-size so that a curve can be stored in NVS as is.
+  */
+  static constexpr size_t MAX_SEGMENTS = 4;
+
+  struct Segment {
+    float from;
+    Polynomial polynomial;
+  };
+
+  uint8_t size = 0;
+  Segment segments[MAX_SEGMENTS] = {};
+
+  constexpr float operator()(float x) const {
+    return size == 0 ? 0 : segmentFor(x).polynomial(x);
+  }
+
+  // Evaluate in double precision, e.g. for large pulse totals
+  constexpr double evaluate(double x) const {
+    return size == 0 ? 0 : segmentFor(x).polynomial.evaluate(x);
+  }
+
+  constexpr const Segment& segmentFor(double x) const {
+    size_t i = size - 1;
+    while (i > 0 && x < segments[i].from) {
+      i--;
+    }
+    return segments[i];
+  }
+};
+
+// Shorthand for a curve with a single segment
+constexpr CalibrationCurve linearCurve(float c0, float c1) {
+  return {1, {{0, {c0, c1, 0}}}};
+}
+
+constexpr CalibrationCurve quadraticCurve(float c0, float c1, float c2) {
+  return {1, {{0, {c0, c1, c2}}}};
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "Calibration.h"
+
+enum class Diameter {
+  Null,
+  Quarter,
+  ThreeEighth
+};
+
+struct CoreCalibration {
+  CalibrationCurve tds[4];          // Raw ADC value -> ppm for each MAX4618 range
+  CalibrationCurve flow;            // Pulses per second -> L/min
+  CalibrationCurve volume;          // Pulses -> L
+  CalibrationCurve temperature;     // Raw ADC value -> celsius
+};
+
+// Temperature does not depend on the tube diameter
+constexpr CalibrationCurve DEFAULT_TEMPERATURE_CALIBRATION = {
+    2,
+    {{0, {102.619, -0.09, 0}},
+     {589.545, {67.66, -0.03, 0}}}};
+
+// Built-in calibration tables selected at compile time by diameter
+template <Diameter D>
+struct DefaultCoreCalibration {
+  static constexpr CoreCalibration value = {{}, {}, {}, DEFAULT_TEMPERATURE_CALIBRATION};
+};
+
+template <>
+struct DefaultCoreCalibration<Diameter::Quarter> {
+  static constexpr CoreCalibration value = {
+      {quadraticCurve(357.9580, 1.4141, 0.007909),
+       linearCurve(-18.5847, 0.5192),
+       linearCurve(-1.2852, 0.04826),
+       linearCurve(-0.3315, 0.005465)},
+      linearCurve(0, 0.02884),
+      linearCurve(0, 0.02884 / 60),
+      DEFAULT_TEMPERATURE_CALIBRATION};
+};
+
+template <>
+struct DefaultCoreCalibration<Diameter::ThreeEighth> {
+  static constexpr CoreCalibration value = {
+      {quadraticCurve(420.1264, -0.8759, 0.006073),
+       linearCurve(-4.5710, 0.3020),
+       linearCurve(-1.5870, 0.02695),
+       linearCurve(-0.9683, 0.002669)},
+      linearCurve(-0.3894, 0.0683),
+      // The flow intercept is an offset in L/min, which is not a function of the pulse count,
+      // so the volume only uses the slope. Below 5.7 pulses/s the flow reads 0 but the volume
+      // still counts, and above it the volume exceeds the integrated flow by 0.39 L per minute.
+      linearCurve(0, 0.0683 / 60),
+      DEFAULT_TEMPERATURE_CALIBRATION};
+};
+
+constexpr CoreCalibration defaultCoreCalibration(Diameter diameter) {
+  /*
+      Resolve the built-in table once at construction.
+  */
+  switch (diameter) {
+    case Diameter::Quarter:
+      return DefaultCoreCalibration<Diameter::Quarter>::value;
+    case Diameter::ThreeEighth:
+      return DefaultCoreCalibration<Diameter::ThreeEighth>::value;
+    default:
+      return DefaultCoreCalibration<Diameter::Null>::value;
+  }
+}
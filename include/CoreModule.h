@@ -4,19 +4,15 @@
 #include <string>
 
 #include "Base.h"
-
-enum class Diameter {
-  Null,
-  Quarter,
-  ThreeEighth
-};
-
-struct SensorValues {
-  int tds;
-  float flow;
-  float totalFlow;
-  float temperature;
-};
+#include "CoreCalibration.h"
+#include "Filters.h"
+#include "FlowCounter.h"
+#include "History.h"
+#include "SampleRing.h"
+#include "SensorStream.h"
+#include "SensorValues.h"
+#include "TDSAutorange.h"
+#include "Snapshot.h"
 
 class CoreModule : public Base {
  private:
@@ -26,6 +22,9 @@ class CoreModule : public Base {
   float _totalFlow = 0;
   float _temperature = 0;
 
+  // Latest complete sample set, readable from any task
+  Snapshot<SensorValues> _snapshot;
+
  public:
   enum Pin {
     MH_FLOW = 4,
@@ -58,8 +57,11 @@ class CoreModule : public Base {
   void update(int printInterval = 1000);
 
   // TDS
-  void updateTDS(int samples = 5);
+  // One reading per call by default. Valid readings are averaged over the last 5 calls.
+  void updateTDS(int samples = 1);
   int getTDS() { return _tds; };
+  // Convert a raw ADC voltage read in resistanceNo to ppm
+  int calculateTDS(float voltage, int resistanceNo);
 
   // Flow
   void updateFlow();
@@ -67,15 +69,31 @@ class CoreModule : public Base {
   void resetTotalFlow();
   float getFlow() { return _flow; };
   float getTotalFlow() { return _totalFlow; };
+  uint64_t getFlowPulses();
+  uint64_t getTotalFlowPulses();
+  void setFlowWindow(unsigned long windowMs);
+  void setTotalFlowCheckpoint(float volume, unsigned long intervalMs);
 
   // Temperature
   void updateTemperature();
   float getTemperature() { return _temperature; };
 
-  // All sensor values
-  SensorValues getSensorValues() { return {_tds, _flow, _totalFlow, _temperature}; };
+  // All sensor values from the same sample cycle
+  SensorValues getSensorValues() { return _snapshot.read(); };
   String getSensorValuesJson();
 
+  // Acquisition task
+  void startAcquisition(int intervalMs = 10, int core = 1, int priority = 2);
+  boolean isAcquiring() { return _acquisitionTask != nullptr; }
+  // Start reading from the next sample with sampleCursor(), then call readSample() until it returns false.
+  uint32_t sampleCursor() { return _samples.head(); }
+  boolean readSample(uint32_t &cursor, SensorValues &values) { return _samples.read(cursor, values); }
+  boolean latestSample(SensorValues &values) { return _samples.latest(values); }
+
+  // History
+  boolean enableHistory(size_t memoryBudget = 16384);
+  History &history() { return _history; }
+
   // Analog port reader
   uint16_t readA0() { return ADCread(AnalogPort::A0); };
   uint16_t readA1() { return ADCread(AnalogPort::A1); };
@@ -87,35 +105,60 @@ class CoreModule : public Base {
   void setD1_2(boolean state) { setPinState(Pin::D1_2, state); };
 
   // Digital port getter
-  boolean getD0_1() { return states[Pin::D0_1]; };
-  boolean getD0_2() { return states[Pin::D0_2]; };
-  boolean getD1_1() { return states[Pin::D1_1]; };
-  boolean getD1_2() { return states[Pin::D1_2]; };
+  boolean getD0_1() { return getPortState(Pin::D0_1); };
+  boolean getD0_2() { return getPortState(Pin::D0_2); };
+  boolean getD1_1() { return getPortState(Pin::D1_1); };
+  boolean getD1_2() { return getPortState(Pin::D1_2); };
 
  private:
   Diameter _diameter;
 
+  // Conversion curves. Initialized from the built-in table for _diameter
+  // and overridden by values stored in NVS at init().
+  CoreCalibration _calibration;
+
   // PWM parameters for TDS
   const int LEDC_CHANNEL_0 = 0;
   const int LEDC_TIMER_BIT = 8;
   const float LEDC_BASE_FREQ = 2400.0;
-  const int TDS_SETTLING_TIME = 150;
-
-  const int FLOW_COUNT_MAX = 60000;
 
+  // Flow
   void addResetFlowEndpoint();
   std::string pinToString(Pin value);
-  void checkTimer();
+
+  // Acquisition
+  static const int SAMPLE_RING_SIZE = 64;
+  SampleRing<SensorValues, SAMPLE_RING_SIZE> _samples;
+  TaskHandle_t _acquisitionTask = nullptr;
+  int _acquisitionInterval = 10;
+  void sample();
+  static void acquisitionTask(void *arg);
+
+  // Profiler stages
+  struct {
+    int temperature, flow, totalFlow, tds, publish, samplePeriod;
+    int checkpoint, stream, log, loopPeriod;
+  } _stages;
+  void addProfilerStages();
+
+  // History
+  History _history;
+  void addHistoryEndpoint();
+
+  // Live stream
+  SensorStream _stream;
+  uint32_t _streamedSequence = 0;
 
   // TDS
   void setTDSResistance(int i);
-  int calculateTDS(float voltage, int resistanceNo);
+  void switchTDSRange(int resistanceNo);
+  TDSAutorange _tdsAutorange;
+  // Valid readings of the current range. Cleared on a switch, since they do not carry over.
+  MovingAverage<5> _tdsFilter;
 
   // Flow
-  int16_t getFlowCount();
   float calculateFlow(float flowCountPerSec);
-  unsigned long _lastFlowUpdatedAt = 0;
-  uint16_t _flowCountPerSec = 0;
+  FlowCounter _flowCounter;
 
   // Digital port
   struct _D0 : public PortBase {
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <esp_system.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+
+class JsonAllocationCounter : public ArduinoJson::Allocator {
+  /*
+      Allocator for JsonDocument which counts allocations.
+      Pass instance() to JsonDocument so that its memory shows up in /diagnostics.
+  */
+ public:
+  static JsonAllocationCounter& instance() {
+    static JsonAllocationCounter counter;
+    return counter;
+  }
+
+  void* allocate(size_t size) override {
+    void* ptr = malloc(size);
+    if (ptr != nullptr) {
+      _live.fetch_add(1, std::memory_order_relaxed);
+      _total.fetch_add(1, std::memory_order_relaxed);
+    }
+    return ptr;
+  }
+
+  void deallocate(void* ptr) override {
+    if (ptr != nullptr) {
+      _live.fetch_sub(1, std::memory_order_relaxed);
+    }
+    free(ptr);
+  }
+
+  void* reallocate(void* ptr, size_t size) override {
+    void* result = realloc(ptr, size);
+    if (ptr == nullptr && result != nullptr) {
+      _live.fetch_add(1, std::memory_order_relaxed);
+      _total.fetch_add(1, std::memory_order_relaxed);
+    }
+    return result;
+  }
+
+  // Blocks currently allocated, and allocations since boot
+  uint32_t live() const { return _live.load(std::memory_order_relaxed); }
+  uint32_t total() const { return _total.load(std::memory_order_relaxed); }
+
+ private:
+  std::atomic<uint32_t> _live{0};
+  std::atomic<uint32_t> _total{0};
+};
+
+struct Diagnostics {
+  /*
+      Memory and task telemetry, collected by Base::diagnostics().
+  */
+  static const int MAX_TASKS = 12;
+
+  struct Task {
+    const char* name;
+    uint32_t stackHighWaterMark;  // Minimum free stack since the task started [bytes]
+  };
+
+  uint32_t freeHeap;
+  uint32_t minFreeHeap;       // Lowest free heap since boot
+  uint32_t largestFreeBlock;  // Largest block which can be allocated
+  uint32_t psramSize;         // 0 if PSRAM is not present
+  uint32_t freePsram;
+
+  int taskCount;
+  Task tasks[MAX_TASKS];  // Tasks which are not running are left out
+
+  size_t endpoints;
+  int schedules;  // Running ActuatorScheduler schedules
+  uint32_t jsonAllocations;
+  uint32_t jsonAllocationsTotal;
+
+  uint64_t uptime;  // [ms]
+  esp_reset_reason_t resetReason;
+
+  // Share of free heap which cannot be allocated at once [%]
+  int fragmentation() const {
+    return freeHeap == 0 ? 0 : 100 - static_cast<int>(static_cast<uint64_t>(largestFreeBlock) * 100 / freeHeap);
+  }
+
+  static const char* resetReasonName(esp_reset_reason_t reason) {
+    switch (reason) {
+      case ESP_RST_POWERON:
+        return "power_on";
+      case ESP_RST_EXT:
+        return "external";
+      case ESP_RST_SW:
+        return "software";
+      case ESP_RST_PANIC:
+        return "panic";
+      case ESP_RST_INT_WDT:
+        return "interrupt_watchdog";
+      case ESP_RST_TASK_WDT:
+        return "task_watchdog";
+      case ESP_RST_WDT:
+        return "watchdog";
+      case ESP_RST_DEEPSLEEP:
+        return "deep_sleep";
+      case ESP_RST_BROWNOUT:
+        return "brownout";
+      case ESP_RST_SDIO:
+        return "sdio";
+      default:
+        return "unknown";
+    }
+  }
+};
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <tuple>
+
+/*
+    Incremental filters for sensor readings. Each takes one sample per call and returns
+    the filtered value, with fixed-size state and float math only.
+    They are used as a policy of sensor templates, e.g. PressureSensor<CoreModule, Ema>.
+*/
+
+// Pass readings through as they are
+struct NoFilter {
+  float operator()(float x) { return x; }
+  void reset() {}
+};
+
+template <size_t N>
+class MovingAverage {
+  /*
+      Average of the last N samples.
+  */
+  static_assert(N > 0, "N must be > 0");
+
+ public:
+  float operator()(float x) {
+    if (_size == N) {
+      _sum -= _window[_index];
+    } else {
+      _size++;
+    }
+    _window[_index] = x;
+    _sum += x;
+    _index = (_index + 1) % N;
+
+    // Sum again once per window so that rounding errors do not build up
+    if (_index == 0) {
+      _sum = 0;
+      for (size_t i = 0; i < _size; i++) {
+        _sum += _window[i];
+      }
+    }
+    return _sum / _size;
+  }
+
+  void reset() {
+    _index = 0;
+    _size = 0;
+    _sum = 0;
+  }
+
+ private:
+  float _window[N] = {};
+  size_t _index = 0;
+  size_t _size = 0;
+  float _sum = 0;
+};
+
+template <size_t N>
+class Median {
+  /*
+      Median of the last N samples. Removes spikes which averaging would smear.
+      A sorted copy of the window is kept, so a sample costs O(N).
+  */
+  static_assert(N % 2 == 1, "N must be odd");
+
+ public:
+  float operator()(float x) {
+    if (_size == N) {
+      // Remove the oldest sample from the sorted window
+      size_t i = 0;
+      while (i + 1 < _size && _sorted[i] != _window[_index]) {
+        i++;
+      }
+      for (; i + 1 < _size; i++) {
+        _sorted[i] = _sorted[i + 1];
+      }
+      _size--;
+    }
+    _window[_index] = x;
+    _index = (_index + 1) % N;
+
+    size_t i = _size;
+    while (i > 0 && _sorted[i - 1] > x) {
+      _sorted[i] = _sorted[i - 1];
+      i--;
+    }
+    _sorted[i] = x;
+    _size++;
+    return _sorted[_size / 2];
+  }
+
+  void reset() {
+    _index = 0;
+    _size = 0;
+  }
+
+ private:
+  float _window[N] = {};
+  float _sorted[N] = {};
+  size_t _index = 0;
+  size_t _size = 0;
+};
+
+class Ema {
+  /*
+      Exponential moving average: y += alpha * (x - y).
+      alpha = 1 passes readings through, and smaller values smooth more.
+  */
+ public:
+  explicit Ema(float alpha = 0.1f) : _alpha(alpha) {}
+
+  float operator()(float x) {
+    _y = _started ? _y + _alpha * (x - _y) : x;
+    _started = true;
+    return _y;
+  }
+
+  void setAlpha(float alpha) { _alpha = alpha; }
+  void reset() { _started = false; }
+
+ private:
+  float _alpha;
+  float _y = 0;
+  bool _started = false;
+};
+
+class FirstOrderIIR {
+  /*
+      y[n] = b0 * x[n] + b1 * x[n-1] - a1 * y[n-1]
+      lowPass() designs a low-pass filter with the bilinear transform. It has a zero at the
+      Nyquist frequency, so noise near the sample rate is rejected better than with Ema.
+  */
+ public:
+  FirstOrderIIR(float b0 = 1, float b1 = 0, float a1 = 0) : _b0(b0), _b1(b1), _a1(a1) {}
+
+  // cutoff and sampleRate in Hz. Samples must be fed at sampleRate.
+  static FirstOrderIIR lowPass(float cutoff, float sampleRate) {
+    float k = tanf(static_cast<float>(M_PI) * cutoff / sampleRate);
+    return FirstOrderIIR(k / (1 + k), k / (1 + k), (k - 1) / (k + 1));
+  }
+
+  float operator()(float x) {
+    if (!_started) {
+      // Start from the steady state for x so that the output does not ramp up from 0
+      _x = x;
+      _y = x;
+      _started = true;
+      return x;
+    }
+    _y = _b0 * x + _b1 * _x - _a1 * _y;
+    _x = x;
+    return _y;
+  }
+
+  void reset() { _started = false; }
+
+ private:
+  float _b0;
+  float _b1;
+  float _a1;
+  float _x = 0;
+  float _y = 0;
+  bool _started = false;
+};
+
+template <typename... Filters>
+class FilterChain {
+  /*
+      Apply filters in order, e.g. FilterChain<Median<5>, Ema> removes spikes and then smooths.
+  */
+ public:
+  float operator()(float x) {
+    std::apply([&x](auto&... filters) { ((x = filters(x)), ...); }, _filters);
+    return x;
+  }
+
+  void reset() {
+    std::apply([](auto&... filters) { (filters.reset(), ...); }, _filters);
+  }
+
+  // Access a filter to configure it, e.g. chain.get<1>().setAlpha(0.2)
+  template <size_t I>
+  auto& get() { return std::get<I>(_filters); }
+
+ private:
+  std::tuple<Filters...> _filters;
+};
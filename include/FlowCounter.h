@@ -0,0 +1,100 @@
+#pragma once
+
+#include <Arduino.h>
+#include <driver/pcnt.h>
+
+#include <atomic>
+#include <cstdint>
+
+#include "Calibration.h"
+
+class FlowCounter {
+  /*
+      Pulse counting, rate measurement and totalizer of a flow meter on one PCNT unit.
+
+      - PCNT counts pulses in hardware. Counter wraps are accumulated by the PCNT event,
+        so the pulse total never overflows.
+      - A GPIO interrupt timestamps each edge. update() calculates the rate from the PCNT
+        count over the time between edges in a sliding window, so low flow is still updated
+        within a second. Edges missed by the interrupt are still counted, so the rate and
+        the total agree.
+      - The pulse total is checkpointed to NVS and restored after reboot. Only checkpoint()
+        writes NVS, so it must be called from one task (the loop task).
+
+      Conversion to L/min and L is left to the owner (CoreModule or FlowMeter).
+  */
+ public:
+  static const int16_t COUNT_LIMIT = 10000;  // PCNT counter wraps here and raises an event
+  static const int RECORDS = 16;             // Edge records kept for the sliding window
+  static const int64_t TIMEOUT = 5000000;    // Rate is 0 without pulses for this [us]
+  static const int TOTALIZER_SLOTS = 8;      // NVS keys rotated by checkpoints
+  static const size_t NAMESPACE_SIZE = 16;   // NVS namespaces are up to 15 characters
+
+  FlowCounter() = default;
+  // ISRs hold the address
+  FlowCounter(const FlowCounter&) = delete;
+  FlowCounter& operator=(const FlowCounter&) = delete;
+
+  // Start counting rising edges on pin with unit. Checkpoints are kept in nvsNamespace (truncated to 15 characters).
+  void begin(int pin, pcnt_unit_t unit, const char* nvsNamespace);
+  bool isStarted() const { return _unit != PCNT_UNIT_MAX; }
+  pcnt_unit_t unit() const { return _unit; }
+
+  // Update the rate from edges seen since the last call
+  void update();
+  float pulsesPerSec() const { return _pulsesPerSec; }
+  void setWindow(unsigned long windowMs);
+
+  // Pulses counted since begin()
+  uint64_t pulses();
+  // Pulses since the last reset, including pulses before reboots
+  uint64_t totalPulses();
+
+  // Totalizer
+  void restore();
+  // May be called from any task. The reset is saved by the next checkpoint().
+  void reset();
+  void setCheckpoint(float volume, unsigned long intervalMs);
+  // Save the pulse total if volume(pulses) has increased by the checkpoint volume or the interval passed
+  void checkpoint(const CalibrationCurve& volume);
+
+ private:
+  pcnt_unit_t _unit = PCNT_UNIT_MAX;
+  char _namespace[NAMESPACE_SIZE] = {};
+
+  // Rate
+  float _pulsesPerSec = 0;
+  int64_t _window = 1000000;  // [us]
+
+  // Written from ISRs and guarded by _mux
+  portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+  uint64_t _countOverflow = 0;   // Sum of PCNT counter wraps
+  int64_t _lastEdgeAt = 0;       // esp_timer time of the last edge [us]
+  uint64_t _lastPulses = 0;      // Keeps pulses() monotonic
+  uint64_t _totalPulsesBase = 0; // Total restored from NVS or 0 after reset
+  uint64_t _pulsesAtBase = 0;    // pulses() when _totalPulsesBase was set
+  static void IRAM_ATTR onCountLimit(void* arg);
+  static void IRAM_ATTR onEdge(void* arg);
+
+  // (pulses(), edge time) pairs spaced by _window / RECORDS
+  struct Record {
+    uint64_t count;
+    int64_t at;
+  };
+  Record _records[RECORDS];
+  int _recordHead = 0;
+  int _recordSize = 0;
+
+  // Totalizer checkpoints
+  struct Checkpoint {
+    uint32_t sequence;
+    uint64_t pulses;
+  };
+  std::atomic<uint32_t> _sequence{0};
+  std::atomic<bool> _resetPending{false};
+  uint64_t _checkpointPulses = 0;
+  unsigned long _checkpointAt = 0;
+  float _checkpointVolume = 1.0;               // [L]
+  unsigned long _checkpointInterval = 600000;  // [ms]
+  void save(uint64_t pulses);
+};
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <cstddef>
+#include <cstdint>
+
+class History {
+  /*
+      Fixed-memory history of sensor values in tiered ring buffers.
+
+      - Tier 0 keeps a point per second, tier 1 per minute and tier 2 per hour.
+      - Each point keeps avg/min/max per field. Higher tiers are rolled up from lower tiers.
+      - avg is stored as a 16 bit delta from the previous point, and min/max as 16 bit offsets
+        from avg, quantized with a per-field scale (6 bytes per field per point).
+      - All memory is allocated once in begin() and never exceeds the given budget.
+  */
+ public:
+  static const int MAX_FIELDS = 8;
+  static const int TIERS = 3;
+  static const int QUERY_CHUNK = 32;  // Points copied per lock by query()
+
+  History();
+  ~History();
+
+  // names and scales must outlive History. scale = 100 keeps 2 decimal places.
+  bool begin(size_t fields, const char* const* names, const float* scales, size_t memoryBudget);
+  boolean isEnabled() const { return _storage != nullptr; }
+  size_t memoryUsage() const { return _memoryUsage; }
+  int fieldIndex(const char* name) const;
+
+  void add(unsigned long time, const float* values);
+  void query(Print& out, int field, unsigned long from, unsigned long to, unsigned long step);
+
+ private:
+  struct Point {
+    int16_t avgDelta;
+    uint16_t minOffset;
+    uint16_t maxOffset;
+  };
+
+  struct Aggregate {
+    float min;
+    float max;
+    float sum;
+    uint32_t count;
+  };
+
+  struct Tier {
+    uint32_t step;      // Seconds per point
+    size_t capacity;
+    size_t start;       // Index of the oldest point
+    size_t size;
+    uint32_t newestBucket;
+    Point* points;      // capacity * fields
+    int32_t oldest[MAX_FIELDS];  // Quantized avg of the oldest point
+    int32_t newest[MAX_FIELDS];  // Quantized avg of the newest point
+
+    // Points being rolled up into the next point of this tier
+    uint32_t pendingBucket;
+    Aggregate pending[MAX_FIELDS];
+  };
+
+  size_t _fields = 0;
+  const char* const* _names = nullptr;
+  const float* _scales = nullptr;
+  Tier _tiers[TIERS];
+  Point* _storage = nullptr;
+  size_t _memoryUsage = 0;
+  SemaphoreHandle_t _mutex = nullptr;
+
+  void accumulate(int tier, uint32_t bucket, const Aggregate* values);
+  void push(int tier, uint32_t bucket, const Aggregate* values);
+  void append(Tier& tier, const Aggregate* values);
+};
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <cstddef>
+
+class JsonBuffer {
+  /*
+      Fixed-size buffer to format small JSON bodies on the stack, without JsonDocument or String.
+      Writes past the end are dropped and mark the buffer as overflowed.
+  */
+ public:
+  static const size_t SIZE = 256;
+
+  JsonBuffer& raw(const char* text);
+  JsonBuffer& printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+  // Values in JSON notation. Non-finite numbers become null and strings are escaped.
+  JsonBuffer& value(bool value);
+  JsonBuffer& value(int value);
+  JsonBuffer& value(long value);
+  JsonBuffer& value(unsigned int value);
+  JsonBuffer& value(unsigned long value);
+  JsonBuffer& value(float value);
+  JsonBuffer& value(double value);
+  JsonBuffer& value(const char* value);
+  JsonBuffer& value(const String& value) { return this->value(value.c_str()); }
+  JsonBuffer& value(const IPAddress& value);
+
+  const char* c_str() const { return _buffer; }
+  size_t length() const { return _length; }
+  bool overflowed() const { return _overflowed; }
+
+ private:
+  char _buffer[SIZE] = {};
+  size_t _length = 0;
+  bool _overflowed = false;
+
+  void put(char c);
+};
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+enum class LogLevel : uint8_t {
+  Debug,
+  Info,
+  Warn,
+  Error,
+  None,
+};
+
+class Logger {
+  /*
+      Leveled logger which never blocks the caller.
+
+      - Callers format a line into a lock-free ring buffer (any number of producers).
+      - A low-priority task drains the ring to the output (Serial by default).
+      - If the ring is full, the line is dropped and counted instead of waiting for the UART.
+      - Drained lines stay in the ring until overwritten, so the latest ones can be read by tail().
+  */
+ public:
+  static const size_t LINE_SIZE = 128;
+  static const size_t LINES = 64;
+  static const int MAX_SAMPLED_PATHS = 8;
+
+  void begin(Print& out = Serial, int priority = 1);
+
+  void log(LogLevel level, const char* format, ...) __attribute__((format(printf, 3, 4)));
+  void setLevel(LogLevel level) { _level = level; }
+  LogLevel level() const { return _level; }
+  bool enabled(LogLevel level) const { return level >= _level && level != LogLevel::None; }
+
+  // Log 1 of every n successful requests to path, or none if n is 0. Also set by POST /logs/level.
+  // Calls must come from one task at a time, such as the AsyncTCP task; sample() may run anywhere.
+  void setPathSampling(const char* path, uint16_t every);
+  bool sample(const char* path);
+
+  // Write the latest lines as a JSON array of strings
+  void tail(Print& out, size_t lines) const;
+  uint32_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+  TaskHandle_t task() const { return _task; }
+
+  static const char* levelName(LogLevel level);
+  static bool parseLevel(const char* name, LogLevel& level);
+
+ private:
+  struct Line {
+    // Odd while the line is being written, (ticket + 1) * 2 when complete
+    std::atomic<uint32_t> seq{0};
+    char text[LINE_SIZE];
+  };
+
+  struct SampledPath {
+    char path[32];
+    std::atomic<uint16_t> every;
+    std::atomic<uint16_t> count;
+  };
+
+  Line _lines[LINES];
+  std::atomic<uint32_t> _head{0};     // Tickets taken by producers
+  std::atomic<uint32_t> _drained{0};  // Lines written to the output
+  std::atomic<uint32_t> _dropped{0};
+  LogLevel _level = LogLevel::Info;
+
+  SampledPath _sampledPaths[MAX_SAMPLED_PATHS];
+  std::atomic<int> _sampledPathCount{0};
+
+  Print* _out = nullptr;
+  TaskHandle_t _task = nullptr;
+
+  void drain();
+  static void drainTask(void* arg);
+};
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <Arduino.h>
+#include <PubSubClient.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include "CoreModule.h"
+#include "PayloadWriter.h"
+#include "PublishPolicy.h"
+
+class MQTTPublisher {
+  /*
+      Publishes sensor values to an MQTT broker while publishing is started with /publish/start.
+
+      - Connection management runs on its own task, so loop() never waits for the broker.
+        Failed connections are retried with exponential backoff.
+      - A sample is queued every publishInterval() by a separate task, so sampling goes on
+        while PubSubClient::connect() blocks. While disconnected, the queue keeps the latest
+        samples, and older ones can be spilled to flash with enableSpool().
+      - On reconnect, the backlog is sent in batches of up to BATCH_SIZE samples per message.
+      - With the report-by-exception policy, a sample only carries the fields which moved
+        out of their deadbands, and a full sample is sent at each heartbeat.
+
+      Payloads are JSON, MessagePack or CBOR as chosen by /publish/start, optionally with
+      numeric keys (1: tds, 2: flow, 3: totalFlow, 4: temperature, 5: time).
+
+      time is the millis() of the sample cycle, i.e. uptime, since the module keeps no wall clock.
+      ThingsBoard stores telemetry without a "ts" at the time it is received, so the samples of a
+      backlog batch are stored at the time of the batch, and only time keeps when they were taken.
+
+      client_id given to /publish/start is used as the MQTT user name (e.g. a ThingsBoard access token).
+      Any Client can be used, so the publisher can be pointed to a local broker for testing.
+  */
+ public:
+  static const size_t QUEUE_SIZE = 256;
+  static const size_t BATCH_SIZE = 16;
+  static const size_t PAYLOAD_SIZE = 1024;
+  static const size_t METADATA_SIZE = 256;
+  static const unsigned long MIN_BACKOFF = 1000;   // [ms]
+  static const unsigned long MAX_BACKOFF = 60000;  // [ms]
+  // Kept free for the sampler while the publisher task waits for the broker
+  static const size_t HEADROOM = QUEUE_SIZE / 4;
+
+  MQTTPublisher(CoreModule& module, Client& client);
+
+  void setServer(const char* host, uint16_t port);
+  void setTopic(const char* topic) { _topic = topic; }
+  void setMQTTClientId(const char* id) { _mqttClientId = id; }
+  // Spill samples which overflow the queue to a LittleFS file of up to maxBytes
+  void enableSpool(const char* path = "/mqtt_spool.bin", size_t maxBytes = 65536);
+  void begin(int core = 0, int priority = 1);
+
+  // Fields of a sample, in the order of PublishPolicy::FIELD_NAMES
+  enum Field : uint8_t {
+    TDS = 1 << 0,
+    FLOW = 1 << 1,
+    TOTAL_FLOW = 1 << 2,
+    TEMPERATURE = 1 << 3,
+    ALL = TDS | FLOW | TOTAL_FLOW | TEMPERATURE,
+  };
+
+  bool connected() const { return _connected.load(std::memory_order_relaxed); }
+  size_t queued() const {
+    // The tail first, since the head never moves back
+    uint32_t tail = _queueTail.load(std::memory_order_acquire);
+    return _queueHead.load(std::memory_order_acquire) - tail + _spooled.load(std::memory_order_relaxed);
+  }
+  uint32_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+
+ private:
+  struct Sample {
+    SensorValues values;
+    uint8_t fields;
+  };
+
+  CoreModule& _module;
+  PubSubClient _mqtt;
+  std::string _topic = "v1/devices/me/telemetry";
+  std::string _mqttClientId = "o-ware";
+  TaskHandle_t _task = nullptr;         // Connection and publishing
+  TaskHandle_t _samplerTask = nullptr;  // Sampling, which never waits for the broker
+
+  // Session state of the publisher task. Sessions are immutable, so they are read without a lock.
+  std::shared_ptr<const Base::PublishSettings> _session;
+  PayloadFormat _format = PayloadFormat::JSON;
+  bool _shortKeys = false;
+  // Metadata entries encoded once per session in _format
+  uint8_t _metadata[METADATA_SIZE];
+  size_t _metadataLength = 0;
+  size_t _metadataEntries = 0;
+  unsigned long _backoff = MIN_BACKOFF;
+  unsigned long _connectAt = 0;
+
+  // Session state of the sampler task
+  std::shared_ptr<const Base::PublishSettings> _samplerSession;
+  unsigned long _sampledAt = 0;
+
+  // Report by exception, on the sampler task
+  bool _hasReported = false;
+  float _reported[PublishPolicy::FIELDS];
+  unsigned long _reportedAt = 0;
+  unsigned long _fullReportedAt = 0;
+
+  // Samples waiting to be published, oldest at _queueTail. Only the sampler task moves the head
+  // and only the publisher task moves the tail, so neither waits for the other.
+  Sample _queue[QUEUE_SIZE];
+  std::atomic<uint32_t> _queueHead{0};
+  std::atomic<uint32_t> _queueTail{0};
+
+  // Samples spilled to flash by the publisher task. They are older than the queue, so they are sent first.
+  bool _spoolEnabled = false;
+  std::string _spoolPath;
+  size_t _spoolMaxBytes = 0;
+  size_t _spoolSize = 0;
+  size_t _spoolReadOffset = 0;
+
+  std::atomic<bool> _connected{false};
+  std::atomic<size_t> _spooled{0};
+  std::atomic<uint32_t> _dropped{0};
+
+  uint8_t _payload[PAYLOAD_SIZE];
+
+  void run();
+  void sample();
+  void startSession();
+  void endSession();
+  void enqueue(const SensorValues& values, uint8_t fields);
+  void reportByException(const SensorValues& values, unsigned long now);
+  void makeRoom();
+  void spill();
+  bool connect();
+  bool publishBacklog();
+  bool publishBatch(const Sample* records, size_t count, size_t& published);
+  size_t encode(const Sample& sample, uint8_t* buffer, size_t size) const;
+  void key(PayloadWriter& writer, const char* name, uint8_t id) const;
+  void updateSpooled();
+  static void publisherTask(void* arg);
+  static void samplerTask(void* arg);
+};
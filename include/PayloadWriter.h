@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+enum class PayloadFormat : uint8_t {
+  JSON,
+  MessagePack,
+  CBOR,
+};
+
+class PayloadWriter {
+  /*
+      Writes maps and arrays of numbers and strings as JSON, MessagePack or CBOR into a fixed buffer.
+
+      Maps and arrays take the number of entries up front, as MessagePack and CBOR encode it in the header.
+      Keys can be strings or small numbers. In JSON, numeric keys are written as strings ("1").
+      Entries encoded beforehand (e.g. metadata) can be copied in with raw().
+  */
+ public:
+  static const int MAX_DEPTH = 4;
+
+  PayloadWriter(PayloadFormat format, uint8_t* buffer, size_t size);
+
+  void beginMap(size_t entries);
+  void endMap();
+  void beginArray(size_t items);
+  void endArray();
+
+  void key(const char* name);
+  void key(uint8_t id);
+  void value(int32_t value);
+  void value(uint32_t value);
+  void value(float value);
+  void value(const char* value);
+
+  // Copy entries encoded with the same format. In JSON, entries are separated by commas.
+  void raw(const uint8_t* data, size_t length, size_t entries);
+
+  size_t length() const { return _length; }
+  bool overflowed() const { return _overflowed; }
+
+  static bool parseFormat(const char* name, PayloadFormat& format);
+  static const char* formatName(PayloadFormat format);
+
+ private:
+  PayloadFormat _format;
+  uint8_t* _buffer;
+  size_t _size;
+  size_t _length = 0;
+  bool _overflowed = false;
+
+  // JSON separators: whether the container at each depth has an entry, and whether a value follows a key
+  bool _hasEntry[MAX_DEPTH + 1] = {};
+  int _depth = 0;
+  bool _afterKey = false;
+
+  void put(uint8_t byte);
+  void put(const void* data, size_t length);
+  void separate();
+  void putText(const char* text);
+  void putHeader(uint8_t major, uint32_t value);
+  void putBigEndian(uint32_t value, int bytes);
+};
@@ -0,0 +1,290 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <cstdint>
+#include <cstring>
+
+#include "Logger.h"
+
+template <bool Enabled>
+class Profiler {
+  /*
+      Per-stage latency histograms measured with the CPU cycle counter.
+
+      - Durations are counted in log-linear buckets (4 per power of two, within 19 %),
+        from which p50/p99 are read. max is exact.
+      - period() records the time between calls, e.g. to measure loop jitter.
+      - The cycle counter is per core, so a measured stage must not move between cores.
+        Tasks of this library and loopTask are pinned.
+
+      Profiler<false> has the same interface and does nothing, so profiling compiles out.
+  */
+ public:
+  // 12 stages of Base and CoreModule, one per analog sensor (16 at most) and a few for other modules
+  static const int MAX_STAGES = 32;
+  static const size_t NAME_SIZE = 16;
+
+  struct Stats {
+    uint32_t count;
+    float p50;  // [us]
+    float p99;
+    float max;
+  };
+
+  // Register a stage and return its id, or -1 if all stages are taken. name is copied.
+  // Measuring stage -1 does nothing, so a module goes on without being profiled.
+  int addStage(const char* name, bool period = false);
+
+  uint32_t now() const { return ESP.getCycleCount(); }
+  void record(int stage, uint32_t cycles);
+  // Record the time since the previous call for stage
+  void period(int stage);
+
+  // Measure the duration of fn as stage
+  template <typename Fn>
+  void measure(int stage, Fn fn) {
+    uint32_t start = now();
+    fn();
+    record(stage, now() - start);
+  }
+
+  Stats stats(int stage);
+  void reset();
+
+  // Write all stages as a JSON object
+  void write(Print& out);
+  // Log a line per stage every interval [ms]. 0 disables the summary.
+  void setSummaryInterval(unsigned long interval) { _summaryInterval = interval; }
+  void summarize(Logger& logger);
+
+ private:
+  static const int MIN_EXPONENT = 6;  // Durations below 2^6 cycles fall into bucket 0
+  static const int SUB_BUCKETS = 4;
+  static const int BUCKETS = 1 + (32 - MIN_EXPONENT) * SUB_BUCKETS;
+
+  struct Stage {
+    char name[NAME_SIZE];
+    bool period;
+    bool started;
+    uint32_t lastAt;
+    uint32_t count;
+    uint32_t max;
+    uint32_t buckets[BUCKETS];
+  };
+
+  Stage _stages[MAX_STAGES];
+  int _stageCount = 0;
+  portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+  unsigned long _summaryInterval = 10000;
+  unsigned long _summarizedAt = 0;
+
+  void add(Stage& s, uint32_t cycles);
+  static int bucketOf(uint32_t cycles);
+  static uint32_t bucketLimit(int bucket);
+  static uint32_t percentile(const Stage& stage, float ratio);
+};
+
+template <bool Enabled>
+int Profiler<Enabled>::addStage(const char* name, bool period) {
+  /*
+      Call before the stage is measured. Stages cannot be removed.
+  */
+  if (_stageCount >= MAX_STAGES) {
+    return -1;
+  }
+  Stage& stage = _stages[_stageCount];
+  memset(&stage, 0, sizeof(stage));
+  strncpy(stage.name, name, NAME_SIZE - 1);
+  stage.period = period;
+  return _stageCount++;
+}
+
+template <bool Enabled>
+int Profiler<Enabled>::bucketOf(uint32_t cycles) {
+  if (cycles < (1u << MIN_EXPONENT)) {
+    return 0;
+  }
+  int exponent = 31 - __builtin_clz(cycles);
+  int mantissa = (cycles >> (exponent - 2)) & (SUB_BUCKETS - 1);
+  return 1 + (exponent - MIN_EXPONENT) * SUB_BUCKETS + mantissa;
+}
+
+template <bool Enabled>
+uint32_t Profiler<Enabled>::bucketLimit(int bucket) {
+  /*
+      Upper limit of a bucket [cycles]
+  */
+  if (bucket == 0) {
+    return 1u << MIN_EXPONENT;
+  }
+  int exponent = (bucket - 1) / SUB_BUCKETS + MIN_EXPONENT;
+  uint64_t mantissa = (bucket - 1) % SUB_BUCKETS + SUB_BUCKETS + 1;
+  uint64_t limit = mantissa << (exponent - 2);
+  return limit > UINT32_MAX ? UINT32_MAX : limit;
+}
+
+template <bool Enabled>
+void Profiler<Enabled>::record(int stage, uint32_t cycles) {
+  if (stage < 0 || stage >= _stageCount) {
+    return;
+  }
+  portENTER_CRITICAL(&_mux);
+  add(_stages[stage], cycles);
+  portEXIT_CRITICAL(&_mux);
+}
+
+template <bool Enabled>
+void Profiler<Enabled>::add(Stage& s, uint32_t cycles) {
+  /*
+      Count a duration. Called under _mux.
+  */
+  s.count++;
+  s.buckets[bucketOf(cycles)]++;
+  if (cycles > s.max) {
+    s.max = cycles;
+  }
+}
+
+template <bool Enabled>
+void Profiler<Enabled>::period(int stage) {
+  if (stage < 0 || stage >= _stageCount) {
+    return;
+  }
+  uint32_t at = now();
+  // started and lastAt are read and written under _mux, as reset() clears started
+  portENTER_CRITICAL(&_mux);
+  Stage& s = _stages[stage];
+  if (s.started) {
+    add(s, at - s.lastAt);
+  }
+  s.lastAt = at;
+  s.started = true;
+  portEXIT_CRITICAL(&_mux);
+}
+
+template <bool Enabled>
+uint32_t Profiler<Enabled>::percentile(const Stage& stage, float ratio) {
+  uint32_t rank = static_cast<uint32_t>(stage.count * ratio + 0.5f);
+  if (rank == 0) {
+    rank = 1;
+  }
+  uint32_t seen = 0;
+  for (int i = 0; i < BUCKETS; i++) {
+    seen += stage.buckets[i];
+    if (seen >= rank) {
+      uint32_t limit = bucketLimit(i);
+      return limit < stage.max ? limit : stage.max;
+    }
+  }
+  return stage.max;
+}
+
+template <bool Enabled>
+typename Profiler<Enabled>::Stats Profiler<Enabled>::stats(int stage) {
+  if (stage < 0 || stage >= _stageCount) {
+    return {};
+  }
+  float cyclesPerUs = ESP.getCpuFreqMHz();
+  portENTER_CRITICAL(&_mux);
+  const Stage& s = _stages[stage];
+  Stats stats = {s.count, 0, 0, 0};
+  if (s.count > 0) {
+    stats.p50 = percentile(s, 0.5f) / cyclesPerUs;
+    stats.p99 = percentile(s, 0.99f) / cyclesPerUs;
+    stats.max = s.max / cyclesPerUs;
+  }
+  portEXIT_CRITICAL(&_mux);
+  return stats;
+}
+
+template <bool Enabled>
+void Profiler<Enabled>::reset() {
+  portENTER_CRITICAL(&_mux);
+  for (int i = 0; i < _stageCount; i++) {
+    Stage& s = _stages[i];
+    s.started = false;
+    s.count = 0;
+    s.max = 0;
+    memset(s.buckets, 0, sizeof(s.buckets));
+  }
+  portEXIT_CRITICAL(&_mux);
+}
+
+template <bool Enabled>
+void Profiler<Enabled>::write(Print& out) {
+  /*
+      {"enabled":true,"stages":{"tds":{"count":100,"p50":812.3,"p99":950.0,"max":1020.4},...}}
+      Times are in microseconds. Period stages also have jitter (p99 - p50).
+  */
+  out.print("{\"enabled\":true,\"stages\":{");
+  for (int i = 0; i < _stageCount; i++) {
+    Stats s = stats(i);
+    out.printf("%s\"%s\":{\"count\":%lu,\"p50\":%.1f,\"p99\":%.1f,\"max\":%.1f",
+               i == 0 ? "" : ",", _stages[i].name, static_cast<unsigned long>(s.count), s.p50, s.p99, s.max);
+    if (_stages[i].period) {
+      out.printf(",\"jitter\":%.1f", s.p99 - s.p50);
+    }
+    out.print("}");
+  }
+  out.print("}}");
+}
+
+template <bool Enabled>
+void Profiler<Enabled>::summarize(Logger& logger) {
+  /*
+      Call from the loop. Lines go through the logger, so the caller never waits for Serial.
+  */
+  unsigned long time = millis();
+  if (_summaryInterval == 0 || time - _summarizedAt < _summaryInterval) {
+    return;
+  }
+  _summarizedAt = time;
+
+  for (int i = 0; i < _stageCount; i++) {
+    Stats s = stats(i);
+    if (s.count > 0) {
+      logger.log(LogLevel::Info, "Profile %s: n=%lu p50=%.1fus p99=%.1fus max=%.1fus",
+                 _stages[i].name, static_cast<unsigned long>(s.count), s.p50, s.p99, s.max);
+    }
+  }
+}
+
+template <>
+class Profiler<false> {
+  /*
+      Profiling compiled out. Every call is inlined away.
+  */
+ public:
+  static const int MAX_STAGES = 0;
+
+  struct Stats {
+    uint32_t count;
+    float p50;
+    float p99;
+    float max;
+  };
+
+  int addStage(const char* name, bool period = false) { return -1; }
+  uint32_t now() const { return 0; }
+  void record(int stage, uint32_t cycles) {}
+  void period(int stage) {}
+
+  template <typename Fn>
+  void measure(int stage, Fn fn) {
+    fn();
+  }
+
+  Stats stats(int stage) { return {}; }
+  void reset() {}
+  void write(Print& out) { out.print("{\"enabled\":false,\"stages\":{}}"); }
+  void setSummaryInterval(unsigned long interval) {}
+  void summarize(Logger& logger) {}
+};
+
+// Build with -D O_PROFILER to profile CoreModule::update() and sensor modules
+#ifdef O_PROFILER
+typedef Profiler<true> StageProfiler;
+#else
+typedef Profiler<false> StageProfiler;
+#endif
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cmath>
+
+struct Deadband {
+  /*
+      A change larger than value (or value % of the last reported value) is reported.
+      0 reports any change.
+  */
+  float value = 0;
+  bool percent = false;
+
+  bool exceeded(float current, float reported) const {
+    if (std::isnan(current) || std::isnan(reported)) {
+      return std::isnan(current) != std::isnan(reported);
+    }
+    float limit = percent ? std::fabs(reported) * value / 100 : value;
+    return std::fabs(current - reported) > limit;
+  }
+};
+
+struct PublishPolicy {
+  /*
+      When onChange is false, every sample is published at the publish interval.
+      When onChange is true, samples are checked at the publish interval and published when
+      a field moves out of its deadband, at most once per minInterval. A full sample is
+      published at least once per heartbeat.
+  */
+  static constexpr int FIELDS = 4;
+  static constexpr const char* FIELD_NAMES[FIELDS] = {"tds", "flow", "totalFlow", "temperature"};
+
+  bool onChange = false;
+  Deadband deadbands[FIELDS];
+  unsigned long minInterval = 1000;  // [ms]
+  unsigned long heartbeat = 60000;   // [ms]
+};
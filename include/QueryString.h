@@ -0,0 +1,63 @@
+#pragma once
+
+#include <charconv>
+#include <string_view>
+
+class QueryString {
+  /*
+      Zero-copy view of a query string such as "fields=tds,flow&interval=500".
+      Names and values point into the original string, which must outlive QueryString.
+      Values are not URL-decoded.
+  */
+ public:
+  explicit QueryString(std::string_view query) : _query(query) {}
+
+  // Call fn(name, value) for each parameter in order
+  template <typename Fn>
+  void forEach(Fn fn) const {
+    std::string_view rest = _query;
+    while (!rest.empty()) {
+      size_t end = rest.find('&');
+      std::string_view pair = rest.substr(0, end);
+      rest = end == std::string_view::npos ? std::string_view() : rest.substr(end + 1);
+      if (pair.empty()) {
+        continue;
+      }
+
+      size_t separator = pair.find('=');
+      if (separator == std::string_view::npos) {
+        fn(pair, std::string_view());
+      } else {
+        fn(pair.substr(0, separator), pair.substr(separator + 1));
+      }
+    }
+  }
+
+  bool has(std::string_view name) const {
+    bool found = false;
+    forEach([&](std::string_view key, std::string_view) { found = found || key == name; });
+    return found;
+  }
+
+  // The first value of name, or fallback if missing
+  std::string_view get(std::string_view name, std::string_view fallback = {}) const {
+    std::string_view value = fallback;
+    bool found = false;
+    forEach([&](std::string_view key, std::string_view v) {
+      if (!found && key == name) {
+        value = v;
+        found = true;
+      }
+    });
+    return value;
+  }
+
+  // Parse an unsigned integer. Returns false if value is not a number.
+  static bool toUnsigned(std::string_view value, unsigned long& result) {
+    auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), result);
+    return error == std::errc() && end == value.data() + value.size();
+  }
+
+ private:
+  std::string_view _query;
+};
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+// Values of "{name}" segments of a matched route
+struct RouteParams {
+  static const int MAX_PARAMS = 4;
+
+  int size = 0;
+  std::string_view names[MAX_PARAMS];
+  std::string_view values[MAX_PARAMS];
+
+  std::string_view get(std::string_view name) const {
+    for (int i = 0; i < size; i++) {
+      if (names[i] == name) {
+        return values[i];
+      }
+    }
+    return {};
+  }
+};
+
+class Router : public AsyncWebHandler {
+  /*
+      A single handler which dispatches requests to routes by path.
+
+      - Paths are split into segments, and each segment is looked up in a hash table keyed by
+        the parent node and the segment, so a lookup takes O(path length) regardless of the
+        number of routes.
+      - A segment in braces is a parameter, e.g. "/{device}/{action}". Literal segments take
+        precedence over parameters.
+      - A trailing '/' in the request path is ignored.
+      - on() never throws, so routes can be added before anything can catch. It returns false
+        for a path which cannot be added.
+  */
+ public:
+  using Handler = std::function<void(AsyncWebServerRequest*, const RouteParams&)>;
+
+  Router();
+  bool on(const char* path, WebRequestMethodComposite method, Handler handler);
+  bool on(const char* path, WebRequestMethodComposite method, ArRequestHandlerFunction handler);
+  size_t size() const { return _handlers.size(); }
+  // Called for a request whose route is gone by the time it is handled. Default is a bare 404.
+  void onNotFound(ArRequestHandlerFunction handler) { _notFound = std::move(handler); }
+
+  bool canHandle(AsyncWebServerRequest* request) override;
+  void handleRequest(AsyncWebServerRequest* request) override;
+  // Let the server parse body parameters of POST requests
+  bool isRequestHandlerTrivial() override { return false; }
+
+ private:
+  struct Route {
+    WebRequestMethodComposite method;
+    int handler;
+  };
+
+  struct Node {
+    std::string segment;  // Literal segment, or the name of a parameter
+    int parameter = -1;   // Child node for a parameter segment
+    std::vector<Route> routes;
+  };
+
+  std::vector<Node> _nodes;
+  // Handlers are kept as given, without wrapping one callable in another
+  std::vector<std::variant<Handler, ArRequestHandlerFunction>> _handlers;
+  // (parent node << 32 | hash of segment) -> child node
+  std::unordered_map<uint64_t, int> _children;
+  ArRequestHandlerFunction _notFound;
+
+  static uint64_t childKey(int parent, std::string_view segment);
+  int add(const char* path, WebRequestMethodComposite method);
+  int match(AsyncWebServerRequest* request, RouteParams& params) const;
+  int find(int node, std::string_view path, WebRequestMethodComposite method, RouteParams& params) const;
+};
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+template <typename T, size_t N>
+class SampleRing {
+  /*
+      Lock-free ring buffer with a single producer and any number of readers.
+
+      Each reader keeps its own cursor, so the loop, HTTP handlers and publishers
+      can consume the same records independently. The producer never waits for readers.
+      A reader which falls more than N records behind skips to the oldest record still held.
+  */
+  static_assert(N > 0 && (N & (N - 1)) == 0, "N must be a power of two");
+
+ private:
+  struct Slot {
+    // Odd while the record is being written, (record number + 1) * 2 when complete
+    std::atomic<uint32_t> seq{0};
+    T value;
+  };
+
+  Slot _slots[N];
+  std::atomic<uint32_t> _head{0};  // Number of records pushed so far
+
+ public:
+  void push(const T& value);
+  bool read(uint32_t& cursor, T& out) const;
+  bool latest(T& out) const;
+  uint32_t head() const { return _head.load(std::memory_order_acquire); }
+  static constexpr size_t capacity() { return N; }
+};
+
+template <typename T, size_t N>
+void SampleRing<T, N>::push(const T& value) {
+  /*
+      Append a record. Must be called from a single producer.
+  */
+  uint32_t record = _head.load(std::memory_order_relaxed);
+  Slot& slot = _slots[record & (N - 1)];
+
+  slot.seq.store((record << 1) | 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot.value = value;
+  slot.seq.store((record + 1) << 1, std::memory_order_release);
+
+  _head.store(record + 1, std::memory_order_release);
+}
+
+template <typename T, size_t N>
+bool SampleRing<T, N>::read(uint32_t& cursor, T& out) const {
+  /*
+      Copy the record at cursor into out and advance cursor.
+      Returns false if there is no new record.
+  */
+  while (true) {
+    uint32_t pushed = _head.load(std::memory_order_acquire);
+    if (cursor == pushed) {
+      return false;
+    }
+
+    // Skip records which have already been overwritten
+    if (pushed - cursor > N) {
+      cursor = pushed - N;
+    }
+
+    // If the slot no longer holds the record, the producer has overwritten it: skip it.
+    const Slot& slot = _slots[cursor & (N - 1)];
+    uint32_t expected = (cursor + 1) << 1;
+    if (slot.seq.load(std::memory_order_acquire) != expected) {
+      cursor++;
+      continue;
+    }
+    out = slot.value;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.seq.load(std::memory_order_relaxed) != expected) {
+      cursor++;
+      continue;
+    }
+
+    cursor++;
+    return true;
+  }
+}
+
+template <typename T, size_t N>
+bool SampleRing<T, N>::latest(T& out) const {
+  /*
+      Copy the most recent record into out.
+      Returns false if nothing has been pushed yet.
+  */
+  uint32_t pushed = head();
+  if (pushed == 0) {
+    return false;
+  }
+  uint32_t cursor = pushed - 1;
+  return read(cursor, out);
+}
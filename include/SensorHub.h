@@ -0,0 +1,50 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "SensorValues.h"
+
+class SensorHub {
+  /*
+      Registry of sensor values which can be read together with one request.
+      Sensors are registered from init() of each module, before the server starts,
+      so the registry is not locked while it is read.
+
+      With a sample source, write() takes one sample cycle and reports its time and sequence.
+      Sensors added with a SampleGetter read from that sample, so they never mix two cycles.
+  */
+ public:
+  static const int MAX_SENSORS = 32;
+  typedef std::function<float(void)> Getter;
+  typedef std::function<float(const SensorValues&)> SampleGetter;
+  typedef std::function<SensorValues(void)> SampleSource;
+
+  // Names must be unique
+  void add(std::string name, std::string unit, Getter getter, int decimals = 2);
+  void add(std::string name, std::string unit, SampleGetter getter, int decimals = 2);
+  void setSampleSource(SampleSource source) { _source = source; }
+  size_t size() const { return _sensors.size(); }
+  bool contains(const std::string& name) const { return indexOf(name.c_str(), name.size()) >= 0; }
+
+  // Bit mask of sensors in a comma separated list of names. Empty selects all.
+  uint32_t select(const char* names) const;
+  void write(Print& out, uint32_t selection, unsigned long time) const;
+
+ private:
+  struct Sensor {
+    std::string name;
+    std::string unit;
+    Getter getter;
+    SampleGetter sampleGetter;
+    int decimals;
+  };
+  std::vector<Sensor> _sensors;
+  SampleSource _source;
+
+  void insert(Sensor sensor);
+  int indexOf(const char* name, size_t length) const;
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+#include <string_view>
+#include <vector>
+
+#include "SensorValues.h"
+
+class SensorStream {
+  /*
+      Live stream of sensor values over WebSocket and Server-Sent Events.
+
+      - WebSocket (/stream): each connection chooses fields and a minimum interval with
+        query parameters (e.g. /stream?fields=tds,flow&interval=500) or by sending the same
+        string as a text message.
+      - Server-Sent Events (/events): all fields at the interval set by setEventsInterval().
+
+      Each frame is serialized once per field set into one buffer, which is queued to each
+      subscriber with that field set. With ESPAsyncWebServer 1.2.3 only textAll() frees a buffer
+      from makeBuffer(), so the buffers are owned here and freed once no message holds them.
+      A subscriber whose send queue is full skips frames instead of queueing more.
+      Up to MAX_SUBSCRIBERS WebSocket clients are accepted, and more are closed.
+
+      publish() runs on the loop task, while clients connect and disconnect on the AsyncTCP task.
+      WebSocket clients are kept here from WS_EVT_CONNECT until WS_EVT_DISCONNECT, which is raised
+      before a client is freed, and are sent to under _lock, so publish() never walks the client
+      list of AsyncWebSocket. AsyncEventSource raises no event on disconnect, so /events is still
+      sent with AsyncEventSource::send().
+  */
+ public:
+  static const int MAX_SUBSCRIBERS = 8;
+  static const unsigned long DEFAULT_INTERVAL = 100;  // [ms]
+  static const unsigned long MIN_INTERVAL = 10;       // [ms]
+
+  enum Field : uint8_t {
+    TDS = 1 << 0,
+    FLOW = 1 << 1,
+    TOTAL_FLOW = 1 << 2,
+    TEMPERATURE = 1 << 3,
+    ALL = TDS | FLOW | TOTAL_FLOW | TEMPERATURE,
+  };
+
+  SensorStream(const char* streamPath = "/stream", const char* eventsPath = "/events");
+  void attach(AsyncWebServer& server);
+  void publish(const SensorValues& values);
+  void setEventsInterval(unsigned long interval) { _eventsInterval = interval; }
+
+ private:
+  struct Subscriber {
+    AsyncWebSocketClient* client;
+    uint8_t fields;
+    unsigned long interval;
+    unsigned long lastSentAt;
+  };
+
+  AsyncWebSocket _ws;
+  AsyncEventSource _events;
+  Subscriber _subscribers[MAX_SUBSCRIBERS];
+  int _subscriberCount = 0;
+  // Subscribers and sends to them. Created by attach().
+  SemaphoreHandle_t _lock = nullptr;
+  // Frame buffers which may still be held by queued messages
+  std::vector<AsyncWebSocketMessageBuffer*> _frames;
+
+  unsigned long _eventsInterval = DEFAULT_INTERVAL;
+  unsigned long _eventsSentAt = 0;
+
+  void onEvent(AsyncWebSocketClient* client, AwsEventType type, void* arg, uint8_t* data, size_t len);
+  bool subscribe(AsyncWebSocketClient* client, uint8_t fields, unsigned long interval);
+  void unsubscribe(AsyncWebSocketClient* client);
+  void releaseFrames();
+  static void parseQuery(std::string_view query, uint8_t& fields, unsigned long& interval);
+  static size_t serialize(const SensorValues& values, uint8_t fields, char* buffer, size_t size);
+};
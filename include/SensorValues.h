@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstdint>
+
+struct SensorValues {
+  int tds;
+  float flow;
+  float totalFlow;
+  float temperature;
+  unsigned long timestamp;  // millis() when the values were sampled
+  uint32_t sequence;        // Incremented on every sample cycle. 0 means not sampled yet.
+};
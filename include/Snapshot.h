@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+template <typename T>
+class Snapshot {
+  /*
+      Double-buffered seqlock holding the latest value written by a single writer.
+
+      Readers never take a mutex and always get a value from one write.
+      The writer fills the buffer readers are not pointed at, so a reader only retries
+      if two writes complete while it copies. A writer preempted in the middle of a write
+      therefore never blocks readers, even when they run at a higher priority on the same core.
+  */
+ private:
+  struct Buffer {
+    // version * 2 when complete, odd while being written
+    std::atomic<uint32_t> seq{0};
+    T value{};
+  };
+
+  Buffer _buffers[2];
+  std::atomic<uint32_t> _version{0};
+
+ public:
+  void write(const T& value);
+  T read() const;
+  uint32_t version() const { return _version.load(std::memory_order_acquire); }
+};
+
+template <typename T>
+void Snapshot<T>::write(const T& value) {
+  /*
+      Publish a new value. Must be called from a single writer.
+  */
+  uint32_t next = _version.load(std::memory_order_relaxed) + 1;
+  Buffer& buffer = _buffers[next & 1];
+
+  buffer.seq.store((next << 1) - 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  buffer.value = value;
+  buffer.seq.store(next << 1, std::memory_order_release);
+
+  _version.store(next, std::memory_order_release);
+}
+
+template <typename T>
+T Snapshot<T>::read() const {
+  /*
+      Return a consistent copy of the latest value.
+  */
+  while (true) {
+    uint32_t version = _version.load(std::memory_order_acquire);
+    const Buffer& buffer = _buffers[version & 1];
+
+    uint32_t seq = buffer.seq.load(std::memory_order_acquire);
+    if (seq != version << 1) {
+      continue;
+    }
+    T value = buffer.value;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (buffer.seq.load(std::memory_order_relaxed) == seq) {
+      return value;
+    }
+  }
+}
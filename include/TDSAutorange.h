@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cmath>
+
+class TDSAutorange {
+  /*
+      MAX4618 range selection for the TDS circuit. Voltages are raw ADC values.
+
+      - A reading within the valid window is valid. The first reading after a switch must be in
+        VOLTAGE_MIN..VOLTAGE_MAX, and the window is widened by HYSTERESIS once a range is entered.
+      - Otherwise, it jumps to the range estimated from how far the reading is out of the window,
+        and waits until consecutive readings agree or SETTLING_TIME passes.
+
+      It has no hardware access, so it can be compiled and exercised on a host.
+  */
+ public:
+  static constexpr int RANGE_MAX = 3;                  // MAX4618 channel for the lowest TDS
+  static constexpr float VOLTAGE_MIN = 100;            // Valid window when entering a range
+  static constexpr float VOLTAGE_MAX = 1500;
+  static constexpr float HYSTERESIS = 10;              // Window is widened by this while staying in a range
+  static constexpr float VOLTAGE_SATURATED = 4000;     // Actual voltage is unknown above this
+  static constexpr float RANGE_RATIO = 10.0;           // Approximate voltage ratio between adjacent ranges
+  static constexpr float SETTLE_TOLERANCE = 8;         // Consecutive readings within max(8, 2%) agree
+  static constexpr float SETTLE_TOLERANCE_RATIO = 0.02;
+  static constexpr int SETTLE_COUNT = 2;               // Number of agreeing readings to regard as settled
+  static constexpr unsigned long SETTLING_TIME = 150;  // Upper limit of waiting for settling [ms]
+
+  enum class Result {
+    Valid,       // The reading can be converted with range()
+    Settling,    // Waiting for readings to settle after a switch
+    Switch,      // range() has changed and the circuit must be switched to it
+    OutOfRange,  // Out of the window in the lowest or highest range
+  };
+
+  explicit TDSAutorange(int range = RANGE_MAX) : _range(range) {}
+
+  int range() const { return _range; }
+
+  // Start waiting for readings to settle in range at now [ms]
+  void switchTo(int range, unsigned long now) {
+    _range = range;
+    _switchedAt = now;
+    _settling = true;
+    _stableCount = 0;
+    _lastVoltage = -VOLTAGE_SATURATED;  // Never agrees with the first reading
+    _entered = false;
+  }
+
+  Result update(float voltage, unsigned long now) {
+    // After switching, wait until readings settle or SETTLING_TIME passes
+    if (_settling) {
+      float tolerance = std::fmax(SETTLE_TOLERANCE, voltage * SETTLE_TOLERANCE_RATIO);
+      _stableCount = std::fabs(voltage - _lastVoltage) <= tolerance ? _stableCount + 1 : 0;
+      _lastVoltage = voltage;
+
+      if (_stableCount < SETTLE_COUNT && now - _switchedAt < SETTLING_TIME) {
+        return Result::Settling;
+      }
+      _settling = false;
+    }
+
+    float margin = _entered ? HYSTERESIS : 0;
+    if (voltage >= VOLTAGE_MIN - margin && voltage <= VOLTAGE_MAX + margin) {
+      _entered = true;
+      return Result::Valid;
+    }
+
+    int target = predict(voltage, _range);
+    if (target == _range) {
+      return Result::OutOfRange;
+    }
+    switchTo(target, now);
+    return Result::Switch;
+  }
+
+  static int predict(float voltage, int range) {
+    /*
+        Estimate the range where voltage falls within the valid window.
+        Adjacent ranges differ by about RANGE_RATIO, so the distance to the target range
+        can be estimated from how far voltage is out of the window.
+    */
+    int target = range;
+    if (voltage > VOLTAGE_MAX) {
+      // Voltage is clipped, so go to the highest-TDS (lowest-gain) range and estimate again from there.
+      if (voltage >= VOLTAGE_SATURATED) {
+        return 0;
+      }
+      while (target > 0 && voltage > VOLTAGE_MAX) {
+        voltage /= RANGE_RATIO;
+        target--;
+      }
+    } else if (voltage < VOLTAGE_MIN) {
+      while (target < RANGE_MAX && voltage < VOLTAGE_MIN) {
+        voltage *= RANGE_RATIO;
+        target++;
+      }
+    }
+    return target;
+  }
+
+ private:
+  int _range;
+  unsigned long _switchedAt = 0;
+  bool _settling = false;
+  bool _entered = false;  // A reading has been valid since the last switch
+  float _lastVoltage = 0;
+  int _stableCount = 0;
+};
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stdexcept>
+#include <string>
+
+#include "AnalogChannel.h"
+#include "Calibration.h"
+
+template <class ModuleType, class Conversion>
+class AnalogSensor : protected AnalogChannel {
+  /*
+      Base of sensors which convert an ADC channel into a value (CRTP).
+
+      Sensors register themselves to the module, and the module reads all sensors which
+      are due in one ADC pass per update() (see Base::updateAnalogSensors()).
+      Each sensor has its own interval, so a slow sensor does not throttle the others.
+
+      Conversion must provide:
+        - void convert(float raw): set the value from the average of raw readings
+        - float value(): the latest value
+  */
+ public:
+  AnalogSensor(ModuleType &module, int channel) : _module(module) {
+    // MCP3208 has channels 0-7
+    if (channel < 0 || channel >= 8) {
+      throw std::invalid_argument("ADC channel must be 0-7");
+    }
+    this->channel = channel;
+    this->onSample = &AnalogSensor::dispatch;
+    _module.registerAnalogSensor(*this);
+  }
+
+  // Registered by address
+  AnalogSensor(const AnalogSensor &) = delete;
+  AnalogSensor &operator=(const AnalogSensor &) = delete;
+
+  // Minimum time between readings [ms]. 0 reads on every update.
+  void setInterval(unsigned long interval) { this->interval = interval; }
+
+  // Readings averaged per update
+  void setSamples(int samples) {
+    if (samples < 1 || samples > UINT16_MAX) {
+      throw std::invalid_argument("samples must be 1-65535");
+    }
+    this->samples = samples;
+  }
+
+  // Sensors are read by the module's update(). Reading here as well sampled them twice per loop.
+  [[deprecated("sensors are read by the module's update(); remove this call")]] void update() {}
+
+ protected:
+  ModuleType &_module;
+  int _stage = -1;
+
+  void addRoutes(const std::string &path, const char *unit, int decimals, CalibrationCurve *calibration) {
+    /*
+        Add a GET endpoint at path, and list the value in /sensors with the path
+        (without leading '/') as a name. The calibration, if any, can be overridden with the same name.
+    */
+    if (path == "") {
+      return;
+    }
+    Conversion *sensor = static_cast<Conversion *>(this);
+    _module.addGetValueEndpoint([sensor]() { return sensor->value(); }, path, std::string(unit));
+
+    std::string name = path.substr(path.find_first_not_of('/'));
+    if (calibration != nullptr) {
+      _module.registerCalibration(name, *calibration);
+    }
+    _module.registerSensor(name, unit, [sensor]() { return sensor->value(); }, decimals);
+    _stage = _module.profiler().addStage(name.c_str());
+  }
+
+ private:
+  static void dispatch(AnalogChannel *channel, float raw) {
+    AnalogSensor *self = static_cast<AnalogSensor *>(channel);
+    self->_module.profiler().measure(self->_stage, [self, raw]() { static_cast<Conversion *>(self)->convert(raw); });
+  }
+};
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <stdexcept>
+#include <string>
+
+#include "Calibration.h"
+#include "CoreCalibration.h"
+#include "FlowCounter.h"
+
+template <class ModuleType>
+class FlowMeter {
+  /*
+      Flow meter with a pulse output on a digital pin, e.g. for inlet, product and reject lines.
+
+      Each meter claims a free PCNT unit at init(), so up to 8 meters can be used
+      (one less with CoreModule, which takes one for its own meter).
+      All meters are updated in one pass by the module's update().
+  */
+ private:
+  ModuleType& _module;
+  int _pin;
+  CalibrationCurve _flow;    // Pulses per second -> L/min
+  CalibrationCurve _volume;  // Pulses -> L
+  FlowCounter _counter;
+
+ public:
+  // Use the built-in curves of the CoreModule flow sensor for diameter
+  FlowMeter(ModuleType& module, int pin, Diameter diameter);
+  // Linear curves from the K-factor of the meter [pulses/L]
+  FlowMeter(ModuleType& module, int pin, float pulsesPerLiter);
+  void init(std::string path = "");
+
+  float flow();       // [L/min]
+  float totalFlow();  // [L]
+  uint64_t pulses() { return _counter.pulses(); }
+  uint64_t totalPulses() { return _counter.totalPulses(); }
+  void resetTotalFlow() { _counter.reset(); }
+  void setWindow(unsigned long windowMs) { _counter.setWindow(windowMs); }
+  void setTotalFlowCheckpoint(float volume, unsigned long intervalMs) { _counter.setCheckpoint(volume, intervalMs); }
+};
+
+template <class ModuleType>
+FlowMeter<ModuleType>::FlowMeter(ModuleType& module, int pin, Diameter diameter)
+    : _module(module), _pin(pin) {
+  CoreCalibration calibration = defaultCoreCalibration(diameter);
+  _flow = calibration.flow;
+  _volume = calibration.volume;
+}
+
+template <class ModuleType>
+FlowMeter<ModuleType>::FlowMeter(ModuleType& module, int pin, float pulsesPerLiter)
+    : _module(module), _pin(pin) {
+  if (pulsesPerLiter <= 0) {
+    throw std::invalid_argument("pulsesPerLiter must be > 0");
+  }
+  _flow = linearCurve(0, 60 / pulsesPerLiter);
+  _volume = linearCurve(0, 1 / pulsesPerLiter);
+}
+
+template <class ModuleType>
+void FlowMeter<ModuleType>::init(std::string path) {
+  /*
+      Start counting and restore the total saved before reboot.
+      With a path (e.g. "/inlet"), add:
+        - GET path: flow [L/min]
+        - GET path/total: total flow [L]
+        - POST path/total/reset
+      and list both in /sensors. The curves can be overridden as "inlet" and "inletVolume".
+  */
+  std::string name = path == "" ? "" : path.substr(path.find_first_not_of('/'));
+
+  // PCNT units are never released, so names are checked before one is claimed
+  if (name != "") {
+    _module.checkCalibrationName(name);
+    _module.checkCalibrationName(name + "Volume");
+    if (_module.sensors().contains(name) || _module.sensors().contains(name + "Total")) {
+      throw std::invalid_argument("Sensor " + name + " is already registered");
+    }
+  }
+  pcnt_unit_t unit = _module.claimPCNTUnit();
+
+  // The total is kept per name, or per unit without a path. Long names are hashed to fit a namespace.
+  std::string nvsNamespace =
+      name == "" ? "flowmeter" + std::to_string(static_cast<int>(unit)) : ModuleType::nvsName("flow.", name);
+  _counter.begin(_pin, unit, nvsNamespace.c_str());
+  _counter.restore();
+  _module.registerFlowCounter(_counter, _volume);
+
+  if (name == "") {
+    return;
+  }
+  _module.registerCalibration(name, _flow);
+  _module.registerCalibration(name + "Volume", _volume);
+  _module.addGetValueEndpoint([this]() { return this->flow(); }, path, "L/min");
+  _module.addGetValueEndpoint([this]() { return this->totalFlow(); }, path + "/total", "L");
+  _module.addOperationEndpoint([this]() { this->resetTotalFlow(); }, path + "/total/reset");
+  _module.registerSensor(name, "L/min", [this]() { return this->flow(); });
+  _module.registerSensor(name + "Total", "L", [this]() { return this->totalFlow(); });
+}
+
+template <class ModuleType>
+float FlowMeter<ModuleType>::flow() {
+  /*
+      Converted from the rate of the last update, so reading is cheap from any task.
+  */
+  float flow = _module.calibration(_flow)(_counter.pulsesPerSec());
+  return flow < 0 ? 0 : flow;
+}
+
+template <class ModuleType>
+float FlowMeter<ModuleType>::totalFlow() {
+  return _module.calibration(_volume).evaluate(static_cast<double>(_counter.totalPulses()));
+}
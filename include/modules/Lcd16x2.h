@@ -3,80 +3,216 @@
 #include <Arduino.h>
 #include <Wire.h>
 
+#include <atomic>
+#include <cstring>
+#include <stdexcept>
+
 #include "rgb_lcd.h"
 
 template <class ModuleType>
 class Lcd16X2 : public rgb_lcd {
- private:
-  ModuleType& _module;
-  int currentRow = 0;
-  const int nrows = 2;
-  const int ncols = 16;
+  /*
+      Drawing methods only write to a 16x2 framebuffer in RAM, so they never wait for I2C.
+      A background task started by init() sends the cells which differ from the display,
+      one I2C transaction per run of changed cells, at most refreshRate times per second.
 
+      The connection state is cached. It is probed again when a write fails
+      or every PROBE_INTERVAL, and the display is re-initialized when it comes back.
+      Methods inherited from rgb_lcd (e.g. setRGB()) still access the display directly.
+  */
  public:
+  static const int ROWS = 2;
+  static const int COLS = 16;
+  static const unsigned long PROBE_INTERVAL = 2000;  // [ms]
+  static const int RUN_GAP = 3;                      // Unchanged cells merged into a run
+
   Lcd16X2(ModuleType& module);
-  void init();
-  bool isConnected();
+  // Start the flush task on core with priority
+  void init(int refreshRate = 10, int core = 0, int priority = 1);
+  bool isConnected() { return _connected.load(std::memory_order_relaxed); }
   void clear();
   template <typename T>
   void append(T text, bool alignRight = false);
   template <typename T>
   void newLine(int line, T text, bool alignRight = false);
+
+  // Send changed cells to the display. Called by the flush task.
+  void flush();
+
+ private:
+  ModuleType& _module;
+  int _row = 0;
+  int _col = 0;
+
+  // Drawn by the caller and guarded by _mux
+  char _frame[ROWS][COLS];
+  portMUX_TYPE _mux = portMUX_INITIALIZER_UNLOCKED;
+
+  // What the display shows. Only the flush task touches it. 0 never matches a drawn cell.
+  char _shown[ROWS][COLS] = {};
+  std::atomic<bool> _connected{false};
+  unsigned long _checkedAt = 0;
+  TickType_t _refreshPeriod = pdMS_TO_TICKS(100);
+  TaskHandle_t _task = nullptr;
+  int _stage = -1;
+
+  void draw(int row, int col, const String& text);
+  bool probe();
+  bool sendRun(int row, int col, const char* cells, int length);
+  static void flushTask(void* arg);
 };
 
 template <class ModuleType>
-Lcd16X2<ModuleType>::Lcd16X2(ModuleType& module) : _module(module) {}
+Lcd16X2<ModuleType>::Lcd16X2(ModuleType& module) : _module(module) {
+  memset(_frame, ' ', sizeof(_frame));
+}
 
 template <class ModuleType>
-void Lcd16X2<ModuleType>::init() {
+void Lcd16X2<ModuleType>::init(int refreshRate, int core, int priority) {
+  if (refreshRate <= 0) {
+    throw std::invalid_argument("refreshRate must be > 0");
+  }
+  if (_task != nullptr) {
+    return;
+  }
+  _refreshPeriod = pdMS_TO_TICKS(1000 / refreshRate);
+  if (_refreshPeriod == 0) {
+    _refreshPeriod = 1;
+  }
+
   Wire.begin();
-  if (isConnected()) {
-    begin(ncols, nrows);
-    clear();
+  if (probe()) {
+    begin(COLS, ROWS);
   }
+  _stage = _module.profiler().addStage("lcd");
+  xTaskCreatePinnedToCore(flushTask, "lcd", 2048, this, priority, &_task, core);
+  _module.registerTask("lcd", _task);
 }
 
 template <class ModuleType>
 void Lcd16X2<ModuleType>::clear() {
-  if (isConnected()) {
-    rgb_lcd::clear();
-  }
+  portENTER_CRITICAL(&_mux);
+  memset(_frame, ' ', sizeof(_frame));
+  _row = 0;
+  _col = 0;
+  portEXIT_CRITICAL(&_mux);
 }
 
 template <class ModuleType>
-bool Lcd16X2<ModuleType>::isConnected() {
-  byte error;
-  Wire.beginTransmission(LCD_ADDRESS);
-  error = Wire.endTransmission();
-  return error == 0;
+template <typename T>
+void Lcd16X2<ModuleType>::append(T text, bool alignRight) {
+  String strText = String(text);
+  draw(_row, alignRight ? COLS - static_cast<int>(strText.length()) : _col, strText);
 }
 
 template <class ModuleType>
 template <typename T>
-void Lcd16X2<ModuleType>::append(T text, bool alignRight) {
-  if (isConnected()) {
-    String strText = String(text);
-    if (alignRight) {
-      setCursor(ncols - strText.length(), currentRow);
-      print(strText);
-    } else {
-      print(String(text));
+void Lcd16X2<ModuleType>::newLine(int row, T text, bool alignRight) {
+  String strText = String(text);
+  _row = row;
+  draw(row, alignRight ? COLS - static_cast<int>(strText.length()) : 0, strText);
+}
+
+template <class ModuleType>
+void Lcd16X2<ModuleType>::draw(int row, int col, const String& text) {
+  /*
+      Write text from col and move the cursor after it. Characters outside the display are dropped.
+  */
+  if (row < 0 || row >= ROWS) {
+    return;
+  }
+  const char* chars = text.c_str();
+  size_t length = text.length();
+  portENTER_CRITICAL(&_mux);
+  for (size_t i = 0; i < length; i++, col++) {
+    if (col >= 0 && col < COLS) {
+      _frame[row][col] = chars[i];
     }
   }
+  _col = col < COLS ? col : COLS;
+  portEXIT_CRITICAL(&_mux);
 }
 
 template <class ModuleType>
-template <typename T>
-void Lcd16X2<ModuleType>::newLine(int row, T text, bool alignRight) {
-  currentRow = row;
-  if (isConnected()) {
-    String strText = String(text);
-    if (alignRight) {
-      setCursor(ncols - strText.length(), row);
-      print(strText);
-    } else {
-      setCursor(0, row);
-      print(strText);
+bool Lcd16X2<ModuleType>::probe() {
+  Wire.beginTransmission(LCD_ADDRESS);
+  bool connected = Wire.endTransmission() == 0;
+  _connected.store(connected, std::memory_order_relaxed);
+  _checkedAt = millis();
+  return connected;
+}
+
+template <class ModuleType>
+bool Lcd16X2<ModuleType>::sendRun(int row, int col, const char* cells, int length) {
+  /*
+      Set the DDRAM address and write the run in one transaction:
+      [0x80 (command follows), address, 0x40 (data until the end), cells...]
+  */
+  Wire.beginTransmission(LCD_ADDRESS);
+  Wire.write(0x80);
+  Wire.write(0x80 | (row * 0x40 + col));
+  Wire.write(0x40);
+  for (int i = 0; i < length; i++) {
+    Wire.write(static_cast<uint8_t>(cells[i]));
+  }
+  return Wire.endTransmission() == 0;
+}
+
+template <class ModuleType>
+void Lcd16X2<ModuleType>::flush() {
+  bool probeDue = millis() - _checkedAt >= PROBE_INTERVAL;
+  if (!isConnected()) {
+    if (!probeDue || !probe()) {
+      return;
     }
+    // The display may have been power cycled, so initialize it and redraw everything
+    begin(COLS, ROWS);
+    memset(_shown, 0, sizeof(_shown));
+  } else if (probeDue && !probe()) {
+    memset(_shown, 0, sizeof(_shown));
+    return;
+  }
+
+  char frame[ROWS][COLS];
+  portENTER_CRITICAL(&_mux);
+  memcpy(frame, _frame, sizeof(frame));
+  portEXIT_CRITICAL(&_mux);
+
+  _module.profiler().measure(_stage, [&]() {
+    for (int row = 0; row < ROWS; row++) {
+      int col = 0;
+      while (col < COLS) {
+        if (frame[row][col] == _shown[row][col]) {
+          col++;
+          continue;
+        }
+        // Resending a few unchanged cells is cheaper than the 3 bytes which start another run
+        int end = col + 1;
+        for (int next = end; next < COLS && next - end < RUN_GAP; next++) {
+          if (frame[row][next] != _shown[row][next]) {
+            end = next + 1;
+          }
+        }
+        if (!sendRun(row, col, &frame[row][col], end - col)) {
+          // Redraw everything once the display responds again
+          _connected.store(false, std::memory_order_relaxed);
+          memset(_shown, 0, sizeof(_shown));
+          return;
+        }
+        memcpy(&_shown[row][col], &frame[row][col], end - col);
+        _checkedAt = millis();
+        col = end;
+      }
+    }
+  });
+}
+
+template <class ModuleType>
+void Lcd16X2<ModuleType>::flushTask(void* arg) {
+  Lcd16X2* lcd = static_cast<Lcd16X2*>(arg);
+  TickType_t lastWakeTime = xTaskGetTickCount();
+  while (true) {
+    lcd->flush();
+    vTaskDelayUntil(&lastWakeTime, lcd->_refreshPeriod);
   }
 }
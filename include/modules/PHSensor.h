@@ -1,42 +1,46 @@
 #pragma once
 
 #include "DFRobot_ESP_PH.h"
+#include "Filters.h"
+#include "modules/AnalogSensor.h"
 
-template <class ModuleType>
-class PHSensor {
+template <class ModuleType, class Filter = NoFilter>
+class PHSensor : public AnalogSensor<ModuleType, PHSensor<ModuleType, Filter>> {
  private:
-  int _channel;
-  float _ph;
-  ModuleType &_module;
+  using Sensor = AnalogSensor<ModuleType, PHSensor<ModuleType, Filter>>;
+  friend Sensor;
+
+  float _ph = 7.0f;
   DFRobot_ESP_PH _phSensor;
+  Filter _filter;
+
+  void convert(float raw) {
+    float ESPADC = 4096.0f;
+    float ESPVOLTAGE = 3300.0f;
+    float voltage = _filter(raw);
+    voltage = voltage / ESPADC * ESPVOLTAGE;
+    // readPH does not use temperature, so we use 25.0f as default
+    // ref. https://github.com/GreenPonik/DFRobot_ESP_PH_BY_GREENPONIK/blob/731c09f1f8d724e1d400211fa811911c692f6735/src/DFRobot_ESP_PH.cpp#L60
+    _ph = _phSensor.readPH(voltage, 25.0f);
+  }
 
  public:
-  PHSensor(ModuleType &module, int channel)
-      : _module(module), _channel(channel), _ph(7.0f) {}
+  PHSensor(ModuleType &module, int channel) : Sensor(module, channel) {
+    this->interval = 1000;
+  }
 
   void init(std::string path = "") {
     _phSensor.begin();
-    if (path != "") {
-      _module.addGetValueEndpoint(
-          [this]() { return this->ph(); },
-          path,
-          std::string("pH"));
-    }
+    this->addRoutes(path, "pH", 2, nullptr);
   }
 
   float ph() { return _ph; }
+  float value() { return _ph; }
+  Filter &filter() { return _filter; }
 
-  void update(unsigned long interval = 1000) {
-    static unsigned long lastUpdateTime = millis();
-    if (millis() - lastUpdateTime >= interval) {
-      float ESPADC = 4096.0f;
-      float ESPVOLTAGE = 3300.0f;
-      long voltage = _module.ADCread(_channel);
-      voltage = voltage / ESPADC * ESPVOLTAGE;
-      // readPH does not use temperature, so we use 25.0f as default
-      // ref. https://github.com/GreenPonik/DFRobot_ESP_PH_BY_GREENPONIK/blob/731c09f1f8d724e1d400211fa811911c692f6735/src/DFRobot_ESP_PH.cpp#L60
-      _ph = _phSensor.readPH(voltage, 25.0f);
-      lastUpdateTime = millis();
-    }
+  // Only sets the interval [ms]. The sensor is read by the module's update().
+  [[deprecated("sensors are read by the module's update(); use setInterval(interval)")]] void update(
+      unsigned long interval = 1000) {
+    this->setInterval(interval);
   }
-};
\ No newline at end of file
+};
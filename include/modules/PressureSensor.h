@@ -1,44 +1,53 @@
 #pragma once
 
-template <class ModuleType>
-class PressureSensor {
+#include <string>
+#include <type_traits>
+
+#include "Calibration.h"
+#include "Filters.h"
+#include "modules/AnalogSensor.h"
+
+template <class ModuleType, class Filter = NoFilter>
+class PressureSensor : public AnalogSensor<ModuleType, PressureSensor<ModuleType, Filter>> {
  private:
-  int _channel;
-  float _pressure;
-  ModuleType &_module;
+  using Sensor = AnalogSensor<ModuleType, PressureSensor<ModuleType, Filter>>;
+  friend Sensor;
+
+  float _pressure = 0;
+
+  // XDB302: 0.000421 * raw - 0.314433 [MPa], converted to psi
+  static constexpr CalibrationCurve DEFAULT_CALIBRATION = linearCurve(-0.314433 * 145, 0.000421 * 145);
+  CalibrationCurve _calibration = DEFAULT_CALIBRATION;
+  Filter _filter;
+
+  void convert(float raw) { _pressure = this->_module.calibration(_calibration)(_filter(raw)); }
 
  public:
   PressureSensor(ModuleType &module, int channel);
   void init(std::string path = "");
   float pressure() { return _pressure; };
-  void update(int n_sample = 10);
+  float value() { return _pressure; }
+  Filter &filter() { return _filter; }
+  // Without a filter, readings are averaged over a burst of 10 by default. With a filter, one reading
+  // per update. Change it with setSamples().
+  [[deprecated("sensors are read by the module's update(); use setSamples(n_sample)")]] void update(
+      int n_sample = std::is_same_v<Filter, NoFilter> ? 10 : 1);
 };
 
-template <class ModuleType>
-PressureSensor<ModuleType>::PressureSensor(ModuleType &module, int channel) : _module(module), _channel(channel) {}
-
-template <class ModuleType>
-void PressureSensor<ModuleType>::init(std::string path) {
-  if (path != "") {
-    _module.addGetValueEndpoint(
-        [this]() { return this->pressure(); },
-        path,
-        std::string("psi"));
-  }
+template <class ModuleType, class Filter>
+PressureSensor<ModuleType, Filter>::PressureSensor(ModuleType &module, int channel) : Sensor(module, channel) {
+  this->samples = std::is_same_v<Filter, NoFilter> ? 10 : 1;
+}
+
+template <class ModuleType, class Filter>
+void PressureSensor<ModuleType, Filter>::init(std::string path) {
+  this->addRoutes(path, "psi", 2, &_calibration);
 }
 
-template <class ModuleType>
-void PressureSensor<ModuleType>::update(int n_sample) {
+template <class ModuleType, class Filter>
+void PressureSensor<ModuleType, Filter>::update(int n_sample) {
   /*
-      Fetch pressure values at multiple times from the sensor
-      and store the average into _pressure
+      Only sets the burst size. The sensor is read by the module's update().
   */
-  float pressure_value_sum = 0;  // Unit: MPa
-  for (int i = 0; i < n_sample; i++) {
-    long voltage = _module.ADCread(_channel);
-    pressure_value_sum += 0.000421 * voltage - 0.314433;
-  }
-
-  // Convert MPa to psi
-  _pressure = pressure_value_sum / n_sample * 145;
-}
\ No newline at end of file
+  this->setSamples(n_sample);
+}
@@ -3,35 +3,28 @@
 #include <cstdint>
 #include <string>
 
-template <class ModuleType>
-class TDSSensor {
+#include "Calibration.h"
+#include "Filters.h"
+#include "modules/AnalogSensor.h"
+
+template <class ModuleType, class Filter = NoFilter>
+class TDSSensor : public AnalogSensor<ModuleType, TDSSensor<ModuleType, Filter>> {
  private:
-  int _channel;
+  using Sensor = AnalogSensor<ModuleType, TDSSensor<ModuleType, Filter>>;
+  friend Sensor;
+
   int _tds = 0;
-  ModuleType &_module;
+
+  static constexpr CalibrationCurve DEFAULT_CALIBRATION = linearCurve(0, 0.4407);
+  CalibrationCurve _calibration = DEFAULT_CALIBRATION;
+  Filter _filter;
+
+  void convert(float raw) { _tds = this->_module.calibration(_calibration)(_filter(raw)); }
 
  public:
-  TDSSensor(ModuleType &module, int channel);
-  void init(std::string path = "");
+  TDSSensor(ModuleType &module, int channel) : Sensor(module, channel) {}
+  void init(std::string path = "") { this->addRoutes(path, "ppm", 0, &_calibration); }
   float tds() { return _tds; };
-  void update();
+  float value() { return _tds; }
+  Filter &filter() { return _filter; }
 };
-
-template <class ModuleType>
-TDSSensor<ModuleType>::TDSSensor(ModuleType &module, int channel) : _module(module), _channel(channel) {}
-
-template <class ModuleType>
-void TDSSensor<ModuleType>::init(std::string path) {
-  if (path != "") {
-    _module.addGetValueEndpoint(
-        [this]() { return this->tds(); },
-        path,
-        std::string("ppm"));
-  }
-}
-
-template <class ModuleType>
-void TDSSensor<ModuleType>::update() {
-  long voltage = _module.ADCread(_channel);
-  _tds = 0.4407 * voltage;
-}
\ No newline at end of file
@@ -0,0 +1,157 @@
+#include "ActuatorScheduler.h"
+
+#include <stdexcept>
+#include <string>
+
+void ActuatorScheduler::begin(Writer writer) {
+  /*
+      Timers are created here rather than in pulse(), since esp_timer_create() allocates and
+      cannot be called inside the spinlock. If a timer cannot be created, none are kept.
+  */
+  _writer = writer;
+  for (Schedule& schedule : _schedules) {
+    schedule.scheduler = this;
+    if (schedule.timer != nullptr) {
+      continue;
+    }
+    esp_timer_create_args_t args = {};
+    args.callback = onTimer;
+    args.arg = &schedule;
+    args.dispatch_method = ESP_TIMER_TASK;
+    args.name = "actuator";
+    esp_err_t err = esp_timer_create(&args, &schedule.timer);
+    if (err != ESP_OK) {
+      schedule.timer = nullptr;
+      for (Schedule& created : _schedules) {
+        if (created.timer != nullptr) {
+          esp_timer_delete(created.timer);
+          created.timer = nullptr;
+        }
+      }
+      throw std::runtime_error("Failed to create actuator timer: " + std::to_string(err));
+    }
+  }
+}
+
+ActuatorScheduler::Schedule* ActuatorScheduler::find(int pin) {
+  for (Schedule& schedule : _schedules) {
+    if (schedule.pin == pin) {
+      return &schedule;
+    }
+  }
+  return nullptr;
+}
+
+void ActuatorScheduler::pulse(int pin, int activeMode, int64_t onDuration, int64_t offDuration, int repeat) {
+  if (onDuration <= 0) {
+    throw std::invalid_argument("duration must be > 0");
+  }
+  if (repeat < 1) {
+    throw std::invalid_argument("repeat must be >= 1");
+  }
+  if (repeat > 1 && offDuration <= 0) {
+    throw std::invalid_argument("interval must be > 0 to repeat");
+  }
+  int64_t now = esp_timer_get_time();
+
+  portENTER_CRITICAL(&_mux);
+
+  // Reuse the schedule of pin, or a released one
+  Schedule* schedule = find(pin);
+  for (int i = 0; schedule == nullptr && i < MAX_SCHEDULES; i++) {
+    if (!_schedules[i].scheduled) {
+      schedule = &_schedules[i];
+    }
+  }
+  if (schedule == nullptr || schedule->timer == nullptr) {
+    portEXIT_CRITICAL(&_mux);
+    throw std::invalid_argument(schedule == nullptr ? "Too many scheduled ports" : "Scheduler is not started");
+  }
+  esp_timer_stop(schedule->timer);
+
+  schedule->pin = pin;
+  schedule->scheduled = true;
+  schedule->activeMode = activeMode;
+  schedule->activePhase = true;
+  schedule->onDuration = onDuration;
+  schedule->offDuration = offDuration;
+  schedule->remaining = repeat - 1;
+  start(*schedule, now + onDuration);
+
+  portEXIT_CRITICAL(&_mux);
+}
+
+void ActuatorScheduler::start(Schedule& schedule, int64_t deadline) {
+  schedule.deadline = deadline;
+  int64_t delay = deadline - esp_timer_get_time();
+  esp_timer_start_once(schedule.timer, delay > 0 ? delay : 0);
+}
+
+void ActuatorScheduler::cancel(int pin) {
+  /*
+      Stop the schedule of pin. The port is left as it is.
+  */
+  portENTER_CRITICAL(&_mux);
+  Schedule* schedule = find(pin);
+  if (schedule != nullptr && schedule->scheduled) {
+    esp_timer_stop(schedule->timer);
+    schedule->scheduled = false;
+  }
+  portEXIT_CRITICAL(&_mux);
+}
+
+bool ActuatorScheduler::isScheduled(int pin) {
+  return deadline(pin) >= 0;
+}
+
+int ActuatorScheduler::active() {
+  portENTER_CRITICAL(&_mux);
+  int count = 0;
+  for (const Schedule& schedule : _schedules) {
+    count += schedule.scheduled ? 1 : 0;
+  }
+  portEXIT_CRITICAL(&_mux);
+  return count;
+}
+
+int64_t ActuatorScheduler::deadline(int pin) {
+  portENTER_CRITICAL(&_mux);
+  Schedule* schedule = find(pin);
+  int64_t deadline = schedule != nullptr && schedule->scheduled ? schedule->deadline : -1;
+  portEXIT_CRITICAL(&_mux);
+  return deadline;
+}
+
+void ActuatorScheduler::onTimer(void* arg) {
+  /*
+      Advance a schedule by one transition. Runs on the esp_timer task.
+  */
+  Schedule& schedule = *static_cast<Schedule*>(arg);
+  ActuatorScheduler& scheduler = *schedule.scheduler;
+
+  portENTER_CRITICAL(&scheduler._mux);
+
+  // Cancelled or rescheduled after the timer fired
+  if (!schedule.scheduled || esp_timer_get_time() < schedule.deadline) {
+    portEXIT_CRITICAL(&scheduler._mux);
+    return;
+  }
+
+  int inactiveMode = schedule.activeMode == HIGH ? LOW : HIGH;
+  if (schedule.activePhase) {
+    scheduler._writer(schedule.pin, inactiveMode);
+    if (schedule.remaining > 0) {
+      schedule.activePhase = false;
+      scheduler.start(schedule, schedule.deadline + schedule.offDuration);
+    } else {
+      schedule.scheduled = false;
+    }
+  } else {
+    scheduler._writer(schedule.pin, schedule.activeMode);
+    schedule.remaining--;
+    schedule.activePhase = true;
+    scheduler.start(schedule, schedule.deadline + schedule.onDuration);
+  }
+
+  portEXIT_CRITICAL(&scheduler._mux);
+}
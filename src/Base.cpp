@@ -1,18 +1,36 @@
 #include <Base.h>
+#include <Preferences.h>
+#include <soc/gpio_reg.h>
+#include <soc/soc.h>
 
-#include <sstream>
-#include <unordered_map>
+#include "QueryString.h"
 
 extern HardwareSerial Serial;
 
 Base::Base(int port)
     : AsyncWebServer(port) {
+  // Created here so that the ADC can be locked by any task, even before init()
+  _adcMutex = xSemaphoreCreateMutex();
+  if (_adcMutex == nullptr) {
+    throw std::runtime_error("Failed to create ADC mutex");
+  }
+  _publishSettings = std::make_shared<PublishSettings>();
 }
 
 void Base::init() {
+  // Start writing logs to Serial in the background
+  _logger.begin();
+
+  // Scheduled port transitions are written like setPinState()
+  _scheduler.begin([this](int pin, int mode) { this->setPinState(pin, mode == HIGH); });
+
   // Initialize SPI on ESP32 Arduino. It is used to read raw ADC data.
   initializeADC();
 
+  // Dispatch all endpoints with a single handler instead of a handler per endpoint
+  addHandler(&_router);
+  _router.onNotFound([this](AsyncWebServerRequest* request) { this->notFound(request); });
+
   // Add a header to allow cross-origin requests
   DefaultHeaders::Instance().addHeader("Access-Control-Allow-Origin", "*");
 
@@ -23,6 +41,29 @@ void Base::init() {
   // Add endpoints for MQTT broker
   addPublishStartEndpoint();
   addPublishEndEndpoint();
+
+  // Add endpoints for calibration
+  addCalibrationEndpoints();
+
+  // Add an endpoint to read all registered sensors at once
+  addSensorsEndpoint();
+
+  // Add endpoints to read logs and change the log level
+  addLogEndpoints();
+
+  // Add endpoints to read and reset stage latencies
+  addProfilerEndpoints();
+
+  // Measure the batched ADC pass of analog sensors
+  _analogStage = _profiler.addStage("analogScan");
+  _flowStage = _profiler.addStage("flowMeters");
+
+  // Report memory and stacks of tasks which the library runs or relies on
+  registerTask("loopTask");
+  registerTask("async_tcp");
+  registerTask("esp_timer");
+  registerTask("logger", _logger.task());
+  addDiagnosticsEndpoint();
 }
 
 void Base::initializeADC() {
@@ -35,7 +76,148 @@ void Base::initializeADC() {
       getADC_MOSI(),
       getADC_CSb());
 
-  SPI.beginTransaction(SPISettings(100000, MSBFIRST, SPI_MODE0));
+  xSemaphoreTake(_adcMutex, portMAX_DELAY);
+  SPI.beginTransaction(SPISettings(_adcClock, MSBFIRST, SPI_MODE0));
+  _adcStarted = true;
+  xSemaphoreGive(_adcMutex);
+}
+
+void Base::setADCClock(uint32_t frequency) {
+  /*
+      Change the SPI clock used to read the ADC.
+      The frequency is clamped to the maximum rating of MCP320x.
+  */
+  if (frequency == 0) {
+    throw std::invalid_argument("ADC clock must be > 0");
+  }
+  _adcClock = frequency > ADC_MAX_CLOCK ? ADC_MAX_CLOCK : frequency;
+
+  // Before init(), the clock is applied by initializeADC()
+  xSemaphoreTake(_adcMutex, portMAX_DELAY);
+  if (!_adcStarted) {
+    xSemaphoreGive(_adcMutex);
+    return;
+  }
+  SPI.endTransaction();
+  SPI.beginTransaction(SPISettings(_adcClock, MSBFIRST, SPI_MODE0));
+  xSemaphoreGive(_adcMutex);
+}
+
+void Base::startPublishing(std::string clientId, int interval, PayloadFormat format, boolean shortKeys,
+                           const JsonDocument& metadata) {
+  /*
+      Start publishing to MQTT broker as a new session, which replaces the previous one with its metadata.
+  */
+  if (clientId.empty()) {
+    throw std::invalid_argument("client_id is required");
+  }
+  if (interval <= 0) {
+    throw std::invalid_argument("interval must be > 0");
+  }
+  std::shared_ptr<PublishSettings> settings = std::make_shared<PublishSettings>();
+  settings->clientId = clientId;
+  settings->interval = interval;
+  settings->format = format;
+  settings->shortKeys = shortKeys;
+  settings->policy = _publishPolicy;
+  settings->metadata = metadata;
+
+  // The previous session is released after the lock, since it may be the last reference
+  std::shared_ptr<const PublishSettings> previous = settings;
+  portENTER_CRITICAL(&_publishMux);
+  settings->session = _publishSession.load(std::memory_order_relaxed) + 1;
+  _publishSettings.swap(previous);
+  _publishSession.store(settings->session, std::memory_order_release);
+  _isPublishing.store(true, std::memory_order_release);
+  portEXIT_CRITICAL(&_publishMux);
+}
+
+std::shared_ptr<const Base::PublishSettings> Base::publishSettings() {
+  portENTER_CRITICAL(&_publishMux);
+  std::shared_ptr<const PublishSettings> settings = _publishSettings;
+  portEXIT_CRITICAL(&_publishMux);
+  return settings;
+}
+
+void Base::parsePublishParam(const String& name, const String& value, PublishPolicy& policy) {
+  if (name == "mode") {
+    if (value != "interval" && value != "change") {
+      throw std::invalid_argument("mode must be interval or change");
+    }
+    policy.onChange = value == "change";
+  } else if (name == "min_interval" || name == "heartbeat") {
+    unsigned long ms = 0;
+    if (!QueryString::toUnsigned(value.c_str(), ms)) {
+      throw std::invalid_argument(std::string(name.c_str()) + " must be a non-negative integer");
+    }
+    (name == "min_interval" ? policy.minInterval : policy.heartbeat) = ms;
+  } else {
+    String field = name.substring(strlen("deadband_"));
+    for (int i = 0; i < PublishPolicy::FIELDS; i++) {
+      if (field == PublishPolicy::FIELD_NAMES[i]) {
+        policy.deadbands[i].value = value.toFloat();
+        policy.deadbands[i].percent = value.endsWith("%");
+        return;
+      }
+    }
+    throw std::invalid_argument("Unknown deadband field");
+  }
+}
+
+void Base::setPublishPolicy(const PublishPolicy& policy) {
+  for (const Deadband& deadband : policy.deadbands) {
+    if (deadband.value < 0) {
+      throw std::invalid_argument("deadband must be >= 0");
+    }
+  }
+  if (policy.onChange && policy.heartbeat == 0) {
+    throw std::invalid_argument("heartbeat must be > 0");
+  }
+  _publishPolicy = policy;
+}
+
+void Base::stopPublishing() {
+  _isPublishing.store(false, std::memory_order_release);
+}
+
+void Base::setPorts(uint64_t mask, uint64_t values) {
+  /*
+      Set ports in mask to the corresponding bits of values at once.
+      Ports must be configured as OUTPUT.
+
+      Ports are written through the W1TC/W1TS registers, so other pins (e.g. ADC chip select
+      written from another core) are never overwritten. A register write cannot both clear
+      and set, and each bank (GPIO 0-31 or 32-39) has its own registers, so the ports change
+      in up to four writes, back to back with interrupts disabled:
+        1. ports going low in GPIO 0-31, 2. in GPIO 32-39,
+        3. ports going high in GPIO 0-31, 4. in GPIO 32-39.
+      Ports in the same bank and direction switch in the same write. Every port going low
+      switches before any port going high. Ports going high in different banks switch a few
+      CPU cycles apart, GPIO 0-31 first, so ports which must switch at the same instant
+      belong in one bank.
+      Writing GPIO_OUT_REG directly would switch a bank at once, but its read-modify-write
+      would lose pins written meanwhile by the other core.
+  */
+  const uint64_t GPIO_MASK = (1ULL << 40) - 1;
+  mask &= GPIO_MASK;
+  uint64_t set = mask & values;
+  uint64_t clear = mask & ~values;
+
+  portENTER_CRITICAL(&_portMux);
+  if (static_cast<uint32_t>(clear) != 0) {
+    REG_WRITE(GPIO_OUT_W1TC_REG, static_cast<uint32_t>(clear));
+  }
+  if ((clear >> 32) != 0) {
+    REG_WRITE(GPIO_OUT1_W1TC_REG, static_cast<uint32_t>(clear >> 32));
+  }
+  if (static_cast<uint32_t>(set) != 0) {
+    REG_WRITE(GPIO_OUT_W1TS_REG, static_cast<uint32_t>(set));
+  }
+  if ((set >> 32) != 0) {
+    REG_WRITE(GPIO_OUT1_W1TS_REG, static_cast<uint32_t>(set >> 32));
+  }
+  _portStates.store((_portStates.load(std::memory_order_relaxed) & ~mask) | set, std::memory_order_release);
+  portEXIT_CRITICAL(&_portMux);
 }
 
 void Base::addPublishStartEndpoint() {
@@ -44,16 +226,24 @@ void Base::addPublishStartEndpoint() {
       Parameters in query strings except followings are used as a payload to publish
       - interval: int (optional) - interval to publish data in milliseconds
       - client_id: string (optional) - client ID to publish data
+      - format: string (optional) - json (default), msgpack or cbor
+      - short_keys: bool (optional) - use numeric keys for sensor values
+      - mode: string (optional) - interval (default) or change (report by exception)
+      - deadband_<field>: float (optional) - e.g. deadband_tds=5 or deadband_flow=2% in change mode
+      - min_interval, heartbeat: int (optional) - in milliseconds in change mode
   */
 
   // Add endpoint
   std::string path = "/publish/start";
-  this->on(path.c_str(), HTTP_POST, [this, path](AsyncWebServerRequest* request) {
-        int time = millis();
-        this->_clientId = ""; // initialize
+  this->route(path.c_str(), HTTP_POST, [this](AsyncWebServerRequest* request) {
+        std::string clientId = "";
+        int interval = this->publishInterval();
+        PayloadFormat format = PayloadFormat::JSON;
+        boolean shortKeys = false;
+        PublishPolicy policy;
+        // Committed only if all parameters are valid
+        JsonDocument metadata(&JsonAllocationCounter::instance());
 
-        String response;
-        int statusCode;
         try {
             // Construct a payload to publish
             int paramsNum = request->params();
@@ -61,31 +251,35 @@ void Base::addPublishStartEndpoint() {
                 AsyncWebParameter* p = request->getParam(i);
 
                 if (p->name() == "interval") {
-                    this->_publishInterval = p->value().toInt();
+                    unsigned long value = 0;
+                    if (!QueryString::toUnsigned(p->value().c_str(), value) || value > INT32_MAX) {
+                        throw std::invalid_argument("interval must be a positive integer");
+                    }
+                    interval = value;
                 } else if (p->name() == "client_id") {
-                    this->_clientId = std::string(p->value().c_str());
+                    clientId = std::string(p->value().c_str());
+                } else if (p->name() == "format") {
+                    if (!PayloadWriter::parseFormat(p->value().c_str(), format)) {
+                        throw std::invalid_argument("format must be json, msgpack or cbor");
+                    }
+                } else if (p->name() == "short_keys") {
+                    shortKeys = p->value() == "true" || p->value() == "1";
+                } else if (p->name() == "mode" || p->name().startsWith("deadband_") ||
+                           p->name() == "min_interval" || p->name() == "heartbeat") {
+                    parsePublishParam(p->name(), p->value(), policy);
                 } else {
-                    this->_metadata[p->name()] = p->value();
+                    metadata[p->name()] = p->value();
                 }
             }
 
-            // Return an error if client_id is not set
-            if (this->_clientId.empty()) {
-                throw std::invalid_argument("client_id is required");
-            }
+            this->setPublishPolicy(policy);
+            this->startPublishing(clientId, interval, format, shortKeys, metadata);
 
-            this->_isPublishing = true;
-
-            response = this -> createOperationSucceededResponse();
-
-            statusCode = 200;
-            this -> printLog(statusCode, request->url().c_str(), response);
-            request->send(statusCode, "application/json", response);
+            this -> sendOperationSucceeded(request);
+        } catch (std::invalid_argument &e) {
+            this -> sendError(request, 400, e.what());
         } catch (std::exception &e) {
-            statusCode = 500;
-            response = createErrorResponse(e.what());
-            this -> printLog(statusCode, request->url().c_str(), response);
-            request->send(statusCode, "application/json", response);
+            this -> sendError(request, 500, e.what());
         } });
 }
 
@@ -94,26 +288,241 @@ void Base::addPublishEndEndpoint() {
       Add an endpoint to end publishing data to MQTT broker.
   */
   std::string path = "/publish/end";
-  this->on(path.c_str(), HTTP_POST, [this, path](AsyncWebServerRequest* request) {
-        int time = millis();
+  this->route(path.c_str(), HTTP_POST, [this](AsyncWebServerRequest* request) {
+        this->stopPublishing();
+
+        try {
+            this -> sendOperationSucceeded(request);
+        } catch (std::exception &e) {
+            this -> sendError(request, 500, e.what());
+        } });
+}
+
+void Base::registerSensor(std::string name, std::string unit, SensorHub::Getter getter, int decimals) {
+  /*
+      Register a sensor value so that it is included in /sensors.
+      Call this before the server starts.
+  */
+  _sensors.add(name, unit, getter, decimals);
+}
+
+void Base::registerSensor(std::string name, std::string unit, SensorHub::SampleGetter getter, int decimals) {
+  _sensors.add(name, unit, getter, decimals);
+}
+
+void Base::addSensorsEndpoint() {
+  /*
+      Add an endpoint to get all registered sensor values in one response.
+      - fields: string (optional) - comma separated sensor names. Default is all.
+  */
+  this->route("/sensors", HTTP_GET, [this](AsyncWebServerRequest* request) {
+    try {
+      const char* fields = request->hasParam("fields") ? request->getParam("fields")->value().c_str() : "";
+      uint32_t selection = this->_sensors.select(fields);
 
-        // Construct a payload to publish
-        this->_metadata.clear();
-        this->_isPublishing = false;
+      AsyncResponseStream* response = request->beginResponseStream(JSON_CONTENT_TYPE);
+      this->_sensors.write(*response, selection, millis());
+      this->printLog(200, "/sensors", "");
+      request->send(response);
+    }
+    catch (std::invalid_argument& e) {
+      this->sendError(request, 400, e.what());
+    }
+    catch (std::exception& e) {
+      this->sendError(request, 500, e.what());
+    } });
+}
+
+void Base::registerCalibration(std::string name, CalibrationCurve& curve) {
+  /*
+      Register a calibration curve so that it can be overridden through HTTP.
+      If an override for name is stored in NVS, it is loaded into curve.
+      Names up to 15 characters are used as NVS keys as is, and longer names are hashed.
+  */
+  checkCalibrationName(name);
+  std::string key = calibrationKey(name);
+  CalibrationEntry& entry = _calibrations[name] = CalibrationEntry{&curve, calibration(curve), key};
+
+  Preferences preferences;
+  preferences.begin("calibration", true);
+  if (preferences.getBytesLength(key.c_str()) == sizeof(CalibrationCurve)) {
+    CalibrationCurve stored;
+    preferences.getBytes(key.c_str(), &stored, sizeof(stored));
+    if (stored.size > 0 && stored.size <= CalibrationCurve::MAX_SEGMENTS) {
+      replaceCalibration(entry, stored);
+    }
+  }
+  preferences.end();
+}
+
+void Base::setCalibration(std::string name, const CalibrationCurve& curve) {
+  /*
+      Override a registered calibration curve and store it in NVS.
+  */
+  auto entry = _calibrations.find(name);
+  if (entry == _calibrations.end()) {
+    throw std::invalid_argument("Unknown calibration name");
+  }
+  if (curve.size == 0 || curve.size > CalibrationCurve::MAX_SEGMENTS) {
+    throw std::invalid_argument("Invalid number of segments");
+  }
+  for (int i = 1; i < curve.size; i++) {
+    if (curve.segments[i].from <= curve.segments[i - 1].from) {
+      throw std::invalid_argument("Segments must be sorted by from");
+    }
+  }
+
+  replaceCalibration(entry->second, curve);
+
+  Preferences preferences;
+  preferences.begin("calibration", false);
+  preferences.putBytes(entry->second.key.c_str(), &curve, sizeof(CalibrationCurve));
+  preferences.end();
+}
+
+void Base::resetCalibration(std::string name) {
+  /*
+      Restore the built-in calibration curve and remove the override from NVS.
+  */
+  auto entry = _calibrations.find(name);
+  if (entry == _calibrations.end()) {
+    throw std::invalid_argument("Unknown calibration name");
+  }
+  replaceCalibration(entry->second, entry->second.defaults);
+
+  Preferences preferences;
+  preferences.begin("calibration", false);
+  preferences.remove(entry->second.key.c_str());
+  preferences.end();
+}
+
+CalibrationCurve Base::calibration(const CalibrationCurve& curve) {
+  portENTER_CRITICAL(&_calibrationMux);
+  CalibrationCurve copy = curve;
+  portEXIT_CRITICAL(&_calibrationMux);
+  return copy;
+}
+
+void Base::replaceCalibration(CalibrationEntry& entry, const CalibrationCurve& curve) {
+  portENTER_CRITICAL(&_calibrationMux);
+  *entry.curve = curve;
+  portEXIT_CRITICAL(&_calibrationMux);
+}
+
+void Base::checkCalibrationName(const std::string& name) {
+  /*
+      Lets a module check its names before it claims hardware which cannot be released.
+  */
+  if (name.empty()) {
+    throw std::invalid_argument("Calibration name must not be empty");
+  }
+  if (_calibrations.count(name) > 0) {
+    throw std::invalid_argument("Calibration " + name + " is already registered");
+  }
+  std::string key = calibrationKey(name);
+  for (auto const& [other, entry] : _calibrations) {
+    if (entry.key == key) {
+      throw std::invalid_argument("Calibration " + name + " has the same NVS key as " + other);
+    }
+  }
+}
+
+std::string Base::nvsName(const std::string& prefix, const std::string& name) {
+  /*
+      NVS keys and namespaces are limited to 15 characters, so a longer name is replaced with
+      '#' and its FNV-1a hash. registerCalibration() rejects a key which is taken.
+  */
+  if (prefix.size() + name.size() <= 15) {
+    return prefix + name;
+  }
+  uint32_t hash = 2166136261u;
+  for (char c : name) {
+    hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+  }
+  char hashed[10];
+  snprintf(hashed, sizeof(hashed), "#%08x", static_cast<unsigned int>(hash));
+  return prefix + hashed;
+}
+
+void Base::addCalibrationEndpoints() {
+  /*
+      Add endpoints to read and override calibration curves.
+      - GET  /calibration: all registered curves
+      - POST /calibration: update a segment of a curve
+          - name: string (required) - name of the curve
+          - segment: int (optional) - index of the segment, default 0.
+                     Specifying the next index of the last segment appends a segment.
+          - from, c0, c1, c2: float (optional) - values to set
+      - POST /calibration/reset: restore the built-in curve
+          - name: string (required) - name of the curve
+  */
+  this->route("/calibration", HTTP_GET, [this](AsyncWebServerRequest* request) {
+        JsonDocument doc(&JsonAllocationCounter::instance());
+        for (auto const &[name, entry] : this->_calibrations) {
+            JsonArray segments = doc[name].to<JsonArray>();
+            CalibrationCurve curve = this->calibration(*entry.curve);
+            for (int i = 0; i < curve.size; i++) {
+                const CalibrationCurve::Segment &segment = curve.segments[i];
+                JsonObject item = segments.add<JsonObject>();
+                item["from"] = segment.from;
+                item["c0"] = segment.polynomial.c0;
+                item["c1"] = segment.polynomial.c1;
+                item["c2"] = segment.polynomial.c2;
+            }
+        }
 
         String response;
-        int statusCode;
+        serializeJson(doc, response);
+        this -> printLog(200, request->url().c_str(), response.c_str());
+        request->send(200, JSON_CONTENT_TYPE, response); });
+
+  this->route("/calibration", HTTP_POST, [this](AsyncWebServerRequest* request) {
         try {
-            response = this -> createOperationSucceededResponse();
+            if (!request->hasParam("name")) {
+                throw std::invalid_argument("name is required");
+            }
+            std::string name = request->getParam("name")->value().c_str();
+            auto entry = this->_calibrations.find(name);
+            if (entry == this->_calibrations.end()) {
+                throw std::invalid_argument("Unknown calibration name");
+            }
+
+            CalibrationCurve curve = this->calibration(*entry->second.curve);
+            int index = request->hasParam("segment") ? request->getParam("segment")->value().toInt() : 0;
+            if (index < 0 || index > curve.size || index >= static_cast<int>(CalibrationCurve::MAX_SEGMENTS)) {
+                throw std::invalid_argument("Invalid segment");
+            }
+            if (index == curve.size) {
+                curve.segments[index] = {};
+                curve.size++;
+            }
+
+            CalibrationCurve::Segment &segment = curve.segments[index];
+            if (request->hasParam("from")) segment.from = request->getParam("from")->value().toFloat();
+            if (request->hasParam("c0")) segment.polynomial.c0 = request->getParam("c0")->value().toFloat();
+            if (request->hasParam("c1")) segment.polynomial.c1 = request->getParam("c1")->value().toFloat();
+            if (request->hasParam("c2")) segment.polynomial.c2 = request->getParam("c2")->value().toFloat();
+            this->setCalibration(name, curve);
+
+            this -> sendOperationSucceeded(request);
+        } catch (std::invalid_argument &e) {
+            this -> sendError(request, 400, e.what());
+        } catch (std::exception &e) {
+            this -> sendError(request, 500, e.what());
+        } });
 
-            statusCode = 200;
-            this -> printLog(statusCode, request->url().c_str(), response);
-            request->send(statusCode, "application/json", response);
+  this->route("/calibration/reset", HTTP_POST, [this](AsyncWebServerRequest* request) {
+        try {
+            if (!request->hasParam("name")) {
+                throw std::invalid_argument("name is required");
+            }
+            this->resetCalibration(request->getParam("name")->value().c_str());
+
+            this -> sendOperationSucceeded(request);
+        } catch (std::invalid_argument &e) {
+            this -> sendError(request, 400, e.what());
         } catch (std::exception &e) {
-            statusCode = 500;
-            response = createErrorResponse(e.what());
-            this -> printLog(statusCode, request->url().c_str(), response);
-            request->send(statusCode, "application/json", response);
+            this -> sendError(request, 500, e.what());
         } });
 }
 
@@ -121,87 +530,439 @@ void Base::notFound(AsyncWebServerRequest* request) {
   /*
       Add a handler for 404 error.
   */
-  int time = millis();
-  int statusCode = 404;
-  std::string path = request->url().c_str();
-  String response = createErrorResponse("Not found");
-  this->printLog(statusCode, path, response);
-  request->send(statusCode, "application/json", response);
+  sendError(request, 404, "Not found");
 }
 
-std::unordered_map<std::string, std::string> Base::parseQueryString(const std::string& queryString) {
+void Base::registerTask(const char* name, TaskHandle_t task) {
   /*
-      Parse a query string to a map.
+      Tasks beyond Diagnostics::MAX_TASKS are logged and not reported, since this is called
+      from init() and begin() where nothing catches.
   */
+  int index = _taskCount.load(std::memory_order_relaxed);
+  if (index >= Diagnostics::MAX_TASKS) {
+    _logger.log(LogLevel::Error, "Too many tasks to report: %s", name);
+    return;
+  }
+  _tasks[index] = {name, task};
+  _taskCount.store(index + 1, std::memory_order_release);
+}
 
-  std::unordered_map<std::string, std::string> params;
+Diagnostics Base::diagnostics() {
+  /*
+      Collect memory and task telemetry.
+      Nothing is allocated, and finding the largest free block is the only walk over the heap,
+      so this can be called every few seconds.
+  */
+  Diagnostics diagnostics = {};
+  diagnostics.freeHeap = ESP.getFreeHeap();
+  diagnostics.minFreeHeap = ESP.getMinFreeHeap();
+  diagnostics.largestFreeBlock = ESP.getMaxAllocHeap();
+  diagnostics.psramSize = ESP.getPsramSize();
+  diagnostics.freePsram = diagnostics.psramSize > 0 ? ESP.getFreePsram() : 0;
 
-  std::istringstream iss(queryString);
-  std::string pair;
+  int taskCount = _taskCount.load(std::memory_order_acquire);
+  for (int i = 0; i < taskCount; i++) {
+    TaskHandle_t handle = _tasks[i].handle != nullptr ? _tasks[i].handle : xTaskGetHandle(_tasks[i].name);
+    if (handle == nullptr) {
+      continue;
+    }
+    // ESP-IDF reports the high-water mark in bytes
+    diagnostics.tasks[diagnostics.taskCount++] = {_tasks[i].name, uxTaskGetStackHighWaterMark(handle)};
+  }
+
+  diagnostics.endpoints = _router.size();
+  diagnostics.schedules = _scheduler.active();
+  diagnostics.jsonAllocations = JsonAllocationCounter::instance().live();
+  diagnostics.jsonAllocationsTotal = JsonAllocationCounter::instance().total();
 
-  while (std::getline(iss, pair, '&')) {
-    std::istringstream pairStream(pair);
-    std::string key, value;
+  diagnostics.uptime = esp_timer_get_time() / 1000;
+  diagnostics.resetReason = esp_reset_reason();
+  return diagnostics;
+}
 
-    if (std::getline(std::getline(pairStream, key, '='), value)) {
-      // URL decoding is required if the value contains special characters.
-      params[key] = value;
+void Base::addDiagnosticsEndpoint() {
+  /*
+      Add an endpoint to get memory and task telemetry.
+  */
+  this->route("/diagnostics", HTTP_GET, [this](AsyncWebServerRequest* request) {
+    Diagnostics d = this->diagnostics();
+    typedef unsigned long ul;
+
+    AsyncResponseStream* response = request->beginResponseStream(JSON_CONTENT_TYPE);
+    response->printf("{\"uptime\":%llu,\"resetReason\":\"%s\",",
+                     static_cast<unsigned long long>(d.uptime), Diagnostics::resetReasonName(d.resetReason));
+    response->printf("\"heap\":{\"free\":%lu,\"minFree\":%lu,\"largestFreeBlock\":%lu,\"fragmentation\":%d},",
+                     ul(d.freeHeap), ul(d.minFreeHeap), ul(d.largestFreeBlock), d.fragmentation());
+    response->printf("\"psram\":{\"size\":%lu,\"free\":%lu},\"tasks\":{", ul(d.psramSize), ul(d.freePsram));
+    for (int i = 0; i < d.taskCount; i++) {
+      response->printf("%s\"%s\":%lu", i == 0 ? "" : ",", d.tasks[i].name, ul(d.tasks[i].stackHighWaterMark));
     }
+    response->printf("},\"endpoints\":%lu,\"schedules\":%d,\"json\":{\"live\":%lu,\"total\":%lu}}",
+                     ul(d.endpoints), d.schedules, ul(d.jsonAllocations), ul(d.jsonAllocationsTotal));
+    this->printLog(200, "/diagnostics", "");
+    request->send(response); });
+}
+
+void Base::printLog(int statusCode, const char* path, const char* response) {
+  /*
+      Log a request. Successful requests are subject to per-path sampling.
+  */
+  LogLevel level = statusCode >= 500 ? LogLevel::Error : (statusCode >= 400 ? LogLevel::Warn : LogLevel::Info);
+  if (!_logger.enabled(level) || (level == LogLevel::Info && !_logger.sample(path))) {
+    return;
   }
+  _logger.log(level, "Status Code: %d, Path: %s, Response: %s", statusCode, path, response);
+}
+
+void Base::addLogEndpoints() {
+  /*
+      Add endpoints for logs.
+      - GET  /logs: the latest lines
+          - lines: int (optional) - number of lines, default 20
+      - POST /logs/level: change the log level and the sampling of a path
+          - level: string (optional) - debug, info, warn, error or none
+          - path: string (optional) - log 1 of every `every` successful requests to path
+          - every: int (required with path) - 0 to 65535, 0 logs none
+      At least one of level and path is required.
+  */
+  this->route("/logs", HTTP_GET, [this](AsyncWebServerRequest* request) {
+    size_t lines = request->hasParam("lines") ? request->getParam("lines")->value().toInt() : 20;
+
+    AsyncResponseStream* response = request->beginResponseStream(JSON_CONTENT_TYPE);
+    response->printf("{\"level\":\"%s\",\"dropped\":%lu,\"lines\":",
+                     Logger::levelName(this->_logger.level()), static_cast<unsigned long>(this->_logger.dropped()));
+    this->_logger.tail(*response, lines);
+    response->print("}");
+    request->send(response); });
+
+  this->route("/logs/level", HTTP_POST, [this](AsyncWebServerRequest* request) {
+    bool hasLevel = request->hasParam("level");
+    bool hasPath = request->hasParam("path");
+    LogLevel level = this->_logger.level();
+    if ((!hasLevel && !hasPath) || (hasLevel && !Logger::parseLevel(request->getParam("level")->value().c_str(), level))) {
+      this->sendError(request, 400, "level is required to be debug, info, warn, error or none");
+      return;
+    }
+    if (hasPath) {
+      unsigned long every = 0;
+      if (!request->hasParam("every") || !QueryString::toUnsigned(request->getParam("every")->value().c_str(), every) ||
+          every > UINT16_MAX) {
+        this->sendError(request, 400, "every is required to be 0 to 65535 with path");
+        return;
+      }
+      try {
+        this->_logger.setPathSampling(request->getParam("path")->value().c_str(), every);
+      }
+      catch (std::invalid_argument& e) {
+        this->sendError(request, 400, e.what());
+        return;
+      }
+    }
+    this->_logger.setLevel(level);
+    this->sendOperationSucceeded(request); });
+}
+
+void Base::addProfilerEndpoints() {
+  /*
+      Add endpoints for the stage profiler.
+      - GET  /profile: latency of each stage in microseconds
+      - POST /profile/reset: clear the histograms
+  */
+  this->route("/profile", HTTP_GET, [this](AsyncWebServerRequest* request) {
+    AsyncResponseStream* response = request->beginResponseStream(JSON_CONTENT_TYPE);
+    this->_profiler.write(*response);
+    this->printLog(200, "/profile", "");
+    request->send(response); });
 
-  return params;
+  this->route("/profile/reset", HTTP_POST, [this](AsyncWebServerRequest* request) {
+    this->_profiler.reset();
+    this->sendOperationSucceeded(request); });
 }
 
-void Base::printLog(int statusCode, std::string path, String response, std::map<std::string, std::string> params) {
+const String Base::JSON_CONTENT_TYPE = "application/json";
+const char Base::OPERATION_SUCCEEDED_RESPONSE[] PROGMEM = "{\"result\":\"success\"}";
+const char Base::RESPONSE_TOO_LARGE_RESPONSE[] PROGMEM = "{\"result\":\"error\",\"detail\":\"Response too large\"}";
+
+void Base::sendJson(AsyncWebServerRequest* request, int statusCode, const JsonBuffer& body) {
   /*
-      Print a request log.
+      Send a JSON body formatted on the stack.
+      The body is written directly into the response stream; no String is built for it.
   */
-  Serial.printf("Status Code: %d, ", statusCode);
-  Serial.printf("Path: %s, ", path.c_str());
-  Serial.printf("Response: %s, ", response.c_str());
-  Serial.printf("Params: %s\n", params);
+  if (body.overflowed()) {
+    printLog(500, request->url().c_str(), RESPONSE_TOO_LARGE_RESPONSE);
+    request->send_P(500, JSON_CONTENT_TYPE, RESPONSE_TOO_LARGE_RESPONSE);
+    return;
+  }
+  printLog(statusCode, request->url().c_str(), body.c_str());
+  // The stream's cbuf holds one byte less than its size
+  AsyncResponseStream* response = request->beginResponseStream(JSON_CONTENT_TYPE, body.length() + 1);
+  response->setCode(statusCode);
+  response->write(reinterpret_cast<const uint8_t*>(body.c_str()), body.length());
+  request->send(response);
 }
 
-String Base::createOperationSucceededResponse() {
+void Base::sendOperationSucceeded(AsyncWebServerRequest* request) {
   /*
-      Create a response for a successful operation.
+      Send the constant body for a successful operation directly from flash.
   */
+  printLog(200, request->url().c_str(), OPERATION_SUCCEEDED_RESPONSE);
+  request->send_P(200, JSON_CONTENT_TYPE, OPERATION_SUCCEEDED_RESPONSE);
+}
 
-  JsonDocument doc;
-  doc["result"] = "success";
+void Base::sendError(AsyncWebServerRequest* request, int statusCode, const char* detail) {
+  JsonBuffer body;
+  body.raw("{\"result\":\"error\",\"detail\":").value(detail).raw("}");
+  sendJson(request, statusCode, body);
+}
 
-  String serialized;
-  serializeJson(doc, serialized);
-  return serialized;
+String Base::createOperationSucceededResponse() {
+  /*
+      Create a response for a successful operation.
+  */
+  return OPERATION_SUCCEEDED_RESPONSE;
 }
 
 String Base::createErrorResponse(std::string detail) {
   /*
       Create a response for an error.
   */
-  JsonDocument doc;
-  doc["result"] = "error";
-  doc["detail"] = detail;
+  JsonBuffer body;
+  body.raw("{\"result\":\"error\",\"detail\":").value(detail.c_str()).raw("}");
+  return body.overflowed() ? RESPONSE_TOO_LARGE_RESPONSE : body.c_str();
+}
 
-  String serialized;
-  serializeJson(doc, serialized);
-  return serialized;
+void Base::packADCCommand(uint8_t ch, uint8_t* frame) {
+  /*
+      Pack a single-ended conversion command for MCP320x into a 3 byte frame.
+      Byte 0: start bit, SGL/DIFF and D2 / Byte 1: D1, D0 / Byte 2: don't care
+  */
+  frame[0] = 0x06 | ((ch >> 2) & 0x01);
+  frame[1] = (ch & 0x03) << 6;
+  frame[2] = 0x00;
+}
+
+uint16_t Base::unpackADCData(const uint8_t* frame) {
+  /*
+      Extract 12 bit conversion result from a received frame.
+  */
+  return ((frame[1] & 0x0f) << 8) | frame[2];
 }
 
 uint16_t Base::ADCread(uint8_t ch) {
   /*
       Read raw ADC data.
   */
-  uint16_t data = 0;
-  uint8_t dh, dl;
+  uint8_t frame[ADC_FRAME_SIZE];
+  packADCCommand(ch, frame);
+
+  xSemaphoreTake(_adcMutex, portMAX_DELAY);
   digitalWrite(getADC_CSb(), LOW);
-  SPI.transfer(0x06);
-  dh = SPI.transfer(ch << 6);
-  dl = SPI.transfer(0x00);
+  SPI.transferBytes(frame, frame, ADC_FRAME_SIZE);
   digitalWrite(getADC_CSb(), HIGH);
-  data = ((dh & 0x0f) << 8) | dl;
+  xSemaphoreGive(_adcMutex);
+
+  return unpackADCData(frame);
+}
 
-  return data;
+void Base::ADCscan(uint8_t channelMask, int samplesPerChannel, uint16_t* buffer) {
+  /*
+      Read all channels in channelMask (bit n = channel n) samplesPerChannel times.
+      Results are stored in ascending channel order:
+        buffer[channelIndex * samplesPerChannel + sampleIndex]
+      so buffer must hold popcount(channelMask) * samplesPerChannel values.
+  */
+  int samples[8];
+  for (int ch = 0; ch < 8; ch++) {
+    samples[ch] = channelMask & (1 << ch) ? samplesPerChannel : 0;
+  }
+  ADCscan(samples, buffer);
+}
+
+void Base::ADCscan(const int samplesPerChannel[8], uint16_t* buffer) {
+  /*
+      Read channel n samplesPerChannel[n] times. Results are stored in ascending channel
+      order, the readings of a channel one after another, so buffer must hold the sum of
+      samplesPerChannel values.
+
+      Command frames are packed once and sent with a buffer transfer.
+      MCP320x starts a conversion on the falling edge of CS, so CS is still toggled per frame.
+  */
+  uint8_t command[ADC_FRAME_SIZE];
+  uint8_t frame[ADC_FRAME_SIZE];
+  int index = 0;
+  xSemaphoreTake(_adcMutex, portMAX_DELAY);
+  for (uint8_t ch = 0; ch < 8; ch++) {
+    if (samplesPerChannel[ch] <= 0) {
+      continue;
+    }
+
+    packADCCommand(ch, command);
+    for (int i = 0; i < samplesPerChannel[ch]; i++) {
+      digitalWrite(getADC_CSb(), LOW);
+      SPI.transferBytes(command, frame, ADC_FRAME_SIZE);
+      digitalWrite(getADC_CSb(), HIGH);
+      buffer[index++] = unpackADCData(frame);
+    }
+  }
+  xSemaphoreGive(_adcMutex);
+}
+
+float Base::ADCaverage(uint8_t ch, int samples) {
+  /*
+      Read a channel samples times with ADCscan() and return the average.
+  */
+  if (samples <= 0) {
+    return 0;
+  }
+
+  uint16_t buffer[ADC_SCAN_CHUNK];
+  uint32_t total = 0;
+  for (int done = 0; done < samples; done += ADC_SCAN_CHUNK) {
+    int n = samples - done < ADC_SCAN_CHUNK ? samples - done : ADC_SCAN_CHUNK;
+    ADCscan(1 << ch, n, buffer);
+    for (int i = 0; i < n; i++) {
+      total += buffer[i];
+    }
+  }
+  return static_cast<float>(total) / samples;
+}
+
+void Base::registerAnalogSensor(AnalogChannel& sensor) {
+  /*
+      Add a sensor to the batched ADC pass. Called by the AnalogSensor constructor.
+  */
+  if (_analogSensorCount >= MAX_ANALOG_SENSORS) {
+    throw std::invalid_argument("Too many analog sensors");
+  }
+  _analogSensors[_analogSensorCount++] = &sensor;
+}
+
+void Base::updateAnalogSensors() {
+  /*
+      Read the channels of all analog sensors which are due in one ADC pass,
+      and pass the average of each sensor's samples to it.
+      Each channel is read as many times as the sensor on it with the most samples,
+      so one more sensor costs its own readings instead of separate transactions.
+      More than ADC_SCAN_CHUNK readings of a channel are taken in further passes.
+  */
+  unsigned long now = millis();
+  AnalogChannel* due[MAX_ANALOG_SENSORS];
+  int dueCount = 0;
+  int samples[8] = {};
+  for (int i = 0; i < _analogSensorCount; i++) {
+    AnalogChannel* sensor = _analogSensors[i];
+    if (sensor->due(now)) {
+      due[dueCount++] = sensor;
+      samples[sensor->channel] = std::max<int>(samples[sensor->channel], std::max<int>(sensor->samples, 1));
+    }
+  }
+  if (dueCount == 0) {
+    return;
+  }
+
+  uint32_t totals[MAX_ANALOG_SENSORS] = {};
+  _profiler.measure(_analogStage, [&]() {
+    uint16_t buffer[8 * ADC_SCAN_CHUNK];
+    for (int done = 0;; done += ADC_SCAN_CHUNK) {
+      // Readings done..done + ADC_SCAN_CHUNK of every channel, and where each channel starts in buffer
+      int chunk[8];
+      int offsets[8];
+      int size = 0;
+      for (int ch = 0; ch < 8; ch++) {
+        chunk[ch] = std::min(std::max(samples[ch] - done, 0), ADC_SCAN_CHUNK);
+        offsets[ch] = size;
+        size += chunk[ch];
+      }
+      if (size == 0) {
+        break;
+      }
+      this->ADCscan(chunk, buffer);
+
+      for (int i = 0; i < dueCount; i++) {
+        int ch = due[i]->channel;
+        int n = std::min<int>(std::max<int>(due[i]->samples, 1) - done, chunk[ch]);
+        for (int j = 0; j < n; j++) {
+          totals[i] += buffer[offsets[ch] + j];
+        }
+      }
+    }
+  });
+
+  for (int i = 0; i < dueCount; i++) {
+    AnalogChannel* sensor = due[i];
+    sensor->done(now);
+    sensor->onSample(sensor, static_cast<float>(totals[i]) / std::max<int>(sensor->samples, 1));
+  }
+}
+
+pcnt_unit_t Base::claimPCNTUnit() {
+  /*
+      Return a PCNT unit which nobody has claimed yet. Units are never released.
+  */
+  for (int unit = 0; unit < PCNT_UNIT_MAX; unit++) {
+    if (!(_claimedPCNTUnits & (1 << unit))) {
+      _claimedPCNTUnits |= 1 << unit;
+      return static_cast<pcnt_unit_t>(unit);
+    }
+  }
+  throw std::invalid_argument("No free PCNT unit");
+}
+
+void Base::registerFlowCounter(FlowCounter& counter, const CalibrationCurve& volume) {
+  /*
+      Add a started counter to the pass of updateFlowCounters().
+      volume converts pulses into L to decide when the total is checkpointed.
+  */
+  if (_flowCounterCount >= MAX_FLOW_COUNTERS) {
+    throw std::invalid_argument("Too many flow counters");
+  }
+  _flowCounters[_flowCounterCount++] = {&counter, &volume};
+}
+
+void Base::updateFlowCounters() {
+  /*
+      Update the rate of all registered counters and checkpoint their totals.
+      Pulses are counted by PCNT and timestamped by interrupts, so a meter without new pulses
+      costs a few reads here and nothing is polled between passes.
+  */
+  if (_flowCounterCount == 0) {
+    return;
+  }
+  _profiler.measure(_flowStage, [this]() {
+    for (int i = 0; i < _flowCounterCount; i++) {
+      _flowCounters[i].counter->update();
+      _flowCounters[i].counter->checkpoint(calibration(*_flowCounters[i].volume));
+    }
+  });
+}
+
+bool Base::route(const char* path, WebRequestMethodComposite method, Router::Handler handler) {
+  if (!_router.on(path, method, std::move(handler))) {
+    _logger.log(LogLevel::Error, "Failed to add an endpoint: %s", path);
+    return false;
+  }
+  return true;
+}
+
+bool Base::route(const char* path, WebRequestMethodComposite method, ArRequestHandlerFunction handler) {
+  if (!_router.on(path, method, std::move(handler))) {
+    _logger.log(LogLevel::Error, "Failed to add an endpoint: %s", path);
+    return false;
+  }
+  return true;
+}
+
+uint32_t Base::deviceActionKey(std::string_view device, std::string_view action) {
+  // FNV-1a of "device/action"
+  uint32_t hash = 2166136261u;
+  for (char c : device) {
+    hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+  }
+  hash = (hash ^ static_cast<uint8_t>('/')) * 16777619u;
+  for (char c : action) {
+    hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+  }
+  return hash;
 }
 
 void Base::addDigitalPortOutputEndpoint(
@@ -212,86 +973,106 @@ void Base::addDigitalPortOutputEndpoint(
     std::function<boolean(void)> getter) {
   /*
       Add an endpoint to set a digital port state.
+      - duration: int (optional) - set the port back after duration [ms]. 0 only cancels a running schedule.
+      - interval, repeat: int (optional) - with duration, repeat the pulse repeat times, interval [ms] apart
+
+      A path like "/light/on" is served by the "/{device}/{action}" route which all devices share,
+      and the action is looked up by name. Other paths get a route of their own.
   */
 
-  Serial.printf("Add an endpoint: %s\n", path.c_str());
+  _logger.log(LogLevel::Debug, "Add an endpoint: %s", path.c_str());
 
-  // Add endpoint
-  this->on(path.c_str(), HTTP_POST,
-           [path, pinNumber, setter, getter, mode, this](AsyncWebServerRequest* request) {
-        int time = millis();
-
-        unsigned long duration;
-        const char param[] = "duration";
-        bool invalid = false;
-        if (request->hasParam(param)) {
-            // String.toInt() returns 0 if the string is not a valid number.
-            duration = request->getParam(param)->value().toInt();
-        } else {
-            duration = INT_MAX;
-        }
+  size_t start = path.find_first_not_of('/');
+  size_t separator = path.find('/', start);
+  bool shared = start != std::string::npos && separator != std::string::npos && separator > start &&
+                separator + 1 < path.size() && path.find('/', separator + 1) == std::string::npos;
+  int index = _deviceActions.size();
+  DeviceAction action{shared ? path.substr(start, separator - start) : path,
+                      shared ? path.substr(separator + 1) : std::string(), pinNumber, mode, std::move(setter)};
 
-        // Validate
-        if (duration < 0) {
-            int statusCode = 400;
-            std::string detail = "duration is required to be int >= 0";
-            String response = createErrorResponse(detail);
-            this -> printLog(statusCode, request->url().c_str(), response);
+  if (!shared) {
+    if (route(path.c_str(), HTTP_POST, [this, index](AsyncWebServerRequest* request) {
+          this->handleDeviceAction(request, this->_deviceActions[index]);
+        })) {
+      _deviceActions.push_back(std::move(action));
+    }
+    return;
+  }
 
-            request -> send(statusCode, "application/json", response);
-            return;
+  uint32_t key = deviceActionKey(action.device, action.action);
+  if (_deviceActionIndex.count(key) > 0) {
+    _logger.log(LogLevel::Error, "Failed to add an endpoint: %s is taken", path.c_str());
+    return;
+  }
+  if (_deviceActionIndex.empty() &&
+      !route("/{device}/{action}", HTTP_POST, [this](AsyncWebServerRequest* request, const RouteParams& params) {
+        auto found = this->_deviceActionIndex.find(deviceActionKey(params.get("device"), params.get("action")));
+        if (found == this->_deviceActionIndex.end() ||
+            this->_deviceActions[found->second].device != params.get("device") ||
+            this->_deviceActions[found->second].action != params.get("action")) {
+          this->notFound(request);
+          return;
         }
+        this->handleDeviceAction(request, this->_deviceActions[found->second]);
+      })) {
+    return;
+  }
+  _deviceActionIndex[key] = index;
+  _deviceActions.push_back(std::move(action));
+}
 
-        String response;
-        int statusCode;
-        int currentState = getter();
-        try {
-            if (duration > 0) {
-                setter();
-            }
-            response = this -> createOperationSucceededResponse();
+void Base::handleDeviceAction(AsyncWebServerRequest* request, const DeviceAction& action) {
+  long duration;
+  const char param[] = "duration";
+  if (request->hasParam(param)) {
+    // String.toInt() returns 0 if the string is not a valid number.
+    duration = request->getParam(param)->value().toInt();
+  } else {
+    duration = INT_MAX;
+  }
+  long interval = request->hasParam("interval") ? request->getParam("interval")->value().toInt() : 0;
+  long repeat = request->hasParam("repeat") ? request->getParam("repeat")->value().toInt() : 1;
 
-            // Remove timer if exists.
-            if (this -> timers.count(pinNumber) > 0) {
-                this -> timers.erase(pinNumber);
-            }
+  // Validate
+  if (duration < 0) {
+    this->sendError(request, 400, "duration is required to be int >= 0");
+    return;
+  }
+  if (repeat < 1 || interval < 0 || (repeat > 1 && (duration == INT_MAX || interval == 0))) {
+    this->sendError(request, 400, "repeat requires duration and interval > 0");
+    return;
+  }
 
-            // Set timer if duration is set and the state before updating is different from the target state.
-            if (duration > 0 && duration < INT_MAX) {
-                int targetMode = mode == HIGH ? LOW : HIGH;
-                this -> timers.emplace(pinNumber, Timer{millis() + duration, targetMode});
-            }
+  try {
+    // Replace a running schedule first, so that its timer cannot undo the setter
+    _scheduler.cancel(action.pinNumber);
 
-            // Writing Serial.print does not work, so use a function to print logs instead.
-            statusCode = 200;
-            this -> printLog(statusCode, request->url().c_str(), response);
-            request->send(statusCode, "application/json", response);
-        } catch (std::exception &e) {
-            statusCode = 500;
-            response = createErrorResponse(e.what());
-            this -> printLog(statusCode, request->url().c_str(), response);
-            request->send(statusCode, "application/json", response);
-        } });
+    if (duration > 0) {
+      action.setter();
+    }
+
+    // Set the port back after duration, repeating if requested
+    if (duration > 0 && duration < INT_MAX) {
+      _scheduler.pulse(action.pinNumber, action.mode, duration * 1000LL, interval * 1000LL, repeat);
+    }
+
+    // Writing Serial.print does not work, so use a function to print logs instead.
+    this->sendOperationSucceeded(request);
+  } catch (std::exception& e) {
+    this->sendError(request, 500, e.what());
+  }
 }
 
 void Base::addOperationEndpoint(std::function<void(void)> fn, std::string path) {
   /*
       Add an endpoint to execute an operation.
   */
-  this->on(path.c_str(), HTTP_POST, [path, fn, this](AsyncWebServerRequest* request) {
-        String response;
-        int statusCode;
+  this->route(path.c_str(), HTTP_POST, [fn, this](AsyncWebServerRequest* request) {
         try {
             fn();
-            statusCode = 200;
-            response = this -> createOperationSucceededResponse();
-            this -> printLog(statusCode, request->url().c_str(), response);
-            request->send(statusCode, "application/json", response);
+            this -> sendOperationSucceeded(request);
         } catch (std::exception &e) {
-            statusCode = 500;
-            response = createErrorResponse(e.what());
-            this -> printLog(statusCode, request->url().c_str(), response);
-            request->send(statusCode, "application/json", response);
+            this -> sendError(request, 500, e.what());
         } });
 }
 
@@ -299,26 +1080,15 @@ void Base::addOperationEndpoint(std::function<void(float)> fn, std::string path,
   /*
       Add an endpoint to execute an operation with a float parameter.
   */
-  this->on(path.c_str(), HTTP_POST, [path, fn, param, this](AsyncWebServerRequest* request) {
-        String response;
-        int statusCode;
+  this->route(path.c_str(), HTTP_POST, [fn, param, this](AsyncWebServerRequest* request) {
         try {
-            float *value = nullptr;
-            if (request->hasParam(param.c_str())) {
-                value = new float();
-                *value = request->getParam(param.c_str())->value().toFloat();
+            if (!request->hasParam(param.c_str())) {
+                throw std::invalid_argument(param + " is required");
             }
 
-            fn(*value);
-            response = this -> createOperationSucceededResponse();
-
-            statusCode = 200;
-            this -> printLog(statusCode, request->url().c_str(), response);
-            request->send(statusCode, "application/json", response);
+            fn(request->getParam(param.c_str())->value().toFloat());
+            this -> sendOperationSucceeded(request);
         } catch (std::exception &e) {
-            statusCode = 500;
-            response = createErrorResponse(e.what());
-            this -> printLog(statusCode, request->url().c_str(), response);
-            request->send(statusCode, "application/json", response);
+            this -> sendError(request, 500, e.what());
         } });
 }
\ No newline at end of file
@@ -1,44 +1,45 @@
 #include "CoreModule.h"
 
 #include <SPI.h>
-#include <driver/pcnt.h>
+
+#include "QueryString.h"
 
 CoreModule::CoreModule(Diameter diameter, int port)
-    : Base(port) {
+    : Base(port), _calibration(defaultCoreCalibration(diameter)) {
   _diameter = diameter;
 }
 
-void CoreModule::updateFlow()
+uint64_t CoreModule::getFlowPulses()
 /*
-  Update flow [L/min]
+  Get the number of pulses counted by PCNT since init().
 */
 {
-  static long m = millis();
-  // Update flow every 1 second
-  if (millis() - m > 1000) {
-    _flowCountPerSec = getFlowCount();
-    _flow = calculateFlow(_flowCountPerSec);
-    m = millis();
-  }
+  return _flowCounter.pulses();
 }
 
-int16_t CoreModule::getFlowCount()
+uint64_t CoreModule::getTotalFlowPulses()
 /*
-  Get flow count.
+  Get the number of pulses since the last reset, including pulses before reboots.
 */
 {
-  int16_t flowCount = 0;
-  pcnt_get_counter_value(PCNT_UNIT_0, &flowCount);
-
-  if (flowCount > FLOW_COUNT_MAX) {
-    flowCount = FLOW_COUNT_MAX;
-  }
+  return _flowCounter.totalPulses();
+}
 
-  pcnt_counter_pause(PCNT_UNIT_0);
-  pcnt_counter_clear(PCNT_UNIT_0);
-  pcnt_counter_resume(PCNT_UNIT_0);
+void CoreModule::setFlowWindow(unsigned long windowMs)
+/*
+  Set the length of the sliding window used to calculate flow.
+*/
+{
+  _flowCounter.setWindow(windowMs);
+}
 
-  return flowCount;
+void CoreModule::updateFlow()
+/*
+  Update flow [L/min] from the pulse rate over the sliding window (see FlowCounter::update()).
+*/
+{
+  _flowCounter.update();
+  _flow = calculateFlow(_flowCounter.pulsesPerSec());
 }
 
 float CoreModule::calculateFlow(float flow_count_per_sec)
@@ -46,49 +47,36 @@ float CoreModule::calculateFlow(float flow_count_per_sec)
   Calculate flow [L/min] from flow count per second.
 */
 {
-  float flowLitterPerMin = 0;
-  switch (_diameter) {
-    case Diameter::Quarter:
-      flowLitterPerMin = 0.02884 * _flowCountPerSec;
-      break;
-    case Diameter::ThreeEighth:
-      flowLitterPerMin = 0.0683 * _flowCountPerSec - 0.3894;
-      if (flowLitterPerMin < 0) flowLitterPerMin = 0;
-      break;
-    default:
-      throw std::invalid_argument("Invalid diameter");
-  }
+  float flowLitterPerMin = calibration(_calibration.flow)(flow_count_per_sec);
+  if (flowLitterPerMin < 0) flowLitterPerMin = 0;
   return flowLitterPerMin;
 }
 
-void CoreModule::updateTotalFlow() {
-  static float prevFlow = 0;
-
-  // _lastFlowUpdatedAt == 0 means just after constructed or reset.
-  if (_lastFlowUpdatedAt == 0) {
-    _lastFlowUpdatedAt = millis();
-  }
-
-  // Add an average between latest flow and previous flow to total flow multiplied by time
-  float averageFlow = (_flow + prevFlow) / 2;
-  unsigned long currentTime = millis();
-  float timeDiff = static_cast<float>(currentTime - _lastFlowUpdatedAt) / 1000;
-
-  // flow and prev_flow is L/min, time_diff is sec
-  _totalFlow += (averageFlow + prevFlow) / 60 * timeDiff / 2;
-
-  // Update last updated time and flow
-  _lastFlowUpdatedAt = currentTime;
-  prevFlow = _flow;
+void CoreModule::updateTotalFlow()
+/*
+  Update total flow [L] from the pulse total.
+  Pulses are counted as an integer and converted only here, so precision does not degrade.
+*/
+{
+  _totalFlow = calibration(_calibration.volume).evaluate(static_cast<double>(getTotalFlowPulses()));
 }
 
 void CoreModule::resetTotalFlow()
 /*
-  Reset total flow.
+  Reset total flow. The reset is persisted by the next update() on the loop task.
 */
 {
+  _flowCounter.reset();
   _totalFlow = 0;
-  _lastFlowUpdatedAt = 0;
+}
+
+void CoreModule::setTotalFlowCheckpoint(float volume, unsigned long intervalMs)
+/*
+  Set how often the total flow is saved to NVS.
+  A checkpoint is written when volume [L] has flowed or intervalMs passed with any flow.
+*/
+{
+  _flowCounter.setCheckpoint(volume, intervalMs);
 }
 
 void CoreModule::setTDSResistance(int i)
@@ -112,83 +100,43 @@ int CoreModule::calculateTDS(float voltage, int resistanceNo)
   Calculate TDS [ppm] from voltage and resistance number.
 */
 {
-  float tds;
-  if (_diameter == Diameter::Quarter) {
-    switch (resistanceNo) {
-      case 0:
-	tds = 0.007909 * voltage * voltage + 1.4141 * voltage + 357.9580;
-	break;
-      case 1:
-	tds = 0.5192 * voltage - 18.5847;
-	break;
-      case 2:
-	tds = 0.04826 * voltage - 1.2852;
-	break;
-      case 3:
-	tds = 0.005465 * voltage - 0.3315;
-	break;
-      default:
-	Serial.println("calculateTDS with 1/4 diameter failed.");
-	tds = 0.0;
-    }
-  } else if (_diameter == Diameter::ThreeEighth) {
-    switch (resistanceNo) {
-      case 0:
-	tds = 0.006073 * voltage * voltage - 0.8759 * voltage + 420.1264;
-	break;
-      case 1:
-	tds = 0.3020 * voltage - 4.5710;
-	break;
-      case 2:
-	tds = 0.02695 * voltage - 1.5870;
-	break;
-      case 3:
-	tds = 0.002669 * voltage - 0.9683;
-	break;
-      default:
-	Serial.println("calculateTDS with 3/8 diameter failed.");
-	tds = 0.0;
-    }
-  } else {
-    throw std::invalid_argument("Invalid diameter");
+  if (resistanceNo < 0 || resistanceNo > TDSAutorange::RANGE_MAX) {
+    _logger.log(LogLevel::Warn, "calculateTDS failed: resistanceNo %d", resistanceNo);
+    return 0;
   }
+  return calibration(_calibration.tds[resistanceNo])(voltage);
+}
 
-  return tds;
+void CoreModule::switchTDSRange(int resistanceNo)
+/*
+  Switch the TDS range and start waiting for readings to settle.
+*/
+{
+  _tdsAutorange.switchTo(resistanceNo, millis());
+  _tdsFilter.reset();
+  setTDSResistance(resistanceNo);
 }
 
 void CoreModule::updateTDS(int samples) {
   /*
-    If an observed values is within the range (100 < value < 1500), update _tds.
-    Otherwise, switch the resistance and wait for TDS_SETTLING_TIME milliseconds.
+    If an observed value is within the range of the current resistance, update _tds.
+    Otherwise, switch to the estimated range. See TDSAutorange for details.
   */
-  static int resistanceNo = 3;
-  static unsigned long _lastSwitchedAt = 0;
 
-  // Initialize resistance setting
-  if (_lastSwitchedAt == 0)
-    setTDSResistance(resistanceNo);
-
-  // If TDS_SETTING_TIME milliseconds passes after switching at last, exit
-  if (millis() - _lastSwitchedAt < TDS_SETTLING_TIME)
-    return;
+  // Get votages n_sample times in one scan and take average
+  float avgVoltage = ADCaverage(2, samples);
 
-  // Get votages n_sample times and take average
-  float totalVoltage = 0;
-  for (int i = 0; i < samples; i++) {
-    totalVoltage += ADCread(2);
-  }
-  float avgVoltage = totalVoltage / samples;
-
-  // If observed value is within the scope, update _tds.
-  // Otherwise, switch the resistance.
-  if (avgVoltage >= 100 && avgVoltage <= 1500) {
-    _tds = calculateTDS(avgVoltage, resistanceNo);
-  } else if (avgVoltage > 1500 && resistanceNo != 0) {
-    _lastSwitchedAt = millis();
-    setTDSResistance(--resistanceNo);
-  } else if (avgVoltage < 100 && resistanceNo != 3) {
-    _lastSwitchedAt = millis();
-    setTDSResistance(++resistanceNo);
+  // Ranges are selected from the reading itself, so that a step is not delayed by the filter
+  switch (_tdsAutorange.update(avgVoltage, millis())) {
+    case TDSAutorange::Result::Valid:
+      _tds = calculateTDS(_tdsFilter(avgVoltage), _tdsAutorange.range());
+      break;
+    case TDSAutorange::Result::Switch:
+      _tdsFilter.reset();
+      setTDSResistance(_tdsAutorange.range());
+      break;
+    default:
+      break;
   }
 }
 
@@ -199,66 +147,225 @@ void CoreModule::updateTemperature()
 {
   uint16_t data;
   data = ADCread(0);
-  if (data > 589.545) {
-    _temperature = -0.03 * data + 67.66;
-  } else {
-    _temperature = -0.09 * data + 102.619;
-  }
+  _temperature = calibration(_calibration.temperature)(data);
 }
 
 String CoreModule::getSensorValuesJson() {
-  JsonDocument doc;
-  doc["tds"] = _tds;
-  doc["flow"] = _flow;
-  doc["total_flow"] = _totalFlow;
-  doc["temperature"] = _temperature;
+  SensorValues values = getSensorValues();
+  JsonDocument doc(&JsonAllocationCounter::instance());
+  doc["tds"] = values.tds;
+  doc["flow"] = values.flow;
+  doc["total_flow"] = values.totalFlow;
+  doc["temperature"] = values.temperature;
+  doc["sequence"] = values.sequence;
+  doc["time"] = values.timestamp;
   String json;
   serializeJson(doc, json);
   return json;
 }
 
+void CoreModule::sample()
+/*
+  Run one acquisition cycle and push the result to the sample ring.
+*/
+{
+  _profiler.period(_stages.samplePeriod);
+  _profiler.measure(_stages.temperature, [this]() { this->updateTemperature(); });
+  _profiler.measure(_stages.flow, [this]() { this->updateFlow(); });
+  _profiler.measure(_stages.totalFlow, [this]() { this->updateTotalFlow(); });
+  _profiler.measure(_stages.tds, [this]() { this->updateTDS(); });
+
+  _profiler.measure(_stages.publish, [this]() {
+    // Publish the sample set at once so that readers never see a mix of two cycles
+    SensorValues values = {_tds, _flow, _totalFlow, _temperature, millis(), _snapshot.version() + 1};
+    _snapshot.write(values);
+    _samples.push(values);
+
+    if (_history.isEnabled()) {
+      float fields[] = {static_cast<float>(_tds), _flow, _totalFlow, _temperature};
+      _history.add(values.timestamp, fields);
+    }
+  });
+}
+
+void CoreModule::addProfilerStages()
+/*
+  Register the stages of sample() and update(). With the profiler compiled out, ids are -1.
+*/
+{
+  _stages.temperature = _profiler.addStage("temperature");
+  _stages.flow = _profiler.addStage("flow");
+  _stages.totalFlow = _profiler.addStage("totalFlow");
+  _stages.tds = _profiler.addStage("tds");
+  _stages.publish = _profiler.addStage("publish");
+  _stages.samplePeriod = _profiler.addStage("samplePeriod", true);
+  _stages.checkpoint = _profiler.addStage("checkpoint");
+  _stages.stream = _profiler.addStage("stream");
+  _stages.log = _profiler.addStage("log");
+  _stages.loopPeriod = _profiler.addStage("loopPeriod", true);
+}
+
+void CoreModule::acquisitionTask(void *arg)
+/*
+  FreeRTOS task which samples sensors at a fixed rate.
+*/
+{
+  CoreModule *cm = static_cast<CoreModule *>(arg);
+  TickType_t lastWakeTime = xTaskGetTickCount();
+  while (true) {
+    cm->sample();
+    vTaskDelayUntil(&lastWakeTime, pdMS_TO_TICKS(cm->_acquisitionInterval));
+  }
+}
+
+void CoreModule::startAcquisition(int intervalMs, int core, int priority)
+/*
+  Start sampling sensors on a dedicated task pinned to core.
+  After this, update() no longer samples sensors and only handles checkpoints, streaming and printing.
+*/
+{
+  if (_diameter == Diameter::Null) {
+    throw std::invalid_argument("Invalid diameter");
+  }
+  if (intervalMs <= 0) {
+    throw std::invalid_argument("intervalMs must be > 0");
+  }
+  if (_acquisitionTask != nullptr) {
+    return;
+  }
+
+  _acquisitionInterval = intervalMs;
+  xTaskCreatePinnedToCore(acquisitionTask, "acquisition", 4096, this, priority, &_acquisitionTask, core);
+  registerTask("acquisition", _acquisitionTask);
+}
+
 void CoreModule::update(int printInterval)
 /*
   Update sensor values and print them if the diameter is not Null.
+  If the acquisition task is running, sensor values are updated by the task instead.
+  External analog sensors which are due are read in one ADC pass, and external flow meters in one pass.
 */
 {
-  // Check timers
-  this->checkTimer();
+  updateAnalogSensors();
+  updateFlowCounters();
 
   if (_diameter != Diameter::Null) {
     static int printMillis = millis();
+    _profiler.period(_stages.loopPeriod);
 
     // Update sensor values
-    updateTemperature();
-    updateFlow();
-    updateTotalFlow();
-    updateTDS();
-
-    // Print sensor values
-    if (millis() - printMillis > printInterval) {
-      Serial.print("\n--- Preset Sensor Values[Start] ---\n");
-      Serial.printf("Temperature: %.2f\n", _temperature);
-      Serial.printf("Flow: %.2f\n", _flow);
-      Serial.printf("Total Flow: %.2f\n", _totalFlow);
-      Serial.printf("TDS: %d\n", _tds);
-      Serial.println("--- Preset Sensor Values[End]   ---\n");
-      printMillis = millis();
+    if (!isAcquiring()) {
+      sample();
     }
+
+    // Save total flow on the loop task so that NVS writes never delay sampling
+    _profiler.measure(_stages.checkpoint, [this]() { this->_flowCounter.checkpoint(this->calibration(this->_calibration.volume)); });
+
+    // Stream each sample set once, also on the loop task
+    SensorValues values = getSensorValues();
+    _profiler.measure(_stages.stream, [this, &values]() {
+      if (values.sequence != _streamedSequence) {
+        _stream.publish(values);
+        _streamedSequence = values.sequence;
+      }
+    });
+
+    // Log sensor values. The logger task writes them to Serial, so the loop never waits for the UART.
+    _profiler.measure(_stages.log, [this, &values, printInterval]() {
+      if (millis() - printMillis > printInterval) {
+        _logger.log(LogLevel::Info, "Temperature: %.2f, Flow: %.2f, Total Flow: %.2f, TDS: %d",
+                    values.temperature, values.flow, values.totalFlow, values.tds);
+        printMillis = millis();
+      }
+    });
+
+    _profiler.summarize(_logger);
   }
 }
 
+namespace {
+// Fields kept in history, in the order passed to History::add()
+const char *const HISTORY_FIELDS[] = {"tds", "flow", "totalFlow", "temperature"};
+const char *const HISTORY_UNITS[] = {"ppm", "L/min", "L", "celcius"};
+const float HISTORY_SCALES[] = {1, 100, 100, 100};
+}  // namespace
+
+boolean CoreModule::enableHistory(size_t memoryBudget)
+/*
+  Start keeping the history of sensor values within memoryBudget bytes.
+  Call this before startAcquisition().
+*/
+{
+  return _history.begin(4, HISTORY_FIELDS, HISTORY_SCALES, memoryBudget);
+}
+
+void CoreModule::addHistoryEndpoint()
+/*
+  Add an endpoint to get the history of a sensor value.
+  - field: string (required) - tds, flow, totalFlow or temperature
+  - from, to: unsigned int (optional) - range in millis(). Default is the last hour.
+  - step: unsigned int (optional) - interval of points in milliseconds. Default is 1000.
+  Invalid parameters are rejected with 400.
+*/
+{
+  this->route("/history", HTTP_GET, [this](AsyncWebServerRequest *request) {
+    try {
+      if (!this->_history.isEnabled()) {
+        throw std::runtime_error("History is not enabled");
+      }
+      if (!request->hasParam("field")) {
+        throw std::invalid_argument("field is required");
+      }
+      int field = this->_history.fieldIndex(request->getParam("field")->value().c_str());
+      if (field < 0) {
+        throw std::invalid_argument("Unknown field");
+      }
+
+      // Times are millis(), so they are parsed as unsigned to cover the whole range before it wraps
+      auto parse = [request](const char *name, unsigned long fallback) {
+        if (!request->hasParam(name)) {
+          return fallback;
+        }
+        const String &value = request->getParam(name)->value();
+        unsigned long result;
+        if (!QueryString::toUnsigned(std::string_view(value.c_str(), value.length()), result)) {
+          throw std::invalid_argument(std::string(name) + " must be an unsigned integer");
+        }
+        return result;
+      };
+      unsigned long now = millis();
+      unsigned long to = parse("to", now);
+      unsigned long from = parse("from", to > 3600000 ? to - 3600000 : 0);
+      unsigned long step = parse("step", 1000);
+
+      // Stream points directly into the response instead of building a JSON document
+      AsyncResponseStream *response = request->beginResponseStream(JSON_CONTENT_TYPE);
+      response->printf("{\"field\":\"%s\",\"unit\":\"%s\",\"step\":%lu,\"time\":%lu,\"points\":",
+                       HISTORY_FIELDS[field], HISTORY_UNITS[field], step, now);
+      this->_history.query(*response, field, from, to, step);
+      response->print("}");
+      request->send(response);
+    }
+    catch (std::invalid_argument &e) {
+      this->sendError(request, 400, e.what());
+    }
+    catch (std::exception &e) {
+      this->sendError(request, 500, e.what());
+    } });
+}
+
 void CoreModule::addResetFlowEndpoint()
 /*
   Add an endpoint to reset total flow.
 */
 {
-  this->on("/totalFlow/reset", HTTP_POST, [this](AsyncWebServerRequest *request) {
+  this->route("/totalFlow/reset", HTTP_POST, [this](AsyncWebServerRequest *request) {
     try {
       this->resetTotalFlow();
-        request->send(200, "application/json", this->createOperationSucceededResponse());
+      this->sendOperationSucceeded(request);
     }
     catch (std::exception &e) {
-      request->send(500, "application/json", this->createErrorResponse(e.what()));
+      this->sendError(request, 500, e.what());
     } });
 }
 
@@ -266,79 +373,68 @@ void CoreModule::init() {
   Base::init();
 
   pinMode(Pin::TDS_RSEL0, OUTPUT);
-  digitalWrite(Pin::TDS_RSEL0, 0);
-
   pinMode(Pin::TDS_RSEL1, OUTPUT);
-  digitalWrite(Pin::TDS_RSEL1, 0);
+  switchTDSRange(_tdsAutorange.range());
 
   // Clock for TDS drive
   ledcSetup(LEDC_CHANNEL_0, LEDC_BASE_FREQ, LEDC_TIMER_BIT);
   ledcAttachPin(Pin::TDS_CLK_PIN, LEDC_CHANNEL_0);
   ledcWrite(LEDC_CHANNEL_0, 0x80);
 
-  // Counter for flow
-  pcnt_config_t pcnt_config;
-  pcnt_config.pulse_gpio_num = MH_FLOW;
-  pcnt_config.ctrl_gpio_num = PCNT_PIN_NOT_USED;
-  pcnt_config.lctrl_mode = PCNT_MODE_KEEP;
-  pcnt_config.hctrl_mode = PCNT_MODE_KEEP;
-  pcnt_config.channel = PCNT_CHANNEL_0;
-  pcnt_config.unit = PCNT_UNIT_0;
-  pcnt_config.pos_mode = PCNT_COUNT_INC;
-  pcnt_config.neg_mode = PCNT_COUNT_DIS;
-  pcnt_config.counter_h_lim = 1000;
-  pcnt_config.counter_l_lim = -1000;
-
-  pcnt_unit_config(&pcnt_config);
-  pcnt_counter_pause(PCNT_UNIT_0);
-  pcnt_counter_clear(PCNT_UNIT_0);
-  pcnt_counter_resume(PCNT_UNIT_0);
-
-  // Initialize digital port states
-  states[Pin::D0_1] = false;
-  states[Pin::D0_2] = false;
-  states[Pin::D1_1] = false;
-  states[Pin::D1_2] = false;
+  // Counter for flow. Checkpoints keep the namespace used before FlowCounter.
+  _flowCounter.begin(MH_FLOW, claimPCNTUnit(), "totalizer");
+
+  // Initialize digital ports to off at once
+  setPorts(portMask(Pin::D0_1) | portMask(Pin::D0_2) | portMask(Pin::D1_1) | portMask(Pin::D1_2), 0);
 
   pinMode(Pin::LED, OUTPUT);
 
-  // Add an endpoint to get a sensor value
-  addGetValueEndpoint([this]() { return this->getTDS(); },
+  // Measure each stage of sample() and update() if the profiler is built in
+  addProfilerStages();
+
+  // Load calibration overrides from NVS
+  registerCalibration("tds0", _calibration.tds[0]);
+  registerCalibration("tds1", _calibration.tds[1]);
+  registerCalibration("tds2", _calibration.tds[2]);
+  registerCalibration("tds3", _calibration.tds[3]);
+  registerCalibration("flow", _calibration.flow);
+  registerCalibration("volume", _calibration.volume);
+  registerCalibration("temperature", _calibration.temperature);
+
+  // List sensor values in /sensors, all read from one snapshot per request
+  setSensorSample([this]() { return this->getSensorValues(); });
+  registerSensor("tds", "ppm", [](const SensorValues &v) { return static_cast<float>(v.tds); }, 0);
+  registerSensor("flow", "L/min", [](const SensorValues &v) { return v.flow; });
+  registerSensor("totalFlow", "L", [](const SensorValues &v) { return v.totalFlow; });
+  registerSensor("temperature", "celcius", [](const SensorValues &v) { return v.temperature; });
+
+  // Restore total flow saved before reboot
+  if (_diameter != Diameter::Null) {
+    _flowCounter.restore();
+    updateTotalFlow();
+  }
+
+  // Add an endpoint to get a sensor value.
+  // Values are read from the snapshot because handlers run on the AsyncTCP task.
+  addGetValueEndpoint([this]() {
+    SensorValues v = this->getSensorValues();
+    return SampledValue<int>{v.tds, v.sequence, v.timestamp}; },
                       "/tds", "ppm");
-  addGetValueEndpoint([this]() { return this->getFlow(); },
+  addGetValueEndpoint([this]() {
+    SensorValues v = this->getSensorValues();
+    return SampledValue<float>{v.flow, v.sequence, v.timestamp}; },
                       "/flow", "L/min");
-  addGetValueEndpoint([this]() { return this->getTotalFlow(); },
+  addGetValueEndpoint([this]() {
+    SensorValues v = this->getSensorValues();
+    return SampledValue<float>{v.totalFlow, v.sequence, v.timestamp}; },
                       "/totalFlow", "L");
-  addGetValueEndpoint([this]() { return this->getTemperature(); },
+  addGetValueEndpoint([this]() {
+    SensorValues v = this->getSensorValues();
+    return SampledValue<float>{v.temperature, v.sequence, v.timestamp}; },
                       "/temperature", "celcius");
   addResetFlowEndpoint();
+  addHistoryEndpoint();
+  _stream.attach(*this);
 
   this->onNotFound([this](AsyncWebServerRequest *request) { this->notFound(request); });
 }
-
-void CoreModule::checkTimer()
-/*
-  Check Timer object and if Timer.time is expired, set pin to Timer.mode.
-*/
-{
-  for (auto const &[pinNumber, timer] : this->timers) {
-    if (millis() >= timer.time) {
-      digitalWrite(pinNumber, timer.mode);
-
-      switch (pinNumber) {
-	case Pin::D0_1:
-	  setD0_1(timer.mode == HIGH);
-	  break;
-	case Pin::D0_2:
-	  setD0_2(timer.mode == HIGH);
-	  break;
-	case Pin::D1_1:
-	  setD1_1(timer.mode == HIGH);
-	  break;
-	case Pin::D1_2:
-	  setD1_2(timer.mode == HIGH);
-	  break;
-      }
-    }
-  }
-}
\ No newline at end of file
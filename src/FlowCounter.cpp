@@ -0,0 +1,273 @@
+#include "FlowCounter.h"
+
+#include <Preferences.h>
+#include <esp_timer.h>
+
+#include <cstring>
+#include <stdexcept>
+
+void IRAM_ATTR FlowCounter::onCountLimit(void* arg) {
+  /*
+      PCNT event handler. The counter is reset to 0 when it reaches COUNT_LIMIT.
+  */
+  FlowCounter* counter = static_cast<FlowCounter*>(arg);
+  portENTER_CRITICAL_ISR(&counter->_mux);
+  counter->_countOverflow += COUNT_LIMIT;
+  portEXIT_CRITICAL_ISR(&counter->_mux);
+}
+
+void IRAM_ATTR FlowCounter::onEdge(void* arg) {
+  /*
+      GPIO interrupt handler which timestamps each pulse.
+  */
+  FlowCounter* counter = static_cast<FlowCounter*>(arg);
+  int64_t now = esp_timer_get_time();
+  portENTER_CRITICAL_ISR(&counter->_mux);
+  counter->_lastEdgeAt = now;
+  portEXIT_CRITICAL_ISR(&counter->_mux);
+}
+
+void FlowCounter::begin(int pin, pcnt_unit_t unit, const char* nvsNamespace) {
+  /*
+      unit must not be used by anything else. Base::claimPCNTUnit() gives a free one.
+  */
+  if (isStarted()) {
+    throw std::invalid_argument("Flow counter is already started");
+  }
+  _unit = unit;
+  strncpy(_namespace, nvsNamespace, NAMESPACE_SIZE - 1);
+
+  pcnt_config_t pcnt_config;
+  pcnt_config.pulse_gpio_num = pin;
+  pcnt_config.ctrl_gpio_num = PCNT_PIN_NOT_USED;
+  pcnt_config.lctrl_mode = PCNT_MODE_KEEP;
+  pcnt_config.hctrl_mode = PCNT_MODE_KEEP;
+  pcnt_config.channel = PCNT_CHANNEL_0;
+  pcnt_config.unit = unit;
+  pcnt_config.pos_mode = PCNT_COUNT_INC;
+  pcnt_config.neg_mode = PCNT_COUNT_DIS;
+  pcnt_config.counter_h_lim = COUNT_LIMIT;
+  pcnt_config.counter_l_lim = -COUNT_LIMIT;
+
+  pcnt_unit_config(&pcnt_config);
+  pcnt_counter_pause(unit);
+  pcnt_counter_clear(unit);
+
+  // Accumulate counter wraps so that the pulse total never overflows.
+  // The ISR service is shared by all units, so installing it again fails harmlessly.
+  pcnt_event_enable(unit, PCNT_EVT_H_LIM);
+  pcnt_isr_service_install(0);
+  pcnt_isr_handler_add(unit, onCountLimit, this);
+  pcnt_counter_resume(unit);
+
+  // Timestamp each pulse for period measurement
+  attachInterruptArg(pin, onEdge, this, RISING);
+}
+
+uint64_t FlowCounter::pulses() {
+  if (!isStarted()) {
+    return 0;
+  }
+
+  uint64_t overflow, overflowAfter;
+  int16_t count = 0;
+  do {
+    portENTER_CRITICAL(&_mux);
+    overflow = _countOverflow;
+    portEXIT_CRITICAL(&_mux);
+
+    pcnt_get_counter_value(_unit, &count);
+
+    portENTER_CRITICAL(&_mux);
+    overflowAfter = _countOverflow;
+    portEXIT_CRITICAL(&_mux);
+  } while (overflow != overflowAfter);
+
+  // The counter may have wrapped before the event handler runs
+  uint64_t pulses = overflow + count;
+  portENTER_CRITICAL(&_mux);
+  if (pulses < _lastPulses) {
+    pulses = _lastPulses;
+  } else {
+    _lastPulses = pulses;
+  }
+  portEXIT_CRITICAL(&_mux);
+  return pulses;
+}
+
+uint64_t FlowCounter::totalPulses() {
+  uint64_t count = pulses();
+  portENTER_CRITICAL(&_mux);
+  uint64_t total = _totalPulsesBase + (count - _pulsesAtBase);
+  portEXIT_CRITICAL(&_mux);
+  return total;
+}
+
+void FlowCounter::setWindow(unsigned long windowMs) {
+  /*
+      Set the length of the sliding window used to calculate the rate.
+  */
+  if (windowMs == 0) {
+    throw std::invalid_argument("windowMs must be > 0");
+  }
+  _window = static_cast<int64_t>(windowMs) * 1000;
+}
+
+void FlowCounter::update() {
+  /*
+      Rate is calculated from the pulses counted by PCNT between edges over the sliding window.
+      If the window contains fewer than two edges, the period of the latest edges is used.
+      The count is read between two reads of the last edge time, and read again if an edge
+      came in between, so that it belongs to that edge.
+  */
+  uint64_t count;
+  int64_t lastEdgeAt, lastEdgeAfter;
+  do {
+    portENTER_CRITICAL(&_mux);
+    lastEdgeAt = _lastEdgeAt;
+    portEXIT_CRITICAL(&_mux);
+
+    count = pulses();
+
+    portENTER_CRITICAL(&_mux);
+    lastEdgeAfter = _lastEdgeAt;
+    portEXIT_CRITICAL(&_mux);
+  } while (lastEdgeAt != lastEdgeAfter);
+  int64_t now = esp_timer_get_time();
+
+  // Record the latest edge if enough time passed since the previous record
+  Record& newest = _records[(_recordHead + RECORDS - 1) % RECORDS];
+  if (_recordSize == 0 || (count != newest.count && lastEdgeAt - newest.at >= _window / RECORDS)) {
+    _records[_recordHead] = {count, lastEdgeAt};
+    _recordHead = (_recordHead + 1) % RECORDS;
+    if (_recordSize < RECORDS) _recordSize++;
+  }
+
+  // Find the oldest record within the window, or the latest one before it
+  const Record* base = nullptr;
+  for (int i = 1; i <= _recordSize; i++) {
+    const Record& record = _records[(_recordHead + RECORDS - i) % RECORDS];
+    if (record.count == count) {
+      continue;
+    }
+    if (record.at < now - _window && base != nullptr) {
+      break;
+    }
+    base = &record;
+  }
+
+  float pulsesPerSec = 0;
+  if (base != nullptr && lastEdgeAt > base->at) {
+    pulsesPerSec = (count - base->count) * 1000000.0f / (lastEdgeAt - base->at);
+  }
+
+  // The next edge has not arrived yet, so the period is at least the time since the last edge
+  int64_t sinceLastEdge = now - lastEdgeAt;
+  if (sinceLastEdge > TIMEOUT) {
+    pulsesPerSec = 0;
+  } else if (pulsesPerSec > 0 && sinceLastEdge * pulsesPerSec > 1000000.0f) {
+    pulsesPerSec = 1000000.0f / sinceLastEdge;
+  }
+
+  _pulsesPerSec = pulsesPerSec;
+}
+
+void FlowCounter::reset() {
+  /*
+      Reset the pulse total. Saving is left to checkpoint() on the loop task,
+      so that a reset from the AsyncTCP task never races a checkpoint.
+  */
+  uint64_t count = pulses();
+  portENTER_CRITICAL(&_mux);
+  _totalPulsesBase = 0;
+  _pulsesAtBase = count;
+  portEXIT_CRITICAL(&_mux);
+
+  _resetPending.store(true, std::memory_order_release);
+}
+
+void FlowCounter::setCheckpoint(float volume, unsigned long intervalMs) {
+  /*
+      Set how often the pulse total is saved to NVS.
+      A checkpoint is written when volume [L] has flowed or intervalMs passed with any flow.
+  */
+  if (volume <= 0 || intervalMs == 0) {
+    throw std::invalid_argument("volume and intervalMs must be > 0");
+  }
+  _checkpointVolume = volume;
+  _checkpointInterval = intervalMs;
+}
+
+void FlowCounter::restore() {
+  /*
+      Restore the pulse total from the checkpoint with the latest sequence number.
+  */
+  Preferences preferences;
+  preferences.begin(_namespace, true);
+
+  Checkpoint latest = {0, 0};
+  char key[8];
+  for (int i = 0; i < TOTALIZER_SLOTS; i++) {
+    Checkpoint checkpoint;
+    snprintf(key, sizeof(key), "slot%d", i);
+    if (preferences.getBytesLength(key) != sizeof(checkpoint)) {
+      continue;
+    }
+    preferences.getBytes(key, &checkpoint, sizeof(checkpoint));
+    if (checkpoint.sequence > latest.sequence) {
+      latest = checkpoint;
+    }
+  }
+  preferences.end();
+
+  uint64_t count = pulses();
+  portENTER_CRITICAL(&_mux);
+  _totalPulsesBase = latest.pulses;
+  _pulsesAtBase = count;
+  portEXIT_CRITICAL(&_mux);
+
+  _sequence = latest.sequence;
+  _checkpointPulses = latest.pulses;
+  _checkpointAt = millis();
+}
+
+void FlowCounter::save(uint64_t pulses) {
+  /*
+      Write a checkpoint to the next slot. Slots are rotated to spread flash wear.
+  */
+  Checkpoint checkpoint = {++_sequence, pulses};
+  char key[8];
+  snprintf(key, sizeof(key), "slot%d", static_cast<int>(checkpoint.sequence % TOTALIZER_SLOTS));
+
+  Preferences preferences;
+  preferences.begin(_namespace, false);
+  preferences.putBytes(key, &checkpoint, sizeof(checkpoint));
+  preferences.end();
+
+  _checkpointPulses = pulses;
+  _checkpointAt = millis();
+}
+
+void FlowCounter::checkpoint(const CalibrationCurve& volume) {
+  /*
+      Call from the loop task so that NVS writes never delay sampling.
+      A pending reset is saved right away. The flag is taken before the total is read,
+      so the saved total is never from before the reset.
+  */
+  bool resetPending = _resetPending.exchange(false, std::memory_order_acq_rel);
+  uint64_t total = totalPulses();
+  if (resetPending) {
+    save(total);
+    return;
+  }
+  if (total == _checkpointPulses) {
+    _checkpointAt = millis();
+    return;
+  }
+
+  float flowed = volume.evaluate(static_cast<double>(total)) - volume.evaluate(static_cast<double>(_checkpointPulses));
+  if (flowed >= _checkpointVolume || total < _checkpointPulses ||
+      millis() - _checkpointAt >= _checkpointInterval) {
+    save(total);
+  }
+}
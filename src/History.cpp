@@ -0,0 +1,343 @@
+#include "History.h"
+
+#include <algorithm>
+#include <cmath>
+#include <new>
+
+namespace {
+// Seconds per point and share of the memory budget [%] of each tier
+const uint32_t TIER_STEPS[History::TIERS] = {1, 60, 3600};
+const int TIER_SHARES[History::TIERS] = {50, 30, 20};
+
+int32_t clampDelta(int32_t value) {
+  return std::min<int32_t>(std::max<int32_t>(value, INT16_MIN), INT16_MAX);
+}
+
+uint16_t clampOffset(int32_t value) {
+  return std::min<int32_t>(std::max<int32_t>(value, 0), UINT16_MAX);
+}
+
+void merge(float& min, float& max, float value) {
+  min = std::min(min, value);
+  max = std::max(max, value);
+}
+}  // namespace
+
+History::History() {
+  for (Tier& tier : _tiers) {
+    tier = {};
+  }
+}
+
+History::~History() {
+  if (_mutex != nullptr) {
+    vSemaphoreDelete(_mutex);
+  }
+  delete[] _storage;
+}
+
+bool History::begin(size_t fields, const char* const* names, const float* scales, size_t memoryBudget) {
+  /*
+      Allocate ring buffers for fields within memoryBudget bytes.
+      Returns false if the budget is too small or allocation fails.
+  */
+  if (_storage != nullptr || fields == 0 || fields > MAX_FIELDS) {
+    return false;
+  }
+
+  size_t capacities[TIERS];
+  size_t total = 0;
+  for (int i = 0; i < TIERS; i++) {
+    capacities[i] = memoryBudget * TIER_SHARES[i] / 100 / (fields * sizeof(Point));
+    if (capacities[i] < 2) {
+      return false;
+    }
+    total += capacities[i];
+  }
+
+  _mutex = xSemaphoreCreateMutex();
+  if (_mutex == nullptr) {
+    return false;
+  }
+  _storage = new (std::nothrow) Point[total * fields];
+  if (_storage == nullptr) {
+    vSemaphoreDelete(_mutex);
+    _mutex = nullptr;
+    return false;
+  }
+
+  _fields = fields;
+  _names = names;
+  _scales = scales;
+  _memoryUsage = total * fields * sizeof(Point);
+
+  Point* points = _storage;
+  for (int i = 0; i < TIERS; i++) {
+    _tiers[i] = {};
+    _tiers[i].step = TIER_STEPS[i];
+    _tiers[i].capacity = capacities[i];
+    _tiers[i].points = points;
+    points += capacities[i] * fields;
+  }
+  return true;
+}
+
+int History::fieldIndex(const char* name) const {
+  for (size_t i = 0; i < _fields; i++) {
+    if (strcmp(_names[i], name) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+void History::add(unsigned long time, const float* values) {
+  /*
+      Add a sample taken at time [ms].
+      History restarts when millis() wraps around.
+  */
+  if (!isEnabled()) {
+    return;
+  }
+
+  Aggregate sample[MAX_FIELDS];
+  for (size_t f = 0; f < _fields; f++) {
+    sample[f] = {values[f], values[f], values[f], 1};
+  }
+
+  xSemaphoreTake(_mutex, portMAX_DELAY);
+  accumulate(0, time / 1000, sample);
+  xSemaphoreGive(_mutex);
+}
+
+void History::accumulate(int tier, uint32_t bucket, const Aggregate* values) {
+  /*
+      Roll values up into the pending point of tier.
+      When bucket moves on, the pending point is pushed to the tier.
+  */
+  Tier& t = _tiers[tier];
+  if (t.pending[0].count > 0 && bucket != t.pendingBucket) {
+    push(tier, t.pendingBucket, t.pending);
+    for (size_t f = 0; f < _fields; f++) {
+      t.pending[f] = {};
+    }
+  }
+
+  t.pendingBucket = bucket;
+  for (size_t f = 0; f < _fields; f++) {
+    Aggregate& pending = t.pending[f];
+    if (pending.count == 0) {
+      pending = values[f];
+      continue;
+    }
+    merge(pending.min, pending.max, values[f].min);
+    merge(pending.min, pending.max, values[f].max);
+    pending.sum += values[f].sum;
+    pending.count += values[f].count;
+  }
+}
+
+void History::push(int tier, uint32_t bucket, const Aggregate* values) {
+  /*
+      Append a point to tier and roll it up into the next tier.
+  */
+  Tier& t = _tiers[tier];
+
+  // Restart if time went back, and fill short gaps with the latest point
+  if (t.size > 0 && bucket <= t.newestBucket) {
+    t.size = 0;
+  } else if (t.size > 0 && bucket - t.newestBucket - 1 >= t.capacity) {
+    t.size = 0;
+  } else if (t.size > 0) {
+    Aggregate latest[MAX_FIELDS];
+    for (size_t f = 0; f < _fields; f++) {
+      float value = t.newest[f] / _scales[f];
+      latest[f] = {value, value, value, 1};
+    }
+    for (uint32_t gap = t.newestBucket + 1; gap < bucket; gap++) {
+      append(t, latest);
+    }
+  }
+
+  Aggregate point[MAX_FIELDS];
+  for (size_t f = 0; f < _fields; f++) {
+    float avg = values[f].sum / values[f].count;
+    point[f] = {values[f].min, values[f].max, avg, 1};
+  }
+  append(t, point);
+  t.newestBucket = bucket;
+
+  if (tier + 1 < TIERS) {
+    accumulate(tier + 1, bucket * t.step / _tiers[tier + 1].step, point);
+  }
+}
+
+void History::append(Tier& tier, const Aggregate* values) {
+  /*
+      Delta-encode a point into the ring, overwriting the oldest point if full.
+  */
+  if (tier.size == tier.capacity) {
+    // The next point becomes the oldest, so its absolute value is restored from its delta
+    size_t next = (tier.start + 1) % tier.capacity;
+    for (size_t f = 0; f < _fields; f++) {
+      tier.oldest[f] += tier.points[next * _fields + f].avgDelta;
+    }
+    tier.start = next;
+    tier.size--;
+  }
+
+  size_t index = (tier.start + tier.size) % tier.capacity;
+  for (size_t f = 0; f < _fields; f++) {
+    float scale = _scales[f];
+    int32_t avg = lroundf(values[f].sum / values[f].count * scale);
+
+    // Deltas are taken from the reconstructed value, so a clamped jump catches up in the next points
+    int32_t delta = 0;
+    if (tier.size == 0) {
+      tier.oldest[f] = avg;
+      tier.newest[f] = avg;
+    } else {
+      delta = clampDelta(avg - tier.newest[f]);
+      tier.newest[f] += delta;
+    }
+
+    Point& point = tier.points[index * _fields + f];
+    point.avgDelta = delta;
+    point.minOffset = clampOffset(tier.newest[f] - lroundf(values[f].min * scale));
+    point.maxOffset = clampOffset(lroundf(values[f].max * scale) - tier.newest[f]);
+  }
+  tier.size++;
+}
+
+void History::query(Print& out, int field, unsigned long from, unsigned long to, unsigned long step) {
+  /*
+      Write points of field between from and to [ms] as a JSON array of [time, avg, min, max].
+      The coarsest tier whose step does not exceed step [ms] is used, falling back to
+      coarser tiers if it no longer holds from. Points are merged to match step.
+
+      Points are copied in chunks under the lock and written after releasing it,
+      so a slow client never blocks add().
+  */
+  out.print("[");
+  if (!isEnabled() || field < 0 || static_cast<size_t>(field) >= _fields) {
+    out.print("]");
+    return;
+  }
+
+  uint32_t fromSec = from / 1000;
+  uint32_t toSec = to / 1000;
+  uint32_t stepSec = std::max<uint32_t>(step / 1000, 1);
+
+  struct Copy {
+    uint32_t bucket;
+    int32_t value;  // Quantized avg
+    uint16_t minOffset;
+    uint16_t maxOffset;
+  };
+  Copy chunk[QUERY_CHUNK];
+
+  int index = -1;
+  float scale = _scales[field];
+  int decimals = scale >= 100 ? 2 : (scale >= 10 ? 1 : 0);
+  uint32_t tierStep = 1;
+  uint32_t outStep = 1;
+
+  // The last copied point. Deltas of the next points are applied to its value.
+  bool started = false;
+  uint32_t lastBucket = 0;
+  int32_t lastValue = 0;
+
+  bool first = true;
+  bool hasBucket = false;
+  uint32_t bucket = 0;
+  float sum = 0, min = 0, max = 0;
+  uint32_t count = 0;
+  auto emit = [&]() {
+    out.printf("%s[%lu,%.*f,%.*f,%.*f]", first ? "" : ",",
+               static_cast<unsigned long>(bucket) * outStep * 1000,
+               decimals, sum / count, decimals, min, decimals, max);
+    first = false;
+  };
+
+  bool done = false;
+  while (!done) {
+    size_t copied = 0;
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+
+    if (index < 0) {
+      index = 0;
+      for (int i = 0; i < TIERS; i++) {
+        if (_tiers[i].step <= stepSec) {
+          index = i;
+        }
+      }
+      while (index + 1 < TIERS && _tiers[index + 1].size > 0) {
+        const Tier& t = _tiers[index];
+        uint32_t oldestSec = (t.newestBucket - (t.size - 1)) * t.step;
+        if (t.size > 0 && oldestSec <= fromSec) {
+          break;
+        }
+        index++;
+      }
+      tierStep = _tiers[index].step;
+      outStep = (stepSec + tierStep - 1) / tierStep * tierStep;
+    }
+
+    const Tier& tier = _tiers[index];
+    uint32_t oldestBucket = tier.newestBucket - (tier.size - 1);
+    size_t i = 0;
+    int32_t value = lastValue;
+    if (started && (tier.size == 0 || tier.newestBucket < lastBucket)) {
+      // History restarted since the last chunk
+      i = tier.size;
+    } else if (started && lastBucket >= oldestBucket) {
+      i = lastBucket - oldestBucket + 1;
+    }
+
+    for (; i < tier.size && copied < QUERY_CHUNK; i++) {
+      const Point& point = tier.points[((tier.start + i) % tier.capacity) * _fields + field];
+      value = i == 0 ? tier.oldest[field] : value + point.avgDelta;
+      lastBucket = oldestBucket + i;
+      lastValue = value;
+      started = true;
+
+      uint32_t time = lastBucket * tier.step;
+      if (time > toSec) {
+        break;
+      }
+      if (time >= fromSec) {
+        chunk[copied++] = {lastBucket, value, point.minOffset, point.maxOffset};
+      }
+    }
+    done = i >= tier.size || lastBucket * tier.step > toSec;
+    xSemaphoreGive(_mutex);
+
+    for (size_t c = 0; c < copied; c++) {
+      const Copy& point = chunk[c];
+      uint32_t time = point.bucket * tierStep;
+      float avg = point.value / scale;
+      float pointMin = (point.value - point.minOffset) / scale;
+      float pointMax = (point.value + point.maxOffset) / scale;
+      if (hasBucket && time / outStep != bucket) {
+        emit();
+        hasBucket = false;
+      }
+      if (!hasBucket) {
+        bucket = time / outStep;
+        sum = 0;
+        count = 0;
+        min = pointMin;
+        max = pointMax;
+        hasBucket = true;
+      }
+      sum += avg;
+      count++;
+      merge(min, max, pointMin);
+      merge(min, max, pointMax);
+    }
+  }
+  if (hasBucket) {
+    emit();
+  }
+  out.print("]");
+}
@@ -0,0 +1,93 @@
+#include "JsonBuffer.h"
+
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+
+void JsonBuffer::put(char c) {
+  if (_length + 1 >= SIZE) {
+    _overflowed = true;
+    return;
+  }
+  _buffer[_length++] = c;
+  _buffer[_length] = '\0';
+}
+
+JsonBuffer& JsonBuffer::raw(const char* text) {
+  while (*text != '\0') {
+    put(*text++);
+  }
+  return *this;
+}
+
+JsonBuffer& JsonBuffer::printf(const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  int written = vsnprintf(_buffer + _length, SIZE - _length, format, args);
+  va_end(args);
+
+  if (written < 0 || _length + written >= SIZE) {
+    // Keep the buffer as it was, so a truncated token never appears in the body
+    _buffer[_length] = '\0';
+    _overflowed = true;
+  } else {
+    _length += written;
+  }
+  return *this;
+}
+
+JsonBuffer& JsonBuffer::value(bool value) {
+  return raw(value ? "true" : "false");
+}
+
+JsonBuffer& JsonBuffer::value(int value) {
+  return printf("%d", value);
+}
+
+JsonBuffer& JsonBuffer::value(long value) {
+  return printf("%ld", value);
+}
+
+JsonBuffer& JsonBuffer::value(unsigned int value) {
+  return printf("%u", value);
+}
+
+JsonBuffer& JsonBuffer::value(unsigned long value) {
+  return printf("%lu", value);
+}
+
+JsonBuffer& JsonBuffer::value(float value) {
+  // 7 significant digits cover float precision, so 24.1f is printed as 24.1
+  if (!std::isfinite(value)) {
+    return raw("null");
+  }
+  return printf("%.7g", value);
+}
+
+JsonBuffer& JsonBuffer::value(double value) {
+  if (!std::isfinite(value)) {
+    return raw("null");
+  }
+  return printf("%.15g", value);
+}
+
+JsonBuffer& JsonBuffer::value(const char* value) {
+  put('"');
+  for (; *value != '\0'; value++) {
+    char c = *value;
+    if (c == '"' || c == '\\') {
+      put('\\');
+      put(c);
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      printf("\\u%04x", c);
+    } else {
+      put(c);
+    }
+  }
+  put('"');
+  return *this;
+}
+
+JsonBuffer& JsonBuffer::value(const IPAddress& value) {
+  return printf("\"%u.%u.%u.%u\"", value[0], value[1], value[2], value[3]);
+}
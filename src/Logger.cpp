@@ -0,0 +1,186 @@
+#include "Logger.h"
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+const char* const LEVEL_NAMES[] = {"debug", "info", "warn", "error", "none"};
+const TickType_t DRAIN_INTERVAL = pdMS_TO_TICKS(20);
+}  // namespace
+
+void Logger::begin(Print& out, int priority) {
+  /*
+      Start the task which writes lines to out.
+      Lines logged before begin() are kept and written once it starts.
+  */
+  if (_task != nullptr) {
+    return;
+  }
+  _out = &out;
+  xTaskCreate(drainTask, "logger", 3072, this, priority, &_task);
+}
+
+void Logger::log(LogLevel level, const char* format, ...) {
+  /*
+      Format a line into the ring. Never waits: the line is dropped if the ring is full.
+  */
+  if (!enabled(level)) {
+    return;
+  }
+
+  // Claim a free line
+  uint32_t ticket = _head.load(std::memory_order_relaxed);
+  do {
+    if (ticket - _drained.load(std::memory_order_acquire) >= LINES) {
+      _dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+  } while (!_head.compare_exchange_weak(ticket, ticket + 1, std::memory_order_acq_rel));
+
+  Line& line = _lines[ticket % LINES];
+  line.seq.store((ticket << 1) | 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  int length = snprintf(line.text, LINE_SIZE, "[%lu][%s] ", millis(), levelName(level));
+  if (length > 0 && static_cast<size_t>(length) < LINE_SIZE) {
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line.text + length, LINE_SIZE - length, format, args);
+    va_end(args);
+  }
+
+  line.seq.store((ticket + 1) << 1, std::memory_order_release);
+}
+
+void Logger::setPathSampling(const char* path, uint16_t every) {
+  /*
+      A new path is published by incrementing the count after it is written, so sample() may run
+      on other tasks meanwhile. Paths are never removed.
+  */
+  int count = _sampledPathCount.load(std::memory_order_acquire);
+  for (int i = 0; i < count; i++) {
+    if (strcmp(_sampledPaths[i].path, path) == 0) {
+      _sampledPaths[i].every.store(every, std::memory_order_relaxed);
+      return;
+    }
+  }
+  if (path[0] == '\0' || strlen(path) >= sizeof(SampledPath::path)) {
+    throw std::invalid_argument("Sampled path must be 1 to 31 characters");
+  }
+  if (count == MAX_SAMPLED_PATHS) {
+    throw std::invalid_argument("Cannot sample more paths");
+  }
+  SampledPath& sampled = _sampledPaths[count];
+  strcpy(sampled.path, path);
+  sampled.every.store(every, std::memory_order_relaxed);
+  sampled.count = 0;
+  _sampledPathCount.store(count + 1, std::memory_order_release);
+}
+
+bool Logger::sample(const char* path) {
+  /*
+      Returns true if a request to path should be logged.
+  */
+  int count = _sampledPathCount.load(std::memory_order_acquire);
+  for (int i = 0; i < count; i++) {
+    SampledPath& sampled = _sampledPaths[i];
+    if (strcmp(sampled.path, path) == 0) {
+      uint16_t every = sampled.every.load(std::memory_order_relaxed);
+      if (every == 0) {
+        return false;
+      }
+      return sampled.count.fetch_add(1, std::memory_order_relaxed) % every == 0;
+    }
+  }
+  return true;
+}
+
+void Logger::drain() {
+  /*
+      Write completed lines in order. Stops at a line which is still being written.
+  */
+  uint32_t ticket = _drained.load(std::memory_order_relaxed);
+  while (ticket != _head.load(std::memory_order_acquire)) {
+    const Line& line = _lines[ticket % LINES];
+    if (line.seq.load(std::memory_order_acquire) != (ticket + 1) << 1) {
+      break;
+    }
+    _out->write(reinterpret_cast<const uint8_t*>(line.text), strnlen(line.text, LINE_SIZE));
+    _out->write('\n');
+    ticket++;
+    _drained.store(ticket, std::memory_order_release);
+  }
+}
+
+void Logger::drainTask(void* arg) {
+  Logger* logger = static_cast<Logger*>(arg);
+  uint32_t reportedDropped = 0;
+  while (true) {
+    logger->drain();
+
+    uint32_t dropped = logger->dropped();
+    if (dropped != reportedDropped) {
+      logger->_out->printf("[logger] %lu lines dropped\n", static_cast<unsigned long>(dropped - reportedDropped));
+      reportedDropped = dropped;
+    }
+    vTaskDelay(DRAIN_INTERVAL);
+  }
+}
+
+void Logger::tail(Print& out, size_t lines) const {
+  /*
+      Lines being overwritten while they are copied are skipped.
+  */
+  // Lines not drained yet are included. Lines older than LINES before head are gone.
+  uint32_t end = _head.load(std::memory_order_acquire);
+  uint32_t oldest = end > LINES ? end - LINES : 0;
+  uint32_t start = end - oldest > lines ? end - lines : oldest;
+
+  out.print("[");
+  bool first = true;
+  char text[LINE_SIZE];
+  for (uint32_t ticket = start; ticket != end; ticket++) {
+    const Line& line = _lines[ticket % LINES];
+    uint32_t expected = (ticket + 1) << 1;
+    if (line.seq.load(std::memory_order_acquire) != expected) {
+      continue;
+    }
+    memcpy(text, line.text, LINE_SIZE);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (line.seq.load(std::memory_order_relaxed) != expected) {
+      continue;
+    }
+    text[LINE_SIZE - 1] = '\0';
+
+    out.print(first ? "\"" : ",\"");
+    for (const char* c = text; *c != '\0'; c++) {
+      if (*c == '"' || *c == '\\') {
+        out.write('\\');
+        out.write(*c);
+      } else if (static_cast<unsigned char>(*c) < 0x20) {
+        out.print(" ");
+      } else {
+        out.write(*c);
+      }
+    }
+    out.print("\"");
+    first = false;
+  }
+  out.print("]");
+}
+
+const char* Logger::levelName(LogLevel level) {
+  return LEVEL_NAMES[static_cast<int>(level)];
+}
+
+bool Logger::parseLevel(const char* name, LogLevel& level) {
+  for (int i = 0; i <= static_cast<int>(LogLevel::None); i++) {
+    if (strcmp(LEVEL_NAMES[i], name) == 0) {
+      level = static_cast<LogLevel>(i);
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,436 @@
+#include "MQTTPublisher.h"
+
+#include <LittleFS.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+// Limit messages per cycle so that a long backlog does not delay sampling
+const int MAX_BATCHES_PER_CYCLE = 4;
+const TickType_t CYCLE = pdMS_TO_TICKS(10);
+const TickType_t IDLE_CYCLE = pdMS_TO_TICKS(100);
+
+// Numeric keys used with short keys
+enum Key : uint8_t {
+  KEY_TDS = 1,
+  KEY_FLOW,
+  KEY_TOTAL_FLOW,
+  KEY_TEMPERATURE,
+  KEY_TIME,
+};
+
+// Room for the array header of a batch (at most 3 bytes in any format)
+const size_t BATCH_HEADER_SIZE = 3;
+}  // namespace
+
+MQTTPublisher::MQTTPublisher(CoreModule& module, Client& client) : _module(module), _mqtt(client) {}
+
+void MQTTPublisher::setServer(const char* host, uint16_t port) {
+  /*
+      host is not copied, so it must outlive the publisher.
+  */
+  _mqtt.setServer(host, port);
+}
+
+void MQTTPublisher::enableSpool(const char* path, size_t maxBytes) {
+  /*
+      Samples in the spool are timestamped with millis(), so a spool left from
+      before a reboot is discarded.
+  */
+  if (!LittleFS.begin(true)) {
+    throw std::runtime_error("Failed to mount LittleFS");
+  }
+  if (LittleFS.exists(path)) {
+    LittleFS.remove(path);
+  }
+  _spoolEnabled = true;
+  _spoolPath = path;
+  _spoolMaxBytes = maxBytes;
+}
+
+void MQTTPublisher::begin(int core, int priority) {
+  if (_task != nullptr) {
+    return;
+  }
+  _mqtt.setBufferSize(PAYLOAD_SIZE + 128);
+  _mqtt.setSocketTimeout(5);
+  xTaskCreatePinnedToCore(publisherTask, "mqtt", 6144, this, priority, &_task, core);
+  xTaskCreatePinnedToCore(samplerTask, "mqtt_sample", 3072, this, priority, &_samplerTask, core);
+  _module.registerTask("mqtt", _task);
+  _module.registerTask("mqtt_sample", _samplerTask);
+}
+
+void MQTTPublisher::publisherTask(void* arg) {
+  static_cast<MQTTPublisher*>(arg)->run();
+}
+
+void MQTTPublisher::samplerTask(void* arg) {
+  static_cast<MQTTPublisher*>(arg)->sample();
+}
+
+void MQTTPublisher::sample() {
+  /*
+      Queue a sample every publish interval whether or not the broker is reachable.
+  */
+  while (true) {
+    if (!_module.isPublishing()) {
+      _samplerSession.reset();
+      vTaskDelay(IDLE_CYCLE);
+      continue;
+    }
+    if (!_samplerSession || _samplerSession->session != _module.publishSession()) {
+      _samplerSession = _module.publishSettings();
+      _hasReported = false;
+      _sampledAt = millis() - _samplerSession->interval;
+    }
+
+    unsigned long now = millis();
+    if (now - _sampledAt >= static_cast<unsigned long>(_samplerSession->interval)) {
+      if (_samplerSession->policy.onChange) {
+        reportByException(_module.getSensorValues(), now);
+      } else {
+        enqueue(_module.getSensorValues(), ALL);
+      }
+      _sampledAt = now;
+    }
+    vTaskDelay(CYCLE);
+  }
+}
+
+void MQTTPublisher::run() {
+  while (true) {
+    if (!_module.isPublishing()) {
+      if (_session) {
+        endSession();
+      }
+      vTaskDelay(IDLE_CYCLE);
+      continue;
+    }
+    if (!_session || _session->session != _module.publishSession()) {
+      startSession();
+    }
+    makeRoom();
+
+    // Blocks this task until the broker answers or the connection times out
+    unsigned long now = millis();
+    if (!_mqtt.connected() && static_cast<long>(now - _connectAt) >= 0) {
+      if (connect()) {
+        _backoff = MIN_BACKOFF;
+      } else {
+        _module.logger().log(LogLevel::Warn, "MQTT connect failed: state %d, retry in %lu ms", _mqtt.state(), _backoff);
+        _connectAt = now + _backoff;
+        _backoff = std::min(_backoff * 2, MAX_BACKOFF);
+      }
+    }
+
+    _connected = _mqtt.connected();
+    if (_connected) {
+      publishBacklog();
+      _mqtt.loop();
+    }
+    vTaskDelay(CYCLE);
+  }
+}
+
+void MQTTPublisher::startSession() {
+  /*
+      Encode metadata given to /publish/start once, as entries prepended to every sample.
+      A new session reconnects, since client_id may have changed.
+  */
+  if (_session) {
+    _mqtt.disconnect();
+  }
+
+  _session = _module.publishSettings();
+  _format = _session->format;
+  _shortKeys = _session->shortKeys;
+
+  JsonDocument metadata = _session->metadata;
+  PayloadWriter writer(_format, _metadata, METADATA_SIZE);
+  _metadataEntries = 0;
+  for (JsonPair pair : metadata.as<JsonObject>()) {
+    writer.key(pair.key().c_str());
+    writer.value(pair.value().as<const char*>());
+    _metadataEntries++;
+  }
+  if (writer.overflowed()) {
+    _module.logger().log(LogLevel::Warn, "MQTT metadata exceeds %u bytes and is not published", static_cast<unsigned>(METADATA_SIZE));
+    _metadataEntries = 0;
+  }
+  _metadataLength = _metadataEntries > 0 ? writer.length() : 0;
+
+  _connectAt = millis();
+  _backoff = MIN_BACKOFF;
+}
+
+void MQTTPublisher::endSession() {
+  /*
+      Samples not published yet are discarded when publishing is ended.
+  */
+  _mqtt.disconnect();
+  _connected = false;
+  _session.reset();
+
+  _queueTail.store(_queueHead.load(std::memory_order_acquire), std::memory_order_release);
+  if (_spoolSize > 0) {
+    LittleFS.remove(_spoolPath.c_str());
+    _spoolSize = 0;
+    _spoolReadOffset = 0;
+  }
+  updateSpooled();
+}
+
+bool MQTTPublisher::connect() {
+  if (WiFi.status() != WL_CONNECTED) {
+    return false;
+  }
+  return _mqtt.connect(_mqttClientId.c_str(), _session->clientId.c_str(), nullptr);
+}
+
+void MQTTPublisher::reportByException(const SensorValues& values, unsigned long now) {
+  /*
+      Queue the fields which moved out of their deadbands since they were last reported.
+      Changes within minInterval of the last report are held back and compared again later.
+  */
+  float current[PublishPolicy::FIELDS] = {static_cast<float>(values.tds), values.flow, values.totalFlow, values.temperature};
+
+  const PublishPolicy& policy = _samplerSession->policy;
+  uint8_t fields = 0;
+  if (!_hasReported || now - _fullReportedAt >= policy.heartbeat) {
+    fields = ALL;
+    _fullReportedAt = now;
+  } else if (now - _reportedAt >= policy.minInterval) {
+    for (int i = 0; i < PublishPolicy::FIELDS; i++) {
+      if (policy.deadbands[i].exceeded(current[i], _reported[i])) {
+        fields |= 1 << i;
+      }
+    }
+  }
+  if (fields == 0) {
+    return;
+  }
+
+  for (int i = 0; i < PublishPolicy::FIELDS; i++) {
+    if (fields & (1 << i)) {
+      _reported[i] = current[i];
+    }
+  }
+  _hasReported = true;
+  _reportedAt = now;
+  enqueue(values, fields);
+}
+
+void MQTTPublisher::enqueue(const SensorValues& values, uint8_t fields) {
+  /*
+      Called by the sampler task. The publisher task keeps HEADROOM free, so the queue is only
+      full if it has been blocked for that many samples. Then the new sample is dropped.
+  */
+  uint32_t head = _queueHead.load(std::memory_order_relaxed);
+  if (head - _queueTail.load(std::memory_order_acquire) == QUEUE_SIZE) {
+    _dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  _queue[head % QUEUE_SIZE] = {values, fields};
+  _queueHead.store(head + 1, std::memory_order_release);
+}
+
+void MQTTPublisher::makeRoom() {
+  /*
+      Keep HEADROOM free in the queue by spilling or dropping the oldest samples, so that the
+      latest samples are kept.
+  */
+  uint32_t tail = _queueTail.load(std::memory_order_relaxed);
+  size_t queued = _queueHead.load(std::memory_order_acquire) - tail;
+  if (queued + HEADROOM <= QUEUE_SIZE) {
+    return;
+  }
+  if (_spoolEnabled) {
+    spill();
+  } else {
+    size_t count = queued + HEADROOM - QUEUE_SIZE;
+    _queueTail.store(tail + count, std::memory_order_release);
+    _dropped.fetch_add(count, std::memory_order_relaxed);
+  }
+}
+
+void MQTTPublisher::spill() {
+  /*
+      Move the older half of the queue to the spool.
+      If the spool or the flash is full, the samples which do not fit are dropped.
+  */
+  size_t count = QUEUE_SIZE / 2;
+  size_t bytes = count * sizeof(Sample);
+  uint32_t tail = _queueTail.load(std::memory_order_relaxed);
+  if (_spoolSize + bytes > _spoolMaxBytes) {
+    _queueTail.store(tail + count, std::memory_order_release);
+    _dropped.fetch_add(count, std::memory_order_relaxed);
+    return;
+  }
+
+  // Records are written at _spoolSize, over the bytes of a record which was cut short
+  File file = LittleFS.open(_spoolPath.c_str(), _spoolSize > 0 ? "r+" : FILE_WRITE);
+  if (!file || !file.seek(_spoolSize)) {
+    _queueTail.store(tail + count, std::memory_order_release);
+    _dropped.fetch_add(count, std::memory_order_relaxed);
+    return;
+  }
+  size_t spilled = 0;
+  while (spilled < count) {
+    const Sample& record = _queue[(tail + spilled) % QUEUE_SIZE];
+    if (file.write(reinterpret_cast<const uint8_t*>(&record), sizeof(record)) != sizeof(record)) {
+      // Flash is full: the spool ends at the last whole record, and the rest is dropped
+      break;
+    }
+    _spoolSize += sizeof(record);
+    spilled++;
+  }
+  file.close();
+  _queueTail.store(tail + count, std::memory_order_release);
+  _dropped.fetch_add(count - spilled, std::memory_order_relaxed);
+  updateSpooled();
+}
+
+bool MQTTPublisher::publishBacklog() {
+  /*
+      Publish queued samples in batches, spooled ones first.
+      Samples are removed only after the broker accepted them.
+  */
+  Sample records[BATCH_SIZE];
+  size_t published;
+  for (int batch = 0; batch < MAX_BATCHES_PER_CYCLE; batch++) {
+    uint32_t tail = _queueTail.load(std::memory_order_relaxed);
+    size_t queued = _queueHead.load(std::memory_order_acquire) - tail;
+    if (_spoolSize > _spoolReadOffset) {
+      File file = LittleFS.open(_spoolPath.c_str(), FILE_READ);
+      size_t count = 0;
+      if (file) {
+        // Bytes past _spoolSize belong to a record which was cut short
+        file.seek(_spoolReadOffset);
+        size_t bytes = std::min(sizeof(records), _spoolSize - _spoolReadOffset);
+        count = file.read(reinterpret_cast<uint8_t*>(records), bytes) / sizeof(Sample);
+        file.close();
+      }
+      if (count > 0 && !publishBatch(records, count, published)) {
+        return false;
+      }
+      _spoolReadOffset = count > 0 ? _spoolReadOffset + published * sizeof(Sample) : _spoolSize;
+      if (_spoolReadOffset >= _spoolSize) {
+        LittleFS.remove(_spoolPath.c_str());
+        _spoolSize = 0;
+        _spoolReadOffset = 0;
+      }
+      updateSpooled();
+    } else if (queued > 0) {
+      size_t count = std::min<size_t>(queued, BATCH_SIZE);
+      for (size_t i = 0; i < count; i++) {
+        records[i] = _queue[(tail + i) % QUEUE_SIZE];
+      }
+      if (!publishBatch(records, count, published)) {
+        return false;
+      }
+      _queueTail.store(tail + published, std::memory_order_release);
+    } else {
+      break;
+    }
+  }
+  return true;
+}
+
+bool MQTTPublisher::publishBatch(const Sample* records, size_t count, size_t& published) {
+  /*
+      Publish as many of records as fit in a message.
+      A single sample is sent as a map, and several samples as an array of maps.
+  */
+  size_t length = 0;
+  published = 0;
+  if (count == 1) {
+    length = encode(records[0], _payload, PAYLOAD_SIZE);
+    published = length > 0 ? 1 : 0;
+  } else {
+    // Encode samples after room for the array header, as the header depends on how many fit
+    bool json = _format == PayloadFormat::JSON;
+    size_t end = BATCH_HEADER_SIZE;
+    while (published < count) {
+      // In JSON, leave room for a comma and the closing bracket
+      size_t separator = json && published > 0 ? 1 : 0;
+      size_t reserved = json ? 1 : 0;
+      if (end + separator + reserved >= PAYLOAD_SIZE) {
+        break;
+      }
+      size_t written = encode(records[published], _payload + end + separator, PAYLOAD_SIZE - end - separator - reserved);
+      if (written == 0) {
+        break;
+      }
+      if (separator > 0) {
+        _payload[end] = ',';
+      }
+      end += separator + written;
+      published++;
+    }
+
+    if (published > 0) {
+      uint8_t header[BATCH_HEADER_SIZE];
+      PayloadWriter writer(_format, header, sizeof(header));
+      writer.beginArray(published);
+      memmove(_payload + writer.length(), _payload + BATCH_HEADER_SIZE, end - BATCH_HEADER_SIZE);
+      memcpy(_payload, header, writer.length());
+      length = end - BATCH_HEADER_SIZE + writer.length();
+      if (json) {
+        _payload[length++] = ']';
+      }
+    }
+  }
+
+  if (published == 0) {
+    // A sample which never fits a message is dropped so that it does not block the queue
+    _dropped.fetch_add(1, std::memory_order_relaxed);
+    published = 1;
+    return true;
+  }
+  return _mqtt.publish(_topic.c_str(), _payload, length);
+}
+
+void MQTTPublisher::key(PayloadWriter& writer, const char* name, uint8_t id) const {
+  if (_shortKeys) {
+    writer.key(id);
+  } else {
+    writer.key(name);
+  }
+}
+
+size_t MQTTPublisher::encode(const Sample& sample, uint8_t* buffer, size_t size) const {
+  /*
+      Encode the fields of a sample and its time as a map. Returns 0 if it does not fit in size.
+      time is uptime [ms], not an epoch "ts" (see the class comment).
+  */
+  const SensorValues& values = sample.values;
+  PayloadWriter writer(_format, buffer, size);
+  writer.beginMap(_metadataEntries + __builtin_popcount(sample.fields) + 1);
+  writer.raw(_metadata, _metadataLength, _metadataEntries);
+  if (sample.fields & TDS) {
+    key(writer, "tds", KEY_TDS);
+    writer.value(static_cast<int32_t>(values.tds));
+  }
+  if (sample.fields & FLOW) {
+    key(writer, "flow", KEY_FLOW);
+    writer.value(values.flow);
+  }
+  if (sample.fields & TOTAL_FLOW) {
+    key(writer, "totalFlow", KEY_TOTAL_FLOW);
+    writer.value(values.totalFlow);
+  }
+  if (sample.fields & TEMPERATURE) {
+    key(writer, "temperature", KEY_TEMPERATURE);
+    writer.value(values.temperature);
+  }
+  key(writer, "time", KEY_TIME);
+  writer.value(static_cast<uint32_t>(values.timestamp));
+  writer.endMap();
+  return writer.overflowed() ? 0 : writer.length();
+}
+
+void MQTTPublisher::updateSpooled() {
+  _spooled.store((_spoolSize - _spoolReadOffset) / sizeof(Sample), std::memory_order_relaxed);
+}
@@ -0,0 +1,302 @@
+#include "PayloadWriter.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+namespace {
+// CBOR major types
+const uint8_t CBOR_UNSIGNED = 0;
+const uint8_t CBOR_NEGATIVE = 1;
+const uint8_t CBOR_TEXT = 3;
+const uint8_t CBOR_ARRAY = 4;
+const uint8_t CBOR_MAP = 5;
+
+const char* const FORMAT_NAMES[] = {"json", "msgpack", "cbor"};
+}  // namespace
+
+PayloadWriter::PayloadWriter(PayloadFormat format, uint8_t* buffer, size_t size)
+    : _format(format), _buffer(buffer), _size(size) {}
+
+void PayloadWriter::put(uint8_t byte) {
+  if (_length >= _size) {
+    _overflowed = true;
+    return;
+  }
+  _buffer[_length++] = byte;
+}
+
+void PayloadWriter::put(const void* data, size_t length) {
+  if (_length + length > _size) {
+    _overflowed = true;
+    return;
+  }
+  memcpy(_buffer + _length, data, length);
+  _length += length;
+}
+
+void PayloadWriter::putBigEndian(uint32_t value, int bytes) {
+  for (int i = bytes - 1; i >= 0; i--) {
+    put(static_cast<uint8_t>(value >> (i * 8)));
+  }
+}
+
+void PayloadWriter::putHeader(uint8_t major, uint32_t value) {
+  /*
+      CBOR initial byte with the argument in the shortest form
+  */
+  if (value < 24) {
+    put((major << 5) | value);
+  } else if (value <= UINT8_MAX) {
+    put((major << 5) | 24);
+    putBigEndian(value, 1);
+  } else if (value <= UINT16_MAX) {
+    put((major << 5) | 25);
+    putBigEndian(value, 2);
+  } else {
+    put((major << 5) | 26);
+    putBigEndian(value, 4);
+  }
+}
+
+void PayloadWriter::separate() {
+  /*
+      Put a comma before a key or an array item in JSON, except for the first one.
+  */
+  if (_afterKey) {
+    _afterKey = false;
+    return;
+  }
+  if (_hasEntry[_depth]) {
+    put(',');
+  }
+  _hasEntry[_depth] = true;
+}
+
+void PayloadWriter::putText(const char* text) {
+  size_t length = strlen(text);
+  switch (_format) {
+    case PayloadFormat::JSON:
+      put('"');
+      for (const char* c = text; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\') {
+          put('\\');
+        }
+        put(static_cast<uint8_t>(*c) < 0x20 ? ' ' : *c);
+      }
+      put('"');
+      break;
+    case PayloadFormat::MessagePack:
+      if (length < 32) {
+        put(0xa0 | length);
+      } else if (length <= UINT8_MAX) {
+        put(0xd9);
+        putBigEndian(length, 1);
+      } else {
+        put(0xda);
+        putBigEndian(length, 2);
+      }
+      put(text, length);
+      break;
+    case PayloadFormat::CBOR:
+      putHeader(CBOR_TEXT, length);
+      put(text, length);
+      break;
+  }
+}
+
+void PayloadWriter::beginMap(size_t entries) {
+  switch (_format) {
+    case PayloadFormat::JSON:
+      separate();
+      put('{');
+      if (_depth < MAX_DEPTH) {
+        _hasEntry[++_depth] = false;
+      }
+      break;
+    case PayloadFormat::MessagePack:
+      if (entries < 16) {
+        put(0x80 | entries);
+      } else {
+        put(0xde);
+        putBigEndian(entries, 2);
+      }
+      break;
+    case PayloadFormat::CBOR:
+      putHeader(CBOR_MAP, entries);
+      break;
+  }
+}
+
+void PayloadWriter::endMap() {
+  if (_format == PayloadFormat::JSON) {
+    put('}');
+    if (_depth > 0) {
+      _depth--;
+    }
+  }
+}
+
+void PayloadWriter::beginArray(size_t items) {
+  switch (_format) {
+    case PayloadFormat::JSON:
+      separate();
+      put('[');
+      if (_depth < MAX_DEPTH) {
+        _hasEntry[++_depth] = false;
+      }
+      break;
+    case PayloadFormat::MessagePack:
+      if (items < 16) {
+        put(0x90 | items);
+      } else {
+        put(0xdc);
+        putBigEndian(items, 2);
+      }
+      break;
+    case PayloadFormat::CBOR:
+      putHeader(CBOR_ARRAY, items);
+      break;
+  }
+}
+
+void PayloadWriter::endArray() {
+  if (_format == PayloadFormat::JSON) {
+    put(']');
+    if (_depth > 0) {
+      _depth--;
+    }
+  }
+}
+
+void PayloadWriter::key(const char* name) {
+  if (_format == PayloadFormat::JSON) {
+    separate();
+    putText(name);
+    put(':');
+    _afterKey = true;
+    return;
+  }
+  putText(name);
+}
+
+void PayloadWriter::key(uint8_t id) {
+  if (_format == PayloadFormat::JSON) {
+    char name[4];
+    snprintf(name, sizeof(name), "%u", id);
+    key(name);
+    return;
+  }
+  value(static_cast<uint32_t>(id));
+}
+
+void PayloadWriter::value(int32_t value) {
+  if (value >= 0) {
+    this->value(static_cast<uint32_t>(value));
+    return;
+  }
+  switch (_format) {
+    case PayloadFormat::JSON: {
+      separate();
+      char text[12];
+      put(text, snprintf(text, sizeof(text), "%ld", static_cast<long>(value)));
+      break;
+    }
+    case PayloadFormat::MessagePack:
+      if (value >= -32) {
+        put(static_cast<uint8_t>(value));
+      } else {
+        put(0xd2);
+        putBigEndian(static_cast<uint32_t>(value), 4);
+      }
+      break;
+    case PayloadFormat::CBOR:
+      putHeader(CBOR_NEGATIVE, static_cast<uint32_t>(-1 - value));
+      break;
+  }
+}
+
+void PayloadWriter::value(uint32_t value) {
+  switch (_format) {
+    case PayloadFormat::JSON: {
+      separate();
+      char text[12];
+      put(text, snprintf(text, sizeof(text), "%lu", static_cast<unsigned long>(value)));
+      break;
+    }
+    case PayloadFormat::MessagePack:
+      if (value < 128) {
+        put(value);
+      } else if (value <= UINT8_MAX) {
+        put(0xcc);
+        putBigEndian(value, 1);
+      } else if (value <= UINT16_MAX) {
+        put(0xcd);
+        putBigEndian(value, 2);
+      } else {
+        put(0xce);
+        putBigEndian(value, 4);
+      }
+      break;
+    case PayloadFormat::CBOR:
+      putHeader(CBOR_UNSIGNED, value);
+      break;
+  }
+}
+
+void PayloadWriter::value(float value) {
+  /*
+      Floats are written in single precision. JSON keeps 2 decimal places like the HTTP API.
+  */
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  switch (_format) {
+    case PayloadFormat::JSON: {
+      separate();
+      if (!std::isfinite(value)) {
+        put("null", 4);
+        break;
+      }
+      char text[24];
+      int length = snprintf(text, sizeof(text), "%.2f", value);
+      put(text, length > 0 && static_cast<size_t>(length) < sizeof(text) ? length : 0);
+      break;
+    }
+    case PayloadFormat::MessagePack:
+      put(0xca);
+      putBigEndian(bits, 4);
+      break;
+    case PayloadFormat::CBOR:
+      put(0xfa);
+      putBigEndian(bits, 4);
+      break;
+  }
+}
+
+void PayloadWriter::value(const char* value) {
+  if (_format == PayloadFormat::JSON) {
+    separate();
+  }
+  putText(value);
+}
+
+void PayloadWriter::raw(const uint8_t* data, size_t length, size_t entries) {
+  if (_format == PayloadFormat::JSON && entries > 0) {
+    separate();
+  }
+  put(data, length);
+}
+
+bool PayloadWriter::parseFormat(const char* name, PayloadFormat& format) {
+  for (int i = 0; i <= static_cast<int>(PayloadFormat::CBOR); i++) {
+    if (strcmp(FORMAT_NAMES[i], name) == 0) {
+      format = static_cast<PayloadFormat>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+const char* PayloadWriter::formatName(PayloadFormat format) {
+  return FORMAT_NAMES[static_cast<int>(format)];
+}
@@ -0,0 +1,189 @@
+#include "Router.h"
+
+Router::Router() {
+  // Node 0 is the root "/"
+  _nodes.emplace_back();
+}
+
+uint64_t Router::childKey(int parent, std::string_view segment) {
+  // FNV-1a
+  uint32_t hash = 2166136261u;
+  for (char c : segment) {
+    hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+  }
+  return static_cast<uint64_t>(parent) << 32 | hash;
+}
+
+bool Router::on(const char* path, WebRequestMethodComposite method, Handler handler) {
+  int node = add(path, method);
+  if (node < 0) {
+    return false;
+  }
+  _handlers.emplace_back(std::move(handler));
+  return true;
+}
+
+bool Router::on(const char* path, WebRequestMethodComposite method, ArRequestHandlerFunction handler) {
+  int node = add(path, method);
+  if (node < 0) {
+    return false;
+  }
+  _handlers.emplace_back(std::move(handler));
+  return true;
+}
+
+int Router::add(const char* path, WebRequestMethodComposite method) {
+  /*
+      Add a route for the next handler and return its node, or -1 if path has too many
+      parameters, names a parameter differently from another route, or collides with a
+      segment hash. Register routes before the server starts, because requests are
+      dispatched on the AsyncTCP task without locking.
+  */
+  // Checked before any node is added, so that a rejected path leaves the tree unchanged
+  std::string_view rest(path);
+  int node = 0;
+  int parameters = 0;
+  while (!rest.empty()) {
+    size_t end = rest.find('/');
+    std::string_view segment = rest.substr(0, end);
+    rest = end == std::string_view::npos ? std::string_view() : rest.substr(end + 1);
+    if (segment.empty()) {
+      continue;
+    }
+    if (node < 0) {
+      // Below a node which does not exist yet, only the number of parameters can be wrong
+      parameters += segment.size() > 2 && segment.front() == '{' && segment.back() == '}';
+      continue;
+    }
+
+    if (segment.size() > 2 && segment.front() == '{' && segment.back() == '}') {
+      parameters++;
+      int parameter = _nodes[node].parameter;
+      if (parameter >= 0 && _nodes[parameter].segment != segment.substr(1, segment.size() - 2)) {
+        return -1;
+      }
+      node = parameter;
+      continue;
+    }
+
+    auto child = _children.find(childKey(node, segment));
+    if (child == _children.end()) {
+      node = -1;
+    } else if (_nodes[child->second].segment == segment) {
+      node = child->second;
+    } else {
+      return -1;
+    }
+  }
+  if (parameters > RouteParams::MAX_PARAMS) {
+    return -1;
+  }
+
+  rest = path;
+  node = 0;
+  while (!rest.empty()) {
+    size_t end = rest.find('/');
+    std::string_view segment = rest.substr(0, end);
+    rest = end == std::string_view::npos ? std::string_view() : rest.substr(end + 1);
+    if (segment.empty()) {
+      continue;
+    }
+
+    if (segment.size() > 2 && segment.front() == '{' && segment.back() == '}') {
+      if (_nodes[node].parameter < 0) {
+        _nodes[node].parameter = _nodes.size();
+        _nodes.emplace_back();
+        _nodes.back().segment = segment.substr(1, segment.size() - 2);
+      }
+      node = _nodes[node].parameter;
+      continue;
+    }
+
+    uint64_t key = childKey(node, segment);
+    auto child = _children.find(key);
+    if (child == _children.end()) {
+      _children[key] = _nodes.size();
+      _nodes.emplace_back();
+      _nodes.back().segment = segment;
+      node = _nodes.size() - 1;
+    } else {
+      node = child->second;
+    }
+  }
+
+  _nodes[node].routes.push_back({method, static_cast<int>(_handlers.size())});
+  return node;
+}
+
+int Router::find(int node, std::string_view path, WebRequestMethodComposite method, RouteParams& params) const {
+  /*
+      Return the handler for the rest of path below node, or -1.
+      Parameters matched on the way are appended to params.
+  */
+  while (!path.empty() && path.front() == '/') {
+    path.remove_prefix(1);
+  }
+  if (path.empty()) {
+    for (const Route& route : _nodes[node].routes) {
+      if (route.method & method) {
+        return route.handler;
+      }
+    }
+    return -1;
+  }
+
+  size_t end = path.find('/');
+  std::string_view segment = path.substr(0, end);
+  std::string_view rest = end == std::string_view::npos ? std::string_view() : path.substr(end);
+
+  auto child = _children.find(childKey(node, segment));
+  if (child != _children.end() && _nodes[child->second].segment == segment) {
+    int handler = find(child->second, rest, method, params);
+    if (handler >= 0) {
+      return handler;
+    }
+  }
+
+  // Fall back to a parameter if the literal segment did not lead to a route
+  int parameter = _nodes[node].parameter;
+  if (parameter >= 0 && params.size < RouteParams::MAX_PARAMS) {
+    params.names[params.size] = _nodes[parameter].segment;
+    params.values[params.size] = segment;
+    params.size++;
+    int handler = find(parameter, rest, method, params);
+    if (handler >= 0) {
+      return handler;
+    }
+    params.size--;
+  }
+  return -1;
+}
+
+int Router::match(AsyncWebServerRequest* request, RouteParams& params) const {
+  const String& url = request->url();
+  return find(0, std::string_view(url.c_str(), url.length()), request->method(), params);
+}
+
+bool Router::canHandle(AsyncWebServerRequest* request) {
+  RouteParams params;
+  return match(request, params) >= 0;
+}
+
+void Router::handleRequest(AsyncWebServerRequest* request) {
+  // Matched again instead of keeping state per request. A lookup only hashes the path once.
+  RouteParams params;
+  int handler = match(request, params);
+  if (handler < 0) {
+    if (_notFound) {
+      _notFound(request);
+    } else {
+      request->send(404);
+    }
+    return;
+  }
+  if (const Handler* withParams = std::get_if<Handler>(&_handlers[handler])) {
+    (*withParams)(request, params);
+  } else {
+    std::get<ArRequestHandlerFunction>(_handlers[handler])(request);
+  }
+}
@@ -0,0 +1,91 @@
+#include "SensorHub.h"
+
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+void SensorHub::add(std::string name, std::string unit, Getter getter, int decimals) {
+  insert({name, unit, getter, nullptr, decimals});
+}
+
+void SensorHub::add(std::string name, std::string unit, SampleGetter getter, int decimals) {
+  insert({name, unit, nullptr, getter, decimals});
+}
+
+void SensorHub::insert(Sensor sensor) {
+  /*
+      Register a sensor. Throws if the name is already registered.
+  */
+  if (indexOf(sensor.name.c_str(), sensor.name.size()) >= 0) {
+    throw std::invalid_argument("Sensor " + sensor.name + " is already registered");
+  }
+  if (_sensors.size() >= MAX_SENSORS) {
+    throw std::invalid_argument("Too many sensors");
+  }
+  _sensors.push_back(sensor);
+}
+
+int SensorHub::indexOf(const char* name, size_t length) const {
+  for (size_t i = 0; i < _sensors.size(); i++) {
+    if (_sensors[i].name.size() == length && strncmp(_sensors[i].name.c_str(), name, length) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+uint32_t SensorHub::select(const char* names) const {
+  if (names == nullptr || *names == '\0') {
+    return _sensors.size() == MAX_SENSORS ? UINT32_MAX : (1UL << _sensors.size()) - 1;
+  }
+
+  uint32_t selection = 0;
+  while (*names != '\0') {
+    size_t length = strcspn(names, ",");
+    if (length > 0) {
+      int index = indexOf(names, length);
+      if (index < 0) {
+        throw std::invalid_argument("Unknown sensor: " + std::string(names, length));
+      }
+      selection |= 1UL << index;
+    }
+    names += length;
+    if (*names == ',') {
+      names++;
+    }
+  }
+  return selection;
+}
+
+void SensorHub::write(Print& out, uint32_t selection, unsigned long time) const {
+  /*
+      Write selected sensors as {"time":...,"sensors":{"<name>":{"value":...,"unit":"..."}}}.
+      All values are read in one pass, so they share the same time [ms].
+      With a sample source, time and "sequence" are those of the sample, which is taken once.
+  */
+  SensorValues sample = {};
+  if (_source) {
+    sample = _source();
+    out.printf("{\"time\":%lu,\"sequence\":%lu,\"sensors\":{", sample.timestamp,
+               static_cast<unsigned long>(sample.sequence));
+  } else {
+    out.printf("{\"time\":%lu,\"sensors\":{", time);
+  }
+  bool first = true;
+  for (size_t i = 0; i < _sensors.size(); i++) {
+    if (!(selection & (1UL << i))) {
+      continue;
+    }
+    const Sensor& sensor = _sensors[i];
+    float value = sensor.sampleGetter ? sensor.sampleGetter(sample) : sensor.getter();
+    out.printf("%s\"%s\":{\"value\":", first ? "" : ",", sensor.name.c_str());
+    if (std::isfinite(value)) {
+      out.printf("%.*f", sensor.decimals, value);
+    } else {
+      out.print("null");
+    }
+    out.printf(",\"unit\":\"%s\"}", sensor.unit.c_str());
+    first = false;
+  }
+  out.print("}}");
+}
@@ -0,0 +1,242 @@
+#include "SensorStream.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "QueryString.h"
+
+namespace {
+const size_t FRAME_SIZE = 192;
+const uint16_t TRY_AGAIN_LATER = 1013;  // WebSocket close code
+
+struct FieldName {
+  const char* name;
+  uint8_t field;
+};
+
+const FieldName FIELD_NAMES[] = {
+    {"tds", SensorStream::TDS},
+    {"flow", SensorStream::FLOW},
+    {"totalFlow", SensorStream::TOTAL_FLOW},
+    {"temperature", SensorStream::TEMPERATURE},
+};
+}  // namespace
+
+SensorStream::SensorStream(const char* streamPath, const char* eventsPath)
+    : _ws(streamPath), _events(eventsPath) {
+}
+
+void SensorStream::attach(AsyncWebServer& server) {
+  /*
+      Add the WebSocket and Server-Sent Events handlers to server.
+  */
+  if (_lock == nullptr) {
+    _lock = xSemaphoreCreateMutex();
+    if (_lock == nullptr) {
+      throw std::runtime_error("Failed to create stream lock");
+    }
+  }
+  _ws.onEvent([this](AsyncWebSocket* server, AsyncWebSocketClient* client, AwsEventType type,
+                     void* arg, uint8_t* data, size_t len) { this->onEvent(client, type, arg, data, len); });
+  server.addHandler(&_ws);
+  server.addHandler(&_events);
+}
+
+void SensorStream::onEvent(AsyncWebSocketClient* client, AwsEventType type, void* arg, uint8_t* data, size_t len) {
+  /*
+      Track subscribers. Runs on the AsyncTCP task.
+  */
+  switch (type) {
+    case WS_EVT_CONNECT: {
+      // arg is the upgrade request, so the settings can be passed as query parameters
+      AsyncWebServerRequest* request = static_cast<AsyncWebServerRequest*>(arg);
+      uint8_t fields = ALL;
+      unsigned long interval = DEFAULT_INTERVAL;
+      if (request->hasParam("fields") || request->hasParam("interval")) {
+        String query = "";
+        if (request->hasParam("fields")) {
+          query += "fields=";
+          query += request->getParam("fields")->value().c_str();
+        }
+        if (request->hasParam("interval")) {
+          query += "&interval=";
+          query += request->getParam("interval")->value().c_str();
+        }
+        parseQuery(std::string_view(query.c_str(), query.length()), fields, interval);
+      }
+      if (!subscribe(client, fields, interval)) {
+        client->close(TRY_AGAIN_LATER, "Too many subscribers");
+      }
+      break;
+    }
+    case WS_EVT_DATA: {
+      // A text message in the query format changes the settings
+      AwsFrameInfo* info = static_cast<AwsFrameInfo*>(arg);
+      if (info->final && info->index == 0 && info->len == len && info->opcode == WS_TEXT && len < 128) {
+        uint8_t fields = ALL;
+        unsigned long interval = DEFAULT_INTERVAL;
+        parseQuery(std::string_view(reinterpret_cast<const char*>(data), len), fields, interval);
+        subscribe(client, fields, interval);
+      }
+      break;
+    }
+    case WS_EVT_DISCONNECT:
+      unsubscribe(client);
+      break;
+    default:
+      break;
+  }
+}
+
+bool SensorStream::subscribe(AsyncWebSocketClient* client, uint8_t fields, unsigned long interval) {
+  /*
+      Add client or change its settings. Returns false if MAX_SUBSCRIBERS are already subscribed.
+  */
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  int index = 0;
+  while (index < _subscriberCount && _subscribers[index].client != client) {
+    index++;
+  }
+  bool subscribed = index < MAX_SUBSCRIBERS;
+  if (subscribed) {
+    _subscribers[index] = {client, fields, interval, 0};
+    if (index == _subscriberCount) {
+      _subscriberCount++;
+    }
+  }
+  xSemaphoreGive(_lock);
+  return subscribed;
+}
+
+void SensorStream::unsubscribe(AsyncWebSocketClient* client) {
+  /*
+      Called before client is freed. Waits for a publish() which may be sending to it.
+  */
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  for (int i = 0; i < _subscriberCount; i++) {
+    if (_subscribers[i].client == client) {
+      _subscribers[i] = _subscribers[--_subscriberCount];
+      break;
+    }
+  }
+  xSemaphoreGive(_lock);
+}
+
+void SensorStream::parseQuery(std::string_view query, uint8_t& fields, unsigned long& interval) {
+  /*
+      Parse "fields=tds,flow&interval=500". Unknown keys and field names are ignored.
+  */
+  QueryString params(query);
+  if (params.has("fields")) {
+    fields = 0;
+    std::string_view names = params.get("fields");
+    while (!names.empty()) {
+      size_t end = names.find(',');
+      std::string_view name = names.substr(0, end);
+      names = end == std::string_view::npos ? std::string_view() : names.substr(end + 1);
+      for (const FieldName& field : FIELD_NAMES) {
+        if (name == field.name) {
+          fields |= field.field;
+        }
+      }
+    }
+    if (fields == 0) {
+      fields = ALL;
+    }
+  }
+
+  if (QueryString::toUnsigned(params.get("interval"), interval) && interval < MIN_INTERVAL) {
+    interval = MIN_INTERVAL;
+  }
+}
+
+size_t SensorStream::serialize(const SensorValues& values, uint8_t fields, char* buffer, size_t size) {
+  /*
+      Serialize values into buffer as JSON. Returns the length.
+  */
+  int length = snprintf(buffer, size, "{\"sequence\":%u,\"time\":%lu",
+                        static_cast<unsigned>(values.sequence), values.timestamp);
+  if (fields & TDS) {
+    length += snprintf(buffer + length, size - length, ",\"tds\":%d", values.tds);
+  }
+  if (fields & FLOW) {
+    length += snprintf(buffer + length, size - length, ",\"flow\":%.2f", values.flow);
+  }
+  if (fields & TOTAL_FLOW) {
+    length += snprintf(buffer + length, size - length, ",\"totalFlow\":%.2f", values.totalFlow);
+  }
+  if (fields & TEMPERATURE) {
+    length += snprintf(buffer + length, size - length, ",\"temperature\":%.2f", values.temperature);
+  }
+  length += snprintf(buffer + length, size - length, "}");
+  return length;
+}
+
+void SensorStream::publish(const SensorValues& values) {
+  /*
+      Push a sample cycle to all subscribers which are due.
+      Subscribers are visited by field set, so each frame is built once into a buffer which is
+      queued to each of them.
+  */
+  if (_lock == nullptr) {
+    return;
+  }
+  unsigned long now = millis();
+  char frame[FRAME_SIZE];
+
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  if (_events.count() > 0 && now - _eventsSentAt >= _eventsInterval) {
+    // AsyncEventSource drops messages for clients whose queue is full
+    serialize(values, ALL, frame, sizeof(frame));
+    _events.send(frame, "values", values.sequence);
+    _eventsSentAt = now;
+  }
+
+  // Pick subscribers which are due, in order of field set
+  Subscriber* due[MAX_SUBSCRIBERS];
+  int dueCount = 0;
+  for (int i = 0; i < _subscriberCount; i++) {
+    if (now - _subscribers[i].lastSentAt >= _subscribers[i].interval) {
+      _subscribers[i].lastSentAt = now;
+      int j = dueCount++;
+      for (; j > 0 && due[j - 1]->fields > _subscribers[i].fields; j--) {
+        due[j] = due[j - 1];
+      }
+      due[j] = &_subscribers[i];
+    }
+  }
+
+  releaseFrames();
+  AsyncWebSocketMessageBuffer* buffer = nullptr;
+  uint8_t bufferFields = 0;
+  for (int i = 0; i < dueCount; i++) {
+    // Slow client: drop this sample instead of queueing it
+    if (!due[i]->client->canSend()) {
+      continue;
+    }
+    if (buffer == nullptr || due[i]->fields != bufferFields) {
+      size_t length = serialize(values, due[i]->fields, frame, sizeof(frame));
+      buffer = new AsyncWebSocketMessageBuffer(reinterpret_cast<uint8_t*>(frame), length);
+      _frames.push_back(buffer);
+      bufferFields = due[i]->fields;
+    }
+    due[i]->client->text(buffer);
+  }
+  releaseFrames();
+  xSemaphoreGive(_lock);
+}
+
+void SensorStream::releaseFrames() {
+  /*
+      Free the frame buffers which no queued message holds anymore. Called under _lock.
+  */
+  _frames.erase(std::remove_if(_frames.begin(), _frames.end(),
+                               [](AsyncWebSocketMessageBuffer* buffer) {
+                                 if (!buffer->canDelete()) {
+                                   return false;
+                                 }
+                                 delete buffer;
+                                 return true;
+                               }),
+                _frames.end());
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+// Minimal test harness for the host build. Each test_*.cpp is an executable:
+//
+//   TEST(name) { CHECK(...); }
+//   int main() { return runTests(); }
+//
+// Every test starts from fake::reset(). A failed CHECK ends the test and is reported.
+
+#include <ESPAsyncWebServer.h>
+
+#include <cmath>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "FakeHal.h"
+
+namespace host {
+
+struct TestCase {
+  const char* name;
+  std::function<void()> body;
+};
+
+inline std::vector<TestCase>& tests() {
+  static std::vector<TestCase> registered;
+  return registered;
+}
+
+struct Registration {
+  Registration(const char* name, std::function<void()> body) { tests().push_back({name, body}); }
+};
+
+struct Failure {
+  std::string message;
+};
+
+template <typename T>
+std::string describe(const T& value) {
+  std::ostringstream out;
+  out << value;
+  return out.str();
+}
+
+inline std::string describe(const String& value) {
+  return std::string("\"") + value.c_str() + "\"";
+}
+
+inline std::string describe(const std::string& value) {
+  return "\"" + value + "\"";
+}
+
+template <typename T>
+std::string describe(const std::vector<T>& values) {
+  std::string text = "{";
+  for (size_t i = 0; i < values.size(); i++) {
+    text += (i > 0 ? ", " : "") + describe(values[i]);
+  }
+  return text + "}";
+}
+
+inline std::string describe(const char* value) {
+  return value != nullptr ? "\"" + std::string(value) + "\"" : "null";
+}
+
+[[noreturn]] inline void fail(const char* file, int line, const std::string& message) {
+  throw Failure{std::string(file) + ":" + std::to_string(line) + ": " + message};
+}
+
+inline int runTests() {
+  int failed = 0;
+  for (const TestCase& test : tests()) {
+    fake::reset();
+    try {
+      test.body();
+      printf("[ OK ] %s\n", test.name);
+    } catch (const Failure& failure) {
+      printf("[FAIL] %s\n  %s\n", test.name, failure.message.c_str());
+      failed++;
+    } catch (const std::exception& e) {
+      printf("[FAIL] %s\n  exception: %s\n", test.name, e.what());
+      failed++;
+    }
+    fake::stopTasks();
+  }
+  printf("%d of %d tests failed\n", failed, static_cast<int>(tests().size()));
+  return failed == 0 ? 0 : 1;
+}
+
+// Dispatch a request to server like the AsyncTCP task, and return it with what was sent.
+// With RCT_WS or RCT_EVENT, the connected client is kept in the request.
+inline std::unique_ptr<AsyncWebServerRequest> request(AsyncWebServer& server, WebRequestMethodComposite method,
+                                                      const char* url, RequestedConnectionType type = RCT_HTTP) {
+  std::unique_ptr<AsyncWebServerRequest> request(new AsyncWebServerRequest(method, url, type));
+  server.handle(request.get());
+  return request;
+}
+
+}  // namespace host
+
+#define HOST_CONCAT_(a, b) a##b
+#define HOST_CONCAT(a, b) HOST_CONCAT_(a, b)
+
+#define TEST(name)                                                                   \
+  static void HOST_CONCAT(test_, name)();                                            \
+  static host::Registration HOST_CONCAT(registration_, name)(#name, HOST_CONCAT(test_, name)); \
+  static void HOST_CONCAT(test_, name)()
+
+#define CHECK(condition)                                     \
+  do {                                                       \
+    if (!(condition)) {                                      \
+      host::fail(__FILE__, __LINE__, "CHECK(" #condition ")"); \
+    }                                                        \
+  } while (0)
+
+#define CHECK_EQ(actual, expected)                                                                         \
+  do {                                                                                                     \
+    auto&& actual_ = (actual);                                                                             \
+    auto&& expected_ = (expected);                                                                         \
+    if (!(actual_ == expected_)) {                                                                         \
+      host::fail(__FILE__, __LINE__,                                                                       \
+                 #actual " == " #expected ": " + host::describe(actual_) + " != " + host::describe(expected_)); \
+    }                                                                                                      \
+  } while (0)
+
+#define CHECK_NEAR(actual, expected, tolerance)                                                              \
+  do {                                                                                                       \
+    double actual_ = (actual);                                                                               \
+    double expected_ = (expected);                                                                           \
+    if (!(std::fabs(actual_ - expected_) <= (tolerance))) {                                                  \
+      host::fail(__FILE__, __LINE__,                                                                         \
+                 #actual " ~ " #expected ": " + host::describe(actual_) + " vs " + host::describe(expected_)); \
+    }                                                                                                        \
+  } while (0)
+
+#define CHECK_THROWS(statement, exception)                                         \
+  do {                                                                             \
+    bool thrown_ = false;                                                          \
+    try {                                                                          \
+      statement;                                                                   \
+    } catch (const exception&) {                                                   \
+      thrown_ = true;                                                              \
+    }                                                                              \
+    if (!thrown_) {                                                                \
+      host::fail(__FILE__, __LINE__, #statement " does not throw " #exception);    \
+    }                                                                              \
+  } while (0)
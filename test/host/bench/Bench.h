@@ -0,0 +1,79 @@
+#pragma once
+
+// Microbenchmarks of the library on the host build.
+//
+// Host time says how the code paths compare (e.g. before and after a change), not how long
+// they take on an ESP32. Simulated quantities which do not depend on the host, such as
+// SPI bus time, heap allocations and time to a valid reading, are reported as metrics.
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "FakeHal.h"
+
+namespace bench {
+
+struct Result {
+  std::string suite;
+  std::string name;
+  uint64_t iterations = 0;
+  double nsPerOp = 0;           // Median of the batches [ns], 0 if not timed
+  double allocationsPerOp = 0;  // operator new calls made by the library
+  double bytesPerOp = 0;
+  std::map<std::string, double> metrics;
+};
+
+struct Options {
+  bool quick = false;  // Few iterations, only to check that every case runs
+  std::string suite;   // Run only this suite
+};
+
+class Context {
+ public:
+  Context(const std::string& suite, const Options& options) : _suite(suite), _options(options) {}
+
+  bool quick() const { return _options.quick; }
+
+  // Time fn, which runs one operation per call, in batches and record it as name.
+  // setup runs before each batch and is not timed.
+  Result& time(const std::string& name, std::function<void()> fn, std::function<void()> setup = nullptr);
+
+  // Record a case which only has metrics
+  Result& record(const std::string& name);
+
+  // Check a result which must hold for the numbers to mean anything. o_bench exits with 1 if one fails.
+  void expect(bool ok, const std::string& message);
+
+  const std::vector<Result>& results() const { return _results; }
+  const std::vector<std::string>& failures() const { return _failures; }
+
+ private:
+  std::string _suite;
+  const Options& _options;
+  std::vector<Result> _results;
+  std::vector<std::string> _failures;
+};
+
+using SuiteFunction = void (*)(Context&);
+
+struct Suite {
+  const char* name;
+  SuiteFunction run;
+};
+
+std::vector<Suite>& suites();
+
+struct Registration {
+  Registration(const char* name, SuiteFunction run) { suites().push_back({name, run}); }
+};
+
+}  // namespace bench
+
+#define BENCH_SUITE(name)                                                 \
+  static void bench_##name(bench::Context& context);                      \
+  static bench::Registration bench_registration_##name(#name, bench_##name); \
+  static void bench_##name(bench::Context& context)
@@ -0,0 +1,35 @@
+#pragma once
+
+// TDS circuit of CoreModule: the ADC code of the TDS channel depends on the solution
+// and on the MAX4618 range selected by TDS_RSEL0/TDS_RSEL1.
+
+#include <algorithm>
+
+#include "CoreModule.h"
+#include "FakeHal.h"
+
+namespace bench {
+
+class TDSProbe {
+ public:
+  static const int CHANNEL = 2;
+
+  // code3(time) is the code the solution gives in range 3 (highest gain). Each range
+  // below divides it by TDSAutorange::RANGE_RATIO. After a switch, the code settles
+  // with time constant tau [us] like the RC filter in front of the ADC.
+  static void attach(fake::Signal code3, int64_t tau = 3000) {
+    fake::Signal selected = [code3](int64_t us) {
+      int range = fake::pinLevel(CoreModule::TDS_RSEL0) | (fake::pinLevel(CoreModule::TDS_RSEL1) << 1);
+      double code = code3(us);
+      for (int r = range; r < TDSAutorange::RANGE_MAX; r++) {
+        code /= TDSAutorange::RANGE_RATIO;
+      }
+      return std::min(code, 4095.0);
+    };
+    fake::setADC(CHANNEL, tau > 0 ? fake::lowPass(selected, tau) : selected);
+  }
+
+  static int range() { return fake::pinLevel(CoreModule::TDS_RSEL0) | (fake::pinLevel(CoreModule::TDS_RSEL1) << 1); }
+};
+
+}  // namespace bench
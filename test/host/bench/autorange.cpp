@@ -0,0 +1,158 @@
+// Replay of TDS step changes: time to a valid reading with CoreModule::updateTDS(),
+// and with the one-range-per-150-ms autoranging it replaced as a reference
+
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Bench.h"
+#include "CoreModule.h"
+#include "TDSProbe.h"
+
+namespace {
+
+const int64_t CYCLE = 10;        // updateTDS() period, as by the acquisition task [ms]
+const int64_t SETTLE = 1000;     // Before the step [ms]
+const int64_t OBSERVE = 2000;    // After the step [ms]
+const double TOLERANCE = 0.02;   // A reading within 2 % of the final one is valid
+const int64_t TAU = 20000;       // Settling of the TDS circuit after a change [us]
+
+// Autoranging before predictive range selection: step one range, then wait 150 ms
+class StepwiseAutorange {
+ public:
+  explicit StepwiseAutorange(CoreModule& module) : _module(module) {}
+
+  void begin() {
+    _range = TDSAutorange::RANGE_MAX;
+    _switchedAt = millis();
+    select();
+  }
+
+  void update(int samples = 5) {
+    if (millis() - _switchedAt < 150) {
+      return;
+    }
+    float voltage = _module.ADCaverage(bench::TDSProbe::CHANNEL, samples);
+    if (voltage >= 100 && voltage <= 1500) {
+      _tds = _module.calculateTDS(voltage, _range);
+    } else if (voltage > 1500 && _range != 0) {
+      _range--;
+      _switchedAt = millis();
+      select();
+    } else if (voltage < 100 && _range != TDSAutorange::RANGE_MAX) {
+      _range++;
+      _switchedAt = millis();
+      select();
+    }
+  }
+
+  int tds() const { return _tds; }
+
+ private:
+  CoreModule& _module;
+  int _range = TDSAutorange::RANGE_MAX;
+  unsigned long _switchedAt = 0;
+  int _tds = 0;
+
+  void select() {
+    digitalWrite(CoreModule::TDS_RSEL0, _range & 0x01);
+    digitalWrite(CoreModule::TDS_RSEL1, (_range >> 1) & 0x01);
+  }
+};
+
+struct Step {
+  const char* name;
+  fake::Signal code3;  // Code in range 3 (see TDSProbe)
+  int range;           // Range where the solution after the step is in the valid window
+};
+
+struct Replay {
+  double timeToValid = -1;  // [ms], -1 if never valid
+  int switches = 0;
+  int finalRange = 0;
+};
+
+Replay replay(const Step& step, std::function<void()> update, std::function<int()> tds) {
+  /*
+      Settle on the first value, then step at time 0 of the replay and record every reading.
+  */
+  int64_t origin = fake::now() + SETTLE * 1000;
+  bench::TDSProbe::attach([&step, origin](int64_t us) { return step.code3(us - origin); }, TAU);
+  for (int64_t t = 0; t < SETTLE; t += CYCLE) {
+    update();
+    fake::advanceMs(CYCLE);
+  }
+
+  struct Reading {
+    int64_t at;
+    int tds;
+  };
+  std::vector<Reading> readings;
+  Replay result;
+  int range = bench::TDSProbe::range();
+  for (int64_t t = 0; t < OBSERVE; t += CYCLE) {
+    update();
+    readings.push_back({fake::now() - origin, tds()});
+    result.switches += bench::TDSProbe::range() != range ? 1 : 0;
+    range = bench::TDSProbe::range();
+    fake::advanceMs(CYCLE);
+  }
+  result.finalRange = range;
+
+  // The first reading from which all readings are within TOLERANCE of the final one
+  int final = readings.back().tds;
+  for (size_t i = readings.size(); i-- > 0;) {
+    if (std::abs(readings[i].tds - final) > std::max(1.0, std::abs(final) * TOLERANCE)) {
+      break;
+    }
+    result.timeToValid = readings[i].at / 1000.0;
+  }
+  return result;
+}
+
+}  // namespace
+
+BENCH_SUITE(autorange) {
+  // Both share the range pins, so each predictive replay starts from a new module in range 3.
+  // Modules are kept until the end, since their tasks still run.
+  std::vector<std::unique_ptr<CoreModule>> modules;
+  CoreModule module(Diameter::Quarter);
+  module.init();
+
+  // A step of the solution at time 0, as the code it gives in range 3.
+  // Names give the ranges where the solution before and after the step reads 800.
+  const Step steps[] = {
+      {"range3_to_range2", fake::step(800, 8000, 0), 2},
+      {"range3_to_range1", fake::step(800, 80000, 0), 1},
+      {"range3_to_range0", fake::step(800, 800000, 0), 0},
+      {"range0_to_range3", fake::step(800000, 800, 0), 3},
+      {"range1_to_range2", fake::step(80000, 8000, 0), 2},
+  };
+
+  StepwiseAutorange stepwise(module);
+  for (const Step& step : steps) {
+    modules.emplace_back(new CoreModule(Diameter::Quarter));
+    CoreModule& current = *modules.back();
+    current.init();
+    Replay predictive = replay(step, [&]() { current.updateTDS(); }, [&]() { return current.getTDS(); });
+    bench::Result& result = context.record(std::string(step.name) + "/predictive");
+    result.metrics["time_to_valid_ms"] = predictive.timeToValid;
+    result.metrics["switches"] = predictive.switches;
+    result.metrics["final_range"] = predictive.finalRange;
+    result.metrics["expected_range"] = step.range;
+    context.expect(predictive.finalRange == step.range,
+                   std::string(step.name) + "/predictive ends in range " + std::to_string(predictive.finalRange));
+
+    stepwise.begin();
+    Replay reference = replay(step, [&]() { stepwise.update(); }, [&]() { return stepwise.tds(); });
+    bench::Result& old = context.record(std::string(step.name) + "/stepwise");
+    old.metrics["time_to_valid_ms"] = reference.timeToValid;
+    old.metrics["switches"] = reference.switches;
+    old.metrics["final_range"] = reference.finalRange;
+    old.metrics["expected_range"] = step.range;
+    context.expect(reference.finalRange == step.range,
+                   std::string(step.name) + "/stepwise ends in range " + std::to_string(reference.finalRange));
+  }
+}
@@ -0,0 +1,120 @@
+// CoreModule hot paths: TDS conversion and autoranging, sensor JSON, responses and update()
+
+#include <cmath>
+#include <memory>
+
+#include "Bench.h"
+#include "CoreModule.h"
+#include "TDSProbe.h"
+
+namespace {
+
+void setInputs() {
+  fake::setADC(0, fake::constant(500));
+  bench::TDSProbe::attach(fake::constant(800));
+  fake::setPulses(CoreModule::MH_FLOW, fake::constant(100));
+}
+
+void dispatch(CoreModule& module, WebRequestMethodComposite method, const char* url) {
+  // The request is built by the server, so its allocations are not the library's
+  std::unique_ptr<AsyncWebServerRequest> request;
+  {
+    fake::UntrackedAllocations untracked;
+    request.reset(new AsyncWebServerRequest(method, url));
+  }
+  module.handle(request.get());
+}
+
+}  // namespace
+
+BENCH_SUITE(core) {
+  CoreModule module(Diameter::Quarter);
+  module.init();
+  setInputs();
+  for (int i = 0; i < 100; i++) {
+    module.update();
+    fake::advanceMs(10);
+  }
+
+  // calculateTDS over the whole code range of every range
+  int code = 0;
+  volatile int sink = 0;
+  context.time("calculateTDS", [&]() {
+    sink = module.calculateTDS(code, code & 3);
+    code = (code + 37) % 4096;
+  });
+
+  // updateTDS with the default 5 samples, without a range switch
+  double busTime = fake::spiBusTime();
+  bench::Result& updateTDS = context.time("updateTDS", [&]() { module.updateTDS(); });
+  updateTDS.metrics["spi_us_per_op"] = (fake::spiBusTime() - busTime) / updateTDS.iterations;
+
+  // Kept until the end of the suite, since its tasks still run
+  CoreModule stepped(Diameter::Quarter);
+  {
+    // Step to a solution 100 times more conductive, calling updateTDS() every 10 ms as the
+    // acquisition task does. The reading is valid from the last change of getTDS() within 2 s.
+    stepped.init();
+    bench::TDSProbe::attach(fake::constant(800));
+    for (int i = 0; i < 50; i++) {
+      stepped.updateTDS();
+      fake::advanceMs(10);
+    }
+    bench::TDSProbe::attach(fake::constant(80000));
+    int64_t start = fake::now();
+    int64_t validAt = start;
+    int switches = 0;
+    int range = bench::TDSProbe::range();
+    int tds = stepped.getTDS();
+    while (fake::now() - start < 2000000) {
+      stepped.updateTDS();
+      fake::advanceMs(10);
+      switches += bench::TDSProbe::range() != range ? 1 : 0;
+      range = bench::TDSProbe::range();
+      if (stepped.getTDS() != tds) {
+        tds = stepped.getTDS();
+        validAt = fake::now();
+      }
+    }
+    bench::Result& convergence = context.record("updateTDS_convergence");
+    convergence.metrics["time_to_valid_ms"] = (validAt - start) / 1000.0;
+    convergence.metrics["switches"] = switches;
+    convergence.metrics["final_range"] = range;
+    bench::TDSProbe::attach(fake::constant(800));
+  }
+
+  context.time("getSensorValuesJson", [&]() { module.getSensorValuesJson(); });
+
+  // Response builders, through the router like a request from the AsyncTCP task.
+  // Host time includes building the fake request. GETs allocate nothing in steady state.
+  context.time("GET /tds", [&]() { dispatch(module, HTTP_GET, "/tds"); });
+  context.time("GET /sensors", [&]() { dispatch(module, HTTP_GET, "/sensors"); });
+  context.time("GET /config/ip", [&]() { dispatch(module, HTTP_GET, "/config/ip"); });
+  context.time("POST /totalFlow/reset", [&]() { dispatch(module, HTTP_POST, "/totalFlow/reset"); });
+  context.time("not found", [&]() { dispatch(module, HTTP_GET, "/nothing"); });
+  context.time("createErrorResponse", [&]() { module.createErrorResponse("field is required"); });
+  context.time("createOperationSucceededResponse", [&]() { module.createOperationSucceededResponse(); });
+
+  // A full update() which samples all sensors, streams and logs
+  busTime = fake::spiBusTime();
+  bench::Result& update = context.time("update", [&]() { module.update(); });
+  update.metrics["spi_us_per_op"] = (fake::spiBusTime() - busTime) / update.iterations;
+
+  // One second of loop() at 1 kHz in simulated time, with the logger and scheduler tasks running
+  {
+    fake::CountAllocations count;
+    busTime = fake::spiBusTime();
+    int loops = context.quick() ? 100 : 1000;
+    for (int i = 0; i < loops; i++) {
+      module.update();
+      fake::advanceMs(1);
+    }
+    fake::Allocations made = count.result();
+    bench::Result& second = context.record("update_1kHz");
+    second.iterations = loops;
+    second.allocationsPerOp = static_cast<double>(made.count) / loops;
+    second.bytesPerOp = static_cast<double>(made.bytes) / loops;
+    second.metrics["spi_us_per_op"] = (fake::spiBusTime() - busTime) / loops;
+    second.metrics["spi_duty"] = (fake::spiBusTime() - busTime) / (loops * 1000.0);
+  }
+}
@@ -0,0 +1,87 @@
+// Filters of Filters.h: cost per sample, and response to a step, a spike and a ripple
+// at the rate of one sample per update() tick
+
+#include <cmath>
+#include <string>
+
+#include "Bench.h"
+#include "Filters.h"
+
+namespace {
+
+const float SAMPLE_RATE = 100;     // Samples per second, one per tick [Hz]
+const float RIPPLE = 10;           // Pump ripple [Hz]
+const float TOLERANCE = 0.02f;     // Within 2 % of the step
+const int OBSERVE = 500;           // Samples fed for each response
+
+// Samples after a step from a steady 0 to 1 until the output stays within TOLERANCE
+template <typename Filter>
+int stepSamples(Filter filter) {
+  for (int i = 0; i < 50; i++) {
+    filter(0);
+  }
+  int settled = 0;
+  for (int i = 1; i <= OBSERVE; i++) {
+    if (std::fabs(filter(1) - 1) > TOLERANCE) {
+      settled = i;
+    }
+  }
+  return settled;
+}
+
+// Largest deviation after a single sample of 10 on a constant 1
+template <typename Filter>
+float spike(Filter filter) {
+  for (int i = 0; i < 50; i++) {
+    filter(1);
+  }
+  float deviation = std::fabs(filter(10) - 1);
+  for (int i = 0; i < 50; i++) {
+    deviation = std::fmax(deviation, std::fabs(filter(1) - 1));
+  }
+  return deviation;
+}
+
+// Peak-to-peak output for a ripple of peak-to-peak 1, after the filter has settled
+template <typename Filter>
+float ripple(Filter filter) {
+  float low = INFINITY;
+  float high = -INFINITY;
+  for (int i = 0; i < OBSERVE; i++) {
+    float y = filter(0.5f * sinf(2 * static_cast<float>(M_PI) * RIPPLE * i / SAMPLE_RATE));
+    if (i >= OBSERVE / 2) {
+      low = std::fmin(low, y);
+      high = std::fmax(high, y);
+    }
+  }
+  return high - low;
+}
+
+template <typename Filter>
+void run(bench::Context& context, const std::string& name, Filter filter) {
+  volatile float sink = 0;
+  float x = 0;
+  Filter timed = filter;
+  bench::Result& result = context.time(name, [&]() {
+    // A noisy reading which does not repeat within a window
+    x = x > 1000 ? 0 : x + 7.3f;
+    sink = timed(x);
+  });
+  result.metrics["step_samples"] = stepSamples(filter);
+  result.metrics["spike"] = spike(filter);
+  result.metrics["ripple"] = ripple(filter);
+  result.metrics["bytes"] = sizeof(Filter);
+}
+
+}  // namespace
+
+BENCH_SUITE(filters) {
+  run(context, "none", NoFilter());
+  run(context, "moving_average5", MovingAverage<5>());
+  run(context, "moving_average16", MovingAverage<16>());
+  run(context, "median5", Median<5>());
+  run(context, "median9", Median<9>());
+  run(context, "ema0.1", Ema(0.1f));
+  run(context, "iir_lowpass1hz", FirstOrderIIR::lowPass(1, SAMPLE_RATE));
+  run(context, "median5_ema0.1", FilterChain<Median<5>, Ema>());
+}
@@ -0,0 +1,114 @@
+// MQTT payload formats: size and encode time of a sample in JSON, MessagePack and CBOR,
+// with string and numeric keys, and the size of the messages MQTTPublisher sends
+
+#include <memory>
+#include <string>
+
+#include "Bench.h"
+#include "CoreModule.h"
+#include "MQTTPublisher.h"
+#include "PayloadWriter.h"
+
+namespace {
+
+const PayloadFormat FORMATS[] = {PayloadFormat::JSON, PayloadFormat::MessagePack, PayloadFormat::CBOR};
+const size_t BATCH = MQTTPublisher::BATCH_SIZE;
+
+// Large enough for a whole batch in any format, so that sizes beyond a message can be compared
+struct Encoded {
+  uint8_t data[BATCH * 256];
+  size_t length = 0;
+};
+
+// Metadata as given to /publish/start, encoded once per session like the publisher does
+Encoded metadata(PayloadFormat format) {
+  Encoded encoded;
+  PayloadWriter writer(format, encoded.data, sizeof(encoded.data));
+  writer.key("site");
+  writer.value("lab");
+  writer.key("device");
+  writer.value("o-ware-01");
+  encoded.length = writer.length();
+  return encoded;
+}
+
+// The map MQTTPublisher::encode() writes for a sample with all fields
+void encodeSample(PayloadWriter& writer, const Encoded& meta, bool shortKeys, uint32_t time) {
+  writer.beginMap(2 + 5);
+  writer.raw(meta.data, meta.length, 2);
+  shortKeys ? writer.key(uint8_t(1)) : writer.key("tds");
+  writer.value(int32_t(412));
+  shortKeys ? writer.key(uint8_t(2)) : writer.key("flow");
+  writer.value(1.25f);
+  shortKeys ? writer.key(uint8_t(3)) : writer.key("totalFlow");
+  writer.value(1234.5f);
+  shortKeys ? writer.key(uint8_t(4)) : writer.key("temperature");
+  writer.value(24.1f);
+  shortKeys ? writer.key(uint8_t(5)) : writer.key("time");
+  writer.value(time);
+  writer.endMap();
+}
+
+std::string caseName(PayloadFormat format, bool shortKeys) {
+  return std::string(PayloadWriter::formatName(format)) + (shortKeys ? "/short_keys" : "");
+}
+
+}  // namespace
+
+BENCH_SUITE(formats) {
+  // A sample, and a batch as sent after reconnecting
+  for (PayloadFormat format : FORMATS) {
+    Encoded meta = metadata(format);
+    for (bool shortKeys : {false, true}) {
+      Encoded out;
+      uint32_t time = 86400000;
+      bench::Result& single = context.time("sample/" + caseName(format, shortKeys), [&]() {
+        PayloadWriter writer(format, out.data, sizeof(out.data));
+        encodeSample(writer, meta, shortKeys, time++);
+        out.length = writer.length();
+      });
+      single.metrics["bytes"] = out.length;
+
+      bench::Result& batch = context.time("batch16/" + caseName(format, shortKeys), [&]() {
+        PayloadWriter writer(format, out.data, sizeof(out.data));
+        writer.beginArray(BATCH);
+        for (size_t i = 0; i < BATCH; i++) {
+          encodeSample(writer, meta, shortKeys, time++);
+        }
+        writer.endArray();
+        out.length = writer.length();
+      });
+      // The publisher sends fewer samples per message if the batch does not fit
+      batch.metrics["bytes"] = out.length;
+      batch.metrics["bytes_per_sample"] = static_cast<double>(out.length) / BATCH;
+      batch.metrics["fits_message"] = out.length <= MQTTPublisher::PAYLOAD_SIZE ? 1 : 0;
+    }
+  }
+
+  // Messages of the publisher through the broker stand-in, one sample per message
+  CoreModule module(Diameter::Quarter);
+  module.init();
+  WiFiClient wifi;
+  MQTTPublisher publisher(module, wifi);
+  publisher.setServer("broker.local", 1883);
+  publisher.begin();
+  JsonDocument meta;
+  meta["site"] = "lab";
+  meta["device"] = "o-ware-01";
+  for (PayloadFormat format : FORMATS) {
+    for (bool shortKeys : {false, true}) {
+      module.startPublishing("token", 100, format, shortKeys, meta);
+      fake::advanceMs(200);
+      fake::broker().messages.clear();
+      fake::advanceMs(context.quick() ? 500 : 5000);
+
+      size_t bytes = 0;
+      for (const fake::Broker::Message& message : fake::broker().messages) {
+        bytes += message.payload.size();
+      }
+      bench::Result& published = context.record("publisher/" + caseName(format, shortKeys));
+      published.iterations = fake::broker().messages.size();
+      published.metrics["bytes_per_message"] = published.iterations > 0 ? static_cast<double>(bytes) / published.iterations : 0;
+    }
+  }
+}
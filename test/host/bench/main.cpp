@@ -0,0 +1,195 @@
+// o_bench [--quick] [--suite name] [--format json|csv] [--out path]
+//
+// Runs the benchmark suites and writes one record per case to path (stdout by default).
+// Exits with 1 if a suite found a result it did not expect.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "Bench.h"
+
+namespace bench {
+
+std::vector<Suite>& suites() {
+  static std::vector<Suite> registered;
+  return registered;
+}
+
+namespace {
+
+const int BATCHES = 7;
+
+uint64_t batchSize(bool quick) {
+  return quick ? 10 : 2000;
+}
+
+}  // namespace
+
+Result& Context::time(const std::string& name, std::function<void()> fn, std::function<void()> setup) {
+  Result result;
+  result.suite = _suite;
+  result.name = name;
+
+  uint64_t perBatch = batchSize(_options.quick);
+  std::vector<double> batches;
+  fake::Allocations allocations;
+  for (int batch = 0; batch < (_options.quick ? 1 : BATCHES); batch++) {
+    if (setup) {
+      setup();
+    }
+    fake::CountAllocations count;
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < perBatch; i++) {
+      fn();
+    }
+    auto end = std::chrono::steady_clock::now();
+    fake::Allocations made = count.result();
+    allocations.count += made.count;
+    allocations.bytes += made.bytes;
+    batches.push_back(std::chrono::duration<double, std::nano>(end - start).count() / perBatch);
+    result.iterations += perBatch;
+  }
+  std::sort(batches.begin(), batches.end());
+  result.nsPerOp = batches[batches.size() / 2];
+  result.allocationsPerOp = static_cast<double>(allocations.count) / result.iterations;
+  result.bytesPerOp = static_cast<double>(allocations.bytes) / result.iterations;
+  _results.push_back(result);
+  return _results.back();
+}
+
+Result& Context::record(const std::string& name) {
+  Result result;
+  result.suite = _suite;
+  result.name = name;
+  _results.push_back(result);
+  return _results.back();
+}
+
+void Context::expect(bool ok, const std::string& message) {
+  if (!ok) {
+    _failures.push_back(_suite + ": " + message);
+  }
+}
+
+}  // namespace bench
+
+namespace {
+
+std::string escape(const std::string& text) {
+  std::string escaped;
+  for (char c : text) {
+    if (c == '"' || c == '\\') {
+      escaped += '\\';
+    }
+    escaped += c;
+  }
+  return escaped;
+}
+
+void writeJson(FILE* out, const std::vector<bench::Result>& results) {
+  fprintf(out, "[\n");
+  for (size_t i = 0; i < results.size(); i++) {
+    const bench::Result& r = results[i];
+    fprintf(out, "  {\"suite\": \"%s\", \"name\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %.1f, ",
+            escape(r.suite).c_str(), escape(r.name).c_str(), static_cast<unsigned long long>(r.iterations), r.nsPerOp);
+    fprintf(out, "\"allocations_per_op\": %.3f, \"bytes_per_op\": %.1f, \"metrics\": {", r.allocationsPerOp, r.bytesPerOp);
+    bool first = true;
+    for (const auto& metric : r.metrics) {
+      fprintf(out, "%s\"%s\": %.6g", first ? "" : ", ", escape(metric.first).c_str(), metric.second);
+      first = false;
+    }
+    fprintf(out, "}}%s\n", i + 1 < results.size() ? "," : "");
+  }
+  fprintf(out, "]\n");
+}
+
+void writeCsv(FILE* out, const std::vector<bench::Result>& results) {
+  // Metrics are flattened into name=value pairs, so that every row has the same columns
+  fprintf(out, "suite,name,iterations,ns_per_op,allocations_per_op,bytes_per_op,metrics\n");
+  for (const bench::Result& r : results) {
+    fprintf(out, "%s,%s,%llu,%.1f,%.3f,%.1f,\"", r.suite.c_str(), r.name.c_str(),
+            static_cast<unsigned long long>(r.iterations), r.nsPerOp, r.allocationsPerOp, r.bytesPerOp);
+    bool first = true;
+    for (const auto& metric : r.metrics) {
+      fprintf(out, "%s%s=%.6g", first ? "" : ";", metric.first.c_str(), metric.second);
+      first = false;
+    }
+    fprintf(out, "\"\n");
+  }
+}
+
+void usage() {
+  fprintf(stderr, "usage: o_bench [--quick] [--suite name] [--format json|csv] [--out path]\nsuites:");
+  for (const bench::Suite& suite : bench::suites()) {
+    fprintf(stderr, " %s", suite.name);
+  }
+  fprintf(stderr, "\n");
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  bench::Options options;
+  std::string format = "json";
+  std::string path;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--quick") {
+      options.quick = true;
+    } else if (arg == "--suite" && i + 1 < argc) {
+      options.suite = argv[++i];
+    } else if (arg == "--format" && i + 1 < argc) {
+      format = argv[++i];
+    } else if (arg == "--out" && i + 1 < argc) {
+      path = argv[++i];
+    } else {
+      usage();
+      return 2;
+    }
+  }
+  if (format != "json" && format != "csv") {
+    usage();
+    return 2;
+  }
+
+  std::vector<bench::Result> results;
+  std::vector<std::string> failures;
+  bool found = options.suite.empty();
+  for (const bench::Suite& suite : bench::suites()) {
+    if (!options.suite.empty() && options.suite != suite.name) {
+      continue;
+    }
+    found = true;
+    fake::reset();
+    bench::Context context(suite.name, options);
+    suite.run(context);
+    fake::stopTasks();
+    results.insert(results.end(), context.results().begin(), context.results().end());
+    failures.insert(failures.end(), context.failures().begin(), context.failures().end());
+    fprintf(stderr, "%s: %d cases\n", suite.name, static_cast<int>(context.results().size()));
+  }
+  if (!found) {
+    usage();
+    return 2;
+  }
+
+  FILE* out = path.empty() ? stdout : fopen(path.c_str(), "w");
+  if (out == nullptr) {
+    fprintf(stderr, "Cannot write %s\n", path.c_str());
+    return 1;
+  }
+  if (format == "json") {
+    writeJson(out, results);
+  } else {
+    writeCsv(out, results);
+  }
+  if (out != stdout) {
+    fclose(out);
+  }
+  for (const std::string& failure : failures) {
+    fprintf(stderr, "FAILED %s\n", failure.c_str());
+  }
+  return failures.empty() ? 0 : 1;
+}
@@ -0,0 +1,286 @@
+#pragma once
+
+// Host stand-in for the Arduino-ESP32 core, with only what O-Library uses.
+// Time, pins and peripherals are simulated and controlled through FakeHal.h.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define HIGH 0x1
+#define LOW 0x0
+
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define PULLUP 0x04
+#define INPUT_PULLUP 0x05
+
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+
+#define LSBFIRST 0
+#define MSBFIRST 1
+
+#define DEC 10
+#define HEX 16
+
+#define PROGMEM
+#define PGM_P const char*
+#define IRAM_ATTR
+
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+void attachInterrupt(uint8_t pin, void (*handler)(void), int mode);
+void attachInterruptArg(uint8_t pin, void (*handler)(void*), void* arg, int mode);
+void detachInterrupt(uint8_t pin);
+
+double ledcSetup(uint8_t channel, double frequency, uint8_t resolutionBits);
+void ledcAttachPin(uint8_t pin, uint8_t channel);
+void ledcWrite(uint8_t channel, uint32_t duty);
+
+class String {
+ public:
+  String(const char* text = "") : _text(text != nullptr ? text : "") {}
+  String(const String&) = default;
+  String(String&&) = default;
+  explicit String(char c) : _text(1, c) {}
+  String(int value, unsigned char base = DEC) : _text(format(base == HEX ? "%x" : "%d", value)) {}
+  String(unsigned int value, unsigned char base = DEC) : _text(format(base == HEX ? "%x" : "%u", value)) {}
+  String(long value, unsigned char base = DEC) : _text(format(base == HEX ? "%lx" : "%ld", value)) {}
+  String(unsigned long value, unsigned char base = DEC) : _text(format(base == HEX ? "%lx" : "%lu", value)) {}
+  String(float value, unsigned int decimals = 2) : _text(format("%.*f", decimals, value)) {}
+  String(double value, unsigned int decimals = 2) : _text(format("%.*f", decimals, value)) {}
+
+  String& operator=(const String&) = default;
+  String& operator=(String&&) = default;
+  String& operator=(const char* text) {
+    _text = text != nullptr ? text : "";
+    return *this;
+  }
+
+  const char* c_str() const { return _text.c_str(); }
+  unsigned int length() const { return _text.size(); }
+  bool isEmpty() const { return _text.empty(); }
+  bool reserve(unsigned int size) {
+    _text.reserve(size);
+    return true;
+  }
+
+  char charAt(unsigned int index) const { return index < _text.size() ? _text[index] : 0; }
+  char operator[](unsigned int index) const { return charAt(index); }
+  char& operator[](unsigned int index) { return _text[index]; }
+
+  // Like the Arduino core: atol() and atof(), so invalid text is 0
+  long toInt() const { return atol(_text.c_str()); }
+  float toFloat() const { return static_cast<float>(atof(_text.c_str())); }
+  double toDouble() const { return atof(_text.c_str()); }
+
+  bool equals(const String& other) const { return _text == other._text; }
+  bool startsWith(const String& prefix) const { return _text.compare(0, prefix._text.size(), prefix._text) == 0; }
+  bool endsWith(const String& suffix) const {
+    return _text.size() >= suffix._text.size() &&
+           _text.compare(_text.size() - suffix._text.size(), suffix._text.size(), suffix._text) == 0;
+  }
+  int indexOf(char c, unsigned int from = 0) const {
+    size_t index = _text.find(c, from);
+    return index == std::string::npos ? -1 : static_cast<int>(index);
+  }
+  int indexOf(const String& text, unsigned int from = 0) const {
+    size_t index = _text.find(text._text, from);
+    return index == std::string::npos ? -1 : static_cast<int>(index);
+  }
+  String substring(unsigned int from) const { return substring(from, _text.size()); }
+  String substring(unsigned int from, unsigned int to) const {
+    if (from > to) {
+      std::swap(from, to);
+    }
+    from = std::min<unsigned int>(from, _text.size());
+    to = std::min<unsigned int>(to, _text.size());
+    return String(_text.substr(from, to - from).c_str());
+  }
+
+  bool concat(const String& text) {
+    _text += text._text;
+    return true;
+  }
+  String& operator+=(const String& text) {
+    _text += text._text;
+    return *this;
+  }
+  String& operator+=(const char* text) {
+    _text += text != nullptr ? text : "";
+    return *this;
+  }
+  String& operator+=(char c) {
+    _text += c;
+    return *this;
+  }
+
+  bool operator==(const String& other) const { return _text == other._text; }
+  bool operator==(const char* other) const { return _text == (other != nullptr ? other : ""); }
+  bool operator!=(const String& other) const { return !(*this == other); }
+  bool operator!=(const char* other) const { return !(*this == other); }
+  bool operator<(const String& other) const { return _text < other._text; }
+
+ private:
+  std::string _text;
+
+  template <typename... Args>
+  static std::string format(const char* format, Args... args) {
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), format, args...);
+    return buffer;
+  }
+};
+
+inline String operator+(const String& a, const String& b) {
+  String result = a;
+  result += b;
+  return result;
+}
+
+inline String operator+(const String& a, const char* b) {
+  String result = a;
+  result += b;
+  return result;
+}
+
+inline String operator+(const char* a, const String& b) {
+  String result = a;
+  result += b;
+  return result;
+}
+
+class Printable;
+
+class Print {
+ public:
+  virtual ~Print() = default;
+
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buffer, size_t size) {
+    size_t written = 0;
+    while (size-- > 0 && write(*buffer++) == 1) {
+      written++;
+    }
+    return written;
+  }
+  size_t write(const char* text) { return text == nullptr ? 0 : write(reinterpret_cast<const uint8_t*>(text), strlen(text)); }
+  size_t write(const char* buffer, size_t size) { return write(reinterpret_cast<const uint8_t*>(buffer), size); }
+  virtual void flush() {}
+
+  // Like the Arduino core, lines which do not fit in 64 bytes are formatted in a heap buffer
+  size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+  size_t print(const String& text) { return write(text.c_str(), text.length()); }
+  size_t print(const char text[]) { return write(text); }
+  size_t print(char c) { return write(static_cast<uint8_t>(c)); }
+  size_t print(unsigned char value, int base = DEC) { return print(static_cast<unsigned long>(value), base); }
+  size_t print(int value, int base = DEC) { return print(static_cast<long>(value), base); }
+  size_t print(unsigned int value, int base = DEC) { return print(static_cast<unsigned long>(value), base); }
+  size_t print(long value, int base = DEC) { return printf(base == HEX ? "%lx" : "%ld", value); }
+  size_t print(unsigned long value, int base = DEC) { return printf(base == HEX ? "%lx" : "%lu", value); }
+  size_t print(double value, int decimals = 2) { return printf("%.*f", decimals, value); }
+  size_t print(const Printable& value);
+
+  size_t println() { return write("\r\n"); }
+  template <typename T>
+  size_t println(const T& value) {
+    size_t written = print(value);
+    return written + println();
+  }
+  template <typename T>
+  size_t println(const T& value, int format) {
+    size_t written = print(value, format);
+    return written + println();
+  }
+};
+
+class Printable {
+ public:
+  virtual ~Printable() = default;
+  virtual size_t printTo(Print& out) const = 0;
+};
+
+inline size_t Print::print(const Printable& value) {
+  return value.printTo(*this);
+}
+
+class Stream : public Print {
+ public:
+  virtual int available() { return 0; }
+  virtual int read() { return -1; }
+  virtual int peek() { return -1; }
+};
+
+class HardwareSerial : public Stream {
+  /*
+      Output is kept in fake::serialOutput(), and echoed to stdout with fake::echoSerial(true).
+  */
+ public:
+  using Print::write;
+  void begin(unsigned long baud) {}
+  void end() {}
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t* buffer, size_t size) override;
+  int availableForWrite() { return 128; }
+  explicit operator bool() const { return true; }
+};
+
+extern HardwareSerial Serial;
+
+class IPAddress : public Printable {
+ public:
+  IPAddress() : _octets{0, 0, 0, 0} {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : _octets{a, b, c, d} {}
+  uint8_t operator[](int index) const { return _octets[index]; }
+  String toString() const {
+    char text[16];
+    snprintf(text, sizeof(text), "%u.%u.%u.%u", _octets[0], _octets[1], _octets[2], _octets[3]);
+    return text;
+  }
+  size_t printTo(Print& out) const override { return out.print(toString()); }
+
+ private:
+  uint8_t _octets[4];
+};
+
+class EspClass {
+ public:
+  uint32_t getFreeHeap();
+  uint32_t getMinFreeHeap();
+  uint32_t getMaxAllocHeap();
+  uint32_t getHeapSize();
+  uint32_t getPsramSize();
+  uint32_t getFreePsram();
+  // Cycles at 240 MHz from the host clock, so profiled stages show host time
+  uint32_t getCycleCount();
+  uint32_t getCpuFreqMHz() { return 240; }
+  void restart();
+};
+
+extern EspClass ESP;
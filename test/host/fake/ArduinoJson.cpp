@@ -0,0 +1,657 @@
+#include <ArduinoJson.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+namespace ArduinoJson {
+
+namespace {
+class MallocAllocator : public Allocator {
+ public:
+  void* allocate(size_t size) override { return malloc(size); }
+  void deallocate(void* ptr) override { free(ptr); }
+  void* reallocate(void* ptr, size_t size) override { return realloc(ptr, size); }
+};
+
+using detail::Node;
+
+char* copyString(Allocator* allocator, const char* text, size_t length) {
+  char* copy = static_cast<char*>(allocator->allocate(length + 1));
+  if (copy != nullptr) {
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+  }
+  return copy;
+}
+
+void freeNode(Allocator* allocator, Node* node) {
+  detail::clearNode(allocator, node);
+  if (node->key != nullptr) {
+    allocator->deallocate(node->key);
+  }
+  node->~Node();
+  allocator->deallocate(node);
+}
+
+void copyNode(Allocator* allocator, Node* target, const Node* source) {
+  detail::clearNode(allocator, target);
+  target->type = source->type;
+  target->unsignedValue = source->unsignedValue;
+  if (source->type == Node::String) {
+    target->text = copyString(allocator, source->text, strlen(source->text));
+  }
+  for (const Node* child = source->first; child != nullptr; child = child->next) {
+    Node* copy = detail::appendNode(allocator, target);
+    if (copy == nullptr) {
+      return;
+    }
+    if (child->key != nullptr) {
+      copy->key = copyString(allocator, child->key, strlen(child->key));
+    }
+    copyNode(allocator, copy, child);
+  }
+}
+}  // namespace
+
+Allocator* defaultAllocator() {
+  static MallocAllocator allocator;
+  return &allocator;
+}
+
+namespace detail {
+void clearNode(Allocator* allocator, Node* node) {
+  if (node->text != nullptr) {
+    allocator->deallocate(node->text);
+    node->text = nullptr;
+  }
+  Node* child = node->first;
+  while (child != nullptr) {
+    Node* next = child->next;
+    freeNode(allocator, child);
+    child = next;
+  }
+  node->first = node->last = nullptr;
+  node->size = 0;
+  node->type = Node::Null;
+  node->unsignedValue = 0;
+}
+
+Node* appendNode(Allocator* allocator, Node* parent) {
+  void* memory = allocator->allocate(sizeof(Node));
+  if (memory == nullptr) {
+    return nullptr;
+  }
+  Node* node = new (memory) Node();
+  if (parent->last != nullptr) {
+    parent->last->next = node;
+  } else {
+    parent->first = node;
+  }
+  parent->last = node;
+  parent->size++;
+  return node;
+}
+}  // namespace detail
+
+// JsonVariant
+
+size_t JsonVariant::size() const {
+  return _node != nullptr && (_node->type == Node::Array || _node->type == Node::Object) ? _node->size : 0;
+}
+
+bool JsonVariant::set(bool value) {
+  if (_node == nullptr) return false;
+  detail::clearNode(_allocator, _node);
+  _node->type = Node::Bool;
+  _node->boolean = value;
+  return true;
+}
+
+bool JsonVariant::set(float value) {
+  if (_node == nullptr) return false;
+  detail::clearNode(_allocator, _node);
+  _node->type = Node::Float;
+  _node->real = value;
+  return true;
+}
+
+bool JsonVariant::set(double value) {
+  if (_node == nullptr) return false;
+  detail::clearNode(_allocator, _node);
+  _node->type = Node::Double;
+  _node->real = value;
+  return true;
+}
+
+bool JsonVariant::set(const char* value) {
+  if (_node == nullptr) return false;
+  detail::clearNode(_allocator, _node);
+  if (value == nullptr) {
+    return true;
+  }
+  _node->text = copyString(_allocator, value, strlen(value));
+  if (_node->text == nullptr) {
+    return false;
+  }
+  _node->type = Node::String;
+  return true;
+}
+
+bool JsonVariant::set(const JsonVariant& value) {
+  if (_node == nullptr) return false;
+  if (value._node == nullptr) {
+    detail::clearNode(_allocator, _node);
+  } else if (value._node != _node) {
+    copyNode(_allocator, _node, value._node);
+  }
+  return true;
+}
+
+bool JsonVariant::setSigned(int64_t value) {
+  if (_node == nullptr) return false;
+  detail::clearNode(_allocator, _node);
+  _node->type = Node::Signed;
+  _node->signedValue = value;
+  return true;
+}
+
+bool JsonVariant::setUnsigned(uint64_t value) {
+  if (_node == nullptr) return false;
+  detail::clearNode(_allocator, _node);
+  _node->type = Node::Unsigned;
+  _node->unsignedValue = value;
+  return true;
+}
+
+Node* JsonVariant::member(const char* key) const {
+  if (_node == nullptr || _node->type != Node::Object || key == nullptr) {
+    return nullptr;
+  }
+  for (Node* child = _node->first; child != nullptr; child = child->next) {
+    if (strcmp(child->key, key) == 0) {
+      return child;
+    }
+  }
+  return nullptr;
+}
+
+JsonVariant JsonVariant::operator[](const char* key) {
+  if (_node == nullptr || key == nullptr) {
+    return JsonVariant();
+  }
+  if (_node->type == Node::Null) {
+    _node->type = Node::Object;
+  }
+  if (_node->type != Node::Object) {
+    return JsonVariant();
+  }
+  Node* node = member(key);
+  if (node == nullptr) {
+    node = detail::appendNode(_allocator, _node);
+    if (node == nullptr) {
+      return JsonVariant();
+    }
+    node->key = copyString(_allocator, key, strlen(key));
+  }
+  return JsonVariant(_allocator, node);
+}
+
+JsonVariant JsonVariant::operator[](size_t index) const {
+  if (_node == nullptr || _node->type != Node::Array) {
+    return JsonVariant();
+  }
+  Node* node = _node->first;
+  while (node != nullptr && index-- > 0) {
+    node = node->next;
+  }
+  return JsonVariant(_allocator, node);
+}
+
+bool JsonVariant::containsKey(const char* key) const {
+  return member(key) != nullptr;
+}
+
+// JsonDocument
+
+JsonDocument::JsonDocument(Allocator* allocator) : _allocator(allocator != nullptr ? allocator : defaultAllocator()) {}
+
+JsonDocument::JsonDocument(const JsonDocument& other) : _allocator(other._allocator) {
+  copyNode(_allocator, &_root, &other._root);
+}
+
+JsonDocument::JsonDocument(JsonDocument&& other) : _allocator(other._allocator), _root(other._root) {
+  other._root = Node();
+}
+
+JsonDocument& JsonDocument::operator=(const JsonDocument& other) {
+  if (this != &other) {
+    copyNode(_allocator, &_root, &other._root);
+  }
+  return *this;
+}
+
+JsonDocument& JsonDocument::operator=(JsonDocument&& other) {
+  if (this != &other) {
+    if (_allocator == other._allocator) {
+      detail::clearNode(_allocator, &_root);
+      _root = other._root;
+      other._root = Node();
+    } else {
+      copyNode(_allocator, &_root, &other._root);
+    }
+  }
+  return *this;
+}
+
+JsonDocument::~JsonDocument() {
+  detail::clearNode(_allocator, &_root);
+}
+
+void JsonDocument::clear() {
+  detail::clearNode(_allocator, &_root);
+}
+
+const char* DeserializationError::c_str() const {
+  static const char* const NAMES[] = {"Ok", "EmptyInput", "IncompleteInput", "InvalidInput", "NoMemory", "TooDeep"};
+  return NAMES[_code];
+}
+
+// Serialization
+
+namespace {
+void writeNumber(std::string& out, double value, bool isFloat) {
+  if (!std::isfinite(value)) {
+    out += "null";
+    return;
+  }
+  // Shortest representation which reads back as the same value
+  char text[32];
+  for (int precision = 1; precision <= 17; precision++) {
+    snprintf(text, sizeof(text), "%.*g", precision, value);
+    double parsed = strtod(text, nullptr);
+    if (isFloat ? static_cast<float>(parsed) == static_cast<float>(value) : parsed == value) {
+      break;
+    }
+  }
+  out += text;
+}
+
+void writeString(std::string& out, const char* text) {
+  out += '"';
+  for (const char* c = text; *c != '\0'; c++) {
+    switch (*c) {
+      case '"':
+        out += "\\\"";
+        break;
+      case '\\':
+        out += "\\\\";
+        break;
+      case '\b':
+        out += "\\b";
+        break;
+      case '\f':
+        out += "\\f";
+        break;
+      case '\n':
+        out += "\\n";
+        break;
+      case '\r':
+        out += "\\r";
+        break;
+      case '\t':
+        out += "\\t";
+        break;
+      default:
+        if (static_cast<uint8_t>(*c) < 0x20) {
+          char escaped[8];
+          snprintf(escaped, sizeof(escaped), "\\u%04x", *c);
+          out += escaped;
+        } else {
+          out += *c;
+        }
+    }
+  }
+  out += '"';
+}
+
+void writeNode(std::string& out, const Node* node) {
+  if (node == nullptr) {
+    out += "null";
+    return;
+  }
+  switch (node->type) {
+    case Node::Null:
+      out += "null";
+      break;
+    case Node::Bool:
+      out += node->boolean ? "true" : "false";
+      break;
+    case Node::Signed:
+      out += std::to_string(node->signedValue);
+      break;
+    case Node::Unsigned:
+      out += std::to_string(node->unsignedValue);
+      break;
+    case Node::Float:
+      writeNumber(out, node->real, true);
+      break;
+    case Node::Double:
+      writeNumber(out, node->real, false);
+      break;
+    case Node::String:
+      writeString(out, node->text);
+      break;
+    case Node::Array:
+    case Node::Object: {
+      bool isObject = node->type == Node::Object;
+      out += isObject ? '{' : '[';
+      for (const Node* child = node->first; child != nullptr; child = child->next) {
+        if (child != node->first) {
+          out += ',';
+        }
+        if (isObject) {
+          writeString(out, child->key);
+          out += ':';
+        }
+        writeNode(out, child);
+      }
+      out += isObject ? '}' : ']';
+      break;
+    }
+  }
+}
+
+std::string toJson(const JsonVariant& source) {
+  std::string out;
+  writeNode(out, source.node());
+  return out;
+}
+}  // namespace
+
+size_t serializeJson(const JsonVariant& source, Print& output) {
+  std::string json = toJson(source);
+  return output.write(json.data(), json.size());
+}
+
+size_t serializeJson(const JsonVariant& source, String& output) {
+  // Like the original, the text is appended
+  std::string json = toJson(source);
+  output += json.c_str();
+  return json.size();
+}
+
+size_t serializeJson(const JsonVariant& source, std::string& output) {
+  std::string json = toJson(source);
+  output += json;
+  return json.size();
+}
+
+size_t serializeJson(const JsonVariant& source, char* output, size_t size) {
+  if (size == 0) {
+    return 0;
+  }
+  std::string json = toJson(source);
+  size_t length = json.size() < size - 1 ? json.size() : size - 1;
+  memcpy(output, json.data(), length);
+  output[length] = '\0';
+  return length;
+}
+
+size_t measureJson(const JsonVariant& source) {
+  return toJson(source).size();
+}
+
+// Deserialization
+
+namespace {
+const int MAX_NESTING = 10;
+
+class Parser {
+ public:
+  Parser(Allocator* allocator, const char* input, size_t length)
+      : _allocator(allocator), _input(input), _end(input + length) {}
+
+  DeserializationError parse(Node* node) {
+    skipSpace();
+    if (_input == _end) {
+      return DeserializationError::EmptyInput;
+    }
+    DeserializationError error = parseValue(node, 0);
+    if (error) {
+      return error;
+    }
+    skipSpace();
+    return _input == _end || *_input == '\0' ? DeserializationError::Ok : DeserializationError::InvalidInput;
+  }
+
+ private:
+  Allocator* _allocator;
+  const char* _input;
+  const char* _end;
+
+  void skipSpace() {
+    while (_input < _end && (*_input == ' ' || *_input == '\t' || *_input == '\r' || *_input == '\n')) {
+      _input++;
+    }
+  }
+
+  bool consume(const char* word) {
+    size_t length = strlen(word);
+    if (static_cast<size_t>(_end - _input) < length || strncmp(_input, word, length) != 0) {
+      return false;
+    }
+    _input += length;
+    return true;
+  }
+
+  DeserializationError parseValue(Node* node, int depth) {
+    skipSpace();
+    if (_input == _end) {
+      return DeserializationError::IncompleteInput;
+    }
+    JsonVariant variant(_allocator, node);
+    switch (*_input) {
+      case '{':
+      case '[':
+        if (depth >= MAX_NESTING) {
+          return DeserializationError::TooDeep;
+        }
+        return *_input == '{' ? parseObject(node, depth + 1) : parseArray(node, depth + 1);
+      case '"': {
+        std::string text;
+        DeserializationError error = parseString(text);
+        if (!error && !variant.set(text.c_str())) {
+          return DeserializationError::NoMemory;
+        }
+        return error;
+      }
+      case 't':
+        return consume("true") && variant.set(true) ? DeserializationError::Ok : DeserializationError::InvalidInput;
+      case 'f':
+        return consume("false") && variant.set(false) ? DeserializationError::Ok : DeserializationError::InvalidInput;
+      case 'n':
+        return consume("null") ? DeserializationError::Ok : DeserializationError::InvalidInput;
+      default:
+        return parseNumber(variant);
+    }
+  }
+
+  DeserializationError parseNumber(JsonVariant& variant) {
+    const char* start = _input;
+    bool isInteger = true;
+    while (_input < _end && (isdigit(*_input) || strchr("+-.eE", *_input) != nullptr)) {
+      if (!isdigit(*_input) && *_input != '-') {
+        isInteger = false;
+      }
+      _input++;
+    }
+    if (_input == start) {
+      return DeserializationError::InvalidInput;
+    }
+    std::string text(start, _input);
+    char* end = nullptr;
+    if (isInteger && text[0] == '-') {
+      long long value = strtoll(text.c_str(), &end, 10);
+      variant.set(value);
+    } else if (isInteger) {
+      unsigned long long value = strtoull(text.c_str(), &end, 10);
+      variant.set(value);
+    } else {
+      variant.set(strtod(text.c_str(), &end));
+    }
+    return *end == '\0' ? DeserializationError::Ok : DeserializationError::InvalidInput;
+  }
+
+  DeserializationError parseString(std::string& text) {
+    _input++;  // '"'
+    while (_input < _end && *_input != '"') {
+      char c = *_input++;
+      if (c != '\\') {
+        text += c;
+        continue;
+      }
+      if (_input == _end) {
+        return DeserializationError::IncompleteInput;
+      }
+      c = *_input++;
+      switch (c) {
+        case 'b':
+          text += '\b';
+          break;
+        case 'f':
+          text += '\f';
+          break;
+        case 'n':
+          text += '\n';
+          break;
+        case 'r':
+          text += '\r';
+          break;
+        case 't':
+          text += '\t';
+          break;
+        case 'u': {
+          if (_end - _input < 4) {
+            return DeserializationError::IncompleteInput;
+          }
+          unsigned code = strtoul(std::string(_input, 4).c_str(), nullptr, 16);
+          _input += 4;
+          // UTF-8 without surrogate pairs
+          if (code < 0x80) {
+            text += static_cast<char>(code);
+          } else if (code < 0x800) {
+            text += static_cast<char>(0xc0 | (code >> 6));
+            text += static_cast<char>(0x80 | (code & 0x3f));
+          } else {
+            text += static_cast<char>(0xe0 | (code >> 12));
+            text += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+            text += static_cast<char>(0x80 | (code & 0x3f));
+          }
+          break;
+        }
+        default:
+          text += c;
+      }
+    }
+    if (_input == _end) {
+      return DeserializationError::IncompleteInput;
+    }
+    _input++;  // '"'
+    return DeserializationError::Ok;
+  }
+
+  DeserializationError parseArray(Node* node, int depth) {
+    _input++;  // '['
+    node->type = Node::Array;
+    skipSpace();
+    if (_input < _end && *_input == ']') {
+      _input++;
+      return DeserializationError::Ok;
+    }
+    while (true) {
+      Node* item = detail::appendNode(_allocator, node);
+      if (item == nullptr) {
+        return DeserializationError::NoMemory;
+      }
+      DeserializationError error = parseValue(item, depth);
+      if (error) {
+        return error;
+      }
+      skipSpace();
+      if (_input == _end) {
+        return DeserializationError::IncompleteInput;
+      }
+      char c = *_input++;
+      if (c == ']') {
+        return DeserializationError::Ok;
+      }
+      if (c != ',') {
+        return DeserializationError::InvalidInput;
+      }
+    }
+  }
+
+  DeserializationError parseObject(Node* node, int depth) {
+    _input++;  // '{'
+    node->type = Node::Object;
+    skipSpace();
+    if (_input < _end && *_input == '}') {
+      _input++;
+      return DeserializationError::Ok;
+    }
+    while (true) {
+      skipSpace();
+      if (_input == _end) {
+        return DeserializationError::IncompleteInput;
+      }
+      if (*_input != '"') {
+        return DeserializationError::InvalidInput;
+      }
+      std::string key;
+      DeserializationError error = parseString(key);
+      if (error) {
+        return error;
+      }
+      skipSpace();
+      if (_input == _end) {
+        return DeserializationError::IncompleteInput;
+      }
+      if (*_input++ != ':') {
+        return DeserializationError::InvalidInput;
+      }
+      JsonVariant member = JsonVariant(_allocator, node)[key.c_str()];
+      if (member.node() == nullptr) {
+        return DeserializationError::NoMemory;
+      }
+      error = parseValue(member.node(), depth);
+      if (error) {
+        return error;
+      }
+      skipSpace();
+      if (_input == _end) {
+        return DeserializationError::IncompleteInput;
+      }
+      char c = *_input++;
+      if (c == '}') {
+        return DeserializationError::Ok;
+      }
+      if (c != ',') {
+        return DeserializationError::InvalidInput;
+      }
+    }
+  }
+};
+}  // namespace
+
+DeserializationError deserializeJson(JsonDocument& document, const char* input, size_t length) {
+  document.clear();
+  if (input == nullptr) {
+    return DeserializationError::EmptyInput;
+  }
+  Parser parser(document.allocator(), input, length);
+  return parser.parse(document.variant().node());
+}
+
+}  // namespace ArduinoJson
@@ -0,0 +1,401 @@
+#pragma once
+
+// Host stand-in for ArduinoJson 7 with the API used by O-Library and the host tests.
+// Values are kept in a tree of nodes. Each node and each copied string is one block from the
+// document's Allocator, so JsonAllocationCounter still counts every allocation. The real
+// library pools nodes, so it allocates less often; counts here are an upper bound.
+
+#include <Arduino.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+
+namespace ArduinoJson {
+
+class Allocator {
+ public:
+  virtual void* allocate(size_t size) = 0;
+  virtual void deallocate(void* ptr) = 0;
+  virtual void* reallocate(void* ptr, size_t size) = 0;
+
+ protected:
+  ~Allocator() = default;
+};
+
+// malloc() and free()
+Allocator* defaultAllocator();
+
+namespace detail {
+struct Node {
+  enum Type : uint8_t { Null, Bool, Signed, Unsigned, Float, Double, String, Array, Object };
+  Type type = Null;
+  union {
+    bool boolean;
+    int64_t signedValue;
+    uint64_t unsignedValue;
+    double real;
+  };
+  char* text = nullptr;  // String value
+  char* key = nullptr;   // Member name in an object
+  Node* first = nullptr;
+  Node* last = nullptr;
+  Node* next = nullptr;
+  size_t size = 0;
+
+  Node() : unsignedValue(0) {}
+};
+}  // namespace detail
+
+class JsonArray;
+class JsonObject;
+
+class JsonString {
+ public:
+  JsonString(const char* text = nullptr) : _text(text) {}
+  const char* c_str() const { return _text; }
+  size_t size() const { return _text != nullptr ? strlen(_text) : 0; }
+  bool isNull() const { return _text == nullptr; }
+  bool operator==(const char* other) const { return _text != nullptr && other != nullptr && strcmp(_text, other) == 0; }
+
+ private:
+  const char* _text;
+};
+
+class JsonVariant {
+ public:
+  JsonVariant() = default;
+  JsonVariant(Allocator* allocator, detail::Node* node) : _allocator(allocator), _node(node) {}
+
+  bool isNull() const { return _node == nullptr || _node->type == detail::Node::Null; }
+  size_t size() const;
+
+  template <typename T>
+  JsonVariant& operator=(const T& value) {
+    set(value);
+    return *this;
+  }
+  JsonVariant& operator=(const JsonVariant& value) {
+    set(value);
+    return *this;
+  }
+  JsonVariant(const JsonVariant&) = default;
+
+  bool set(bool value);
+  bool set(float value);
+  bool set(double value);
+  bool set(const char* value);
+  bool set(char* value) { return set(static_cast<const char*>(value)); }
+  bool set(const String& value) { return set(value.c_str()); }
+  bool set(const std::string& value) { return set(value.c_str()); }
+  bool set(JsonString value) { return set(value.c_str()); }
+  bool set(const JsonVariant& value);
+  template <size_t N>
+  bool set(const char (&value)[N]) {
+    return set(static_cast<const char*>(value));
+  }
+  template <typename T>
+  typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value, bool>::type set(T value) {
+    return std::is_signed<T>::value ? setSigned(static_cast<int64_t>(value)) : setUnsigned(static_cast<uint64_t>(value));
+  }
+
+  template <typename T>
+  T as() const;
+  template <typename T>
+  bool is() const;
+  template <typename T>
+  T to();
+
+  // Object members and array elements. Missing members are added.
+  JsonVariant operator[](const char* key);
+  JsonVariant operator[](const String& key) { return (*this)[key.c_str()]; }
+  JsonVariant operator[](const std::string& key) { return (*this)[key.c_str()]; }
+  JsonVariant operator[](size_t index) const;
+  JsonVariant operator[](int index) const { return (*this)[static_cast<size_t>(index)]; }
+  bool containsKey(const char* key) const;
+
+  template <typename T>
+  T add();
+  template <typename T>
+  bool add(const T& value) {
+    return add<JsonVariant>().set(value);
+  }
+
+  detail::Node* node() const { return _node; }
+  Allocator* allocator() const { return _allocator; }
+
+ protected:
+  Allocator* _allocator = nullptr;
+  detail::Node* _node = nullptr;
+
+  bool setSigned(int64_t value);
+  bool setUnsigned(uint64_t value);
+  detail::Node* member(const char* key) const;
+};
+
+class JsonPair {
+ public:
+  JsonPair(Allocator* allocator, detail::Node* node) : _allocator(allocator), _node(node) {}
+  JsonString key() const { return JsonString(_node->key); }
+  JsonVariant value() const { return JsonVariant(_allocator, _node); }
+
+ private:
+  Allocator* _allocator;
+  detail::Node* _node;
+};
+
+template <typename Item>
+class JsonIterator {
+ public:
+  JsonIterator(Allocator* allocator, detail::Node* node) : _allocator(allocator), _node(node) {}
+  Item operator*() const { return Item(_allocator, _node); }
+  JsonIterator& operator++() {
+    _node = _node->next;
+    return *this;
+  }
+  bool operator!=(const JsonIterator& other) const { return _node != other._node; }
+  bool operator==(const JsonIterator& other) const { return _node == other._node; }
+
+ private:
+  Allocator* _allocator;
+  detail::Node* _node;
+};
+
+class JsonObject : public JsonVariant {
+ public:
+  JsonObject() = default;
+  JsonObject(Allocator* allocator, detail::Node* node)
+      : JsonVariant(allocator, node != nullptr && node->type == detail::Node::Object ? node : nullptr) {}
+  using JsonVariant::operator=;
+  JsonIterator<JsonPair> begin() const { return {_allocator, _node != nullptr ? _node->first : nullptr}; }
+  JsonIterator<JsonPair> end() const { return {_allocator, nullptr}; }
+};
+
+class JsonArray : public JsonVariant {
+ public:
+  JsonArray() = default;
+  JsonArray(Allocator* allocator, detail::Node* node)
+      : JsonVariant(allocator, node != nullptr && node->type == detail::Node::Array ? node : nullptr) {}
+  using JsonVariant::operator=;
+  JsonIterator<JsonVariant> begin() const { return {_allocator, _node != nullptr ? _node->first : nullptr}; }
+  JsonIterator<JsonVariant> end() const { return {_allocator, nullptr}; }
+};
+
+namespace detail {
+// Conversions for JsonVariant::as()
+template <typename T, typename Enable = void>
+struct Converter;
+
+template <typename T>
+struct Converter<T, typename std::enable_if<std::is_arithmetic<T>::value && !std::is_same<T, bool>::value>::type> {
+  static T from(const Node* node) {
+    if (node == nullptr) return 0;
+    switch (node->type) {
+      case Node::Signed:
+        return static_cast<T>(node->signedValue);
+      case Node::Unsigned:
+        return static_cast<T>(node->unsignedValue);
+      case Node::Float:
+      case Node::Double:
+        return static_cast<T>(node->real);
+      case Node::Bool:
+        return static_cast<T>(node->boolean);
+      default:
+        return 0;
+    }
+  }
+  static bool is(const Node* node) {
+    if (node == nullptr) return false;
+    if (std::is_floating_point<T>::value) {
+      return node->type == Node::Signed || node->type == Node::Unsigned || node->type == Node::Float ||
+             node->type == Node::Double;
+    }
+    return node->type == Node::Signed || node->type == Node::Unsigned;
+  }
+};
+
+template <>
+struct Converter<bool> {
+  static bool from(const Node* node) {
+    if (node == nullptr) return false;
+    if (node->type == Node::Bool) return node->boolean;
+    return Converter<double>::from(node) != 0;
+  }
+  static bool is(const Node* node) { return node != nullptr && node->type == Node::Bool; }
+};
+
+template <>
+struct Converter<const char*> {
+  static const char* from(const Node* node) { return node != nullptr && node->type == Node::String ? node->text : nullptr; }
+  static bool is(const Node* node) { return node != nullptr && node->type == Node::String; }
+};
+
+template <>
+struct Converter<JsonString> {
+  static JsonString from(const Node* node) { return JsonString(Converter<const char*>::from(node)); }
+  static bool is(const Node* node) { return Converter<const char*>::is(node); }
+};
+
+template <>
+struct Converter<String> {
+  static String from(const Node* node) { return String(Converter<const char*>::from(node)); }
+  static bool is(const Node* node) { return Converter<const char*>::is(node); }
+};
+
+template <>
+struct Converter<std::string> {
+  static std::string from(const Node* node) {
+    const char* text = Converter<const char*>::from(node);
+    return text != nullptr ? text : "";
+  }
+  static bool is(const Node* node) { return Converter<const char*>::is(node); }
+};
+}  // namespace detail
+
+template <typename T>
+T JsonVariant::as() const {
+  if constexpr (std::is_same<T, JsonObject>::value || std::is_same<T, JsonArray>::value) {
+    return T(_allocator, _node);
+  } else if constexpr (std::is_same<T, JsonVariant>::value) {
+    return *this;
+  } else {
+    return detail::Converter<T>::from(_node);
+  }
+}
+
+template <typename T>
+bool JsonVariant::is() const {
+  if constexpr (std::is_same<T, JsonObject>::value) {
+    return _node != nullptr && _node->type == detail::Node::Object;
+  } else if constexpr (std::is_same<T, JsonArray>::value) {
+    return _node != nullptr && _node->type == detail::Node::Array;
+  } else {
+    return detail::Converter<T>::is(_node);
+  }
+}
+
+namespace detail {
+void clearNode(Allocator* allocator, Node* node);
+Node* appendNode(Allocator* allocator, Node* parent);
+}  // namespace detail
+
+template <typename T>
+T JsonVariant::to() {
+  static_assert(std::is_same<T, JsonObject>::value || std::is_same<T, JsonArray>::value, "to<JsonObject> or to<JsonArray>");
+  if (_node == nullptr) {
+    return T();
+  }
+  detail::clearNode(_allocator, _node);
+  _node->type = std::is_same<T, JsonObject>::value ? detail::Node::Object : detail::Node::Array;
+  return T(_allocator, _node);
+}
+
+template <typename T>
+T JsonVariant::add() {
+  if (_node == nullptr) {
+    return T();
+  }
+  if (_node->type == detail::Node::Null) {
+    _node->type = detail::Node::Array;
+  }
+  if (_node->type != detail::Node::Array) {
+    return T();
+  }
+  JsonVariant item(_allocator, detail::appendNode(_allocator, _node));
+  if constexpr (std::is_same<T, JsonVariant>::value) {
+    return item;
+  } else {
+    return item.to<T>();
+  }
+}
+
+class JsonDocument {
+ public:
+  explicit JsonDocument(Allocator* allocator = defaultAllocator());
+  JsonDocument(const JsonDocument& other);
+  JsonDocument(JsonDocument&& other);
+  JsonDocument& operator=(const JsonDocument& other);
+  JsonDocument& operator=(JsonDocument&& other);
+  ~JsonDocument();
+
+  void clear();
+  bool overflowed() const { return false; }
+  size_t size() const { return variant().size(); }
+  bool isNull() const { return _root.type == detail::Node::Null; }
+
+  template <typename T>
+  JsonVariant operator[](const T& key) {
+    return variant()[key];
+  }
+  JsonVariant operator[](const char* key) { return variant()[key]; }
+  template <typename T>
+  T as() const {
+    return variant().as<T>();
+  }
+  template <typename T>
+  bool is() const {
+    return variant().is<T>();
+  }
+  template <typename T>
+  T to() {
+    return variant().to<T>();
+  }
+  template <typename T>
+  T add() {
+    return variant().add<T>();
+  }
+  template <typename T>
+  bool add(const T& value) {
+    return variant().add(value);
+  }
+  template <typename T>
+  bool set(const T& value) {
+    return variant().set(value);
+  }
+  bool containsKey(const char* key) const { return variant().containsKey(key); }
+
+  operator JsonVariant() const { return variant(); }
+  JsonVariant variant() const { return JsonVariant(_allocator, const_cast<detail::Node*>(&_root)); }
+  Allocator* allocator() const { return _allocator; }
+
+ private:
+  Allocator* _allocator;
+  detail::Node _root;
+};
+
+class DeserializationError {
+ public:
+  enum Code { Ok, EmptyInput, IncompleteInput, InvalidInput, NoMemory, TooDeep };
+
+  DeserializationError(Code code = Ok) : _code(code) {}
+  explicit operator bool() const { return _code != Ok; }
+  bool operator==(Code code) const { return _code == code; }
+  bool operator!=(Code code) const { return _code != code; }
+  Code code() const { return _code; }
+  const char* c_str() const;
+
+ private:
+  Code _code;
+};
+
+size_t serializeJson(const JsonVariant& source, Print& output);
+size_t serializeJson(const JsonVariant& source, String& output);
+size_t serializeJson(const JsonVariant& source, std::string& output);
+size_t serializeJson(const JsonVariant& source, char* output, size_t size);
+size_t measureJson(const JsonVariant& source);
+
+DeserializationError deserializeJson(JsonDocument& document, const char* input, size_t length);
+inline DeserializationError deserializeJson(JsonDocument& document, const char* input) {
+  return deserializeJson(document, input, input != nullptr ? strlen(input) : 0);
+}
+inline DeserializationError deserializeJson(JsonDocument& document, const String& input) {
+  return deserializeJson(document, input.c_str(), input.length());
+}
+inline DeserializationError deserializeJson(JsonDocument& document, const std::string& input) {
+  return deserializeJson(document, input.c_str(), input.size());
+}
+
+}  // namespace ArduinoJson
+
+using namespace ArduinoJson;
@@ -0,0 +1,19 @@
+#pragma once
+
+class DFRobot_ESP_PH {
+  /*
+      Conversion of the original library with its default calibration
+      (neutral 1500 mV, acid 2032.44 mV). Voltages are in mV.
+  */
+ public:
+  void begin() {}
+  float readPH(float voltage, float temperature) {
+    float slope = (7.0f - 4.0f) / ((_neutralVoltage - 1500.0f) / 3.0f - (_acidVoltage - 1500.0f) / 3.0f);
+    float intercept = 7.0f - slope * (_neutralVoltage - 1500.0f) / 3.0f;
+    return slope * (voltage - 1500.0f) / 3.0f + intercept;
+  }
+
+ private:
+  float _neutralVoltage = 1500.0f;
+  float _acidVoltage = 2032.44f;
+};
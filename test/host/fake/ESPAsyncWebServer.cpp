@@ -0,0 +1,464 @@
+#include <ESPAsyncWebServer.h>
+
+#include <algorithm>
+
+#include "FakeHal.h"
+
+namespace {
+
+int liveBuffers = 0;
+int madeBuffers = 0;
+
+int hexDigit(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+// Percent-decoding of a query component, with '+' as a space
+std::string urlDecode(const std::string& text) {
+  std::string decoded;
+  for (size_t i = 0; i < text.size(); i++) {
+    if (text[i] == '+') {
+      decoded += ' ';
+    } else if (text[i] == '%' && i + 2 < text.size() && hexDigit(text[i + 1]) >= 0 && hexDigit(text[i + 2]) >= 0) {
+      decoded += static_cast<char>(hexDigit(text[i + 1]) * 16 + hexDigit(text[i + 2]));
+      i += 2;
+    } else {
+      decoded += text[i];
+    }
+  }
+  return decoded;
+}
+
+}  // namespace
+
+// Responses
+
+AsyncResponseStream::AsyncResponseStream(const String& contentType, size_t bufferSize)
+    : AsyncWebServerResponse(200, contentType), _room(bufferSize > 0 ? bufferSize - 1 : 0) {
+  _content.reserve(_room);
+}
+
+size_t AsyncResponseStream::write(uint8_t c) {
+  return write(&c, 1);
+}
+
+size_t AsyncResponseStream::write(const uint8_t* data, size_t length) {
+  /*
+      Like 1.2.3, the content is kept in a cbuf of bufferSize, which holds bufferSize - 1 bytes.
+      A write beyond that grows the cbuf, and the allocation is counted.
+  */
+  if (_content.size() + length > _room) {
+    _room = _content.size() + length;
+    _content.reserve(_room);
+  }
+  fake::UntrackedAllocations untracked;
+  _content.append(reinterpret_cast<const char*>(data), length);
+  return length;
+}
+
+namespace {
+
+class BasicResponse : public AsyncWebServerResponse {
+ public:
+  BasicResponse(int code, const String& contentType, const char* content)
+      : AsyncWebServerResponse(code, contentType), _content(content) {}
+  std::string body() const override { return _content; }
+
+ private:
+  std::string _content;
+};
+
+}  // namespace
+
+// Requests
+
+AsyncWebServerRequest::AsyncWebServerRequest(WebRequestMethodComposite method, const char* url,
+                                             RequestedConnectionType type)
+    : _method(method), _connectionType(type) {
+  fake::UntrackedAllocations untracked;
+  std::string text = url;
+  size_t query = text.find('?');
+  _url = text.substr(0, query).c_str();
+  if (query == std::string::npos) {
+    return;
+  }
+  size_t start = query + 1;
+  while (start <= text.size()) {
+    size_t end = text.find('&', start);
+    if (end == std::string::npos) {
+      end = text.size();
+    }
+    std::string pair = text.substr(start, end - start);
+    if (!pair.empty()) {
+      size_t equals = pair.find('=');
+      std::string name = urlDecode(pair.substr(0, equals));
+      std::string value = equals == std::string::npos ? "" : urlDecode(pair.substr(equals + 1));
+      _params.push_back(new AsyncWebParameter(name.c_str(), value.c_str()));
+    }
+    start = end + 1;
+  }
+}
+
+AsyncWebServerRequest::~AsyncWebServerRequest() {
+  fake::UntrackedAllocations untracked;
+  for (AsyncWebParameter* param : _params) {
+    delete param;
+  }
+}
+
+bool AsyncWebServerRequest::hasParam(const String& name, bool post, bool file) const {
+  return getParam(name, post, file) != nullptr;
+}
+
+AsyncWebParameter* AsyncWebServerRequest::getParam(const String& name, bool post, bool file) const {
+  for (AsyncWebParameter* param : _params) {
+    if (param->name().equals(name) && param->isPost() == post && param->isFile() == file) {
+      return param;
+    }
+  }
+  return nullptr;
+}
+
+AsyncWebParameter* AsyncWebServerRequest::getParam(size_t index) const {
+  return index < _params.size() ? _params[index] : nullptr;
+}
+
+void AsyncWebServerRequest::addParam(const String& name, const String& value, bool post) {
+  fake::UntrackedAllocations untracked;
+  _params.push_back(new AsyncWebParameter(name, value, post));
+}
+
+void AsyncWebServerRequest::record(const AsyncWebServerResponse& response) {
+  fake::UntrackedAllocations untracked;
+  _sendCount++;
+  _sentCode = response.code();
+  _sentType = response.contentType().c_str();
+  _sentBody = response.body();
+  _sentHeaders = DefaultHeaders::Instance().headers();
+  for (const auto& header : response.headers()) {
+    _sentHeaders[header.first] = header.second;
+  }
+}
+
+void AsyncWebServerRequest::send(AsyncWebServerResponse* response) {
+  record(*response);
+  fake::UntrackedAllocations untracked;
+  delete response;
+}
+
+void AsyncWebServerRequest::send(int code, const String& contentType, const String& content) {
+  fake::UntrackedAllocations untracked;
+  record(BasicResponse(code, contentType, content.c_str()));
+}
+
+void AsyncWebServerRequest::send_P(int code, const String& contentType, PGM_P content) {
+  fake::UntrackedAllocations untracked;
+  record(BasicResponse(code, contentType, content));
+}
+
+AsyncResponseStream* AsyncWebServerRequest::beginResponseStream(const String& contentType, size_t bufferSize) {
+  fake::UntrackedAllocations untracked;
+  return new AsyncResponseStream(contentType, bufferSize);
+}
+
+// Server
+
+AsyncWebHandler& AsyncWebServer::addHandler(AsyncWebHandler* handler) {
+  fake::UntrackedAllocations untracked;
+  _handlers.push_back(handler);
+  return *handler;
+}
+
+bool AsyncWebServer::removeHandler(AsyncWebHandler* handler) {
+  auto found = std::find(_handlers.begin(), _handlers.end(), handler);
+  if (found == _handlers.end()) {
+    return false;
+  }
+  _handlers.erase(found);
+  return true;
+}
+
+void AsyncWebServer::handle(AsyncWebServerRequest* request) {
+  for (AsyncWebHandler* handler : _handlers) {
+    if (handler->canHandle(request)) {
+      handler->handleRequest(request);
+      return;
+    }
+  }
+  if (_notFound) {
+    _notFound(request);
+  } else {
+    request->send(404);
+  }
+}
+
+// WebSocket
+
+AsyncWebSocketMessageBuffer::AsyncWebSocketMessageBuffer(const uint8_t* data, size_t size)
+    : _data(data != nullptr ? std::string(reinterpret_cast<const char*>(data), size) : std::string(size, '\0')) {
+  liveBuffers++;
+  madeBuffers++;
+}
+
+AsyncWebSocketMessageBuffer::~AsyncWebSocketMessageBuffer() {
+  liveBuffers--;
+}
+
+int AsyncWebSocketMessageBuffer::live() {
+  return liveBuffers;
+}
+
+int AsyncWebSocketMessageBuffer::made() {
+  return madeBuffers;
+}
+
+AsyncWebSocketClient::AsyncWebSocketClient(AsyncWebSocket* server, uint32_t id) : _server(server), _id(id) {}
+
+AsyncWebSocketClient::~AsyncWebSocketClient() {
+  _server->handleEvent(this, WS_EVT_DISCONNECT, nullptr, nullptr, 0);
+}
+
+void AsyncWebSocketClient::close(uint16_t code, const char* message) {
+  _status = WS_DISCONNECTING;
+}
+
+void AsyncWebSocketClient::text(const char* message, size_t length) {
+  if (_status != WS_CONNECTED || _queueFull) {
+    return;
+  }
+  fake::UntrackedAllocations untracked;
+  _messages.emplace_back(message, length);
+}
+
+void AsyncWebSocketClient::text(AsyncWebSocketMessageBuffer* buffer) {
+  /*
+      Like 1.2.3, the buffer is locked by the message and unlocked when it is sent,
+      but never freed here.
+  */
+  if (buffer == nullptr) {
+    return;
+  }
+  buffer->lock();
+  text(buffer->data().c_str(), buffer->data().size());
+  if (_holding) {
+    fake::UntrackedAllocations untracked;
+    _held.push_back(buffer);
+  } else {
+    buffer->unlock();
+  }
+}
+
+void AsyncWebSocketClient::releaseMessages() {
+  _holding = false;
+  for (AsyncWebSocketMessageBuffer* buffer : _held) {
+    buffer->unlock();
+  }
+  _held.clear();
+}
+
+void AsyncWebSocketClient::receive(const char* text) {
+  AwsFrameInfo info = {WS_TEXT, 0, 1, 1, WS_TEXT, strlen(text), {0, 0, 0, 0}, 0};
+  std::string data = text;
+  _server->handleEvent(this, WS_EVT_DATA, &info, reinterpret_cast<uint8_t*>(&data[0]), data.size());
+}
+
+AsyncWebSocket::~AsyncWebSocket() {
+  fake::UntrackedAllocations untracked;
+  while (!_clients.empty()) {
+    AsyncWebSocketClient* client = _clients.front();
+    _clients.pop_front();
+    delete client;
+  }
+  for (AsyncWebSocketMessageBuffer* buffer : _buffers) {
+    delete buffer;
+  }
+}
+
+AsyncWebSocketClient* AsyncWebSocket::client(uint32_t id) {
+  for (AsyncWebSocketClient* client : _clients) {
+    if (client->id() == id && client->status() == WS_CONNECTED) {
+      return client;
+    }
+  }
+  return nullptr;
+}
+
+size_t AsyncWebSocket::count() const {
+  return std::count_if(_clients.begin(), _clients.end(),
+                       [](const AsyncWebSocketClient* client) { return client->status() == WS_CONNECTED; });
+}
+
+bool AsyncWebSocket::availableForWriteAll() {
+  return std::none_of(_clients.begin(), _clients.end(), [](AsyncWebSocketClient* client) { return client->queueIsFull(); });
+}
+
+void AsyncWebSocket::close(uint32_t id, uint16_t code, const char* message) {
+  AsyncWebSocketClient* found = client(id);
+  if (found != nullptr) {
+    found->close(code, message);
+  }
+}
+
+void AsyncWebSocket::closeAll(uint16_t code, const char* message) {
+  for (AsyncWebSocketClient* client : _clients) {
+    client->close(code, message);
+  }
+}
+
+void AsyncWebSocket::cleanupClients(uint16_t maxClients) {
+  if (count() > maxClients) {
+    _clients.front()->close();
+  }
+}
+
+void AsyncWebSocket::text(uint32_t id, const char* message, size_t length) {
+  AsyncWebSocketClient* found = client(id);
+  if (found != nullptr) {
+    found->text(message, length);
+  }
+}
+
+void AsyncWebSocket::textAll(const char* message, size_t length) {
+  for (AsyncWebSocketClient* client : _clients) {
+    client->text(message, length);
+  }
+}
+
+void AsyncWebSocket::textAll(AsyncWebSocketMessageBuffer* buffer) {
+  if (buffer == nullptr) {
+    return;
+  }
+  buffer->lock();
+  for (AsyncWebSocketClient* client : _clients) {
+    client->text(buffer->data().c_str(), buffer->data().size());
+  }
+  buffer->unlock();
+  cleanBuffers();
+}
+
+AsyncWebSocketMessageBuffer* AsyncWebSocket::makeBuffer(size_t size) {
+  fake::UntrackedAllocations untracked;
+  AsyncWebSocketMessageBuffer* buffer = new AsyncWebSocketMessageBuffer(nullptr, size);
+  _buffers.push_back(buffer);
+  return buffer;
+}
+
+AsyncWebSocketMessageBuffer* AsyncWebSocket::makeBuffer(uint8_t* data, size_t size) {
+  fake::UntrackedAllocations untracked;
+  AsyncWebSocketMessageBuffer* buffer = new AsyncWebSocketMessageBuffer(data, size);
+  _buffers.push_back(buffer);
+  return buffer;
+}
+
+void AsyncWebSocket::cleanBuffers() {
+  fake::UntrackedAllocations untracked;
+  for (auto it = _buffers.begin(); it != _buffers.end();) {
+    if ((*it)->canDelete()) {
+      delete *it;
+      it = _buffers.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+bool AsyncWebSocket::canHandle(AsyncWebServerRequest* request) {
+  return request->requestedConnType() == RCT_WS && request->url().equals(_url);
+}
+
+void AsyncWebSocket::handleRequest(AsyncWebServerRequest* request) {
+  AsyncWebSocketClient* client;
+  {
+    fake::UntrackedAllocations untracked;
+    client = new AsyncWebSocketClient(this, _nextId++);
+    _clients.push_back(client);
+  }
+  request->setWebSocketClient(client);
+  handleEvent(client, WS_EVT_CONNECT, request, nullptr, 0);
+}
+
+void AsyncWebSocket::handleEvent(AsyncWebSocketClient* client, AwsEventType type, void* arg, uint8_t* data,
+                                 size_t length) {
+  if (_handler) {
+    _handler(this, client, type, arg, data, length);
+  }
+}
+
+void AsyncWebSocket::disconnect(AsyncWebSocketClient* client) {
+  fake::UntrackedAllocations untracked;
+  _clients.remove(client);
+  delete client;
+}
+
+// Server-Sent Events
+
+void AsyncEventSourceClient::close() {
+  _connected = false;
+}
+
+void AsyncEventSourceClient::send(const char* message, const char* event, uint32_t id, uint32_t reconnect) {
+  if (!_connected) {
+    return;
+  }
+  fake::UntrackedAllocations untracked;
+  _events.push_back({event != nullptr ? event : "", message != nullptr ? message : "", id});
+  if (id != 0) {
+    _lastId = id;
+  }
+}
+
+AsyncEventSource::~AsyncEventSource() {
+  fake::UntrackedAllocations untracked;
+  for (AsyncEventSourceClient* client : _clients) {
+    delete client;
+  }
+}
+
+void AsyncEventSource::close() {
+  for (AsyncEventSourceClient* client : _clients) {
+    client->close();
+  }
+}
+
+void AsyncEventSource::send(const char* message, const char* event, uint32_t id, uint32_t reconnect) {
+  for (AsyncEventSourceClient* client : _clients) {
+    client->send(message, event, id, reconnect);
+  }
+}
+
+size_t AsyncEventSource::count() const {
+  return std::count_if(_clients.begin(), _clients.end(),
+                       [](const AsyncEventSourceClient* client) { return client->connected(); });
+}
+
+bool AsyncEventSource::canHandle(AsyncWebServerRequest* request) {
+  return request->requestedConnType() == RCT_EVENT && request->url().equals(_url);
+}
+
+void AsyncEventSource::handleRequest(AsyncWebServerRequest* request) {
+  AsyncEventSourceClient* client;
+  {
+    fake::UntrackedAllocations untracked;
+    client = new AsyncEventSourceClient(this);
+    _clients.push_back(client);
+  }
+  request->setEventSourceClient(client);
+  if (_connectHandler) {
+    _connectHandler(client);
+  }
+}
+
+void AsyncEventSource::disconnect(AsyncEventSourceClient* client) {
+  fake::UntrackedAllocations untracked;
+  _clients.remove(client);
+  delete client;
+}
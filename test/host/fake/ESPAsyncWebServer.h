@@ -0,0 +1,362 @@
+#pragma once
+
+// Host stand-in for ESPAsyncWebServer 1.2.3 with the API used by O-Library.
+// There is no network: tests build an AsyncWebServerRequest and pass it to
+// AsyncWebServer::handle(), which dispatches it like the AsyncTCP task does.
+// Memory allocated by the server itself (responses, buffers) is not counted by
+// fake::allocations(), since only allocations made by the library are of interest.
+
+#include <Arduino.h>
+
+#include <functional>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+typedef enum {
+  HTTP_GET = 0b00000001,
+  HTTP_POST = 0b00000010,
+  HTTP_DELETE = 0b00000100,
+  HTTP_PUT = 0b00001000,
+  HTTP_PATCH = 0b00010000,
+  HTTP_HEAD = 0b00100000,
+  HTTP_OPTIONS = 0b01000000,
+  HTTP_ANY = 0b01111111,
+} WebRequestMethod;
+
+typedef uint8_t WebRequestMethodComposite;
+
+// Connection types: plain HTTP, or an upgrade to WebSocket or Server-Sent Events
+typedef enum { RCT_NOT_USED = -1, RCT_DEFAULT = 0, RCT_HTTP, RCT_WS, RCT_EVENT, RCT_MAX } RequestedConnectionType;
+
+class AsyncWebServerRequest;
+class AsyncWebSocketClient;
+class AsyncEventSourceClient;
+
+typedef std::function<void(AsyncWebServerRequest* request)> ArRequestHandlerFunction;
+
+class AsyncWebParameter {
+ public:
+  AsyncWebParameter(const String& name, const String& value, bool form = false, bool file = false)
+      : _name(name), _value(value), _isForm(form), _isFile(file) {}
+  const String& name() const { return _name; }
+  const String& value() const { return _value; }
+  bool isPost() const { return _isForm; }
+  bool isFile() const { return _isFile; }
+
+ private:
+  String _name;
+  String _value;
+  bool _isForm;
+  bool _isFile;
+};
+
+class AsyncWebServerResponse {
+ public:
+  AsyncWebServerResponse(int code, const String& contentType) : _code(code), _contentType(contentType) {}
+  virtual ~AsyncWebServerResponse() = default;
+  void setCode(int code) { _code = code; }
+  void addHeader(const String& name, const String& value) { _headers[name.c_str()] = value.c_str(); }
+  int code() const { return _code; }
+  const String& contentType() const { return _contentType; }
+  const std::map<std::string, std::string>& headers() const { return _headers; }
+  virtual std::string body() const = 0;
+
+ protected:
+  int _code;
+  String _contentType;
+  std::map<std::string, std::string> _headers;
+};
+
+class AsyncResponseStream : public AsyncWebServerResponse, public Print {
+ public:
+  using Print::write;
+  AsyncResponseStream(const String& contentType, size_t bufferSize);
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t* data, size_t length) override;
+  std::string body() const override { return _content; }
+
+ private:
+  std::string _content;
+  size_t _room;  // Bytes which fit without growing the buffer
+};
+
+class AsyncWebServerRequest {
+ public:
+  // url may contain a query string, whose parameters are GET parameters (isPost() is false)
+  AsyncWebServerRequest(WebRequestMethodComposite method, const char* url,
+                        RequestedConnectionType type = RCT_HTTP);
+  ~AsyncWebServerRequest();
+  AsyncWebServerRequest(const AsyncWebServerRequest&) = delete;
+  AsyncWebServerRequest& operator=(const AsyncWebServerRequest&) = delete;
+
+  WebRequestMethodComposite method() const { return _method; }
+  const String& url() const { return _url; }
+  RequestedConnectionType requestedConnType() const { return _connectionType; }
+
+  size_t params() const { return _params.size(); }
+  bool hasParam(const String& name, bool post = false, bool file = false) const;
+  AsyncWebParameter* getParam(const String& name, bool post = false, bool file = false) const;
+  AsyncWebParameter* getParam(size_t index) const;
+  void addParam(const String& name, const String& value, bool post = false);
+
+  void send(AsyncWebServerResponse* response);
+  void send(int code, const String& contentType = String(), const String& content = String());
+  void send_P(int code, const String& contentType, PGM_P content);
+  AsyncResponseStream* beginResponseStream(const String& contentType, size_t bufferSize = 1460);
+
+  // What was sent, for tests. sendCount() counts send() calls, which must be exactly 1.
+  bool sent() const { return _sendCount > 0; }
+  int sendCount() const { return _sendCount; }
+  int sentCode() const { return _sentCode; }
+  const std::string& sentType() const { return _sentType; }
+  const std::string& sentBody() const { return _sentBody; }
+  const std::map<std::string, std::string>& sentHeaders() const { return _sentHeaders; }
+
+  // Connections opened by an upgrade request
+  AsyncWebSocketClient* webSocketClient() const { return _webSocketClient; }
+  AsyncEventSourceClient* eventSourceClient() const { return _eventSourceClient; }
+  void setWebSocketClient(AsyncWebSocketClient* client) { _webSocketClient = client; }
+  void setEventSourceClient(AsyncEventSourceClient* client) { _eventSourceClient = client; }
+
+ private:
+  WebRequestMethodComposite _method;
+  String _url;
+  RequestedConnectionType _connectionType;
+  std::vector<AsyncWebParameter*> _params;
+
+  int _sendCount = 0;
+  int _sentCode = 0;
+  std::string _sentType;
+  std::string _sentBody;
+  std::map<std::string, std::string> _sentHeaders;
+  AsyncWebSocketClient* _webSocketClient = nullptr;
+  AsyncEventSourceClient* _eventSourceClient = nullptr;
+
+  void record(const AsyncWebServerResponse& response);
+};
+
+class AsyncWebHandler {
+ public:
+  virtual ~AsyncWebHandler() = default;
+  virtual bool canHandle(AsyncWebServerRequest* request) { return false; }
+  virtual void handleRequest(AsyncWebServerRequest* request) {}
+  virtual bool isRequestHandlerTrivial() { return true; }
+};
+
+class DefaultHeaders {
+ public:
+  static DefaultHeaders& Instance() {
+    static DefaultHeaders instance;
+    return instance;
+  }
+  void addHeader(const String& name, const String& value) { _headers[name.c_str()] = value.c_str(); }
+  const std::map<std::string, std::string>& headers() const { return _headers; }
+
+ private:
+  std::map<std::string, std::string> _headers;
+};
+
+class AsyncWebServer {
+ public:
+  explicit AsyncWebServer(uint16_t port) : _port(port) {}
+  virtual ~AsyncWebServer() = default;
+  void begin() {}
+  void end() {}
+  AsyncWebHandler& addHandler(AsyncWebHandler* handler);
+  bool removeHandler(AsyncWebHandler* handler);
+  void onNotFound(ArRequestHandlerFunction fn) { _notFound = fn; }
+  uint16_t port() const { return _port; }
+
+  // Dispatch like the AsyncTCP task: the first handler which can handle the request,
+  // or the not found handler. Runs on the calling thread.
+  void handle(AsyncWebServerRequest* request);
+
+ private:
+  uint16_t _port;
+  std::vector<AsyncWebHandler*> _handlers;
+  ArRequestHandlerFunction _notFound;
+};
+
+// WebSocket
+
+typedef enum { WS_DISCONNECTED, WS_CONNECTED, WS_DISCONNECTING } AwsClientStatus;
+typedef enum { WS_CONTINUATION, WS_TEXT, WS_BINARY, WS_DISCONNECT = 0x08, WS_PING, WS_PONG } AwsFrameType;
+typedef enum { WS_EVT_CONNECT, WS_EVT_DISCONNECT, WS_EVT_PONG, WS_EVT_ERROR, WS_EVT_DATA } AwsEventType;
+
+typedef struct {
+  uint8_t message_opcode;
+  uint32_t num;
+  uint8_t final;
+  uint8_t masked;
+  uint8_t opcode;
+  uint64_t len;
+  uint8_t mask[4];
+  uint64_t index;
+} AwsFrameInfo;
+
+class AsyncWebSocket;
+
+class AsyncWebSocketMessageBuffer {
+  /*
+      Like 1.2.3, a buffer is only freed by AsyncWebSocket::textAll(buffer) or binaryAll(buffer),
+      once no message holds it. Sending it to single clients never frees it.
+      live() counts buffers which have not been freed, and made() all buffers ever made.
+  */
+ public:
+  AsyncWebSocketMessageBuffer(const uint8_t* data, size_t size);
+  ~AsyncWebSocketMessageBuffer();
+  void lock() { _count++; }
+  void unlock() { _count--; }
+  bool canDelete() const { return _count == 0; }
+  const std::string& data() const { return _data; }
+  static int live();
+  static int made();
+
+ private:
+  std::string _data;
+  int _count = 0;
+};
+
+class AsyncWebSocketClient {
+ public:
+  AsyncWebSocketClient(AsyncWebSocket* server, uint32_t id);
+  // Like 1.2.3, WS_EVT_DISCONNECT is raised from the destructor
+  ~AsyncWebSocketClient();
+
+  uint32_t id() const { return _id; }
+  AwsClientStatus status() const { return _status; }
+  AsyncWebSocket* server() { return _server; }
+  IPAddress remoteIP() const { return IPAddress(192, 168, 0, 100); }
+
+  bool queueIsFull() const { return _queueFull; }
+  bool canSend() const { return !_queueFull; }
+  void close(uint16_t code = 0, const char* message = nullptr);
+  void ping() {}
+
+  void text(const char* message, size_t length);
+  void text(const char* message) { text(message, strlen(message)); }
+  void text(const String& message) { text(message.c_str(), message.length()); }
+  void text(AsyncWebSocketMessageBuffer* buffer);
+
+  // Test controls: messages received by the peer, a full send queue, and incoming frames
+  const std::vector<std::string>& messages() const { return _messages; }
+  void clearMessages() { _messages.clear(); }
+  void setQueueFull(bool full) { _queueFull = full; }
+  // Keep buffers locked as by messages still queued, until releaseMessages()
+  void holdMessages() { _holding = true; }
+  void releaseMessages();
+  void receive(const char* text);
+
+ private:
+  AsyncWebSocket* _server;
+  uint32_t _id;
+  AwsClientStatus _status = WS_CONNECTED;
+  bool _queueFull = false;
+  bool _holding = false;
+  std::vector<std::string> _messages;
+  std::vector<AsyncWebSocketMessageBuffer*> _held;
+};
+
+typedef std::function<void(AsyncWebSocket* server, AsyncWebSocketClient* client, AwsEventType type, void* arg,
+                           uint8_t* data, size_t length)>
+    AwsEventHandler;
+
+class AsyncWebSocket : public AsyncWebHandler {
+ public:
+  explicit AsyncWebSocket(const String& url) : _url(url) {}
+  ~AsyncWebSocket() override;
+
+  const char* url() const { return _url.c_str(); }
+  void onEvent(AwsEventHandler handler) { _handler = handler; }
+
+  // Walks the client list, which the AsyncTCP task changes on the device
+  AsyncWebSocketClient* client(uint32_t id);
+  size_t count() const;
+  bool availableForWriteAll();
+  void close(uint32_t id, uint16_t code = 0, const char* message = nullptr);
+  void closeAll(uint16_t code = 0, const char* message = nullptr);
+  void cleanupClients(uint16_t maxClients = 8);
+
+  void text(uint32_t id, const char* message, size_t length);
+  void textAll(const char* message, size_t length);
+  void textAll(const char* message) { textAll(message, strlen(message)); }
+  void textAll(const String& message) { textAll(message.c_str(), message.length()); }
+  void textAll(AsyncWebSocketMessageBuffer* buffer);
+
+  AsyncWebSocketMessageBuffer* makeBuffer(size_t size = 0);
+  AsyncWebSocketMessageBuffer* makeBuffer(uint8_t* data, size_t size);
+
+  bool canHandle(AsyncWebServerRequest* request) override;
+  void handleRequest(AsyncWebServerRequest* request) override;
+
+  // Called by clients
+  void handleEvent(AsyncWebSocketClient* client, AwsEventType type, void* arg, uint8_t* data, size_t length);
+  // Remove and delete a closed client, as the AsyncTCP task does on disconnect
+  void disconnect(AsyncWebSocketClient* client);
+
+ private:
+  String _url;
+  AwsEventHandler _handler;
+  std::list<AsyncWebSocketClient*> _clients;
+  std::list<AsyncWebSocketMessageBuffer*> _buffers;
+  uint32_t _nextId = 1;
+
+  void cleanBuffers();
+};
+
+// Server-Sent Events
+
+class AsyncEventSource;
+
+class AsyncEventSourceClient {
+ public:
+  struct Event {
+    std::string event;
+    std::string data;
+    uint32_t id;
+  };
+
+  AsyncEventSourceClient(AsyncEventSource* server) : _server(server) {}
+  bool connected() const { return _connected; }
+  uint32_t lastId() const { return _lastId; }
+  void close();
+  void send(const char* message, const char* event = nullptr, uint32_t id = 0, uint32_t reconnect = 0);
+
+  // Test controls
+  const std::vector<Event>& events() const { return _events; }
+  void clearEvents() { _events.clear(); }
+
+ private:
+  AsyncEventSource* _server;
+  bool _connected = true;
+  uint32_t _lastId = 0;
+  std::vector<Event> _events;
+};
+
+typedef std::function<void(AsyncEventSourceClient* client)> ArEventHandlerFunction;
+
+class AsyncEventSource : public AsyncWebHandler {
+ public:
+  explicit AsyncEventSource(const String& url) : _url(url) {}
+  ~AsyncEventSource() override;
+
+  const char* url() const { return _url.c_str(); }
+  void onConnect(ArEventHandlerFunction handler) { _connectHandler = handler; }
+  void close();
+  // Walk the client list, which the AsyncTCP task changes on the device
+  void send(const char* message, const char* event = nullptr, uint32_t id = 0, uint32_t reconnect = 0);
+  size_t count() const;
+
+  bool canHandle(AsyncWebServerRequest* request) override;
+  void handleRequest(AsyncWebServerRequest* request) override;
+
+  // Remove and delete a client, as the AsyncTCP task does on disconnect
+  void disconnect(AsyncEventSourceClient* client);
+
+ private:
+  String _url;
+  ArEventHandlerFunction _connectHandler;
+  std::list<AsyncEventSourceClient*> _clients;
+};
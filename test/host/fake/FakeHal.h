@@ -0,0 +1,197 @@
+#pragma once
+
+// Control of the simulated hardware behind the fake Arduino/ESP-IDF headers.
+//
+// - Time only moves in advance(), or when the loop (the thread which calls advance())
+//   calls delay(). Events are processed in time order: esp_timer callbacks, pulse edges
+//   (PCNT counts and GPIO interrupts), then tasks whose wake time has come.
+// - Tasks run one at a time, so a test is deterministic: the same script gives the same result.
+// - Analog inputs and pulse rates are Signals of time, which can be combined and scripted.
+
+#include <Arduino.h>
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace fake {
+
+// Reset all simulated state: the clock to 0, pins, buses, NVS, files, the broker, and stop all tasks.
+void reset();
+
+// Clock [us]
+int64_t now();
+void advance(int64_t us);
+inline void advanceMs(int64_t ms) { advance(ms * 1000); }
+// Block the calling task for us, or advance the clock when called from the loop
+void sleepFor(int64_t us);
+// Tasks are never resumed again. Call before objects which tasks use are destroyed.
+void stopTasks();
+int taskCount();
+
+// Signals
+
+using Signal = std::function<double(int64_t us)>;
+
+Signal constant(double value);
+// before until at, then after
+Signal step(double before, double after, int64_t at);
+// from at start, linearly to to at end
+Signal ramp(double from, double to, int64_t start, int64_t end);
+Signal sine(double offset, double amplitude, int64_t period);
+// Uniform noise in [-amplitude, amplitude] added to signal. The same time gives the same value.
+Signal noise(Signal signal, double amplitude, uint32_t seed = 1);
+// Piecewise linear through (time [us], value). Two points at the same time make a step.
+// The first and last values are held before and after the points.
+Signal keyframes(std::vector<std::pair<int64_t, double>> points);
+// keyframes() from text like "0:400 2s:400 2s:1200 2500ms:1200". Times are in ms without a unit.
+Signal script(const std::string& text);
+// First order low-pass response of signal with time constant tau [us], e.g. an RC input.
+// Stateful: evaluate with non-decreasing times. Between two evaluations, the input is taken
+// as its value at the later one, so a range switch made before a read is seen by that read.
+Signal lowPass(Signal signal, int64_t tau);
+// Code of a 12 bit ADC for a voltage signal
+Signal adcCode(Signal volts, double reference = 3.3);
+
+// MCP3208 on SPI
+
+// Raw code of channel (clamped to 0-4095). Unset channels read 0.
+void setADC(int channel, Signal code);
+void setADCChipSelect(int pin);
+// Single-ended channels in conversion order, and differential pairs as -1 - (pair index)
+const std::vector<int>& adcConversions();
+void clearADCConversions();
+// Bytes sent while the chip was not selected, or frames which were cut short
+uint64_t adcErrors();
+// SPI clock of the current transaction, and the bus time of all transfers at that clock [us]
+uint32_t spiClock();
+double spiBusTime();
+
+// Pins and registers
+
+int pinLevel(int pin);
+int pinModeOf(int pin);
+void setPinLevel(int pin, int level);
+struct RegisterWrite {
+  uint32_t reg;
+  uint32_t value;
+};
+const std::vector<RegisterWrite>& registerWrites();
+void clearRegisterWrites();
+
+// Pulses of a flow meter on pin at hz(time). Rising edges are counted by PCNT units
+// configured for pin and raise GPIO interrupts attached to it.
+void setPulses(int pin, Signal hz);
+// count rising edges on pin now
+void pulse(int pin, int count = 1);
+// The next count edges on pin are counted by PCNT but raise no GPIO interrupt,
+// like edges which arrive while the previous interrupt is still pending
+void missInterrupts(int pin, int count);
+
+// LEDC
+struct LedcChannel {
+  double frequency = 0;
+  int resolution = 0;
+  int pin = -1;
+  uint32_t duty = 0;
+};
+const LedcChannel& ledc(int channel);
+
+// esp_timer. Fail the next n esp_timer_create() calls with ESP_ERR_NO_MEM.
+void failTimerCreate(int n = 1);
+int activeTimers();
+// Contended semaphore takes from an esp_timer callback, which must never block
+int blockedTimerCallbacks();
+// Semaphores which have been created and not deleted
+int liveSemaphores();
+
+// I2C: transactions sent to addresses with a device, and all attempts
+void setI2CDevice(uint8_t address, bool present = true);
+struct I2CTransaction {
+  uint8_t address;
+  std::vector<uint8_t> bytes;
+  bool acked;
+};
+const std::vector<I2CTransaction>& i2cTransactions();
+void clearI2CTransactions();
+
+// NVS: namespace -> key -> value, and the number of writes
+using NvsStore = std::map<std::string, std::map<std::string, std::vector<uint8_t>>>;
+NvsStore& nvs();
+uint64_t nvsWrites();
+
+// LittleFS: path -> contents, and the size of the file system, beyond which writes are short
+std::map<std::string, std::shared_ptr<std::vector<uint8_t>>>& files();
+void setLittleFSSize(size_t bytes);
+
+// WiFi
+void setWiFiConnected(bool connected);
+
+// Serial output
+std::string& serialOutput();
+void echoSerial(bool echo);
+
+// Heap as reported by ESP
+struct Heap {
+  uint32_t size = 327680;
+  uint32_t free = 200000;
+  uint32_t minFree = 180000;
+  uint32_t largestFreeBlock = 110000;
+};
+Heap& heap();
+void setResetReason(int reason);
+
+// MQTT broker behind PubSubClient
+struct Broker {
+  struct Message {
+    std::string clientId;
+    std::string topic;
+    std::vector<uint8_t> payload;
+    int64_t at;
+  };
+
+  bool reachable = true;
+  int64_t connectTime = 20000;        // Connection and CONNACK [us]
+  int64_t unreachableTime = 3000000;  // Until the TCP connect times out [us]
+  bool acceptPublish = true;
+  std::vector<Message> messages;
+  std::vector<std::string> connections;  // Client IDs in connection order
+  uint32_t session = 1;
+
+  // Drop all connected clients
+  void disconnectAll() { session++; }
+};
+Broker& broker();
+
+// Heap allocations (operator new) on the calling thread while a CountAllocations is alive
+struct Allocations {
+  uint64_t count = 0;
+  uint64_t bytes = 0;
+};
+
+class CountAllocations {
+ public:
+  CountAllocations();
+  ~CountAllocations();
+  Allocations result() const;
+
+ private:
+  Allocations _start;
+  bool _wasCounting;
+};
+
+// Allocations of the fakes themselves (e.g. the web server) are not counted
+class UntrackedAllocations {
+ public:
+  UntrackedAllocations();
+  ~UntrackedAllocations();
+
+ private:
+  bool _wasCounting;
+};
+
+}  // namespace fake
@@ -0,0 +1,21 @@
+#pragma once
+
+// Shared between the fake implementation files
+
+#include <cstdint>
+
+namespace fake {
+namespace detail {
+
+void resetScheduler();
+void resetHardware();
+void resetNetwork();
+
+// True while an esp_timer callback or an interrupt handler runs
+bool inInterrupt();
+
+// Print a message and abort, like a failed configASSERT
+[[noreturn]] void fail(const char* format, ...) __attribute__((format(printf, 1, 2)));
+
+}  // namespace detail
+}  // namespace fake
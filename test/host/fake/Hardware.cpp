@@ -0,0 +1,894 @@
+// Simulated pins, registers, LEDC, SPI with an MCP3208, I2C, WiFi, NVS, LittleFS, Serial and heap
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <Preferences.h>
+#include <SPI.h>
+#include <WiFi.h>
+#include <Wire.h>
+#include <esp_system.h>
+#include <rgb_lcd.h>
+#include <soc/gpio_reg.h>
+#include <soc/soc.h>
+
+#include <chrono>
+#include <cmath>
+#include <new>
+
+#include "FakeHal.h"
+#include "FakeInternal.h"
+
+HardwareSerial Serial;
+EspClass ESP;
+SPIClass SPI;
+TwoWire Wire;
+WiFiClass WiFi;
+LittleFSFS LittleFS;
+
+namespace fake {
+namespace detail {
+namespace {
+
+const int PINS = 40;
+const int ADC_CHANNELS = 8;
+
+class Mcp3208 {
+  /*
+      Decodes the bit stream of a selection like the datasheet: zeros, the start bit,
+      SGL/DIFF, D2, D1, D0, the sample clock, a null bit, then B11..B0 MSB first.
+      Output bits are 1 while the output is high impedance, and 0 after B0.
+  */
+ public:
+  Signal channels[ADC_CHANNELS];
+  std::vector<int> conversions;
+  uint64_t errors = 0;
+
+  void select(bool selected) {
+    if (_selected && !selected && _state != WaitStart && _state != Done) {
+      errors++;  // Deselected in the middle of a frame
+    }
+    _selected = selected;
+    _state = WaitStart;
+  }
+
+  bool selected() const { return _selected; }
+
+  int clock(int in) {
+    switch (_state) {
+      case WaitStart:
+        if (in) {
+          _state = Config;
+          _configBits = 0;
+          _config = 0;
+        }
+        return 1;
+      case Config:
+        _config = (_config << 1) | in;
+        if (++_configBits == 4) {
+          convert();
+          _state = Sample;
+        }
+        return 1;
+      case Sample:
+        _state = Null;
+        return 1;
+      case Null:
+        _state = Data;
+        _dataBit = 11;
+        return 0;
+      case Data: {
+        int out = (_result >> _dataBit) & 1;
+        if (_dataBit-- == 0) {
+          _state = Done;
+        }
+        return out;
+      }
+      case Done:
+        return 0;
+    }
+    return 0;
+  }
+
+ private:
+  enum State { WaitStart, Config, Sample, Null, Data, Done } _state = WaitStart;
+  bool _selected = false;
+  int _configBits = 0;
+  int _config = 0;  // SGL, D2, D1, D0
+  int _dataBit = 0;
+  uint16_t _result = 0;
+
+  int code(int channel) const {
+    if (!channels[channel]) {
+      return 0;
+    }
+    double value = std::round(channels[channel](fake::now()));
+    return static_cast<int>(std::min(4095.0, std::max(0.0, value)));
+  }
+
+  void convert() {
+    fake::UntrackedAllocations untracked;
+    bool single = _config & 0x08;
+    int channel = _config & 0x07;
+    if (single) {
+      conversions.push_back(channel);
+      _result = code(channel);
+    } else {
+      // Pairs are CH0-CH1, CH1-CH0, CH2-CH3, ... by D2..D0
+      int positive = channel;
+      int negative = channel ^ 1;
+      conversions.push_back(-1 - channel);
+      _result = std::max(0, code(positive) - code(negative));
+    }
+  }
+};
+
+struct Hardware {
+  int levels[PINS] = {};
+  int modes[PINS] = {};
+  std::vector<RegisterWrite> registerWrites;
+  LedcChannel ledc[16];
+
+  Mcp3208 adc;
+  int adcChipSelect = 5;
+  uint32_t spiClock = 1000000;
+  double spiBusTime = 0;
+
+  bool i2cDevices[128] = {};
+  std::vector<I2CTransaction> i2cTransactions;
+
+  NvsStore nvs;
+  uint64_t nvsWrites = 0;
+  std::map<std::string, std::shared_ptr<std::vector<uint8_t>>> files;
+  size_t littleFSSize = 1441792;
+
+  bool wifiConnected = true;
+  std::string serial;
+  bool echoSerial = false;
+  Heap heap;
+  int resetReason = ESP_RST_POWERON;
+};
+
+Hardware& hardware() {
+  static Hardware* instance = new Hardware();
+  return *instance;
+}
+
+// Heap allocations counted on this thread
+thread_local bool countingAllocations = false;
+thread_local Allocations allocations;
+
+bool validPin(int pin) {
+  return pin >= 0 && pin < PINS;
+}
+
+}  // namespace
+
+void resetHardware() {
+  Hardware& h = hardware();
+  bool echo = h.echoSerial;
+  int chipSelect = h.adcChipSelect;
+  h.~Hardware();
+  new (&h) Hardware();
+  h.echoSerial = echo;
+  h.adcChipSelect = chipSelect;
+}
+
+}  // namespace detail
+
+using namespace detail;
+
+void reset() {
+  resetScheduler();
+  resetHardware();
+  resetNetwork();
+}
+
+void setADC(int channel, Signal code) {
+  if (channel < 0 || channel >= ADC_CHANNELS) {
+    fail("ADC channel %d out of range", channel);
+  }
+  hardware().adc.channels[channel] = code;
+}
+
+void setADCChipSelect(int pin) {
+  hardware().adcChipSelect = pin;
+}
+
+const std::vector<int>& adcConversions() {
+  return hardware().adc.conversions;
+}
+
+void clearADCConversions() {
+  hardware().adc.conversions.clear();
+}
+
+uint64_t adcErrors() {
+  return hardware().adc.errors;
+}
+
+uint32_t spiClock() {
+  return hardware().spiClock;
+}
+
+double spiBusTime() {
+  return hardware().spiBusTime;
+}
+
+int pinLevel(int pin) {
+  return validPin(pin) ? hardware().levels[pin] : LOW;
+}
+
+int pinModeOf(int pin) {
+  return validPin(pin) ? hardware().modes[pin] : 0;
+}
+
+void setPinLevel(int pin, int level) {
+  if (validPin(pin)) {
+    hardware().levels[pin] = level ? HIGH : LOW;
+  }
+}
+
+const std::vector<RegisterWrite>& registerWrites() {
+  return hardware().registerWrites;
+}
+
+void clearRegisterWrites() {
+  hardware().registerWrites.clear();
+}
+
+const LedcChannel& ledc(int channel) {
+  return hardware().ledc[channel & 15];
+}
+
+void setI2CDevice(uint8_t address, bool present) {
+  hardware().i2cDevices[address & 0x7f] = present;
+}
+
+const std::vector<I2CTransaction>& i2cTransactions() {
+  return hardware().i2cTransactions;
+}
+
+void clearI2CTransactions() {
+  hardware().i2cTransactions.clear();
+}
+
+NvsStore& nvs() {
+  return hardware().nvs;
+}
+
+uint64_t nvsWrites() {
+  return hardware().nvsWrites;
+}
+
+std::map<std::string, std::shared_ptr<std::vector<uint8_t>>>& files() {
+  return hardware().files;
+}
+
+void setLittleFSSize(size_t bytes) {
+  hardware().littleFSSize = bytes;
+}
+
+void setWiFiConnected(bool connected) {
+  hardware().wifiConnected = connected;
+}
+
+std::string& serialOutput() {
+  return hardware().serial;
+}
+
+void echoSerial(bool echo) {
+  hardware().echoSerial = echo;
+}
+
+Heap& heap() {
+  return hardware().heap;
+}
+
+void setResetReason(int reason) {
+  hardware().resetReason = reason;
+}
+
+CountAllocations::CountAllocations() : _start(allocations), _wasCounting(countingAllocations) {
+  countingAllocations = true;
+}
+
+CountAllocations::~CountAllocations() {
+  countingAllocations = _wasCounting;
+}
+
+Allocations CountAllocations::result() const {
+  return {allocations.count - _start.count, allocations.bytes - _start.bytes};
+}
+
+UntrackedAllocations::UntrackedAllocations() : _wasCounting(countingAllocations) {
+  countingAllocations = false;
+}
+
+UntrackedAllocations::~UntrackedAllocations() {
+  countingAllocations = _wasCounting;
+}
+
+}  // namespace fake
+
+using namespace fake::detail;
+
+// Heap allocations
+
+namespace {
+void* countedAllocate(size_t size) {
+  if (fake::detail::countingAllocations) {
+    fake::detail::allocations.count++;
+    fake::detail::allocations.bytes += size;
+  }
+  void* ptr = malloc(size == 0 ? 1 : size);
+  if (ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+}  // namespace
+
+void* operator new(size_t size) {
+  return countedAllocate(size);
+}
+
+void* operator new[](size_t size) {
+  return countedAllocate(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  try {
+    return countedAllocate(size);
+  } catch (...) {
+    return nullptr;
+  }
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+  try {
+    return countedAllocate(size);
+  } catch (...) {
+    return nullptr;
+  }
+}
+
+void operator delete(void* ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+  free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+  free(ptr);
+}
+
+// Pins and registers
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  if (validPin(pin)) {
+    hardware().modes[pin] = mode;
+  }
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  Hardware& h = hardware();
+  if (!validPin(pin)) {
+    return;
+  }
+  h.levels[pin] = value ? HIGH : LOW;
+  if (pin == h.adcChipSelect) {
+    // MCP3208 is selected while CS is low
+    h.adc.select(value == LOW);
+  }
+}
+
+int digitalRead(uint8_t pin) {
+  return fake::pinLevel(pin);
+}
+
+void fakeRegWrite(uint32_t reg, uint32_t value) {
+  Hardware& h = hardware();
+  fake::UntrackedAllocations untracked;
+  h.registerWrites.push_back({reg, value});
+  switch (reg) {
+    case GPIO_OUT_REG:
+      for (int pin = 0; pin < 32; pin++) h.levels[pin] = (value >> pin) & 1;
+      break;
+    case GPIO_OUT_W1TS_REG:
+      for (int pin = 0; pin < 32; pin++) if (value & (1u << pin)) h.levels[pin] = HIGH;
+      break;
+    case GPIO_OUT_W1TC_REG:
+      for (int pin = 0; pin < 32; pin++) if (value & (1u << pin)) h.levels[pin] = LOW;
+      break;
+    case GPIO_OUT1_REG:
+      for (int pin = 32; pin < PINS; pin++) h.levels[pin] = (value >> (pin - 32)) & 1;
+      break;
+    case GPIO_OUT1_W1TS_REG:
+      for (int pin = 32; pin < PINS; pin++) if (value & (1u << (pin - 32))) h.levels[pin] = HIGH;
+      break;
+    case GPIO_OUT1_W1TC_REG:
+      for (int pin = 32; pin < PINS; pin++) if (value & (1u << (pin - 32))) h.levels[pin] = LOW;
+      break;
+    default:
+      fake::detail::fail("Write to unknown register 0x%08x", reg);
+  }
+}
+
+uint32_t fakeRegRead(uint32_t reg) {
+  Hardware& h = hardware();
+  uint32_t value = 0;
+  if (reg == GPIO_OUT_REG) {
+    for (int pin = 0; pin < 32; pin++) value |= static_cast<uint32_t>(h.levels[pin] & 1) << pin;
+  } else if (reg == GPIO_OUT1_REG) {
+    for (int pin = 32; pin < PINS; pin++) value |= static_cast<uint32_t>(h.levels[pin] & 1) << (pin - 32);
+  }
+  return value;
+}
+
+// LEDC
+
+double ledcSetup(uint8_t channel, double frequency, uint8_t resolutionBits) {
+  fake::LedcChannel& ledc = hardware().ledc[channel & 15];
+  ledc.frequency = frequency;
+  ledc.resolution = resolutionBits;
+  return frequency;
+}
+
+void ledcAttachPin(uint8_t pin, uint8_t channel) {
+  hardware().ledc[channel & 15].pin = pin;
+}
+
+void ledcWrite(uint8_t channel, uint32_t duty) {
+  hardware().ledc[channel & 15].duty = duty;
+}
+
+// SPI
+
+void SPIClass::begin(int8_t sck, int8_t miso, int8_t mosi, int8_t ss) {}
+
+void SPIClass::beginTransaction(SPISettings settings) {
+  hardware().spiClock = settings.clock;
+}
+
+void SPIClass::endTransaction() {}
+
+uint8_t SPIClass::transfer(uint8_t data) {
+  uint8_t out;
+  transferBytes(&data, &out, 1);
+  return out;
+}
+
+void SPIClass::transferBytes(const uint8_t* data, uint8_t* out, uint32_t size) {
+  Hardware& h = hardware();
+  if (!h.adc.selected()) {
+    h.adc.errors++;
+  }
+  for (uint32_t i = 0; i < size; i++) {
+    uint8_t in = data != nullptr ? data[i] : 0xff;
+    uint8_t received = 0;
+    for (int bit = 7; bit >= 0; bit--) {
+      int level = h.adc.selected() ? h.adc.clock((in >> bit) & 1) : 1;
+      received |= level << bit;
+    }
+    if (out != nullptr) {
+      out[i] = received;
+    }
+  }
+  h.spiBusTime += size * 8 * 1e6 / h.spiClock;
+}
+
+// I2C
+
+void TwoWire::beginTransmission(uint8_t address) {
+  _address = address;
+  _transmitting = true;
+  _buffer.clear();
+}
+
+uint8_t TwoWire::endTransmission(bool sendStop) {
+  Hardware& h = hardware();
+  bool acked = h.i2cDevices[_address & 0x7f];
+  {
+    fake::UntrackedAllocations untracked;
+    h.i2cTransactions.push_back({_address, _buffer, acked});
+  }
+  _transmitting = false;
+  return acked ? 0 : 2;  // 2: address not acknowledged
+}
+
+size_t TwoWire::write(uint8_t data) {
+  if (!_transmitting) {
+    return 0;
+  }
+  fake::UntrackedAllocations untracked;
+  _buffer.push_back(data);
+  return 1;
+}
+
+// Grove LCD with the command sequence of the original driver
+
+namespace {
+void i2cSend(uint8_t address, std::initializer_list<uint8_t> bytes) {
+  Wire.beginTransmission(address);
+  for (uint8_t byte : bytes) {
+    Wire.write(byte);
+  }
+  Wire.endTransmission();
+}
+}  // namespace
+
+void rgb_lcd::begin(uint8_t cols, uint8_t rows, uint8_t charSize) {
+  const uint8_t FUNCTION_SET = 0x20 | 0x08;  // 2 lines
+  delay(50);
+  command(FUNCTION_SET);
+  delayMicroseconds(4500);
+  command(FUNCTION_SET);
+  delayMicroseconds(150);
+  command(FUNCTION_SET);
+  command(FUNCTION_SET);
+  command(0x08 | 0x04);  // Display on
+  clear();
+  command(0x04 | 0x02);  // Entry mode: left to right
+  i2cSend(RGB_ADDRESS, {0x00, 0x00});
+  i2cSend(RGB_ADDRESS, {0x08, 0xff});
+  i2cSend(RGB_ADDRESS, {0x01, 0x20});
+  setRGB(255, 255, 255);
+}
+
+void rgb_lcd::clear() {
+  command(0x01);
+  delayMicroseconds(2000);
+}
+
+void rgb_lcd::home() {
+  command(0x02);
+  delayMicroseconds(2000);
+}
+
+void rgb_lcd::setCursor(uint8_t col, uint8_t row) {
+  command(row == 0 ? (col | 0x80) : (col | 0xc0));
+}
+
+void rgb_lcd::setRGB(unsigned char r, unsigned char g, unsigned char b) {
+  i2cSend(RGB_ADDRESS, {0x04, r});
+  i2cSend(RGB_ADDRESS, {0x03, g});
+  i2cSend(RGB_ADDRESS, {0x02, b});
+}
+
+size_t rgb_lcd::write(uint8_t value) {
+  i2cSend(LCD_ADDRESS, {0x40, value});
+  return 1;
+}
+
+void rgb_lcd::command(uint8_t value) {
+  i2cSend(LCD_ADDRESS, {0x80, value});
+}
+
+// WiFi
+
+wl_status_t WiFiClass::begin(const char* ssid, const char* password) {
+  return status();
+}
+
+wl_status_t WiFiClass::status() {
+  return hardware().wifiConnected ? WL_CONNECTED : WL_DISCONNECTED;
+}
+
+bool WiFiClass::reconnect() {
+  return hardware().wifiConnected;
+}
+
+bool WiFiClass::disconnect(bool wifiOff) {
+  return true;
+}
+
+IPAddress WiFiClass::localIP() {
+  return hardware().wifiConnected ? IPAddress(192, 168, 0, 10) : IPAddress();
+}
+
+String WiFiClass::macAddress() {
+  return "24:6F:28:00:00:01";
+}
+
+// Serial and Print
+
+size_t HardwareSerial::write(uint8_t c) {
+  return write(&c, 1);
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+  Hardware& h = hardware();
+  {
+    fake::UntrackedAllocations untracked;
+    h.serial.append(reinterpret_cast<const char*>(buffer), size);
+  }
+  if (h.echoSerial) {
+    fwrite(buffer, 1, size, stdout);
+  }
+  return size;
+}
+
+size_t Print::printf(const char* format, ...) {
+  char stackBuffer[64];
+  char* buffer = stackBuffer;
+  va_list args;
+  va_start(args, format);
+  va_list copy;
+  va_copy(copy, args);
+  int length = vsnprintf(stackBuffer, sizeof(stackBuffer), format, copy);
+  va_end(copy);
+  if (length < 0) {
+    va_end(args);
+    return 0;
+  }
+  if (static_cast<size_t>(length) >= sizeof(stackBuffer)) {
+    buffer = new char[length + 1];
+    vsnprintf(buffer, length + 1, format, args);
+  }
+  va_end(args);
+  size_t written = write(reinterpret_cast<const uint8_t*>(buffer), length);
+  if (buffer != stackBuffer) {
+    delete[] buffer;
+  }
+  return written;
+}
+
+// ESP
+
+uint32_t EspClass::getFreeHeap() {
+  return hardware().heap.free;
+}
+
+uint32_t EspClass::getMinFreeHeap() {
+  return hardware().heap.minFree;
+}
+
+uint32_t EspClass::getMaxAllocHeap() {
+  return hardware().heap.largestFreeBlock;
+}
+
+uint32_t EspClass::getHeapSize() {
+  return hardware().heap.size;
+}
+
+uint32_t EspClass::getPsramSize() {
+  return 0;
+}
+
+uint32_t EspClass::getFreePsram() {
+  return 0;
+}
+
+uint32_t EspClass::getCycleCount() {
+  auto elapsed = std::chrono::steady_clock::now().time_since_epoch();
+  return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count() * 240 / 1000);
+}
+
+void EspClass::restart() {
+  fake::detail::fail("ESP.restart() called");
+}
+
+esp_reset_reason_t esp_reset_reason() {
+  return static_cast<esp_reset_reason_t>(hardware().resetReason);
+}
+
+const char* esp_err_to_name(esp_err_t code) {
+  switch (code) {
+    case ESP_OK:
+      return "ESP_OK";
+    case ESP_FAIL:
+      return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:
+      return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:
+      return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE:
+      return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_NOT_FOUND:
+      return "ESP_ERR_NOT_FOUND";
+    default:
+      return "UNKNOWN ERROR";
+  }
+}
+
+// NVS
+
+namespace {
+const size_t NVS_NAME_LENGTH = 15;
+
+bool validName(const char* name) {
+  return name != nullptr && name[0] != '\0' && strlen(name) <= NVS_NAME_LENGTH;
+}
+}  // namespace
+
+bool Preferences::begin(const char* name, bool readOnly, const char* partition) {
+  end();
+  if (!validName(name)) {
+    return false;
+  }
+  fake::NvsStore& store = hardware().nvs;
+  // A namespace which was never written cannot be opened read-only
+  if (readOnly && store.find(name) == store.end()) {
+    return false;
+  }
+  fake::UntrackedAllocations untracked;
+  _namespace = name;
+  _readOnly = readOnly;
+  _started = true;
+  return true;
+}
+
+void Preferences::end() {
+  _started = false;
+}
+
+bool Preferences::clear() {
+  if (!_started || _readOnly) {
+    return false;
+  }
+  hardware().nvs[_namespace].clear();
+  hardware().nvsWrites++;
+  return true;
+}
+
+bool Preferences::remove(const char* key) {
+  if (!_started || _readOnly || !validName(key)) {
+    return false;
+  }
+  auto& values = hardware().nvs[_namespace];
+  if (values.erase(key) == 0) {
+    return false;
+  }
+  hardware().nvsWrites++;
+  return true;
+}
+
+bool Preferences::isKey(const char* key) {
+  if (!_started || !validName(key)) {
+    return false;
+  }
+  auto& values = hardware().nvs[_namespace];
+  return values.find(key) != values.end();
+}
+
+size_t Preferences::putBytes(const char* key, const void* value, size_t length) {
+  if (!_started || _readOnly || !validName(key) || value == nullptr) {
+    return 0;
+  }
+  fake::UntrackedAllocations untracked;
+  const uint8_t* bytes = static_cast<const uint8_t*>(value);
+  hardware().nvs[_namespace][key].assign(bytes, bytes + length);
+  hardware().nvsWrites++;
+  return length;
+}
+
+size_t Preferences::getBytesLength(const char* key) {
+  if (!_started || !validName(key)) {
+    return 0;
+  }
+  auto& values = hardware().nvs[_namespace];
+  auto value = values.find(key);
+  return value == values.end() ? 0 : value->second.size();
+}
+
+size_t Preferences::getBytes(const char* key, void* buffer, size_t length) {
+  size_t size = getBytesLength(key);
+  if (size == 0 || size > length || buffer == nullptr) {
+    return 0;
+  }
+  memcpy(buffer, hardware().nvs[_namespace][key].data(), size);
+  return size;
+}
+
+size_t Preferences::putFloat(const char* key, float value) {
+  return putBytes(key, &value, sizeof(value));
+}
+
+float Preferences::getFloat(const char* key, float defaultValue) {
+  float value;
+  return getBytesLength(key) == sizeof(value) && getBytes(key, &value, sizeof(value)) ? value : defaultValue;
+}
+
+size_t Preferences::putUInt(const char* key, uint32_t value) {
+  return putBytes(key, &value, sizeof(value));
+}
+
+uint32_t Preferences::getUInt(const char* key, uint32_t defaultValue) {
+  uint32_t value;
+  return getBytesLength(key) == sizeof(value) && getBytes(key, &value, sizeof(value)) ? value : defaultValue;
+}
+
+size_t Preferences::putULong64(const char* key, uint64_t value) {
+  return putBytes(key, &value, sizeof(value));
+}
+
+uint64_t Preferences::getULong64(const char* key, uint64_t defaultValue) {
+  uint64_t value;
+  return getBytesLength(key) == sizeof(value) && getBytes(key, &value, sizeof(value)) ? value : defaultValue;
+}
+
+// LittleFS
+
+size_t File::write(const uint8_t* buffer, size_t size) {
+  if (_data == nullptr || !_writable) {
+    return 0;
+  }
+  fake::UntrackedAllocations untracked;
+  size_t used = 0;
+  for (const auto& file : hardware().files) {
+    used += file.second->size();
+  }
+  size_t growth = _position + size > _data->size() ? _position + size - _data->size() : 0;
+  if (used + growth > hardware().littleFSSize) {
+    // Out of space: a short write
+    size = size - std::min(size, used + growth - hardware().littleFSSize);
+  }
+  if (_position + size > _data->size()) {
+    _data->resize(_position + size);
+  }
+  memcpy(_data->data() + _position, buffer, size);
+  _position += size;
+  return size;
+}
+
+size_t File::read(uint8_t* buffer, size_t size) {
+  if (_data == nullptr) {
+    return 0;
+  }
+  size_t length = std::min(size, _data->size() - _position);
+  memcpy(buffer, _data->data() + _position, length);
+  _position += length;
+  return length;
+}
+
+int File::read() {
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+bool File::seek(uint32_t position) {
+  if (_data == nullptr || position > _data->size()) {
+    return false;
+  }
+  _position = position;
+  return true;
+}
+
+bool LittleFSFS::begin(bool formatOnFail, const char* basePath, uint8_t maxOpenFiles, const char* partitionLabel) {
+  return true;
+}
+
+size_t LittleFSFS::totalBytes() {
+  return hardware().littleFSSize;
+}
+
+bool LittleFSFS::exists(const char* path) {
+  return hardware().files.count(path) > 0;
+}
+
+bool LittleFSFS::remove(const char* path) {
+  return hardware().files.erase(path) > 0;
+}
+
+File LittleFSFS::open(const char* path, const char* mode) {
+  fake::UntrackedAllocations untracked;
+  auto& files = hardware().files;
+  auto file = files.find(path);
+  if (strcmp(mode, FILE_READ) == 0) {
+    return file == files.end() ? File() : File(file->second, false, 0);
+  }
+  if (strcmp(mode, "r+") == 0) {
+    return file == files.end() ? File() : File(file->second, true, 0);
+  }
+  if (file == files.end() || strcmp(mode, FILE_WRITE) == 0) {
+    files[path] = std::make_shared<std::vector<uint8_t>>();
+    file = files.find(path);
+  }
+  return File(file->second, true, file->second->size());
+}
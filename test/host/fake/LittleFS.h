@@ -0,0 +1,50 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <memory>
+#include <vector>
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+class File : public Stream {
+  /*
+      A file of the in-memory file system (see fake::files()).
+  */
+ public:
+  using Print::write;
+  File() = default;
+  File(std::shared_ptr<std::vector<uint8_t>> data, bool writable, size_t position)
+      : _data(data), _writable(writable), _position(position) {}
+
+  explicit operator bool() const { return _data != nullptr; }
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* buffer, size_t size) override;
+  size_t read(uint8_t* buffer, size_t size);
+  int read() override;
+  int available() override { return _data == nullptr ? 0 : static_cast<int>(_data->size() - _position); }
+  bool seek(uint32_t position);
+  size_t position() const { return _position; }
+  size_t size() const { return _data == nullptr ? 0 : _data->size(); }
+  void close() { _data.reset(); }
+
+ private:
+  std::shared_ptr<std::vector<uint8_t>> _data;
+  bool _writable = false;
+  size_t _position = 0;
+};
+
+class LittleFSFS {
+ public:
+  bool begin(bool formatOnFail = false, const char* basePath = "/littlefs", uint8_t maxOpenFiles = 10,
+             const char* partitionLabel = "spiffs");
+  void end() {}
+  bool exists(const char* path);
+  bool remove(const char* path);
+  File open(const char* path, const char* mode = FILE_READ);
+  size_t totalBytes();
+};
+
+extern LittleFSFS LittleFS;
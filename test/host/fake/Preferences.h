@@ -0,0 +1,32 @@
+#pragma once
+
+#include <Arduino.h>
+
+class Preferences {
+  /*
+      NVS kept in memory (see fake::nvs()). Namespaces and keys longer than 15 characters
+      are rejected like NVS does: begin() returns false, and writes and reads fail.
+  */
+ public:
+  ~Preferences() { end(); }
+  bool begin(const char* name, bool readOnly = false, const char* partition = nullptr);
+  void end();
+  bool clear();
+  bool remove(const char* key);
+  bool isKey(const char* key);
+
+  size_t putBytes(const char* key, const void* value, size_t length);
+  size_t getBytes(const char* key, void* buffer, size_t length);
+  size_t getBytesLength(const char* key);
+  size_t putFloat(const char* key, float value);
+  float getFloat(const char* key, float defaultValue = NAN);
+  size_t putUInt(const char* key, uint32_t value);
+  uint32_t getUInt(const char* key, uint32_t defaultValue = 0);
+  size_t putULong64(const char* key, uint64_t value);
+  uint64_t getULong64(const char* key, uint64_t defaultValue = 0);
+
+ private:
+  std::string _namespace;
+  bool _started = false;
+  bool _readOnly = false;
+};
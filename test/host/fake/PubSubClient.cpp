@@ -0,0 +1,167 @@
+#include <PubSubClient.h>
+
+#include "FakeHal.h"
+#include "FakeInternal.h"
+
+namespace fake {
+
+namespace {
+Broker* theBroker = new Broker();
+}  // namespace
+
+Broker& broker() {
+  return *theBroker;
+}
+
+namespace detail {
+
+void resetNetwork() {
+  UntrackedAllocations untracked;
+  *theBroker = Broker();
+}
+
+}  // namespace detail
+}  // namespace fake
+
+PubSubClient& PubSubClient::setServer(const char* domain, uint16_t port) {
+  _domain = domain != nullptr ? domain : "";
+  _port = port;
+  return *this;
+}
+
+PubSubClient& PubSubClient::setServer(IPAddress ip, uint16_t port) {
+  _domain = ip.toString().c_str();
+  _port = port;
+  return *this;
+}
+
+PubSubClient& PubSubClient::setClient(Client& client) {
+  _client = &client;
+  return *this;
+}
+
+PubSubClient& PubSubClient::setKeepAlive(uint16_t keepAlive) {
+  return *this;
+}
+
+PubSubClient& PubSubClient::setSocketTimeout(uint16_t timeout) {
+  _socketTimeout = timeout;
+  return *this;
+}
+
+bool PubSubClient::setBufferSize(uint16_t size) {
+  if (size == 0) {
+    return false;
+  }
+  _bufferSize = size;
+  return true;
+}
+
+bool PubSubClient::connect(const char* id) {
+  return connect(id, nullptr, nullptr);
+}
+
+bool PubSubClient::connect(const char* id, const char* user, const char* password) {
+  /*
+      Blocks the caller for the connect latency, or until the TCP connect times out.
+  */
+  fake::Broker& broker = fake::broker();
+  if (connected()) {
+    return true;
+  }
+  if (_domain.empty() || !broker.reachable) {
+    fake::sleepFor(broker.unreachableTime);
+    _state = MQTT_CONNECT_FAILED;
+    return false;
+  }
+  fake::sleepFor(broker.connectTime);
+  // The broker may have gone away while connecting
+  if (!broker.reachable) {
+    _state = MQTT_CONNECTION_TIMEOUT;
+    return false;
+  }
+  fake::UntrackedAllocations untracked;
+  broker.connections.push_back(id != nullptr ? id : "");
+  _clientId = broker.connections.back();
+  _session = broker.session;
+  _state = MQTT_CONNECTED;
+  return true;
+}
+
+void PubSubClient::disconnect() {
+  _state = MQTT_DISCONNECTED;
+  _session = 0;
+}
+
+bool PubSubClient::connected() {
+  if (_state == MQTT_CONNECTED && _session != fake::broker().session) {
+    _state = MQTT_CONNECTION_LOST;
+  }
+  return _state == MQTT_CONNECTED;
+}
+
+bool PubSubClient::loop() {
+  return connected();
+}
+
+bool PubSubClient::publish(const char* topic, const char* payload) {
+  return publish(topic, reinterpret_cast<const uint8_t*>(payload), strlen(payload), false);
+}
+
+bool PubSubClient::publish(const char* topic, const uint8_t* payload, unsigned int length) {
+  return publish(topic, payload, length, false);
+}
+
+bool PubSubClient::publish(const char* topic, const uint8_t* payload, unsigned int length, bool retained) {
+  /*
+      Like the original, a message which does not fit the buffer with its header is not sent.
+  */
+  if (!connected()) {
+    return false;
+  }
+  size_t size = MQTT_MAX_HEADER_SIZE + 2 + strlen(topic) + length;
+  fake::Broker& broker = fake::broker();
+  if (size > _bufferSize || !broker.acceptPublish) {
+    return false;
+  }
+  fake::UntrackedAllocations untracked;
+  broker.messages.push_back({_clientId, topic, std::vector<uint8_t>(payload, payload + length), fake::now()});
+  return true;
+}
+
+bool PubSubClient::beginPublish(const char* topic, unsigned int length, bool retained) {
+  if (!connected()) {
+    return false;
+  }
+  fake::UntrackedAllocations untracked;
+  _pendingTopic = topic;
+  _pendingPayload.clear();
+  _pendingLength = length;
+  return true;
+}
+
+size_t PubSubClient::write(uint8_t c) {
+  return write(&c, 1);
+}
+
+size_t PubSubClient::write(const uint8_t* buffer, size_t size) {
+  if (!connected()) {
+    return 0;
+  }
+  fake::UntrackedAllocations untracked;
+  _pendingPayload.insert(_pendingPayload.end(), buffer, buffer + size);
+  return size;
+}
+
+int PubSubClient::endPublish() {
+  if (!connected() || _pendingPayload.size() != _pendingLength) {
+    return 0;
+  }
+  fake::Broker& broker = fake::broker();
+  if (!broker.acceptPublish) {
+    return 0;
+  }
+  fake::UntrackedAllocations untracked;
+  broker.messages.push_back({_clientId, _pendingTopic, _pendingPayload, fake::now()});
+  return 1;
+}
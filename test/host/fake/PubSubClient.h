@@ -0,0 +1,67 @@
+#pragma once
+
+#include <Arduino.h>
+#include <WiFi.h>
+
+#include <string>
+#include <vector>
+
+#define MQTT_MAX_HEADER_SIZE 5
+
+#define MQTT_CONNECTION_TIMEOUT -4
+#define MQTT_CONNECTION_LOST -3
+#define MQTT_CONNECT_FAILED -2
+#define MQTT_DISCONNECTED -1
+#define MQTT_CONNECTED 0
+#define MQTT_CONNECT_BAD_CREDENTIALS 4
+#define MQTT_CONNECT_UNAUTHORIZED 5
+
+class PubSubClient : public Print {
+  /*
+      Talks to the broker stand-in of fake::broker() instead of a socket.
+      connect() blocks for the broker's connect latency, or for the TCP timeout when the
+      broker is unreachable, like the original does on the calling task.
+  */
+ public:
+  using Print::write;
+  PubSubClient() = default;
+  explicit PubSubClient(Client& client) : _client(&client) {}
+
+  PubSubClient& setServer(const char* domain, uint16_t port);
+  PubSubClient& setServer(IPAddress ip, uint16_t port);
+  PubSubClient& setClient(Client& client);
+  PubSubClient& setKeepAlive(uint16_t keepAlive);
+  PubSubClient& setSocketTimeout(uint16_t timeout);
+  bool setBufferSize(uint16_t size);
+  uint16_t getBufferSize() { return _bufferSize; }
+
+  bool connect(const char* id);
+  bool connect(const char* id, const char* user, const char* password);
+  void disconnect();
+  bool connected();
+  int state() { return _state; }
+  bool loop();
+
+  bool publish(const char* topic, const char* payload);
+  bool publish(const char* topic, const uint8_t* payload, unsigned int length);
+  bool publish(const char* topic, const uint8_t* payload, unsigned int length, bool retained);
+  bool beginPublish(const char* topic, unsigned int length, bool retained);
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t* buffer, size_t size) override;
+  int endPublish();
+
+ private:
+  Client* _client = nullptr;
+  std::string _domain;
+  uint16_t _port = 1883;
+  uint16_t _bufferSize = 256;
+  uint16_t _socketTimeout = 15;  // [s]
+  int _state = MQTT_DISCONNECTED;
+  uint32_t _session = 0;  // Broker session this client is connected to
+  std::string _clientId;
+
+  // beginPublish() .. endPublish()
+  std::string _pendingTopic;
+  std::vector<uint8_t> _pendingPayload;
+  unsigned int _pendingLength = 0;
+};
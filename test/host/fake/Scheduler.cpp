@@ -0,0 +1,858 @@
+// Simulated clock, tasks, semaphores, esp_timer, pulse inputs, PCNT and GPIO interrupts
+
+#include <Arduino.h>
+#include <driver/pcnt.h>
+#include <esp_timer.h>
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "FakeHal.h"
+#include "FakeInternal.h"
+
+struct FakeTask {
+  std::string name;
+  TaskFunction_t fn = nullptr;
+  void* arg = nullptr;
+  UBaseType_t priority = 0;
+  uint32_t stackDepth = 0;
+  uint64_t order = 0;         // Creation order breaks ties between equal priorities
+  int64_t wakeAt = 0;         // Resumed when the clock reaches this [us]
+  bool finished = false;      // Returned or deleted itself
+  bool stopped = false;       // Deleted, or stopped by fake::stopTasks()
+  uint32_t notifications = 0;
+  bool waitingNotification = false;
+  std::condition_variable resume;
+};
+
+struct FakeSemaphore {
+  bool available;
+};
+
+struct esp_timer {
+  esp_timer_cb_t callback;
+  void* arg;
+  const char* name;
+  bool active = false;
+  bool stale = false;  // Created before fake::reset()
+  int64_t deadline = 0;
+  int64_t period = 0;
+};
+
+namespace fake {
+namespace detail {
+namespace {
+
+const int64_t NEVER = INT64_MAX;
+// The loop gives up waiting for a semaphore after this, since nothing will give it
+const int64_t DEADLOCK_TIMEOUT = 60000000;
+
+// Tasks which exist on the device but are not simulated, so that they can be looked up by name
+FakeTask* systemTask(const char* name, uint32_t stackDepth) {
+  UntrackedAllocations untracked;
+  FakeTask* task = new FakeTask();
+  task->name = name;
+  task->stackDepth = stackDepth;
+  task->wakeAt = NEVER;
+  return task;
+}
+
+FakeTask* const LOOP_TASK = systemTask("loopTask", 8192);
+FakeTask* const ASYNC_TCP_TASK = systemTask("async_tcp", 8192);
+FakeTask* const TIMER_TASK = systemTask("esp_timer", 3584);
+
+struct TaskExit {};
+
+// Not reset with the scheduler, since semaphores may belong to objects which outlive a test
+std::atomic<int>& semaphoreCount() {
+  static std::atomic<int> count{0};
+  return count;
+}
+
+struct PulseInput {
+  int pin;
+  Signal hz;
+  double phase = 0;  // Fraction of the period since the last edge
+  double rate = 0;   // hz at the last evaluation
+  int64_t nextAt = 0;
+  bool edgeNext = false;
+};
+
+struct PcntUnit {
+  bool configured = false;
+  int pin = PCNT_PIN_NOT_USED;
+  pcnt_count_mode_t posMode = PCNT_COUNT_DIS;
+  int16_t count = 0;
+  int16_t highLimit = 0;
+  bool paused = false;
+  uint32_t events = 0;
+  uint32_t status = 0;
+  void (*handler)(void*) = nullptr;
+  void* arg = nullptr;
+};
+
+struct Interrupt {
+  int pin;
+  void (*handler)(void*);
+  void (*plainHandler)();
+  void* arg;
+  int mode;
+};
+
+struct Scheduler {
+  // Hands the right to run between the loop and tasks
+  std::mutex mutex;
+  std::condition_variable loopResume;
+  FakeTask* running = nullptr;  // nullptr while the loop runs
+
+  int64_t now = 0;
+  uint64_t taskOrder = 0;
+  std::vector<FakeTask*> tasks;
+  std::vector<esp_timer*> timers;
+  int failTimerCreate = 0;
+  int blockedTimerCallbacks = 0;
+  int interruptDepth = 0;
+
+  std::vector<PulseInput> pulses;
+  PcntUnit pcnt[PCNT_UNIT_MAX];
+  bool pcntServiceInstalled = false;
+  std::vector<Interrupt> interrupts;
+  int missedInterrupts[64] = {};  // Edges left per pin which raise no GPIO interrupt
+};
+
+// Never destroyed, since parked task threads use it until the process exits
+Scheduler& scheduler() {
+  static Scheduler* instance = new Scheduler();
+  return *instance;
+}
+
+thread_local FakeTask* currentTask = nullptr;
+
+void runTask(FakeTask* task) {
+  Scheduler& s = scheduler();
+  currentTask = task;
+  {
+    std::unique_lock<std::mutex> lock(s.mutex);
+    task->resume.wait(lock, [&]() { return s.running == task; });
+  }
+  try {
+    task->fn(task->arg);
+  } catch (TaskExit&) {
+  } catch (std::exception& e) {
+    fail("Task %s threw: %s", task->name.c_str(), e.what());
+  }
+  std::unique_lock<std::mutex> lock(s.mutex);
+  task->finished = true;
+  s.running = nullptr;
+  s.loopResume.notify_all();
+}
+
+// Let task run until it blocks. Called by the loop.
+void resumeTask(FakeTask* task) {
+  Scheduler& s = scheduler();
+  std::unique_lock<std::mutex> lock(s.mutex);
+  s.running = task;
+  task->resume.notify_one();
+  s.loopResume.wait(lock, [&]() { return s.running == nullptr; });
+}
+
+// Give control back to the loop until the clock reaches wakeAt or the task is notified
+void blockTask(int64_t wakeAt) {
+  Scheduler& s = scheduler();
+  FakeTask* task = currentTask;
+  std::unique_lock<std::mutex> lock(s.mutex);
+  task->wakeAt = wakeAt;
+  s.running = nullptr;
+  s.loopResume.notify_all();
+  task->resume.wait(lock, [&]() { return s.running == task; });
+}
+
+void edge(int pin);
+
+void schedulePulse(PulseInput& input, int64_t at) {
+  // Step at most 1 ms, so that the rate follows the signal
+  input.rate = input.hz(at);
+  if (input.rate <= 0) {
+    input.nextAt = at + 1000;
+    input.edgeNext = false;
+    return;
+  }
+  double untilEdge = (1 - input.phase) / input.rate * 1e6;
+  if (untilEdge <= 1000) {
+    input.nextAt = at + std::max<int64_t>(1, llround(untilEdge));
+    input.edgeNext = true;
+  } else {
+    input.nextAt = at + 1000;
+    input.edgeNext = false;
+  }
+}
+
+struct Event {
+  enum Kind { Timer, Pulse, Task } kind;
+  int64_t at;
+  void* item;
+};
+
+bool nextEvent(int64_t until, Event& event) {
+  Scheduler& s = scheduler();
+  bool found = false;
+  auto consider = [&](Event candidate) {
+    if (candidate.at <= until && (!found || candidate.at < event.at)) {
+      event = candidate;
+      found = true;
+    }
+  };
+  for (esp_timer* timer : s.timers) {
+    if (timer->active) {
+      consider({Event::Timer, timer->deadline, timer});
+    }
+  }
+  for (PulseInput& input : s.pulses) {
+    consider({Event::Pulse, input.nextAt, &input});
+  }
+  // Ready tasks by priority, then creation order
+  FakeTask* ready = nullptr;
+  for (FakeTask* task : s.tasks) {
+    if (task->finished || task->stopped || task->wakeAt == NEVER) {
+      continue;
+    }
+    if (ready == nullptr || task->wakeAt < ready->wakeAt ||
+        (task->wakeAt == ready->wakeAt && (task->priority > ready->priority ||
+                                           (task->priority == ready->priority && task->order < ready->order)))) {
+      ready = task;
+    }
+  }
+  if (ready != nullptr) {
+    consider({Event::Task, ready->wakeAt, ready});
+  }
+  return found;
+}
+
+void process(const Event& event) {
+  Scheduler& s = scheduler();
+  switch (event.kind) {
+    case Event::Timer: {
+      esp_timer* timer = static_cast<esp_timer*>(event.item);
+      if (timer->period > 0) {
+        timer->deadline += timer->period;
+      } else {
+        timer->active = false;
+      }
+      s.interruptDepth++;
+      timer->callback(timer->arg);
+      s.interruptDepth--;
+      break;
+    }
+    case Event::Pulse: {
+      PulseInput& input = *static_cast<PulseInput*>(event.item);
+      if (input.edgeNext) {
+        input.phase = 0;
+        edge(input.pin);
+      } else {
+        input.phase += input.rate * 1e-3;
+      }
+      schedulePulse(input, s.now);
+      break;
+    }
+    case Event::Task:
+      resumeTask(static_cast<FakeTask*>(event.item));
+      break;
+  }
+}
+
+void edge(int pin) {
+  Scheduler& s = scheduler();
+  s.interruptDepth++;
+  for (int unit = 0; unit < PCNT_UNIT_MAX; unit++) {
+    PcntUnit& counter = s.pcnt[unit];
+    if (!counter.configured || counter.paused || counter.pin != pin || counter.posMode != PCNT_COUNT_INC) {
+      continue;
+    }
+    // The counter resets at the high limit and raises the event
+    if (++counter.count >= counter.highLimit && counter.highLimit > 0) {
+      counter.count = 0;
+      if ((counter.events & PCNT_EVT_H_LIM) && s.pcntServiceInstalled && counter.handler != nullptr) {
+        counter.status = PCNT_EVT_H_LIM;
+        counter.handler(counter.arg);
+      }
+    }
+  }
+  if (s.missedInterrupts[pin] > 0) {
+    s.missedInterrupts[pin]--;
+    s.interruptDepth--;
+    return;
+  }
+  for (const Interrupt& interrupt : s.interrupts) {
+    if (interrupt.pin == pin && (interrupt.mode == RISING || interrupt.mode == CHANGE)) {
+      if (interrupt.handler != nullptr) {
+        interrupt.handler(interrupt.arg);
+      } else {
+        interrupt.plainHandler();
+      }
+    }
+  }
+  s.interruptDepth--;
+}
+
+FakeTask* createTask(TaskFunction_t fn, const char* name, uint32_t stackDepth, void* arg, UBaseType_t priority) {
+  Scheduler& s = scheduler();
+  UntrackedAllocations untracked;
+  FakeTask* task = new FakeTask();
+  task->name = name;
+  task->fn = fn;
+  task->arg = arg;
+  task->priority = priority;
+  task->stackDepth = stackDepth;
+  task->order = s.taskOrder++;
+  task->wakeAt = s.now;
+  s.tasks.push_back(task);
+  std::thread(runTask, task).detach();
+  return task;
+}
+
+}  // namespace
+
+bool inInterrupt() {
+  return scheduler().interruptDepth > 0;
+}
+
+void fail(const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  fprintf(stderr, "fake: ");
+  vfprintf(stderr, format, args);
+  fprintf(stderr, "\n");
+  va_end(args);
+  fflush(stderr);
+  abort();
+}
+
+void resetScheduler() {
+  Scheduler& s = scheduler();
+  stopTasks();
+  s.tasks.clear();
+  // Handles may still be held by objects of the last test, so timers are kept but never fire
+  for (esp_timer* timer : s.timers) {
+    timer->active = false;
+    timer->stale = true;
+  }
+  s.timers.clear();
+  s.now = 0;
+  s.failTimerCreate = 0;
+  s.blockedTimerCallbacks = 0;
+  s.pulses.clear();
+  for (PcntUnit& unit : s.pcnt) {
+    unit = PcntUnit();
+  }
+  s.pcntServiceInstalled = false;
+  s.interrupts.clear();
+  std::fill(std::begin(s.missedInterrupts), std::end(s.missedInterrupts), 0);
+}
+
+}  // namespace detail
+
+using namespace detail;
+
+int64_t now() {
+  return scheduler().now;
+}
+
+void advance(int64_t us) {
+  /*
+      Process all events up to now + us in time order.
+  */
+  if (currentTask != nullptr) {
+    fail("advance() called from task %s", currentTask->name.c_str());
+  }
+  Scheduler& s = scheduler();
+  int64_t until = s.now + std::max<int64_t>(us, 0);
+  Event event;
+  while (nextEvent(until, event)) {
+    s.now = std::max(s.now, event.at);
+    process(event);
+  }
+  s.now = std::max(s.now, until);
+}
+
+void sleepFor(int64_t us) {
+  if (currentTask != nullptr) {
+    blockTask(now() + std::max<int64_t>(us, 0));
+  } else {
+    advance(us);
+  }
+}
+
+void stopTasks() {
+  for (FakeTask* task : scheduler().tasks) {
+    task->stopped = true;
+  }
+}
+
+int taskCount() {
+  int count = 0;
+  for (FakeTask* task : scheduler().tasks) {
+    if (!task->finished && !task->stopped) {
+      count++;
+    }
+  }
+  return count;
+}
+
+void setPulses(int pin, Signal hz) {
+  Scheduler& s = scheduler();
+  s.pulses.erase(std::remove_if(s.pulses.begin(), s.pulses.end(), [pin](const PulseInput& input) { return input.pin == pin; }),
+                 s.pulses.end());
+  if (!hz) {
+    return;
+  }
+  UntrackedAllocations untracked;
+  PulseInput input;
+  input.pin = pin;
+  input.hz = hz;
+  schedulePulse(input, s.now);
+  s.pulses.push_back(input);
+}
+
+void pulse(int pin, int count) {
+  for (int i = 0; i < count; i++) {
+    edge(pin);
+  }
+}
+
+void missInterrupts(int pin, int count) {
+  scheduler().missedInterrupts[pin] = count;
+}
+
+void failTimerCreate(int n) {
+  scheduler().failTimerCreate = n;
+}
+
+int activeTimers() {
+  int count = 0;
+  for (esp_timer* timer : scheduler().timers) {
+    count += timer->active ? 1 : 0;
+  }
+  return count;
+}
+
+int blockedTimerCallbacks() {
+  return scheduler().blockedTimerCallbacks;
+}
+
+int liveSemaphores() {
+  return semaphoreCount().load();
+}
+
+}  // namespace fake
+
+using namespace fake::detail;
+
+// Arduino time
+
+unsigned long millis() {
+  // 32 bits like the device, so it wraps after 49.7 days
+  return static_cast<uint32_t>(fake::now() / 1000);
+}
+
+unsigned long micros() {
+  return static_cast<uint32_t>(fake::now());
+}
+
+void delay(uint32_t ms) {
+  fake::sleepFor(static_cast<int64_t>(ms) * 1000);
+}
+
+void delayMicroseconds(uint32_t us) {
+  fake::sleepFor(us);
+}
+
+void yield() {
+  if (currentTask != nullptr) {
+    taskYIELD();
+  }
+}
+
+// GPIO interrupts
+
+void attachInterruptArg(uint8_t pin, void (*handler)(void*), void* arg, int mode) {
+  detachInterrupt(pin);
+  fake::UntrackedAllocations untracked;
+  scheduler().interrupts.push_back({pin, handler, nullptr, arg, mode});
+}
+
+void attachInterrupt(uint8_t pin, void (*handler)(void), int mode) {
+  detachInterrupt(pin);
+  fake::UntrackedAllocations untracked;
+  scheduler().interrupts.push_back({pin, nullptr, handler, nullptr, mode});
+}
+
+void detachInterrupt(uint8_t pin) {
+  std::vector<Interrupt>& interrupts = scheduler().interrupts;
+  interrupts.erase(std::remove_if(interrupts.begin(), interrupts.end(),
+                                  [pin](const Interrupt& interrupt) { return interrupt.pin == pin; }),
+                   interrupts.end());
+}
+
+// Tasks
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char* name, uint32_t stackDepth, void* arg,
+                                   UBaseType_t priority, TaskHandle_t* created, BaseType_t core) {
+  FakeTask* task = createTask(fn, name, stackDepth, arg, priority);
+  if (created != nullptr) {
+    *created = task;
+  }
+  return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char* name, uint32_t stackDepth, void* arg,
+                       UBaseType_t priority, TaskHandle_t* created) {
+  return xTaskCreatePinnedToCore(fn, name, stackDepth, arg, priority, created, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+  if (task == nullptr || task == currentTask) {
+    if (currentTask == nullptr) {
+      fail("vTaskDelete(nullptr) called from the loop");
+    }
+    currentTask->stopped = true;
+    throw TaskExit();
+  }
+  task->stopped = true;
+}
+
+void vTaskDelay(TickType_t ticks) {
+  fake::sleepFor(static_cast<int64_t>(ticks) * 1000);
+}
+
+void vTaskDelayUntil(TickType_t* previousWakeTime, TickType_t increment) {
+  *previousWakeTime += increment;
+  int64_t wakeAt = static_cast<int64_t>(*previousWakeTime) * 1000;
+  if (currentTask != nullptr) {
+    // Like FreeRTOS, a late task does not wait, but it still lets the others run
+    blockTask(std::max(wakeAt, fake::now()));
+  } else if (wakeAt > fake::now()) {
+    fake::advance(wakeAt - fake::now());
+  }
+}
+
+TickType_t xTaskGetTickCount() {
+  return static_cast<TickType_t>(fake::now() / 1000);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+  return currentTask != nullptr ? currentTask : LOOP_TASK;
+}
+
+TaskHandle_t xTaskGetHandle(const char* name) {
+  for (FakeTask* task : scheduler().tasks) {
+    if (task->name == name && !task->stopped && !task->finished) {
+      return task;
+    }
+  }
+  for (FakeTask* task : {LOOP_TASK, ASYNC_TCP_TASK, TIMER_TASK}) {
+    if (task->name == name) {
+      return task;
+    }
+  }
+  return nullptr;
+}
+
+const char* pcTaskGetName(TaskHandle_t task) {
+  task = task != nullptr ? task : xTaskGetCurrentTaskHandle();
+  return task->name.c_str();
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+  // Not measured. Reported as half of the stack.
+  task = task != nullptr ? task : xTaskGetCurrentTaskHandle();
+  return task->stackDepth / 2;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+  task->notifications++;
+  if (task->waitingNotification) {
+    task->waitingNotification = false;
+    task->wakeAt = fake::now();
+  }
+  return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticksToWait) {
+  FakeTask* task = currentTask;
+  if (task == nullptr) {
+    fail("ulTaskNotifyTake() called from the loop");
+  }
+  if (task->notifications == 0 && ticksToWait > 0) {
+    task->waitingNotification = true;
+    blockTask(ticksToWait == portMAX_DELAY ? NEVER : fake::now() + static_cast<int64_t>(ticksToWait) * 1000);
+    task->waitingNotification = false;
+  }
+  uint32_t value = task->notifications;
+  if (value > 0) {
+    task->notifications = clearOnExit ? 0 : value - 1;
+  }
+  return value;
+}
+
+void taskYIELD() {
+  if (currentTask != nullptr) {
+    blockTask(fake::now() + 1);
+  }
+}
+
+// Semaphores
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+  semaphoreCount()++;
+  return new FakeSemaphore{true};
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary() {
+  semaphoreCount()++;
+  return new FakeSemaphore{false};
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore) {
+  if (semaphore != nullptr) {
+    semaphoreCount()--;
+  }
+  delete semaphore;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticksToWait) {
+  /*
+      A contended take waits 1 ms at a time, so that the holder can run.
+  */
+  if (semaphore == nullptr) {
+    fail("xSemaphoreTake() on a null semaphore");
+  }
+  int64_t start = fake::now();
+  int64_t deadline = ticksToWait == portMAX_DELAY ? NEVER : start + static_cast<int64_t>(ticksToWait) * 1000;
+  while (!semaphore->available) {
+    if (ticksToWait == 0 || fake::now() >= deadline) {
+      return pdFALSE;
+    }
+    if (inInterrupt()) {
+      // Waiting here would stall every other timer. The fake cannot wait, so the take fails.
+      scheduler().blockedTimerCallbacks++;
+      return pdFALSE;
+    }
+    if (currentTask == nullptr && ticksToWait == portMAX_DELAY && fake::now() - start > DEADLOCK_TIMEOUT) {
+      fail("The loop waited over 60 s for a semaphore");
+    }
+    fake::sleepFor(std::min<int64_t>(1000, deadline - fake::now()));
+  }
+  semaphore->available = false;
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+  if (semaphore == nullptr) {
+    fail("xSemaphoreGive() on a null semaphore");
+  }
+  if (semaphore->available) {
+    return pdFALSE;
+  }
+  semaphore->available = true;
+  return pdTRUE;
+}
+
+// Critical sections
+
+void vPortEnterCritical(portMUX_TYPE* mux) {
+  // Tasks never run concurrently, so the lock can only be taken if its owner blocked inside it
+  unsigned long self = reinterpret_cast<unsigned long>(xTaskGetCurrentTaskHandle());
+  unsigned long owner = mux->owner.load(std::memory_order_relaxed);
+  if (owner == self) {
+    mux->count++;
+    return;
+  }
+  if (owner != 0) {
+    fail("Critical section taken by %s, which blocked inside it", pcTaskGetName(reinterpret_cast<TaskHandle_t>(owner)));
+  }
+  mux->owner.store(self, std::memory_order_relaxed);
+  mux->count = 1;
+}
+
+void vPortExitCritical(portMUX_TYPE* mux) {
+  if (mux->count == 0) {
+    fail("Critical section exited without entering");
+  }
+  if (--mux->count == 0) {
+    mux->owner.store(0, std::memory_order_relaxed);
+  }
+}
+
+// esp_timer
+
+int64_t esp_timer_get_time() {
+  return fake::now();
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* out_handle) {
+  Scheduler& s = scheduler();
+  if (args == nullptr || args->callback == nullptr || out_handle == nullptr) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (s.failTimerCreate > 0) {
+    s.failTimerCreate--;
+    return ESP_ERR_NO_MEM;
+  }
+  fake::UntrackedAllocations untracked;
+  esp_timer* timer = new esp_timer{args->callback, args->arg, args->name};
+  s.timers.push_back(timer);
+  *out_handle = timer;
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+  if (timer == nullptr) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (timer->active) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  timer->active = !timer->stale;
+  timer->deadline = fake::now() + static_cast<int64_t>(timeout_us);
+  timer->period = 0;
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period) {
+  if (timer == nullptr) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (timer->active) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  timer->active = !timer->stale;
+  timer->deadline = fake::now() + static_cast<int64_t>(period);
+  timer->period = static_cast<int64_t>(period);
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+  if (timer == nullptr) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (!timer->active) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  timer->active = false;
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+  if (timer == nullptr) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (timer->active) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  std::vector<esp_timer*>& timers = scheduler().timers;
+  timers.erase(std::remove(timers.begin(), timers.end(), timer), timers.end());
+  delete timer;
+  return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t timer) {
+  return timer != nullptr && timer->active;
+}
+
+// PCNT
+
+esp_err_t pcnt_unit_config(const pcnt_config_t* config) {
+  if (config == nullptr || config->unit >= PCNT_UNIT_MAX) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  PcntUnit& unit = scheduler().pcnt[config->unit];
+  if (config->channel == PCNT_CHANNEL_0) {
+    unit.pin = config->pulse_gpio_num;
+    unit.posMode = config->pos_mode;
+  }
+  unit.highLimit = config->counter_h_lim;
+  unit.count = 0;
+  unit.configured = true;
+  return ESP_OK;
+}
+
+esp_err_t pcnt_get_counter_value(pcnt_unit_t unit, int16_t* count) {
+  if (unit >= PCNT_UNIT_MAX || count == nullptr) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  *count = scheduler().pcnt[unit].count;
+  return ESP_OK;
+}
+
+esp_err_t pcnt_counter_pause(pcnt_unit_t unit) {
+  if (unit >= PCNT_UNIT_MAX) return ESP_ERR_INVALID_ARG;
+  scheduler().pcnt[unit].paused = true;
+  return ESP_OK;
+}
+
+esp_err_t pcnt_counter_resume(pcnt_unit_t unit) {
+  if (unit >= PCNT_UNIT_MAX) return ESP_ERR_INVALID_ARG;
+  scheduler().pcnt[unit].paused = false;
+  return ESP_OK;
+}
+
+esp_err_t pcnt_counter_clear(pcnt_unit_t unit) {
+  if (unit >= PCNT_UNIT_MAX) return ESP_ERR_INVALID_ARG;
+  scheduler().pcnt[unit].count = 0;
+  return ESP_OK;
+}
+
+esp_err_t pcnt_event_enable(pcnt_unit_t unit, pcnt_evt_type_t event) {
+  if (unit >= PCNT_UNIT_MAX) return ESP_ERR_INVALID_ARG;
+  scheduler().pcnt[unit].events |= event;
+  return ESP_OK;
+}
+
+esp_err_t pcnt_event_disable(pcnt_unit_t unit, pcnt_evt_type_t event) {
+  if (unit >= PCNT_UNIT_MAX) return ESP_ERR_INVALID_ARG;
+  scheduler().pcnt[unit].events &= ~static_cast<uint32_t>(event);
+  return ESP_OK;
+}
+
+esp_err_t pcnt_get_event_status(pcnt_unit_t unit, uint32_t* status) {
+  if (unit >= PCNT_UNIT_MAX || status == nullptr) return ESP_ERR_INVALID_ARG;
+  *status = scheduler().pcnt[unit].status;
+  return ESP_OK;
+}
+
+esp_err_t pcnt_set_filter_value(pcnt_unit_t unit, uint16_t value) {
+  return unit < PCNT_UNIT_MAX ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t pcnt_filter_enable(pcnt_unit_t unit) {
+  return unit < PCNT_UNIT_MAX ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t pcnt_isr_service_install(int intr_alloc_flags) {
+  Scheduler& s = scheduler();
+  if (s.pcntServiceInstalled) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  s.pcntServiceInstalled = true;
+  return ESP_OK;
+}
+
+esp_err_t pcnt_isr_handler_add(pcnt_unit_t unit, void (*isr_handler)(void*), void* args) {
+  Scheduler& s = scheduler();
+  if (unit >= PCNT_UNIT_MAX) return ESP_ERR_INVALID_ARG;
+  if (!s.pcntServiceInstalled) return ESP_ERR_INVALID_STATE;
+  s.pcnt[unit].handler = isr_handler;
+  s.pcnt[unit].arg = args;
+  return ESP_OK;
+}
+
+esp_err_t pcnt_isr_handler_remove(pcnt_unit_t unit) {
+  if (unit >= PCNT_UNIT_MAX) return ESP_ERR_INVALID_ARG;
+  scheduler().pcnt[unit].handler = nullptr;
+  return ESP_OK;
+}
@@ -0,0 +1,124 @@
+// Signal generators for analog inputs and pulse rates
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+#include "FakeHal.h"
+#include "FakeInternal.h"
+
+namespace fake {
+
+Signal constant(double value) {
+  return [value](int64_t) { return value; };
+}
+
+Signal step(double before, double after, int64_t at) {
+  return [=](int64_t us) { return us < at ? before : after; };
+}
+
+Signal ramp(double from, double to, int64_t start, int64_t end) {
+  return keyframes({{start, from}, {end, to}});
+}
+
+Signal sine(double offset, double amplitude, int64_t period) {
+  return [=](int64_t us) { return offset + amplitude * std::sin(2 * M_PI * static_cast<double>(us) / period); };
+}
+
+Signal noise(Signal signal, double amplitude, uint32_t seed) {
+  return [=](int64_t us) {
+    // Hash of (seed, time), so that reading twice at the same time gives the same value
+    uint64_t x = static_cast<uint64_t>(us) * 0x9e3779b97f4a7c15ULL ^ (static_cast<uint64_t>(seed) << 32);
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    double uniform = static_cast<double>(x >> 11) / static_cast<double>(1ULL << 53);
+    return signal(us) + amplitude * (2 * uniform - 1);
+  };
+}
+
+Signal keyframes(std::vector<std::pair<int64_t, double>> points) {
+  if (points.empty()) {
+    return constant(0);
+  }
+  std::stable_sort(points.begin(), points.end(),
+                   [](const std::pair<int64_t, double>& a, const std::pair<int64_t, double>& b) { return a.first < b.first; });
+  return [points](int64_t us) {
+    if (us < points.front().first) {
+      return points.front().second;
+    }
+    // The last point at or before us. Of two points at the same time, the later one wins.
+    auto after = std::upper_bound(points.begin(), points.end(), us,
+                                  [](int64_t time, const std::pair<int64_t, double>& point) { return time < point.first; });
+    if (after == points.end()) {
+      return points.back().second;
+    }
+    const std::pair<int64_t, double>& before = *(after - 1);
+    double fraction = static_cast<double>(us - before.first) / (after->first - before.first);
+    return before.second + (after->second - before.second) * fraction;
+  };
+}
+
+Signal script(const std::string& text) {
+  /*
+      Parse "time:value" pairs separated by spaces. Times are in ms, or with a unit of us, ms or s.
+  */
+  std::vector<std::pair<int64_t, double>> points;
+  std::istringstream tokens(text);
+  std::string token;
+  while (tokens >> token) {
+    size_t colon = token.find(':');
+    if (colon == std::string::npos) {
+      detail::fail("Invalid script point \"%s\"", token.c_str());
+    }
+    std::string time = token.substr(0, colon);
+    double scale = 1000;
+    if (time.size() > 2 && time.compare(time.size() - 2, 2, "us") == 0) {
+      scale = 1;
+      time.resize(time.size() - 2);
+    } else if (time.size() > 2 && time.compare(time.size() - 2, 2, "ms") == 0) {
+      time.resize(time.size() - 2);
+    } else if (time.size() > 1 && time.back() == 's') {
+      scale = 1000000;
+      time.resize(time.size() - 1);
+    }
+    char* end = nullptr;
+    double at = strtod(time.c_str(), &end);
+    double value = strtod(token.c_str() + colon + 1, nullptr);
+    if (end == time.c_str() || *end != '\0') {
+      detail::fail("Invalid script time \"%s\"", token.c_str());
+    }
+    points.push_back({llround(at * scale), value});
+  }
+  return keyframes(points);
+}
+
+Signal lowPass(Signal signal, int64_t tau) {
+  struct State {
+    bool started = false;
+    int64_t at = 0;
+    double value = 0;
+  };
+  auto state = std::make_shared<State>();
+  return [=](int64_t us) {
+    if (!state->started || us < state->at) {
+      // Settled at the start, or after the clock was reset
+      state->started = true;
+      state->value = signal(us);
+    } else if (us > state->at) {
+      // Exact for an input which is constant over the step
+      double input = signal(us);
+      state->value = input + (state->value - input) * std::exp(-static_cast<double>(us - state->at) / tau);
+    }
+    state->at = us;
+    return state->value;
+  };
+}
+
+Signal adcCode(Signal volts, double reference) {
+  return [=](int64_t us) { return volts(us) / reference * 4096; };
+}
+
+}  // namespace fake
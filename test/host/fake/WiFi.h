@@ -0,0 +1,47 @@
+#pragma once
+
+#include <Arduino.h>
+
+typedef enum {
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_CONNECTION_LOST = 5,
+  WL_DISCONNECTED = 6,
+} wl_status_t;
+
+class Client : public Stream {
+ public:
+  using Print::write;
+  virtual int connect(const char* host, uint16_t port) = 0;
+  virtual uint8_t connected() = 0;
+  virtual void stop() = 0;
+  virtual explicit operator bool() { return connected(); }
+};
+
+class WiFiClient : public Client {
+  /*
+      The MQTT broker is simulated behind PubSubClient, so this client never carries data.
+  */
+ public:
+  int connect(const char* host, uint16_t port) override { return 0; }
+  uint8_t connected() override { return 0; }
+  void stop() override {}
+  size_t write(uint8_t) override { return 0; }
+};
+
+class WiFiClass {
+  /*
+      Connected by default. fake::setWiFiConnected() changes the status.
+  */
+ public:
+  wl_status_t begin(const char* ssid, const char* password = nullptr);
+  wl_status_t status();
+  bool reconnect();
+  bool disconnect(bool wifiOff = false);
+  IPAddress localIP();
+  String macAddress();
+};
+
+extern WiFiClass WiFi;
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <vector>
+
+class TwoWire : public Print {
+  /*
+      Transactions are recorded per address. Addresses without a device registered with
+      fake::setI2CDevice() are not acknowledged (endTransmission() returns 2).
+  */
+ public:
+  using Print::write;
+  bool begin(int sda = -1, int scl = -1, uint32_t frequency = 0) { return true; }
+  void beginTransmission(uint8_t address);
+  void beginTransmission(int address) { beginTransmission(static_cast<uint8_t>(address)); }
+  uint8_t endTransmission(bool sendStop = true);
+  size_t write(uint8_t data) override;
+  uint8_t requestFrom(uint8_t address, uint8_t size) { return 0; }
+  int available() { return 0; }
+  int read() { return -1; }
+
+ private:
+  uint8_t _address = 0;
+  bool _transmitting = false;
+  std::vector<uint8_t> _buffer;
+};
+
+extern TwoWire Wire;
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Wire.h>
+
+#define LCD_ADDRESS (0x7c >> 1)
+#define RGB_ADDRESS (0xc4 >> 1)
+
+class rgb_lcd : public Print {
+  /*
+      Grove LCD driver writing the same I2C commands as the original, so the
+      simulated bus sees initialization after begin() and one transaction per character.
+  */
+ public:
+  using Print::write;
+  void begin(uint8_t cols, uint8_t rows, uint8_t charSize = 0);
+  void clear();
+  void home();
+  void setCursor(uint8_t col, uint8_t row);
+  void setRGB(unsigned char r, unsigned char g, unsigned char b);
+  size_t write(uint8_t value) override;
+
+ private:
+  void command(uint8_t value);
+};
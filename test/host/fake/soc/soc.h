@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstdint>
+
+// Register writes go to the simulated GPIO matrix instead of memory
+void fakeRegWrite(uint32_t reg, uint32_t value);
+uint32_t fakeRegRead(uint32_t reg);
+
+#define REG_WRITE(reg, val) fakeRegWrite((reg), (val))
+#define REG_READ(reg) fakeRegRead(reg)
@@ -0,0 +1,134 @@
+// MCP3208 frames and scan ordering, checked by the bit-level ADC behind the fake SPI
+
+#include "CoreModule.h"
+#include "HostTest.h"
+
+namespace {
+
+void setDistinctCodes() {
+  for (int ch = 0; ch < 8; ch++) {
+    fake::setADC(ch, fake::constant(100 + 500 * ch));
+  }
+}
+
+}  // namespace
+
+TEST(read_selects_every_channel) {
+  // D2 comes from ch >> 2, so channels 4-7 are not read as 0-3
+  CoreModule module;
+  module.init();
+  setDistinctCodes();
+  fake::clearADCConversions();
+  for (int ch = 0; ch < 8; ch++) {
+    CHECK_EQ(module.ADCread(ch), 100 + 500 * ch);
+  }
+  CHECK_EQ(fake::adcConversions(), std::vector<int>({0, 1, 2, 3, 4, 5, 6, 7}));
+  CHECK_EQ(fake::adcErrors(), 0u);
+}
+
+TEST(scan_is_in_ascending_channel_order) {
+  CoreModule module;
+  module.init();
+  setDistinctCodes();
+  fake::clearADCConversions();
+
+  uint16_t buffer[12];
+  module.ADCscan(0b10100101, 3, buffer);
+
+  CHECK_EQ(fake::adcConversions(), std::vector<int>({0, 0, 0, 2, 2, 2, 5, 5, 5, 7, 7, 7}));
+  const int channels[] = {0, 2, 5, 7};
+  for (int i = 0; i < 12; i++) {
+    CHECK_EQ(buffer[i], 100 + 500 * channels[i / 3]);
+  }
+  // Each frame toggles CS, so every conversion was a complete frame
+  CHECK_EQ(fake::adcErrors(), 0u);
+}
+
+TEST(average_spans_chunks) {
+  CoreModule module;
+  module.init();
+  fake::setADC(2, fake::constant(1234));
+  fake::clearADCConversions();
+  CHECK_EQ(module.ADCaverage(2, 40), 1234.0f);
+  CHECK_EQ(fake::adcConversions().size(), 40u);
+}
+
+TEST(sensors_are_read_with_their_own_sample_counts) {
+  CoreModule module;
+  module.init();
+  setDistinctCodes();
+  PressureSensor<CoreModule> averaged(module, 4);   // 10 readings
+  PressureSensor<CoreModule, Ema> filtered(module, 5);  // 1 reading
+  PressureSensor<CoreModule> many(module, 6);
+  many.setSamples(40);
+
+  fake::clearADCConversions();
+  module.updateAnalogSensors();
+  std::vector<int> expected(10, 4);
+  expected.push_back(5);
+  // Beyond ADC_SCAN_CHUNK readings, a channel is read in further passes
+  expected.insert(expected.end(), 16, 6);
+  expected.insert(expected.end(), 16, 6);
+  expected.insert(expected.end(), 8, 6);
+  CHECK_EQ(fake::adcConversions(), expected);
+  // XDB302 curve at code 3100
+  CHECK_NEAR(many.pressure(), (0.000421 * 3100 - 0.314433) * 145, 0.01);
+  CHECK_THROWS(many.setSamples(0), std::invalid_argument);
+
+  CHECK_THROWS(PressureSensor<CoreModule>(module, 8), std::invalid_argument);
+  CHECK_THROWS(PressureSensor<CoreModule>(module, -1), std::invalid_argument);
+}
+
+TEST(sensor_update_does_not_read_again) {
+  // Sketches written before batched reading call update() of each sensor after the module's
+  CoreModule module;
+  module.init();
+  setDistinctCodes();
+  PressureSensor<CoreModule> pressure(module, 4);
+  PHSensor<CoreModule> ph(module, 5);
+  fake::clearADCConversions();
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+  pressure.update(20);
+  ph.update(500);
+#pragma GCC diagnostic pop
+  CHECK(fake::adcConversions().empty());
+
+  // Their settings still apply to the module's pass
+  module.updateAnalogSensors();
+  std::vector<int> expected(16, 4);
+  expected.push_back(5);
+  expected.insert(expected.end(), 4, 4);
+  CHECK_EQ(fake::adcConversions(), expected);
+}
+
+TEST(clock_is_clamped_and_applied) {
+  CoreModule module;
+  module.setADCClock(4000000);
+  CHECK_EQ(module.getADCClock(), 1000000u);
+  module.init();
+  CHECK_EQ(fake::spiClock(), 1000000u);
+
+  module.setADCClock(200000);
+  CHECK_EQ(fake::spiClock(), 200000u);
+  double busTime = fake::spiBusTime();
+  module.ADCread(0);
+  // 3 bytes at 200 kHz
+  CHECK_NEAR(fake::spiBusTime() - busTime, 120, 0.01);
+  CHECK_THROWS(module.setADCClock(0), std::invalid_argument);
+}
+
+TEST(lock_exists_before_init) {
+  // Sensors may be read by tasks started before init(). The ADC lock must already exist.
+  CoreModule module;
+  module.setADCClock(500000);
+  module.ADCread(0);
+  uint16_t buffer[2];
+  module.ADCscan(0b11, 1, buffer);
+  module.init();
+  CHECK_EQ(fake::spiClock(), 500000u);
+}
+
+int main() {
+  return host::runTests();
+}
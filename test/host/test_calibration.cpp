@@ -0,0 +1,80 @@
+// Calibration overrides through HTTP and their NVS keys
+
+#include "CoreModule.h"
+#include "HostTest.h"
+
+namespace {
+
+const int TDS_CHANNEL = 2;
+
+void run(CoreModule& module, int64_t ms) {
+  for (int64_t i = 0; i < ms; i++) {
+    module.update();
+    fake::advanceMs(1);
+  }
+}
+
+}  // namespace
+
+TEST(override_is_used_and_reset) {
+  CoreModule module(Diameter::Quarter);
+  module.init();
+  fake::setADC(TDS_CHANNEL, fake::constant(800));
+
+  auto request = host::request(module, HTTP_POST, "/calibration?name=tds3&c0=0&c1=0.5");
+  CHECK_EQ(request->sentCode(), 200);
+  run(module, 200);
+  CHECK_EQ(module.getTDS(), 400);
+  CHECK_EQ(fake::nvs()["calibration"].count("tds3"), 1u);
+
+  request = host::request(module, HTTP_POST, "/calibration/reset?name=tds3");
+  CHECK_EQ(request->sentCode(), 200);
+  run(module, 200);
+  CHECK_EQ(module.getTDS(), 4);
+  CHECK_EQ(fake::nvs()["calibration"].count("tds3"), 0u);
+}
+
+TEST(long_names_are_persisted_under_a_hashed_key) {
+  CalibrationCurve curve = linearCurve(0, 1);
+  CoreModule module;
+  module.init();
+  module.registerCalibration("reverseOsmosisOutlet", curve);
+  auto request = host::request(module, HTTP_POST, "/calibration?name=reverseOsmosisOutlet&c1=2");
+  CHECK_EQ(request->sentCode(), 200);
+  CHECK(host::request(module, HTTP_GET, "/calibration")->sentBody().find("\"reverseOsmosisOutlet\"") !=
+        std::string::npos);
+  CHECK_EQ(fake::nvs()["calibration"].size(), 1u);
+  CHECK(fake::nvs()["calibration"].begin()->first.size() <= 15);
+
+  // Loaded again by the next boot
+  CalibrationCurve restored = linearCurve(0, 1);
+  CoreModule rebooted;
+  rebooted.init();
+  rebooted.registerCalibration("reverseOsmosisOutlet", restored);
+  CHECK_EQ(restored(10), 20.0f);
+}
+
+TEST(duplicate_names_are_rejected) {
+  CoreModule module;
+  module.init();
+  CalibrationCurve curve = linearCurve(0, 1);
+  CHECK_THROWS(module.registerCalibration("tds0", curve), std::invalid_argument);
+  CHECK_THROWS(module.registerCalibration("", curve), std::invalid_argument);
+  module.registerCalibration("inlet", curve);
+  CHECK_THROWS(module.registerCalibration("inlet", curve), std::invalid_argument);
+}
+
+TEST(invalid_requests_are_rejected) {
+  CoreModule module(Diameter::Quarter);
+  module.init();
+  CHECK_EQ(host::request(module, HTTP_POST, "/calibration?c1=2")->sentCode(), 400);
+  CHECK_EQ(host::request(module, HTTP_POST, "/calibration?name=nothing&c1=2")->sentCode(), 400);
+  CHECK_EQ(host::request(module, HTTP_POST, "/calibration?name=tds3&segment=9&c1=2")->sentCode(), 400);
+  CHECK_EQ(host::request(module, HTTP_POST, "/calibration/reset")->sentCode(), 400);
+  CHECK_EQ(host::request(module, HTTP_POST, "/calibration/reset?name=nothing")->sentCode(), 400);
+  CHECK_EQ(fake::nvs()["calibration"].size(), 0u);
+}
+
+int main() {
+  return host::runTests();
+}
@@ -0,0 +1,331 @@
+// CoreModule and the module templates running on the simulated hardware
+
+#include <soc/gpio_reg.h>
+
+#include "CoreModule.h"
+#include "HostTest.h"
+
+namespace {
+
+const int TEMPERATURE_CHANNEL = 0;
+const int TDS_CHANNEL = 2;
+
+// A module which still reads the former states map
+struct LegacyModule : CoreModule {
+  boolean legacyState(int pin) { return states[pin]; }
+};
+
+void run(CoreModule& module, int64_t ms) {
+  for (int64_t i = 0; i < ms; i++) {
+    module.update();
+    fake::advanceMs(1);
+  }
+}
+
+}  // namespace
+
+TEST(update_reads_all_sensors) {
+  CoreModule module(Diameter::Quarter);
+  module.init();
+  fake::setADC(TEMPERATURE_CHANNEL, fake::constant(500));
+  fake::setADC(TDS_CHANNEL, fake::constant(800));
+  fake::setPulses(CoreModule::MH_FLOW, fake::constant(100));
+
+  run(module, 2000);
+
+  // Quarter, range 3: -0.3315 + 0.005465 * 800
+  CHECK_EQ(module.getTDS(), 4);
+  CHECK_NEAR(module.getTemperature(), 102.619 - 0.09 * 500, 0.01);
+  CHECK_NEAR(module.getFlow(), 100 * 0.02884, 0.1);
+  CHECK_NEAR(module.getTotalFlow(), module.getTotalFlowPulses() * 0.02884 / 60, 1e-4);
+  CHECK(module.getTotalFlowPulses() >= 199);
+
+  SensorValues values = module.getSensorValues();
+  CHECK_EQ(values.tds, 4);
+  CHECK(values.sequence > 0);
+}
+
+TEST(value_endpoints) {
+  CoreModule module(Diameter::Quarter);
+  module.init();
+  fake::setADC(TDS_CHANNEL, fake::constant(800));
+  run(module, 100);
+
+  auto request = host::request(module, HTTP_GET, "/tds");
+  CHECK_EQ(request->sendCount(), 1);
+  CHECK_EQ(request->sentCode(), 200);
+  CHECK_EQ(request->sentType(), std::string("application/json"));
+  CHECK(request->sentBody().find("\"value\":4,\"unit\":\"ppm\"") != std::string::npos);
+  CHECK_EQ(request->sentHeaders().at("Access-Control-Allow-Origin"), std::string("*"));
+
+  request = host::request(module, HTTP_GET, "/nothing");
+  CHECK_EQ(request->sentCode(), 404);
+}
+
+TEST(responses_do_not_allocate) {
+  // After warm-up, responding to these requests makes no heap allocation in the library.
+  // The request and the response objects belong to the server and are not counted,
+  // but a response stream which grows past the size it was begun with is.
+  CoreModule module(Diameter::Quarter);
+  module.init();
+  module.registerSensor("pressure1", "psi", []() { return 14.5f; });
+  run(module, 100);
+
+  const std::pair<WebRequestMethodComposite, const char*> requests[] = {
+      {HTTP_GET, "/tds"},       {HTTP_GET, "/flow"},     {HTTP_GET, "/sensors"},
+      {HTTP_GET, "/sensors?fields=tds,pressure1"},      {HTTP_GET, "/config/ip"},
+      {HTTP_GET, "/nothing"},   {HTTP_POST, "/totalFlow/reset"},
+  };
+  for (auto const& [method, url] : requests) {
+    for (int i = 0; i < 3; i++) {
+      AsyncWebServerRequest request(method, url);
+      fake::CountAllocations allocations;
+      module.handle(&request);
+      CHECK_EQ(allocations.result().count, 0u);
+      CHECK_EQ(request.sendCount(), 1);
+    }
+  }
+}
+
+TEST(sensors_come_from_one_snapshot) {
+  CoreModule module(Diameter::Quarter);
+  module.init();
+  fake::setADC(TDS_CHANNEL, fake::constant(800));
+  run(module, 100);
+  fake::advanceMs(50);
+
+  // time and sequence are those of the sample cycle, not of the request
+  SensorValues values = module.getSensorValues();
+  auto request = host::request(module, HTTP_GET, "/sensors?fields=tds,flow");
+  CHECK_EQ(request->sentCode(), 200);
+  std::string head = "{\"time\":" + std::to_string(values.timestamp) + ",\"sequence\":" + std::to_string(values.sequence) +
+                     ",\"sensors\":{\"tds\":{\"value\":4,";
+  CHECK_EQ(request->sentBody().substr(0, head.size()), head);
+}
+
+TEST(sensor_names_are_unique) {
+  CoreModule module(Diameter::Quarter);
+  module.init();
+  CHECK_THROWS(module.registerSensor("tds", "ppm", []() { return 0.0f; }), std::invalid_argument);
+  module.registerSensor("pressure1", "psi", []() { return 14.5f; });
+  CHECK_THROWS(module.registerSensor("pressure1", "psi", []() { return 0.0f; }), std::invalid_argument);
+  CHECK(host::request(module, HTTP_GET, "/sensors?fields=pressure1")->sentBody().find("14.50") != std::string::npos);
+  CHECK_EQ(host::request(module, HTTP_GET, "/sensors?fields=tds,pressure2")->sentCode(), 400);
+}
+
+TEST(path_sampling_is_set_through_http) {
+  CoreModule module(Diameter::Quarter);
+  module.init();
+  host::request(module, HTTP_GET, "/tds");
+  CHECK(host::request(module, HTTP_GET, "/logs?lines=64")->sentBody().find("Path: /tds") != std::string::npos);
+
+  CHECK_EQ(host::request(module, HTTP_POST, "/logs/level?path=/flow&every=0")->sentCode(), 200);
+  host::request(module, HTTP_GET, "/flow");
+  CHECK(host::request(module, HTTP_GET, "/logs?lines=64")->sentBody().find("Path: /flow") == std::string::npos);
+
+  CHECK_EQ(host::request(module, HTTP_POST, "/logs/level")->sentCode(), 400);
+  CHECK_EQ(host::request(module, HTTP_POST, "/logs/level?path=/tds")->sentCode(), 400);
+  CHECK_EQ(host::request(module, HTTP_POST, "/logs/level?path=/tds&every=-1")->sentCode(), 400);
+  CHECK_EQ(host::request(module, HTTP_POST, "/logs/level?path=/tds&every=70000")->sentCode(), 400);
+  CHECK_EQ(host::request(module, HTTP_POST, "/logs/level?level=loud&path=/tds&every=1")->sentCode(), 400);
+  CHECK_EQ(host::request(module, HTTP_POST, "/logs/level?level=warn&path=/tds&every=10")->sentCode(), 200);
+  CHECK(module.logger().level() == LogLevel::Warn);
+}
+
+TEST(ports_switch_low_before_high) {
+  LegacyModule module;
+  module.init();
+  module.setPorts(CoreModule::portMask(CoreModule::D0_2) | CoreModule::portMask(CoreModule::D1_2),
+                  CoreModule::portMask(CoreModule::D0_2) | CoreModule::portMask(CoreModule::D1_2));
+  fake::clearRegisterWrites();
+
+  // D0_1 and D1_1 on, D0_2 and D1_2 off, across both banks
+  uint64_t mask = CoreModule::portMask(CoreModule::D0_1) | CoreModule::portMask(CoreModule::D0_2) |
+                  CoreModule::portMask(CoreModule::D1_1) | CoreModule::portMask(CoreModule::D1_2);
+  module.setPorts(mask, CoreModule::portMask(CoreModule::D0_1) | CoreModule::portMask(CoreModule::D1_1));
+
+  std::vector<uint32_t> registers;
+  for (const fake::RegisterWrite& write : fake::registerWrites()) {
+    registers.push_back(write.reg);
+  }
+  CHECK_EQ(registers, std::vector<uint32_t>({GPIO_OUT_W1TC_REG, GPIO_OUT1_W1TC_REG, GPIO_OUT_W1TS_REG, GPIO_OUT1_W1TS_REG}));
+  CHECK_EQ(fake::pinLevel(CoreModule::D0_1), HIGH);
+  CHECK_EQ(fake::pinLevel(CoreModule::D1_2), LOW);
+  CHECK(module.getPortState(CoreModule::D1_1));
+  CHECK(module.legacyState(CoreModule::D1_1));
+  CHECK(!module.legacyState(CoreModule::D1_2));
+}
+
+TEST(tds_readings_are_not_averaged_across_ranges) {
+  // The code in range 3 steps from 1000 to 5000, which is 500 in range 2
+  fake::setADC(TDS_CHANNEL, [](int64_t us) {
+    int range = fake::pinLevel(CoreModule::TDS_RSEL0) | (fake::pinLevel(CoreModule::TDS_RSEL1) << 1);
+    double code = us < 1000000 ? 1000 : 5000;
+    for (int r = range; r < TDSAutorange::RANGE_MAX; r++) {
+      code /= TDSAutorange::RANGE_RATIO;
+    }
+    return std::min(code, 4095.0);
+  });
+  CoreModule module(Diameter::Quarter);
+  module.init();
+  run(module, 900);
+  int before = module.calculateTDS(1000, 3);
+  int after = module.calculateTDS(500, 2);
+  CHECK_EQ(module.getTDS(), before);
+
+  for (int i = 0; i < 1000; i++) {
+    run(module, 1);
+    CHECK(module.getTDS() == before || module.getTDS() == after);
+  }
+  CHECK_EQ(module.getTDS(), after);
+}
+
+TEST(module_templates) {
+  CoreModule module(Diameter::ThreeEighth);
+  TDSSensor<CoreModule, MovingAverage<4>> tds(module, CoreModule::A0);
+  PHSensor<CoreModule> ph(module, CoreModule::A1);
+  PressureSensor<CoreModule> pressure(module, 4);
+  FlowMeter<CoreModule> inlet(module, 15, 450.0f);
+  Light<CoreModule> light(module, CoreModule::D0_1);
+  Pump<CoreModule> pump(module, CoreModule::D0_2);
+  SolenoidValve<CoreModule> valve(module, CoreModule::D1_1);
+  PushButton<CoreModule> button(module, module.D1);
+  Lcd16X2<CoreModule> lcd(module);
+
+  module.init();
+  tds.init("/ext/tds");
+  ph.init("/ext/ph");
+  pressure.init("/ext/pressure");
+  inlet.init("/inlet");
+  light.init("/light");
+  pump.init("/pump");
+  valve.init("/valve");
+  fake::setI2CDevice(0x3e);
+  fake::setI2CDevice(0x62);
+  lcd.init();
+
+  fake::setADC(CoreModule::A0, fake::constant(1000));
+  fake::setPulses(15, fake::constant(45));
+  lcd.newLine(0, "TDS");
+  run(module, 1500);
+
+  CHECK_NEAR(tds.tds(), 1000 * 0.4407, 1);
+  CHECK_NEAR(inlet.flow(), 45 * 60 / 450.0, 0.2);
+  CHECK(lcd.isConnected());
+
+  CHECK_EQ(host::request(module, HTTP_POST, "/light/on")->sentCode(), 200);
+  CHECK(light.is_on());
+  CHECK_EQ(fake::pinLevel(CoreModule::D0_1), HIGH);
+  CHECK_EQ(host::request(module, HTTP_POST, "/valve/open")->sentCode(), 200);
+  CHECK(valve.is_open());
+  CHECK_EQ(host::request(module, HTTP_GET, "/ext/tds")->sentCode(), 200);
+  CHECK_EQ(host::request(module, HTTP_GET, "/inlet/total")->sentCode(), 200);
+
+  button.update();
+  CHECK(!button.isOn());
+}
+
+TEST(devices_share_one_route) {
+  CoreModule module(Diameter::Quarter);
+  Light<CoreModule> light(module, CoreModule::D0_1);
+  Pump<CoreModule> pump(module, CoreModule::D0_2);
+  SolenoidValve<CoreModule> valve(module, CoreModule::D1_1);
+  module.init();
+  int endpoints = module.diagnostics().endpoints;
+  light.init("/light");
+  pump.init("/pump");
+  valve.init("/room1/valve");
+  // "/{device}/{action}" for the light and the pump, and one route per action of the valve
+  CHECK_EQ(module.diagnostics().endpoints, endpoints + 3);
+
+  CHECK_EQ(host::request(module, HTTP_POST, "/pump/on")->sentCode(), 200);
+  CHECK(pump.is_on());
+  CHECK(!light.is_on());
+  CHECK_EQ(host::request(module, HTTP_POST, "/pump/off/")->sentCode(), 200);
+  CHECK(!pump.is_on());
+  CHECK_EQ(host::request(module, HTTP_POST, "/room1/valve/open")->sentCode(), 200);
+  CHECK(valve.is_open());
+  auto missing = host::request(module, HTTP_POST, "/pump/open");
+  CHECK_EQ(missing->sentCode(), 404);
+  CHECK(missing->sentBody().find("\"detail\":\"Not found\"") != std::string::npos);
+  CHECK_EQ(host::request(module, HTTP_POST, "/heater/on")->sentCode(), 404);
+  CHECK_EQ(host::request(module, HTTP_GET, "/pump/on")->sentCode(), 404);
+  // Literal routes are not shadowed by the devices
+  CHECK_EQ(host::request(module, HTTP_POST, "/calibration/reset?name=tds3")->sentCode(), 200);
+
+  // A route which cannot be added is rejected without throwing, and leaves the others working
+  CHECK(!module.route("/{name}/{action}", HTTP_GET, [](AsyncWebServerRequest* request) { request->send(200); }));
+  CHECK(!module.route("/a/{b}/{c}/{d}/{e}/{f}", HTTP_GET, [](AsyncWebServerRequest* request) { request->send(200); }));
+  CHECK_EQ(host::request(module, HTTP_POST, "/light/on")->sentCode(), 200);
+  CHECK(light.is_on());
+}
+
+TEST(profiler_stages_run_out_without_throwing) {
+  // Built with the profiler whether or not O_PROFILER is set
+  Profiler<true> profiler;
+  for (int i = 0; i < Profiler<true>::MAX_STAGES; i++) {
+    CHECK_EQ(profiler.addStage("stage"), i);
+  }
+  int stage = profiler.addStage("extra");
+  CHECK_EQ(stage, -1);
+  int calls = 0;
+  profiler.measure(stage, [&]() { calls++; });
+  CHECK_EQ(calls, 1);
+  CHECK_EQ(profiler.stats(stage).count, 0u);
+}
+
+int main() {
+  return host::runTests();
+}
+
+TEST(diagnostics_report_memory_tasks_and_json) {
+  CoreModule module(Diameter::Quarter);
+  module.init();
+  fake::heap().free = 150000;
+  fake::heap().largestFreeBlock = 120000;
+  fake::setADC(TDS_CHANNEL, fake::constant(800));
+  run(module, 100);
+
+  // Tasks without a handle are looked up by name, and left out if they do not run
+  module.registerTask("missing");
+  Diagnostics d = module.diagnostics();
+  CHECK_EQ(d.freeHeap, 150000u);
+  CHECK_EQ(d.fragmentation(), 20);
+  bool loopTask = false;
+  for (int i = 0; i < d.taskCount; i++) {
+    loopTask = loopTask || std::string(d.tasks[i].name) == "loopTask";
+    CHECK(std::string(d.tasks[i].name) != "missing");
+    CHECK(d.tasks[i].stackHighWaterMark > 0);
+  }
+  CHECK(loopTask);
+
+  // JSON documents made with the counter show up while they are alive
+  uint32_t total = d.jsonAllocationsTotal;
+  {
+    JsonDocument doc(&JsonAllocationCounter::instance());
+    doc["tds"] = 4;
+    CHECK(module.diagnostics().jsonAllocations > d.jsonAllocations);
+  }
+  CHECK_EQ(module.diagnostics().jsonAllocations, d.jsonAllocations);
+  CHECK(module.diagnostics().jsonAllocationsTotal > total);
+
+  auto request = host::request(module, HTTP_GET, "/diagnostics");
+  CHECK_EQ(request->sentCode(), 200);
+  const std::string& body = request->sentBody();
+  CHECK_EQ(body.substr(0, 10), std::string("{\"uptime\":"));
+  CHECK(body.find("\"resetReason\":\"") != std::string::npos);
+  CHECK(body.find("\"heap\":{\"free\":150000,\"minFree\":180000,\"largestFreeBlock\":120000,"
+                  "\"fragmentation\":20},") != std::string::npos);
+  CHECK(body.find("\"tasks\":{\"loopTask\":") != std::string::npos);
+  CHECK(body.find("missing") == std::string::npos);
+  CHECK(body.find("\"json\":{\"live\":") != std::string::npos);
+  CHECK_EQ(body.back(), '}');
+
+  // Tasks beyond the limit are logged instead of thrown
+  for (int i = d.taskCount; i <= Diagnostics::MAX_TASKS; i++) {
+    module.registerTask("extra");
+  }
+  CHECK(module.diagnostics().taskCount <= Diagnostics::MAX_TASKS);
+  CHECK(host::request(module, HTTP_GET, "/logs?lines=64")->sentBody().find("Too many tasks to report: extra") !=
+        std::string::npos);
+}
@@ -0,0 +1,101 @@
+// FlowCounter rate and totalizer on the simulated PCNT and GPIO interrupts
+
+#include "CoreModule.h"
+#include "HostTest.h"
+
+namespace {
+
+void run(CoreModule& module, int64_t ms) {
+  for (int64_t i = 0; i < ms; i++) {
+    module.update();
+    fake::advanceMs(1);
+  }
+}
+
+}  // namespace
+
+TEST(rate_counts_edges_missed_by_interrupt) {
+  CoreModule module(Diameter::Quarter);
+  module.init();
+  fake::setPulses(CoreModule::MH_FLOW, fake::constant(100));
+  run(module, 2000);
+  CHECK_NEAR(module.getFlow(), 100 * 0.02884, 0.05);
+
+  // One edge in five does not raise an interrupt for a second. PCNT still counts them.
+  for (int i = 0; i < 10; i++) {
+    fake::missInterrupts(CoreModule::MH_FLOW, 2);
+    run(module, 100);
+  }
+  CHECK_NEAR(module.getFlow(), 100 * 0.02884, 0.05);
+  CHECK_NEAR(module.getTotalFlow(), module.getTotalFlowPulses() * 0.02884 / 60, 1e-4);
+}
+
+TEST(reset_is_saved_by_the_loop_task) {
+  fake::setPulses(CoreModule::MH_FLOW, fake::constant(100));
+  CoreModule module(Diameter::Quarter);
+  module.init();
+  module.setTotalFlowCheckpoint(0.1, 600000);
+  run(module, 2000);
+  CHECK(module.getTotalFlowPulses() >= 199);
+
+  // Like POST /totalFlow/reset on the AsyncTCP task: nothing is written until update()
+  uint64_t writes = fake::nvsWrites();
+  module.resetTotalFlow();
+  CHECK_EQ(fake::nvsWrites(), writes);
+  fake::setPulses(CoreModule::MH_FLOW, fake::constant(0));
+  run(module, 1);
+  CHECK_EQ(fake::nvsWrites(), writes + 1);
+
+  // Restored after reboot. Both modules are kept until the test ends, since their tasks still run.
+  CoreModule rebooted(Diameter::Quarter);
+  rebooted.init();
+  CHECK(rebooted.getTotalFlowPulses() <= 1);
+}
+
+TEST(meters_with_long_names_keep_separate_totals) {
+  fake::setPulses(15, fake::constant(45));
+  fake::setPulses(16, fake::constant(90));
+  CoreModule module(Diameter::Quarter);
+  module.init();
+  FlowMeter<CoreModule> first(module, 15, 450.0f);
+  FlowMeter<CoreModule> second(module, 16, 450.0f);
+  // Both are truncated to "flow.reverseOsm" as a namespace
+  first.init("/reverseOsmosisInlet");
+  second.init("/reverseOsmosisOutlet");
+  first.setTotalFlowCheckpoint(0.01, 600000);
+  second.setTotalFlowCheckpoint(0.01, 600000);
+  run(module, 2000);
+  CHECK(fake::nvs().count(CoreModule::nvsName("flow.", "reverseOsmosisInlet")) > 0);
+  CHECK(fake::nvs().count(CoreModule::nvsName("flow.", "reverseOsmosisOutlet")) > 0);
+
+  CoreModule rebooted(Diameter::Quarter);
+  rebooted.init();
+  FlowMeter<CoreModule> firstAgain(rebooted, 15, 450.0f);
+  FlowMeter<CoreModule> secondAgain(rebooted, 16, 450.0f);
+  firstAgain.init("/reverseOsmosisInlet");
+  secondAgain.init("/reverseOsmosisOutlet");
+  CHECK(firstAgain.totalPulses() > 0);
+  CHECK(secondAgain.totalPulses() > firstAgain.totalPulses());
+}
+
+TEST(rejected_meter_does_not_take_a_unit) {
+  CoreModule module(Diameter::Quarter);
+  module.init();
+  FlowMeter<CoreModule> inlet(module, 15, 450.0f);
+  inlet.init("/inlet");
+  pcnt_unit_t next = module.claimPCNTUnit();
+
+  CoreModule other(Diameter::Quarter);
+  other.init();
+  FlowMeter<CoreModule> first(other, 15, 450.0f);
+  FlowMeter<CoreModule> duplicate(other, 16, 450.0f);
+  first.init("/inlet");
+  CHECK_THROWS(duplicate.init("/inlet"), std::invalid_argument);
+  // "tds0" is a calibration of CoreModule
+  CHECK_THROWS(duplicate.init("/tds0"), std::invalid_argument);
+  CHECK_EQ(other.claimPCNTUnit(), next);
+}
+
+int main() {
+  return host::runTests();
+}
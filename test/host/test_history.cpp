@@ -0,0 +1,154 @@
+// History rollups, queries and memory bound
+
+#include "CoreModule.h"
+#include "History.h"
+#include "HostTest.h"
+
+namespace {
+
+const char* const NAMES[] = {"value", "other"};
+const float SCALES[] = {100, 1};
+
+struct Capture : Print {
+  std::string text;
+  std::function<void()> onWrite;
+
+  size_t write(uint8_t c) override {
+    if (onWrite) {
+      onWrite();
+    }
+    text += static_cast<char>(c);
+    return 1;
+  }
+};
+
+// One sample per second with value = seconds
+void fill(History& history, int seconds) {
+  for (int i = 0; i < seconds; i++) {
+    float values[] = {static_cast<float>(i), 0};
+    history.add(i * 1000, values);
+  }
+}
+
+std::string point(unsigned long time, const char* avg, const char* min, const char* max) {
+  return "[" + std::to_string(time) + "," + avg + "," + min + "," + max + "]";
+}
+
+}  // namespace
+
+TEST(seconds_are_rolled_up_per_minute) {
+  History history;
+  CHECK(history.begin(2, NAMES, SCALES, 16384));
+  fill(history, 180);
+
+  // Minute 2 is still pending
+  Capture out;
+  history.query(out, 0, 0, 180000, 60000);
+  CHECK_EQ(out.text, "[" + point(0, "29.50", "0.00", "59.00") + "," + point(60000, "89.50", "60.00", "119.00") + "]");
+}
+
+TEST(points_are_merged_to_step) {
+  History history;
+  CHECK(history.begin(2, NAMES, SCALES, 16384));
+  fill(history, 20);
+
+  Capture out;
+  history.query(out, 0, 0, 9999, 5000);
+  CHECK_EQ(out.text, "[" + point(0, "2.00", "0.00", "4.00") + "," + point(5000, "7.00", "5.00", "9.00") + "]");
+}
+
+TEST(query_spans_chunks) {
+  History history;
+  CHECK(history.begin(2, NAMES, SCALES, 16384));
+  fill(history, 180);
+
+  Capture out;
+  history.query(out, 0, 10000, 178000, 1000);
+  std::string expected = "[";
+  for (int i = 10; i <= 178; i++) {
+    std::string value = std::to_string(i) + ".00";
+    expected += (i > 10 ? "," : "") + point(i * 1000, value.c_str(), value.c_str(), value.c_str());
+  }
+  CHECK_EQ(out.text, expected + "]");
+}
+
+TEST(add_is_not_blocked_by_a_slow_client) {
+  // Points are written without the lock, so add() from the sampling task can go on
+  History history;
+  CHECK(history.begin(2, NAMES, SCALES, 16384));
+  fill(history, 100);
+
+  // A sample per written point. Points added during the query are still written.
+  int added = 0;
+  Capture out;
+  out.onWrite = [&]() {
+    if (!out.text.empty() && out.text.back() == ']') {
+      float values[] = {static_cast<float>(100 + added), 0};
+      history.add((100 + added) * 1000, values);
+      added++;
+    }
+  };
+  history.query(out, 0, 0, 120000, 1000);
+  CHECK(added > 0);
+  CHECK(out.text.find(point(98000, "98.00", "98.00", "98.00")) != std::string::npos);
+  CHECK(out.text.find(point(120000, "120.00", "120.00", "120.00")) != std::string::npos);
+}
+
+TEST(memory_stays_within_budget) {
+  for (size_t fields = 1; fields <= 2; fields++) {
+    for (size_t budget : {1024, 4096, 16384, 65536}) {
+      History history;
+      fake::CountAllocations allocations;
+      CHECK(history.begin(fields, NAMES, SCALES, budget));
+      CHECK(history.memoryUsage() <= budget);
+      // Points, and the mutex
+      CHECK_EQ(allocations.result().count, 2u);
+      CHECK(allocations.result().bytes <= history.memoryUsage() + 128);
+    }
+  }
+
+  // Nothing is allocated after begin()
+  History history;
+  CHECK(history.begin(2, NAMES, SCALES, 4096));
+  Capture out;
+  out.text.reserve(65536);
+  fake::CountAllocations allocations;
+  fill(history, 7200);
+  history.query(out, 0, 0, 7200000, 1000);
+  history.query(out, 1, 0, 7200000, 3600000);
+  CHECK_EQ(allocations.result().count, 0u);
+}
+
+TEST(mutex_is_released) {
+  int semaphores = fake::liveSemaphores();
+  {
+    History history;
+    CHECK(history.begin(2, NAMES, SCALES, 4096));
+    CHECK_EQ(fake::liveSemaphores(), semaphores + 1);
+  }
+  CHECK_EQ(fake::liveSemaphores(), semaphores);
+}
+
+TEST(endpoint_rejects_invalid_times) {
+  CoreModule module(Diameter::Quarter);
+  CHECK(module.enableHistory());
+  module.init();
+
+  CHECK_EQ(host::request(module, HTTP_GET, "/history?field=tds&from=-1000")->sentCode(), 400);
+  CHECK_EQ(host::request(module, HTTP_GET, "/history?field=tds&to=1h")->sentCode(), 400);
+  CHECK_EQ(host::request(module, HTTP_GET, "/history?field=tds&step=")->sentCode(), 400);
+  // Times beyond INT32_MAX, after 24.8 days of uptime
+  auto request = host::request(module, HTTP_GET, "/history?field=tds&from=3000000000&to=3000001000");
+  CHECK_EQ(request->sentCode(), 200);
+  CHECK(request->sentBody().find("\"points\":[]") != std::string::npos);
+}
+
+TEST(too_small_budget_is_rejected) {
+  History history;
+  CHECK(!history.begin(2, NAMES, SCALES, 16));
+  CHECK(!history.isEnabled());
+}
+
+int main() {
+  return host::runTests();
+}
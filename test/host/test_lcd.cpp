@@ -0,0 +1,124 @@
+// Lcd16X2 framebuffer flushes, checked by the I2C transactions on the simulated bus
+
+#include "CoreModule.h"
+#include "HostTest.h"
+
+namespace {
+
+struct Run {
+  int row;
+  int col;
+  std::string cells;
+};
+
+// Runs of cells sent to the display since the last clearI2CTransactions()
+std::vector<Run> sentRuns() {
+  std::vector<Run> runs;
+  for (const fake::I2CTransaction& transaction : fake::i2cTransactions()) {
+    const std::vector<uint8_t>& bytes = transaction.bytes;
+    if (transaction.address != LCD_ADDRESS || !transaction.acked || bytes.size() < 4 || bytes[0] != 0x80 ||
+        bytes[2] != 0x40) {
+      continue;
+    }
+    int address = bytes[1] & 0x7f;
+    runs.push_back({address / 0x40, address % 0x40, std::string(bytes.begin() + 3, bytes.end())});
+  }
+  return runs;
+}
+
+void connectDisplay(bool connected) {
+  fake::setI2CDevice(LCD_ADDRESS, connected);
+  fake::setI2CDevice(RGB_ADDRESS, connected);
+}
+
+}  // namespace
+
+TEST(changed_cells_are_sent_as_runs) {
+  CoreModule module;
+  Lcd16X2<CoreModule> lcd(module);
+  module.init();
+  connectDisplay(true);
+  lcd.init();
+
+  // The first flush draws every cell
+  lcd.newLine(0, "Count: 9");
+  fake::clearI2CTransactions();
+  lcd.flush();
+  std::vector<Run> runs = sentRuns();
+  CHECK_EQ(runs.size(), 2u);
+  CHECK_EQ(runs[0].cells, std::string("Count: 9        "));
+  CHECK_EQ(runs[1].row, 1);
+  CHECK_EQ(runs[1].cells, std::string(16, ' '));
+
+  // "9 " -> "10" is one run of the two cells
+  lcd.newLine(0, "Count: 10");
+  fake::clearI2CTransactions();
+  lcd.flush();
+  runs = sentRuns();
+  CHECK_EQ(runs.size(), 1u);
+  CHECK_EQ(runs[0].row, 0);
+  CHECK_EQ(runs[0].col, 7);
+  CHECK_EQ(runs[0].cells, std::string("10"));
+
+  // Nothing changed, nothing sent
+  fake::clearI2CTransactions();
+  lcd.flush();
+  CHECK(fake::i2cTransactions().empty());
+
+  // Changes up to RUN_GAP cells apart are merged, and further apart are sent separately
+  lcd.newLine(1, "a  b     c");
+  fake::clearI2CTransactions();
+  lcd.flush();
+  runs = sentRuns();
+  CHECK_EQ(runs.size(), 2u);
+  CHECK_EQ(runs[0].col, 0);
+  CHECK_EQ(runs[0].cells, std::string("a  b"));
+  CHECK_EQ(runs[1].col, 9);
+  CHECK_EQ(runs[1].cells, std::string("c"));
+}
+
+TEST(display_is_redrawn_after_reconnect) {
+  CoreModule module;
+  Lcd16X2<CoreModule> lcd(module);
+  module.init();
+  connectDisplay(true);
+  lcd.init();
+  lcd.newLine(0, "Count: 9");
+  lcd.flush();
+  CHECK(lcd.isConnected());
+
+  // A failed write marks the display disconnected
+  connectDisplay(false);
+  lcd.newLine(0, "Count: 10");
+  lcd.flush();
+  CHECK(!lcd.isConnected());
+
+  // Once it answers a probe, it is initialized and every cell is sent again
+  connectDisplay(true);
+  fake::clearI2CTransactions();
+  fake::advanceMs(Lcd16X2<CoreModule>::PROBE_INTERVAL + 200);
+  CHECK(lcd.isConnected());
+  std::vector<Run> runs = sentRuns();
+  CHECK_EQ(runs.size(), 2u);
+  CHECK_EQ(runs[0].row, 0);
+  CHECK_EQ(runs[0].col, 0);
+  CHECK_EQ(runs[0].cells, std::string("Count: 10       "));
+  CHECK_EQ(runs[1].cells, std::string(16, ' '));
+
+  // The redraw comes after the initialization of begin()
+  const std::vector<fake::I2CTransaction>& transactions = fake::i2cTransactions();
+  bool initialized = false;
+  for (const fake::I2CTransaction& transaction : transactions) {
+    if (transaction.address == LCD_ADDRESS && transaction.bytes.size() == 2 && transaction.bytes[0] == 0x80) {
+      initialized = true;
+    }
+    if (transaction.address == LCD_ADDRESS && transaction.bytes.size() > 3 && transaction.bytes[2] == 0x40) {
+      CHECK(initialized);
+      break;
+    }
+  }
+}
+
+int main() {
+  return host::runTests();
+}
@@ -0,0 +1,177 @@
+// MQTTPublisher sessions and sampling against the broker stand-in behind PubSubClient
+
+#include "CoreModule.h"
+#include "HostTest.h"
+#include "MQTTPublisher.h"
+
+namespace {
+
+std::string payload(const fake::Broker::Message& message) {
+  return std::string(message.payload.begin(), message.payload.end());
+}
+
+// Time of every sample in the published messages, in order
+std::vector<unsigned long> sampleTimes() {
+  std::vector<unsigned long> times;
+  for (const fake::Broker::Message& message : fake::broker().messages) {
+    std::string text = payload(message);
+    for (size_t at = text.find("\"time\":"); at != std::string::npos; at = text.find("\"time\":", at + 1)) {
+      times.push_back(std::stoul(text.substr(at + 7)));
+    }
+  }
+  return times;
+}
+
+// Advance time with the loop task running, so sample cycles move on
+void run(CoreModule& module, int64_t ms) {
+  for (int64_t i = 0; i < ms; i++) {
+    module.update();
+    fake::advanceMs(1);
+  }
+}
+
+}  // namespace
+
+TEST(samples_are_published_with_metadata) {
+  CoreModule module(Diameter::Quarter);
+  module.init();
+  WiFiClient wifi;
+  MQTTPublisher publisher(module, wifi);
+  publisher.setServer("broker.local", 1883);
+  publisher.begin();
+
+  auto request = host::request(module, HTTP_POST, "/publish/start?client_id=token&interval=200&site=lab");
+  CHECK_EQ(request->sentCode(), 200);
+  fake::advanceMs(2000);
+
+  CHECK(publisher.connected());
+  CHECK_EQ(fake::broker().connections.size(), 1u);
+  CHECK(fake::broker().messages.size() >= 9);
+  CHECK(payload(fake::broker().messages.back()).find("\"site\":\"lab\"") != std::string::npos);
+}
+
+TEST(invalid_start_keeps_the_session) {
+  CoreModule module(Diameter::Quarter);
+  module.init();
+  WiFiClient wifi;
+  MQTTPublisher publisher(module, wifi);
+  publisher.setServer("broker.local", 1883);
+  publisher.begin();
+
+  CHECK_EQ(host::request(module, HTTP_POST, "/publish/start?client_id=token&site=lab")->sentCode(), 200);
+  fake::advanceMs(500);
+  uint32_t session = module.publishSession();
+
+  // Metadata before the invalid format is not merged into the running session
+  CHECK_EQ(host::request(module, HTTP_POST, "/publish/start?client_id=token&room=1&format=xml")->sentCode(), 400);
+  CHECK_EQ(module.publishSession(), session);
+  CHECK(!module.metadata().containsKey("room"));
+  fake::advanceMs(500);
+  CHECK(payload(fake::broker().messages.back()).find("room") == std::string::npos);
+
+  // A new session does not keep the metadata of the previous one
+  CHECK_EQ(host::request(module, HTTP_POST, "/publish/start?client_id=token")->sentCode(), 200);
+  fake::advanceMs(500);
+  CHECK(payload(fake::broker().messages.back()).find("site") == std::string::npos);
+}
+
+TEST(sampling_goes_on_while_connecting) {
+  // Each connect attempt blocks the publisher task until the TCP timeout
+  fake::broker().reachable = false;
+  fake::broker().unreachableTime = 3000000;
+  CoreModule module(Diameter::Quarter);
+  module.init();
+  WiFiClient wifi;
+  MQTTPublisher publisher(module, wifi);
+  publisher.setServer("broker.local", 1883);
+  publisher.begin();
+
+  CHECK_EQ(host::request(module, HTTP_POST, "/publish/start?client_id=token&interval=200")->sentCode(), 200);
+  fake::advanceMs(10000);
+  CHECK(!publisher.connected());
+  CHECK(publisher.queued() >= 49);
+
+  fake::broker().reachable = true;
+  fake::advanceMs(20000);
+  CHECK(publisher.connected());
+  CHECK(publisher.queued() <= 1);
+  CHECK_EQ(publisher.dropped(), 0u);
+
+  // No gap in the samples while connect() was blocked
+  std::vector<unsigned long> times = sampleTimes();
+  CHECK(times.size() >= 145);
+  for (size_t i = 1; i < times.size(); i++) {
+    CHECK(times[i] - times[i - 1] <= 300);
+  }
+}
+
+TEST(spool_survives_a_short_write) {
+  fake::broker().reachable = false;
+  CoreModule module(Diameter::Quarter);
+  module.init();
+  WiFiClient wifi;
+  MQTTPublisher publisher(module, wifi);
+  publisher.setServer("broker.local", 1883);
+  publisher.enableSpool();
+  publisher.begin();
+  run(module, 1000);
+  CHECK_EQ(host::request(module, HTTP_POST, "/publish/start?client_id=token&interval=50")->sentCode(), 200);
+
+  // Flash runs out in the middle of a record of the second spill
+  while (fake::files().count("/mqtt_spool.bin") == 0) {
+    run(module, 100);
+  }
+  size_t spill = fake::files()["/mqtt_spool.bin"]->size();
+  fake::setLittleFSSize(spill + spill / 2 + 5);
+  while (fake::files()["/mqtt_spool.bin"]->size() == spill) {
+    run(module, 100);
+  }
+  CHECK(publisher.dropped() > 0);
+
+  // The next spill continues after the last whole record
+  fake::setLittleFSSize(1441792);
+  size_t cut = fake::files()["/mqtt_spool.bin"]->size();
+  while (fake::files()["/mqtt_spool.bin"]->size() == cut) {
+    run(module, 100);
+  }
+  fake::broker().reachable = true;
+  run(module, 20000);
+  CHECK(publisher.queued() <= 1);
+
+  // Every sample is published whole and in order, or counted as dropped
+  std::vector<unsigned long> times = sampleTimes();
+  CHECK(!times.empty());
+  for (size_t i = 1; i < times.size(); i++) {
+    CHECK(times[i] > times[i - 1]);
+  }
+  CHECK(times.back() <= millis());
+  CHECK_NEAR(times.size() + publisher.queued() + publisher.dropped(), (millis() - 1000) / 50, 2);
+}
+
+TEST(invalid_policy_is_rejected) {
+  CoreModule module(Diameter::Quarter);
+  module.init();
+  const char* const urls[] = {
+      "/publish/start?client_id=token&mode=change&min_interval=-1",
+      "/publish/start?client_id=token&mode=change&heartbeat=1s",
+      "/publish/start?client_id=token&mode=change&heartbeat=",
+      "/publish/start?client_id=token&mode=change&heartbeat=0",
+      "/publish/start?client_id=token&mode=sometimes",
+      "/publish/start?client_id=token&interval=1s",
+      "/publish/start?client_id=token&interval=0",
+  };
+  for (const char* url : urls) {
+    CHECK_EQ(host::request(module, HTTP_POST, url)->sentCode(), 400);
+  }
+  CHECK(!module.isPublishing());
+
+  CHECK_EQ(host::request(module, HTTP_POST, "/publish/start?client_id=token&mode=change&min_interval=0&heartbeat=5000")
+               ->sentCode(),
+           200);
+  CHECK_EQ(module.publishPolicy().minInterval, 0ul);
+  CHECK_EQ(module.publishPolicy().heartbeat, 5000ul);
+}
+
+int main() {
+  return host::runTests();
+}
@@ -0,0 +1,59 @@
+// ActuatorScheduler pulse trains on the simulated esp_timer
+
+#include "ActuatorScheduler.h"
+#include "HostTest.h"
+
+namespace {
+
+const int PIN = 25;
+
+struct Writes {
+  std::vector<std::pair<int64_t, int>> modes;  // Time [us] and mode
+
+  ActuatorScheduler::Writer writer() {
+    return [this](int pin, int mode) { modes.push_back({fake::now(), mode}); };
+  }
+};
+
+}  // namespace
+
+TEST(pulse_train_does_not_drift) {
+  Writes writes;
+  ActuatorScheduler scheduler;
+  scheduler.begin(writes.writer());
+
+  int64_t start = fake::now();
+  scheduler.pulse(PIN, HIGH, 10000, 30000, 3);
+  CHECK(scheduler.isScheduled(PIN));
+  fake::advanceMs(200);
+
+  const std::vector<std::pair<int64_t, int>> expected = {
+      {10000, LOW}, {40000, HIGH}, {50000, LOW}, {80000, HIGH}, {90000, LOW}};
+  CHECK_EQ(writes.modes.size(), expected.size());
+  for (size_t i = 0; i < expected.size(); i++) {
+    CHECK_EQ(writes.modes[i].first - start, expected[i].first);
+    CHECK_EQ(writes.modes[i].second, expected[i].second);
+  }
+  CHECK(!scheduler.isScheduled(PIN));
+  CHECK_EQ(scheduler.active(), 0);
+  // Callbacks never wait for a lock held by a task
+  CHECK_EQ(fake::blockedTimerCallbacks(), 0);
+}
+
+TEST(timer_create_failure_is_reported) {
+  Writes writes;
+  ActuatorScheduler scheduler;
+  fake::failTimerCreate(1);
+  CHECK_THROWS(scheduler.begin(writes.writer()), std::runtime_error);
+  CHECK_THROWS(scheduler.pulse(PIN, HIGH, 10000), std::invalid_argument);
+
+  // Nothing is left from the failed attempt, so begin() can be retried
+  scheduler.begin(writes.writer());
+  scheduler.pulse(PIN, HIGH, 10000);
+  fake::advanceMs(20);
+  CHECK_EQ(writes.modes.size(), 1u);
+}
+
+int main() {
+  return host::runTests();
+}
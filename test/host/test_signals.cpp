@@ -0,0 +1,55 @@
+// Signal generators and the inputs they drive
+
+#include "CoreModule.h"
+#include "HostTest.h"
+
+TEST(script_steps_and_ramps) {
+  fake::Signal signal = fake::script("0:400 2s:400 2s:1200 2500ms:1600 3000000us:1600");
+  CHECK_EQ(signal(0), 400.0);
+  CHECK_EQ(signal(1999999), 400.0);
+  CHECK_EQ(signal(2000000), 1200.0);
+  CHECK_EQ(signal(2250000), 1400.0);
+  CHECK_EQ(signal(10000000), 1600.0);
+}
+
+TEST(noise_is_bounded_and_repeatable) {
+  fake::Signal signal = fake::noise(fake::constant(1000), 10, 7);
+  for (int64_t us = 0; us < 100000; us += 997) {
+    CHECK(std::fabs(signal(us) - 1000) <= 10);
+    CHECK_EQ(signal(us), signal(us));
+  }
+}
+
+TEST(low_pass_settles_with_tau) {
+  // The input is held at its value at the end of each step, so the step counts from time 0
+  fake::Signal signal = fake::lowPass(fake::step(0, 1000, 1), 1000);
+  CHECK_EQ(signal(0), 0.0);
+  CHECK_NEAR(signal(1000), 1000 * (1 - std::exp(-1.0)), 1e-6);
+  CHECK_NEAR(signal(2000), 1000 * (1 - std::exp(-2.0)), 1e-6);
+}
+
+TEST(adc_follows_signal) {
+  CoreModule module;
+  module.init();
+  fake::setADC(3, fake::ramp(0, 4095, 0, 1000000));
+  fake::advanceMs(500);
+  CHECK_NEAR(module.readA0(), 2047, 1);
+  fake::setADC(3, fake::constant(5000));
+  CHECK_EQ(module.readA0(), 4095);
+}
+
+TEST(pulses_follow_rate) {
+  CoreModule module(Diameter::Quarter);
+  module.init();
+  fake::setPulses(CoreModule::MH_FLOW, fake::script("0:100 1s:100 1s:300"));
+  fake::advanceMs(1000);
+  CHECK_NEAR(static_cast<double>(module.getFlowPulses()), 100, 1);
+  fake::advanceMs(1000);
+  CHECK_NEAR(static_cast<double>(module.getFlowPulses()), 400, 1);
+  fake::pulse(CoreModule::MH_FLOW, 5);
+  CHECK_NEAR(static_cast<double>(module.getFlowPulses()), 405, 1);
+}
+
+int main() {
+  return host::runTests();
+}
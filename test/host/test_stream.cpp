@@ -0,0 +1,108 @@
+// WebSocket and Server-Sent Events streams of CoreModule
+
+#include "CoreModule.h"
+#include "HostTest.h"
+
+namespace {
+
+void run(CoreModule& module, int64_t ms) {
+  for (int64_t i = 0; i < ms; i++) {
+    module.update();
+    fake::advanceMs(1);
+  }
+}
+
+AsyncWebSocketClient* connect(CoreModule& module, const char* url = "/stream") {
+  return host::request(module, HTTP_GET, url, RCT_WS)->webSocketClient();
+}
+
+}  // namespace
+
+TEST(frames_follow_fields_and_interval) {
+  CoreModule module(Diameter::Quarter);
+  module.init();
+  AsyncWebSocketClient* tds = connect(module, "/stream?fields=tds&interval=100");
+  AsyncWebSocketClient* all = connect(module, "/stream?interval=50");
+  AsyncWebSocketClient* flow = connect(module, "/stream?fields=flow,totalFlow&interval=100");
+  run(module, 1000);
+
+  CHECK_NEAR(tds->messages().size(), 10, 1);
+  CHECK_NEAR(all->messages().size(), 20, 1);
+  CHECK_NEAR(flow->messages().size(), 10, 1);
+  const std::string& message = tds->messages().back();
+  CHECK(message.find("\"tds\":") != std::string::npos);
+  CHECK(message.find("\"flow\"") == std::string::npos);
+  CHECK(all->messages().back().find("\"temperature\":") != std::string::npos);
+  CHECK(flow->messages().back().find("\"totalFlow\":") != std::string::npos);
+  CHECK(flow->messages().back().find("\"tds\"") == std::string::npos);
+
+  // Buffers which no message holds are freed by the next cycle
+  CHECK_EQ(AsyncWebSocketMessageBuffer::live(), 0);
+}
+
+TEST(one_buffer_per_field_set) {
+  CoreModule module(Diameter::Quarter);
+  module.init();
+  AsyncWebSocketClient* first = connect(module, "/stream?fields=tds&interval=100");
+  AsyncWebSocketClient* second = connect(module, "/stream?fields=tds&interval=100");
+  AsyncWebSocketClient* all = connect(module, "/stream?interval=100");
+  first->holdMessages();
+  int made = AsyncWebSocketMessageBuffer::made();
+  run(module, 1000);
+
+  CHECK_NEAR(first->messages().size(), 10, 1);
+  CHECK(first->messages() == second->messages());
+  CHECK_EQ(AsyncWebSocketMessageBuffer::made() - made, 2 * static_cast<int>(all->messages().size()));
+
+  // Buffers still held by queued messages are kept until they are sent
+  CHECK_EQ(AsyncWebSocketMessageBuffer::live(), static_cast<int>(first->messages().size()));
+  first->releaseMessages();
+  run(module, 100);
+  CHECK_EQ(AsyncWebSocketMessageBuffer::live(), 0);
+}
+
+TEST(full_queue_skips_frames) {
+  CoreModule module(Diameter::Quarter);
+  module.init();
+  AsyncWebSocketClient* slow = connect(module);
+  AsyncWebSocketClient* fast = connect(module);
+  slow->setQueueFull(true);
+  run(module, 500);
+  CHECK_EQ(slow->messages().size(), 0u);
+  CHECK(fast->messages().size() >= 4);
+}
+
+TEST(subscribers_are_limited) {
+  CoreModule module(Diameter::Quarter);
+  module.init();
+  std::vector<AsyncWebSocketClient*> clients;
+  for (int i = 0; i < SensorStream::MAX_SUBSCRIBERS; i++) {
+    clients.push_back(connect(module));
+    CHECK_EQ(clients.back()->status(), WS_CONNECTED);
+  }
+  AsyncWebSocketClient* rejected = connect(module);
+  CHECK_EQ(rejected->status(), WS_DISCONNECTING);
+  rejected->server()->disconnect(rejected);
+
+  // A disconnected client is freed and no longer sent to, and frees its slot
+  clients.front()->server()->disconnect(clients.front());
+  run(module, 200);
+  AsyncWebSocketClient* next = connect(module);
+  CHECK_EQ(next->status(), WS_CONNECTED);
+  run(module, 200);
+  CHECK(!next->messages().empty());
+}
+
+TEST(events_carry_all_fields) {
+  CoreModule module(Diameter::Quarter);
+  module.init();
+  AsyncEventSourceClient* client = host::request(module, HTTP_GET, "/events", RCT_EVENT)->eventSourceClient();
+  run(module, 1000);
+  CHECK_NEAR(client->events().size(), 10, 1);
+  CHECK_EQ(client->events().back().event, std::string("values"));
+  CHECK(client->events().back().data.find("\"temperature\":") != std::string::npos);
+}
+
+int main() {
+  return host::runTests();
+}